@@ -0,0 +1,94 @@
+/* elfp
+ * CRC-32 benchmark
+ *
+ * Runs every CRC-32 kernel this CPU supports over the same buffer, checks
+ * that they agree with the byte-at-a-time one, and reports their throughput
+ *
+ * usage: elfp_bench_crc32 [MIB [ROUNDS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "elfdebuglink.h"
+
+/* Default size of the buffer, in MiB, and number of passes over it */
+#define DEFAULT_SIZE 256
+#define DEFAULT_ROUNDS 5
+
+static uint64_t _now(void);
+
+int main(int argc, char *argv[]) {
+	const size_t SIZE
+		= (argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_SIZE) << 20;
+	const unsigned ROUNDS
+		= argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+
+	uint8_t *data = malloc(SIZE > 0 ? SIZE : 1);
+	if( data == NULL || ROUNDS == 0 ) {
+		fprintf(stderr, "usage: %s [MIB [ROUNDS]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* Any bytes do, as long as they aren't all alike */
+	uint64_t state = 0x9E3779B97F4A7C15u;
+	for( size_t i = 0; i < SIZE; ++i ) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		data[i] = state;
+	}
+
+	printf("%zu MiB, best of %u rounds\n\n", SIZE >> 20, ROUNDS);
+	printf("Kernel          CRC        GB/s\n");
+	printf("--------------------------------\n");
+
+	uint32_t expected = 0;
+	int status = EXIT_SUCCESS;
+
+	for( int k = 0; k < ELF_CRC32_KERNEL_NUM; ++k ) {
+		if( !elfCrc32Supported(k) ) {
+			printf("%-15s unsupported\n", elfCrc32KernelName(k));
+			continue;
+		}
+
+		uint64_t best = UINT64_MAX;
+		uint32_t crc = 0;
+
+		for( unsigned r = 0; r < ROUNDS; ++r ) {
+			const uint64_t START = _now();
+			crc = elfCrc32Using(k, 0, data, SIZE);
+			const uint64_t ELAPSED = _now() - START;
+
+			best = ELAPSED < best ? ELAPSED : best;
+		}
+
+		if( k == ELF_CRC32_BYTEWISE ) {
+			expected = crc;
+		}
+
+		printf("%-15s 0x%08" PRIx32 " %.2f%s\n", elfCrc32KernelName(k), crc,
+			best > 0 ? (double)SIZE / best : 0.0,
+			crc == expected ? "" : "  MISMATCH");
+
+		if( crc != expected ) {
+			status = EXIT_FAILURE;
+		}
+	}
+
+	free(data);
+	return status;
+}
+
+/* Returns the time on the monotonic clock, in ns */
+static uint64_t _now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
@@ -0,0 +1,133 @@
+/* elfp
+ * Parser fuzz target
+ *
+ * Parses each input with elfParseBuffer, then walks what's parsed the way the
+ * elfp tool does: every index, every dump, the symbol map. Inputs are given
+ * exactly as long as they are, so reading past one shows up under ASan
+ *
+ * Built with Clang, it's a libFuzzer target:
+ *   elfp_fuzz_parse [CORPUS_DIR...]
+ * Otherwise it runs each file it's given once (or stdin), which is what AFL
+ * and crash reproduction need:
+ *   elfp_fuzz_parse [FILE...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfdump.h"
+#include "elfintern.h"
+#include "elfp.h"
+#include "elfsym.h"
+#include "elfsymmap.h"
+
+#define DUMP_FLAGS                                                             \
+	(ELF_DUMP_ALL | ELF_DUMP_UNWIND | ELF_DUMP_DYNSYM | ELF_DUMP_PAGES)
+
+int LLVMFuzzerTestOneInput(const uint8_t *DATA, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *DATA, size_t size) {
+	static FILE *sink = NULL;
+	if( sink == NULL ) {
+		sink = fopen("/dev/null", "w");
+	}
+
+	ELF_Status status;
+	ELF *elf = elfParseBuffer(DATA, size, &status);
+	if( elf == NULL ) {
+		return 0;
+	}
+
+	elfBuildIndices(elf, ELF_INDEX_ALL);
+	elfDynamicSymbols(elf);
+
+	if( sink != NULL ) {
+		elfDumpTo(sink, elf, DUMP_FLAGS);
+	}
+
+	uint8_t *map = NULL;
+	size_t mapSize = 0;
+	if( elfSymmapBuild(elf, &map, &mapSize) == ELF_OK ) {
+		free(map);
+	}
+
+	elfFree(elf);
+
+	/* No ELF is left holding IDs, so the pool can start over */
+	elfInternReset();
+	return 0;
+}
+
+#ifndef ELFP_LIBFUZZER
+static int _runFile(FILE *file);
+
+int main(int argc, char *argv[]) {
+	if( argc < 2 ) {
+		return _runFile(stdin);
+	}
+
+	for( int i = 1; i < argc; ++i ) {
+		FILE *file = fopen(argv[i], "rb");
+		if( file == NULL ) {
+			perror(argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		const int STATUS = _runFile(file);
+		fclose(file);
+
+		if( STATUS != EXIT_SUCCESS ) {
+			return STATUS;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Reads a whole file into a buffer of its exact size, and runs it */
+static int _runFile(FILE *file) {
+	uint8_t *data = NULL;
+	size_t size = 0;
+	size_t cap = 0;
+
+	for( ;; ) {
+		if( size == cap ) {
+			cap = cap > 0 ? 2 * cap : 65536;
+			uint8_t *grown = realloc(data, cap);
+			if( grown == NULL ) {
+				free(data);
+				return EXIT_FAILURE;
+			}
+
+			data = grown;
+		}
+
+		const size_t READ = fread(data + size, 1, cap - size, file);
+		if( READ == 0 ) {
+			break;
+		}
+
+		size += READ;
+	}
+
+	/* Trimmed, so that the allocation ends where the input does */
+	uint8_t *exact = malloc(size > 0 ? size : 1);
+	if( exact == NULL ) {
+		free(data);
+		return EXIT_FAILURE;
+	}
+
+	memcpy(exact, data, size);
+	free(data);
+
+	LLVMFuzzerTestOneInput(exact, size);
+	free(exact);
+
+	return ferror(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
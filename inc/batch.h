@@ -0,0 +1,47 @@
+#ifndef GUARD_ELFP_BATCH_H_
+#define GUARD_ELFP_BATCH_H_
+
+/* Batch file reader
+ *
+ * Reads many files at once, keeping many reads in flight. Each file's first
+ * bytes are read on their own, and the rest of the file is only fetched once
+ * they've shown it's an ELF file. Files that aren't come back holding just
+ * that prefix, so scanning a tree full of other files stays cheap
+ *
+ * Uses io_uring when elfp is built with it and the kernel allows it, and a
+ * pool of threads doing plain reads otherwise
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "budget.h"
+#include "util.h"
+
+/* Called once per file, as soon as it's read
+ * 'fp' is NULL on failure, with 'error' holding an errno value (EFBIG for a
+ * file that can't fit in the budget). Otherwise, the callback takes ownership
+ * of 'fp'
+ *
+ * With the thread pool, this gets called from several threads at once
+ */
+typedef void (*BatchCallback)(
+	void *ctx, size_t idx, const char *PATH, FP *fp, int error);
+
+typedef struct _BatchOptions {
+	unsigned depth; /* Files kept in flight at once */
+	unsigned threads; /* Size of the thread pool, when it's used (0: depth) */
+	bool noUring; /* Use the thread pool even if io_uring is available */
+
+	/* Caps the memory of the files in flight, or NULL for no cap. Implies
+	 * the thread pool, whose threads wait while the next file doesn't fit;
+	 * a file's share is given back once its callback returns
+	 */
+	Budget *budget;
+} BatchOptions;
+
+/* Reads 'num' files, calling 'callback' for each of them */
+ELF_API void batchRead(const char *const *PATHS, size_t num,
+	const BatchOptions *OPTIONS, BatchCallback callback, void *ctx);
+
+#endif // !GUARD_ELFP_BATCH_H_
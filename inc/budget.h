@@ -0,0 +1,45 @@
+#ifndef GUARD_ELFP_BUDGET_H_
+#define GUARD_ELFP_BUDGET_H_
+
+/* Memory budget
+ *
+ * Bytes shared by threads that each hold on to some memory for a while, like
+ * the files a batch has in flight. A thread reserves what it's about to use
+ * and waits while that doesn't fit, so fewer files are handled at once as
+ * they get larger. Reservations are granted in the order they're asked for,
+ * so a large file doesn't wait forever behind a stream of small ones
+ *
+ * A thread must not wait on a reservation while holding one, or it could wait
+ * on itself
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfapi.h"
+
+typedef struct _Budget {
+	size_t limit;
+	size_t used;
+
+	uint64_t next; /* Ticket of the next reservation asked for */
+	uint64_t serving; /* Ticket of the reservation to grant next */
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} Budget;
+
+ELF_API void budgetInit(Budget *budget, size_t limit);
+ELF_API void budgetDestroy(Budget *budget);
+
+/* Reserves 'bytes', waiting for them to become available
+ * Returns false at once if they're more than the whole budget
+ */
+ELF_API bool budgetReserve(Budget *budget, size_t bytes);
+
+/* Gives back bytes reserved with 'budgetReserve' */
+ELF_API void budgetRelease(Budget *budget, size_t bytes);
+
+#endif // !GUARD_ELFP_BUDGET_H_
@@ -0,0 +1,43 @@
+#ifndef GUARD_ELFP_ELFADDR_H_
+#define GUARD_ELFP_ELFADDR_H_
+
+/* Virtual address translation
+ *
+ * Addresses are looked up in the PT_LOAD segments first, then in the
+ * allocated sections (which is all a relocatable object has). Only the
+ * file-backed part of a range translates: addresses in the zero-filled tail
+ * of a segment (e.g. .bss) have no file offset
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Offset stored by the batch translation for untranslatable addresses */
+#define ELF_ADDR_INVALID UINT64_MAX
+
+/* Translates a virtual address into a file offset
+ * Returns false if the address isn't backed by the file
+ */
+ELF_API bool elfAddrToOffset(ELF *elf, uint64_t addr, uint64_t *offset);
+
+/* Translates 'num' virtual addresses into file offsets
+ * Untranslatable addresses get ELF_ADDR_INVALID. Runs fastest when the
+ * addresses are sorted or clustered, but any order works
+ *
+ * Returns how many addresses were translated
+ */
+ELF_API size_t elfAddrToOffsetBatch(
+	ELF *elf, const uint64_t *ADDRS, uint64_t *offsets, size_t num);
+
+/* Builds the translation index of an ELF, if it wasn't built yet
+ * Lookups do this on their own; this is for building it ahead of time
+ */
+ELF_API bool elfAddrIndexBuild(ELF *elf);
+
+/* Frees the translation index of an ELF, if one was built */
+ELF_API void elfAddrIndexFree(ELF_AddrIndex *index);
+
+#endif // !GUARD_ELFP_ELFADDR_H_
@@ -0,0 +1,20 @@
+#ifndef GUARD_ELFP_ELFAPI_H_
+#define GUARD_ELFP_ELFAPI_H_
+
+/* Exported symbols
+ *
+ * libelfp is built with hidden visibility, so only the functions marked
+ * ELF_API are exported by the shared library: the elf* API, along with what
+ * it takes to use it from the installed headers (reading files into an FP for
+ * elfParse, batch reads and their memory budget). The other helpers the
+ * library is built from, like the allocators and readers in util.h, stay
+ * inside it, and don't clash with the symbols of the programs that load it
+ */
+
+#if defined(__GNUC__)
+#define ELF_API __attribute__((visibility("default")))
+#else
+#define ELF_API
+#endif
+
+#endif // !GUARD_ELFP_ELFAPI_H_
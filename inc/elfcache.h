@@ -0,0 +1,90 @@
+#ifndef GUARD_ELFP_ELFCACHE_H_
+#define GUARD_ELFP_ELFCACHE_H_
+
+/* Parse cache
+ *
+ * Keeps recently parsed files around, keyed by device, inode, modification
+ * time and size, so a file that changes on disk is simply parsed again.
+ * Entries are evicted least-recently-used first once the cache goes over its
+ * memory budget. Entries still in use are never evicted
+ *
+ * All functions are thread-safe. Files are parsed outside of the cache's lock,
+ * and only the section index is built before an ELF is shared: a request that
+ * needs more asks for it with 'elfCacheIndex' first, so many threads can use
+ * the same cached ELF at once without every fill paying for every index
+ */
+
+#include <pthread.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+typedef struct _ELF_CacheEntry {
+	ELF *elf; /* The parsed file */
+
+	uint64_t dev; /* Key */
+	uint64_t ino;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	uint64_t size;
+
+	size_t cost; /* Bytes charged against the budget */
+	uint32_t refs; /* Number of users, the entry can't be evicted while > 0 */
+	int cached; /* Whether the entry is in the cache (too-large ones aren't) */
+
+	pthread_mutex_t indexLock; /* Held while building indices */
+	unsigned indexed; /* Indices built so far (ELF_INDEX_*) */
+
+	struct _ELF_CacheEntry *prev; /* LRU list, most recently used first */
+	struct _ELF_CacheEntry *next;
+	struct _ELF_CacheEntry *chain; /* Next entry in the same hash bucket */
+} ELF_CacheEntry;
+
+/* Opaque, as it holds the lock */
+typedef struct _ELF_Cache ELF_Cache;
+
+/* Cache statistics */
+typedef struct _ELF_CacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+	size_t used; /* Bytes */
+	size_t budget; /* Bytes */
+} ELF_CacheStats;
+
+/* Creates a cache that holds at most 'budget' bytes worth of parsed files
+ * Returns NULL on failure
+ */
+ELF_API ELF_Cache *elfCacheNew(size_t budget);
+
+/* Frees a cache
+ * Every acquired entry must have been released beforehand
+ */
+ELF_API void elfCacheFree(ELF_Cache *cache);
+
+/* Returns the entry for the file at 'PATH', parsing it if needed
+ * Returns NULL on failure, with the reason stored in 'status' (if not NULL).
+ * The entry must be given back with 'elfCacheRelease'
+ */
+ELF_API ELF_CacheEntry *elfCacheAcquire(
+	ELF_Cache *cache, const char *PATH, ELF_Status *status);
+
+/* Builds indices (ELF_INDEX_*) of an acquired entry's ELF, unless they were
+ * built already. Their memory is charged to the entry. Returns false if memory
+ * runs out
+ */
+ELF_API bool elfCacheIndex(
+	ELF_Cache *cache, ELF_CacheEntry *entry, unsigned indices);
+
+/* Gives back an entry returned by 'elfCacheAcquire' */
+ELF_API void elfCacheRelease(ELF_Cache *cache, ELF_CacheEntry *entry);
+
+/* Evicts every entry that isn't in use */
+ELF_API void elfCacheClear(ELF_Cache *cache);
+
+/* Fetches the statistics of a cache */
+ELF_API void elfCacheGetStats(ELF_Cache *cache, ELF_CacheStats *stats);
+
+#endif // !GUARD_ELFP_ELFCACHE_H_
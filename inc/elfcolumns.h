@@ -0,0 +1,52 @@
+#ifndef GUARD_ELFP_ELFCOLUMNS_H_
+#define GUARD_ELFP_ELFCOLUMNS_H_
+
+/* Columnar header tables
+ *
+ * Keeps a second copy of the section and program headers, split into one
+ * array per field. Addresses, offsets, sizes and flags take 32 bits per entry
+ * in ELF32 files, as they do on disk, and 64 in ELF64 ones. A filter over
+ * such a table is a linear scan of a single column, so it touches a fraction
+ * of the cache lines a pass over ELF_SHEntry records would, and vectorizes
+ *
+ * Filters write the indices of the matching entries into 'indices', which
+ * must have room for every entry of the table, and return how many matched
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Returns the columnar tables of an ELF, building them if needed
+ * Returns NULL if memory runs out
+ */
+ELF_API const ELF_Columns *elfColumns(ELF *elf);
+
+/* Returns entry 'i' of a column */
+ELF_API uint64_t elfColumnAt(const ELF_Columns *COLUMNS, ELF_Column column,
+	uint32_t i);
+
+/* Sections of type 'type' */
+ELF_API uint32_t elfSectionsOfType(
+	const ELF_Columns *COLUMNS, ELF_SH_Type type, uint32_t *indices);
+
+/* Sections with every bit of 'flags' set (ELF_SHF_*) */
+ELF_API uint32_t elfSectionsWithFlags(
+	const ELF_Columns *COLUMNS, uint64_t flags, uint32_t *indices);
+
+/* Sections with a size between 'min' and 'max', both included */
+ELF_API uint32_t elfSectionsOfSize(const ELF_Columns *COLUMNS, uint64_t min,
+	uint64_t max, uint32_t *indices);
+
+/* Segments of type 'type' */
+ELF_API uint32_t elfSegmentsOfType(
+	const ELF_Columns *COLUMNS, ELF_PH_Type type, uint32_t *indices);
+
+/* Builds the columnar tables of an ELF, if they weren't built yet */
+ELF_API bool elfColumnsBuild(ELF *elf);
+
+/* Frees columnar tables, if they were built */
+ELF_API void elfColumnsFree(ELF_Columns *columns);
+
+#endif // !GUARD_ELFP_ELFCOLUMNS_H_
@@ -0,0 +1,59 @@
+#ifndef GUARD_ELFP_ELFDEBUGLINK_H_
+#define GUARD_ELFP_ELFDEBUGLINK_H_
+
+/* Debug links
+ *
+ * .gnu_debuglink names the file holding an ELF's debugging information, and
+ * gives the CRC-32 of its whole contents, so a candidate found by that name
+ * can be checked before it's trusted
+ *
+ * The CRC is the usual one (as in zlib, gzip or PNG), computed by the fastest
+ * kernel the CPU runs, picked on first use: carry-less multiplication folding
+ * 64 bytes at a time on x86-64 CPUs with PCLMULQDQ, slicing-by-8 otherwise.
+ * The byte-at-a-time kernel is kept as the reference the others are held to
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+typedef struct _ELF_DebugLink {
+	const char *name; /* Points into the ELF's image */
+	uint32_t crc;
+} ELF_DebugLink;
+
+typedef enum _ELF_Crc32Kernel {
+	ELF_CRC32_BYTEWISE = 0,
+	ELF_CRC32_SLICE8,
+	ELF_CRC32_PCLMUL,
+
+	ELF_CRC32_KERNEL_NUM,
+} ELF_Crc32Kernel;
+
+/* Reads the debug link of an ELF
+ * Returns false if it has no .gnu_debuglink, or one too short to hold both
+ * a name and a CRC
+ */
+ELF_API bool elfDebugLink(ELF *elf, ELF_DebugLink *link);
+
+/* Continues a CRC-32 over 'size' more bytes; a new one starts from 0 */
+ELF_API uint32_t elfCrc32(uint32_t crc, const void *DATA, size_t size);
+
+/* Same, with a given kernel, which this CPU must run */
+ELF_API uint32_t elfCrc32Using(
+	ELF_Crc32Kernel kernel, uint32_t crc, const void *DATA, size_t size);
+
+/* Returns whether this CPU runs a kernel */
+ELF_API bool elfCrc32Supported(ELF_Crc32Kernel kernel);
+
+/* Returns the name of a kernel, like "slicing-by-8" */
+ELF_API const char *elfCrc32KernelName(ELF_Crc32Kernel kernel);
+
+/* Computes the CRC-32 of a whole file
+ * Returns false, with errno set, if it can't be read
+ */
+ELF_API bool elfCrc32File(const char *PATH, uint32_t *crc);
+
+#endif // !GUARD_ELFP_ELFDEBUGLINK_H_
@@ -1,14 +1,22 @@
 #ifndef GUARD_ELFP_ELFDUMP_H_
 #define GUARD_ELFP_ELFDUMP_H_
 
+#include <stdio.h>
+
 #include "elfp.h"
 
 #define ELF_DUMP_EH 1 /* Dump entry header */
 #define ELF_DUMP_PH 2 /* Dump program headers */
 #define ELF_DUMP_SH 4 /* Dump section headers */
 #define ELF_DUMP_ALL (ELF_DUMP_EH | ELF_DUMP_PH | ELF_DUMP_SH)
+#define ELF_DUMP_UNWIND 8 /* Dump the .eh_frame_hdr search table */
+#define ELF_DUMP_DYNSYM 16 /* Dump dynamic symbols and their versions */
+#define ELF_DUMP_PAGES 32 /* Dump the page footprint of loadable segments */
+
+/* Dumps an ELF's content to stdout */
+ELF_API void elfDump(ELF *elf, int flags);
 
-/* Dumps an ELF's content */
-void elfDump(ELF *elf, int flags);
+/* Dumps an ELF's content to a stream */
+ELF_API void elfDumpTo(FILE *out, ELF *elf, int flags);
 
 #endif // !GUARD_ELFP_ELFDUMP_H_
@@ -0,0 +1,99 @@
+#ifndef GUARD_ELFP_ELFFRAME_H_
+#define GUARD_ELFP_ELFFRAME_H_
+
+/* Call frame information
+ *
+ * Decodes .eh_frame_hdr (found through PT_GNU_EH_FRAME, or its section) and
+ * the .eh_frame records it points to. PC lookups binary search the header's
+ * own sorted table in place, so there's nothing to build beforehand
+ *
+ * Nothing here is copied: instructions and augmentation strings point into
+ * the ELF's image, and live as long as it does
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Pointer encodings (DW_EH_PE_*) */
+#define ELF_EH_PE_ABSPTR 0x00
+#define ELF_EH_PE_ULEB128 0x01
+#define ELF_EH_PE_UDATA2 0x02
+#define ELF_EH_PE_UDATA4 0x03
+#define ELF_EH_PE_UDATA8 0x04
+#define ELF_EH_PE_SLEB128 0x09
+#define ELF_EH_PE_SDATA2 0x0A
+#define ELF_EH_PE_SDATA4 0x0B
+#define ELF_EH_PE_SDATA8 0x0C
+#define ELF_EH_PE_PCREL 0x10
+#define ELF_EH_PE_DATAREL 0x30
+#define ELF_EH_PE_INDIRECT 0x80
+#define ELF_EH_PE_OMIT 0xFF
+
+/* Decoded .eh_frame_hdr */
+typedef struct _ELF_EhFrameHdr {
+	uint64_t addr; /* Virtual address of the header */
+	uint64_t ehFrame; /* Virtual address of .eh_frame */
+
+	const uint8_t *table; /* Search table, NULL if missing or unusable */
+	uint64_t tableNum; /* Number of entries in the table */
+	uint8_t tableEncoding;
+	uint8_t tableEntrySize;
+} ELF_EhFrameHdr;
+
+/* Common Information Entry */
+typedef struct _ELF_CIE {
+	uint64_t addr; /* Virtual address of the record */
+	uint8_t version;
+	const char *augmentation;
+
+	uint64_t codeAlign;
+	int64_t dataAlign;
+	uint64_t returnReg;
+
+	uint8_t fdeEncoding; /* How the FDEs' addresses are encoded */
+	uint8_t lsdaEncoding; /* ELF_EH_PE_OMIT if the FDEs have no LSDA */
+	uint64_t personality; /* Routine (or slot holding it, if indirect), or 0 */
+	bool signalFrame;
+
+	const uint8_t *instructions; /* Initial instructions */
+	uint64_t instructionsSize;
+} ELF_CIE;
+
+/* Frame Description Entry */
+typedef struct _ELF_FDE {
+	uint64_t addr; /* Virtual address of the record */
+	uint64_t pcBegin;
+	uint64_t pcEnd; /* One past the last address covered */
+	uint64_t lsda; /* 0 if there's none */
+
+	const uint8_t *instructions;
+	uint64_t instructionsSize;
+
+	ELF_CIE cie;
+} ELF_FDE;
+
+/* Decodes the .eh_frame_hdr of an ELF
+ * Returns false if there's none, or it's malformed
+ */
+ELF_API bool elfEhFrameHdr(ELF *elf, ELF_EhFrameHdr *hdr);
+
+/* Reads an entry of the header's search table
+ * Returns false if the entry is out of range
+ */
+ELF_API bool elfEhFrameHdrEntry(ELF *elf, const ELF_EhFrameHdr *HDR,
+	uint64_t idx, uint64_t *pc, uint64_t *fde);
+
+/* Decodes the FDE at a virtual address, along with its CIE
+ * Returns false if there's no well-formed FDE there
+ */
+ELF_API bool elfFDEAt(ELF *elf, uint64_t addr, ELF_FDE *fde);
+
+/* Finds the FDE covering a PC, through the .eh_frame_hdr search table
+ * Returns false if no FDE covers it
+ */
+ELF_API bool elfFindFDE(ELF *elf, uint64_t pc, ELF_FDE *fde);
+
+#endif // !GUARD_ELFP_ELFFRAME_H_
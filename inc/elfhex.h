@@ -0,0 +1,27 @@
+#ifndef GUARD_ELFP_ELFHEX_H_
+#define GUARD_ELFP_ELFHEX_H_
+
+/* Hex dumps
+ *
+ * Formats bytes the way readelf -x does: 16 per line, after their address,
+ * in four groups of four bytes, then as text with unprintable bytes shown as
+ * dots. Whole lines are converted 16 bytes at a time with SSE2 where the
+ * compiler targets it (always, on x86-64), and a byte at a time otherwise
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfapi.h"
+
+/* Bytes a line of output takes at most, for 64-bit addresses */
+#define ELF_HEX_LINE_MAX 74
+
+/* Formats 'size' bytes, the first of which is at 'addr', into 'out'
+ * 'out' must hold ELF_HEX_LINE_MAX bytes per line (of 16 bytes, rounding up).
+ * Returns the length of the text, which isn't NUL-terminated
+ */
+ELF_API size_t elfHexFormat(
+	char *out, const uint8_t *DATA, size_t size, uint64_t addr);
+
+#endif // !GUARD_ELFP_ELFHEX_H_
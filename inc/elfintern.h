@@ -0,0 +1,58 @@
+#ifndef GUARD_ELFP_ELFINTERN_H_
+#define GUARD_ELFP_ELFINTERN_H_
+
+/* String interning
+ *
+ * Process-wide pool holding a single copy of each distinct string it's given.
+ * Strings that show up in most files (section names, note names, interpreter
+ * paths, symbol versions) are stored once, however many files are parsed, and
+ * live until the pool is reset. A long-running scan resets it between files
+ * once it grows past a limit, as nothing else ever frees it
+ *
+ * Each string gets a 32-bit ID, which records store instead of a pointer, so
+ * equal strings compare (and group) as equal integers. The pool is split into
+ * shards with a lock each, so many threads can intern at once. Turning an ID
+ * back into its string takes no lock at all
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfapi.h"
+
+/* ID of the empty string, which also stands for "no string" */
+#define ELF_INTERN_NONE 0
+
+/* Figures about the intern pool */
+typedef struct _ELF_InternStats {
+	size_t strings; /* Distinct strings held */
+	size_t bytes; /* Bytes of string data held */
+	size_t footprint; /* Bytes of memory held, tables included */
+} ELF_InternStats;
+
+/* Returns the ID of the first 'length' bytes of 'STRING', adding it to the
+ * pool if it's new
+ * Returns ELF_INTERN_NONE for an empty string, or if memory runs out
+ */
+ELF_API uint32_t elfInternId(const char *STRING, size_t length);
+
+/* Returns the ID of a string, without adding it to the pool
+ * Returns ELF_INTERN_NONE if it was never interned
+ */
+ELF_API uint32_t elfInternFind(const char *STRING, size_t length);
+
+/* Returns the string an ID stands for
+ * The empty string for ELF_INTERN_NONE. IDs must come from this pool
+ */
+ELF_API const char *elfInternString(uint32_t id);
+
+/* Gets figures about the intern pool */
+ELF_API void elfInternGetStats(ELF_InternStats *stats);
+
+/* Empties the pool, freeing its memory
+ * Every ID handed out so far becomes invalid, so no ELF (or anything else
+ * holding IDs) may be alive, and no other thread may use the pool meanwhile
+ */
+ELF_API void elfInternReset(void);
+
+#endif // !GUARD_ELFP_ELFINTERN_H_
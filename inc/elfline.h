@@ -0,0 +1,47 @@
+#ifndef GUARD_ELFP_ELFLINE_H_
+#define GUARD_ELFP_ELFLINE_H_
+
+/* Source line lookup
+ *
+ * Decodes the DWARF 2 to 5 line programs in .debug_line, once, into a single
+ * table sorted by address. Lookups are then a binary search, without going
+ * back to the DWARF. Compressed debug sections aren't supported, and leave the
+ * table empty. Relocations aren't applied either, so paths and addresses from
+ * relocatable objects are only as good as their unrelocated values
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Source location of an address */
+typedef struct _ELF_LineInfo {
+	const char *file; /* NULL if the address isn't covered */
+	uint32_t line;
+} ELF_LineInfo;
+
+/* Looks up the source location of an address
+ * Returns false if no line program covers the address
+ */
+ELF_API bool elfAddrToLine(ELF *elf, uint64_t addr, ELF_LineInfo *info);
+
+/* Looks up the source locations of 'num' addresses
+ * Uncovered addresses get a NULL file. Runs fastest when the addresses are
+ * sorted or clustered, but any order works
+ *
+ * Returns how many addresses were found
+ */
+ELF_API size_t elfAddrToLineBatch(
+	ELF *elf, const uint64_t *ADDRS, ELF_LineInfo *infos, size_t num);
+
+/* Builds the line table of an ELF, if it wasn't built yet
+ * Lookups do this on their own; this is for building it ahead of time
+ */
+ELF_API bool elfLineTableBuild(ELF *elf);
+
+/* Frees the line table of an ELF, if one was built */
+ELF_API void elfLineTableFree(ELF_LineTable *table);
+
+#endif // !GUARD_ELFP_ELFLINE_H_
@@ -0,0 +1,113 @@
+#ifndef GUARD_ELFP_ELFNOTE_H_
+#define GUARD_ELFP_ELFNOTE_H_
+
+/* Notes
+ *
+ * Walks every note of a PT_NOTE segment or SHT_NOTE section in place: names
+ * and descriptors point into the ELF's image, and nothing is allocated. Notes
+ * are padded to 4 bytes, or to 8 in segments and sections aligned to 8 (as
+ * GNU property notes are in 64-bit files)
+ *
+ * GNU property notes (NT_GNU_PROPERTY_TYPE_0) tell what a binary needs from
+ * the CPU, like an x86-64 ISA level, and how it was hardened, like CET on x86
+ * or BTI on AArch64. elfGnuProperties gathers those of a whole file
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "elfp.h"
+#include "util.h"
+
+/* x86 ISA levels, as bits of x86IsaNeeded and x86IsaUsed */
+#define ELF_X86_ISA_BASELINE 1
+#define ELF_X86_ISA_V2 2
+#define ELF_X86_ISA_V3 4
+#define ELF_X86_ISA_V4 8
+
+/* x86 control-flow protection (CET), as bits of x86Features */
+#define ELF_X86_FEATURE_IBT 1
+#define ELF_X86_FEATURE_SHSTK 2
+
+/* AArch64 branch protection, as bits of aarch64Features */
+#define ELF_AARCH64_FEATURE_BTI 1
+#define ELF_AARCH64_FEATURE_PAC 2
+
+/* Properties found, as bits of 'present' */
+#define ELF_GNU_PROP_X86_ISA_NEEDED 1
+#define ELF_GNU_PROP_X86_ISA_USED 2
+#define ELF_GNU_PROP_X86_FEATURES 4
+#define ELF_GNU_PROP_AARCH64_FEATURES 8
+
+/* A note, read in place */
+typedef struct _ELF_NoteRef {
+	uint32_t namesz;
+	uint32_t descsz;
+	uint32_t type;
+
+	const char *name; /* NUL-terminated only if the file's name is */
+	const uint8_t *desc;
+	uint64_t offset; /* Of the note, in the file */
+} ELF_NoteRef;
+
+typedef struct _ELF_NoteIter {
+	Cursor cursor;
+	uint64_t offset; /* Of the next note, in the file */
+	uint32_t align;
+	bool truncated; /* Notes ended early, or didn't fit in the file */
+} ELF_NoteIter;
+
+/* What a file's GNU property notes say */
+typedef struct _ELF_GnuProperties {
+	uint32_t present; /* ELF_GNU_PROP_* bits of the fields found */
+
+	uint32_t x86IsaNeeded; /* ELF_X86_ISA_* */
+	uint32_t x86IsaUsed;
+	uint32_t x86Features; /* ELF_X86_FEATURE_* */
+	uint32_t aarch64Features; /* ELF_AARCH64_FEATURE_* */
+} ELF_GnuProperties;
+
+/* Starts iterating over the notes in 'size' bytes at 'offset' in the file,
+ * aligned to 'align' (the segment's or section's alignment)
+ */
+ELF_API void elfNotesAt(ELF *elf, uint64_t offset, uint64_t size,
+	uint64_t align, ELF_NoteIter *iter);
+
+ELF_API void elfNotesOfSegment(
+	ELF *elf, const ELF_PHEntry *PH, ELF_NoteIter *iter);
+ELF_API void elfNotesOfSection(
+	ELF *elf, const ELF_SHEntry *SH, ELF_NoteIter *iter);
+
+/* Reads the next note
+ * Returns false once there are no more, or the next one doesn't fit (which
+ * sets 'truncated')
+ */
+ELF_API bool elfNoteNext(ELF_NoteIter *iter, ELF_NoteRef *note);
+
+/* Returns whether a note has a given name, like "GNU" */
+ELF_API bool elfNoteIsNamed(const ELF_NoteRef *NOTE, const char *NAME);
+
+/* Finds the GNU build ID of a file, in its note segments or, if it has no
+ * segments at all, its note sections. Returns its size, 0 if there's none
+ */
+ELF_API uint32_t elfBuildId(ELF *elf, const uint8_t **id);
+
+/* Adds what a GNU property note says to 'properties', returning false if the
+ * note isn't one. Processor-specific properties are read according to the
+ * file's machine
+ */
+ELF_API bool elfGnuPropertiesAdd(
+	ELF *elf, const ELF_NoteRef *NOTE, ELF_GnuProperties *properties);
+
+/* Gathers the GNU properties of a file, from its PT_GNU_PROPERTY segment if
+ * it has one, from its note segments otherwise, or from its note sections if
+ * it has no segments at all. Returns whether a property note was found
+ */
+ELF_API bool elfGnuProperties(ELF *elf, ELF_GnuProperties *properties);
+
+/* Returns the highest x86-64 ISA level among ELF_X86_ISA_* bits: 1 for the
+ * baseline, 2 to 4 for x86-64-v2 to v4, 0 if there are none
+ */
+ELF_API unsigned elfX86IsaLevel(uint32_t isa);
+
+#endif // !GUARD_ELFP_ELFNOTE_H_
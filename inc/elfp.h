@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "elfapi.h"
 #include "util.h"
 
 /* Enumeration of all possible EI_CLASS values
@@ -167,6 +168,10 @@ typedef enum _ELF_Machine {
 	ELF_EM_SVX = 73,
 	ELF_EM_ST19 = 74,
 	ELF_EM_VAX = 75,
+	ELF_EM_AARCH64 = 183,
+	ELF_EM_RISCV = 243,
+	ELF_EM_BPF = 247,
+	ELF_EM_LOONGARCH = 258,
 } ELF_Machine;
 
 /* Structure representing the ELF Entry Header */
@@ -187,11 +192,23 @@ typedef struct _ELF_Header {
 	uint16_t progHeaderEntrySize; /* Size of an entry in the program header */
 	uint16_t progHeaderEntryNum; /* Number of program header entries */
 	uint16_t sectHeaderEntrySize; /* Size of an entry in the section header */
-	uint16_t sectHeaderEntryNum; /* Number of section header entries */
-	uint16_t sectHeaderNameIndex; /* Index of the section names entry on the
+
+	/* These two are widened past their on-disk 16 bits: when a file has more
+	 * sections than fit, the real values are stored in the first section
+	 * header entry, and the parser resolves them here
+	 */
+	uint32_t sectHeaderEntryNum; /* Number of section header entries */
+	uint32_t sectHeaderNameIndex; /* Index of the section names entry on the
 									 section header */
 } ELF_Header;
 
+/* Special section indices */
+#define ELF_SHN_UNDEF 0
+#define ELF_SHN_LORESERVE 0xFF00 /* Indices from here on aren't sections */
+#define ELF_SHN_ABS 0xFFF1
+#define ELF_SHN_COMMON 0xFFF2
+#define ELF_SHN_XINDEX 0xFFFF
+
 /* Enumeration of all possible p_type values
  * Represents the Program Header's type
  */
@@ -220,7 +237,8 @@ typedef enum _ELF_PH_Type {
 typedef enum _ELF_NT {
 	ELF_NT_GNU_ABI = 1,
 	ELF_NT_GNU_HWCAP = 2,
-	ELF_NT_GNU_BUILDID = 3
+	ELF_NT_GNU_BUILDID = 3,
+	ELF_NT_GNU_PROPERTY_TYPE_0 = 5,
 } ELF_NT;
 
 typedef enum _ELF_NT_GNU_ABI_Type {
@@ -237,8 +255,8 @@ typedef struct _ELF_Note {
 	uint32_t namesz;
 	uint32_t descsz;
 	uint32_t type;
-	char *name;
-	char *desc;
+	uint32_t nameId; /* Interned name, see elfintern.h */
+	const char *desc; /* Points into the ELF's image, NULL if it's empty */
 } ELF_Note;
 
 /* p_flags values
@@ -260,6 +278,7 @@ typedef struct _ELF_PHEntry {
 	uint64_t memSize;
 	uint64_t align;
 
+	uint32_t interpId; /* Interned path, for PT_INTERP entries */
 	void *data;
 } ELF_PHEntry;
 
@@ -283,6 +302,10 @@ typedef enum _ELF_SH_Type {
 	ELF_SHT_SYMTAB_EXT = 18,
 	ELF_SHT_RELR = 19,
 
+	ELF_SHT_GNU_VERDEF = 0x6FFFFFFD,
+	ELF_SHT_GNU_VERNEED = 0x6FFFFFFE,
+	ELF_SHT_GNU_VERSYM = 0x6FFFFFFF,
+
 	ELF_SHT_LOOS = 0x60000000,
 	ELF_SHT_HIOS = 0x6FFFFFFF,
 
@@ -309,6 +332,7 @@ typedef enum _ELF_SH_Type {
 #define ELF_SHF_OS_NONCONFORMING 0x100
 #define ELF_SHF_GROUP 0x200
 #define ELF_SHF_TLS 0x400
+#define ELF_SHF_COMPRESSED 0x800
 #define ELF_SHF_ORDERERD 0x4000000
 #define ELF_SHF_EXCLUDE 0x8000000
 #define ELF_SHF_OS 0x0FF00000
@@ -317,6 +341,7 @@ typedef enum _ELF_SH_Type {
 /* Structure representing an entry in the ELF Section Header */
 typedef struct _ELF_SHEntry {
 	uint32_t nameIdx;
+	uint32_t nameId; /* Interned name, see elfintern.h */
 
 	ELF_SH_Type type;
 	uint64_t flags;
@@ -334,20 +359,276 @@ typedef struct _ELF_SHEntry {
 	void *data;
 } ELF_SHEntry;
 
-/* Structure representing an ELF file */
+/* Well-known sections
+ * Resolved once, together with the section name index. Missing sections are
+ * left as NULL
+ */
+typedef struct _ELF_KnownSections {
+	ELF_SHEntry *interp; /* .interp */
+	ELF_SHEntry *dynamic; /* .dynamic */
+	ELF_SHEntry *dynsym; /* .dynsym */
+	ELF_SHEntry *dynstr; /* .dynstr */
+	ELF_SHEntry *symtab; /* .symtab */
+	ELF_SHEntry *strtab; /* .strtab */
+	ELF_SHEntry *buildId; /* .note.gnu.build-id */
+	ELF_SHEntry *ehFrame; /* .eh_frame */
+	ELF_SHEntry *ehFrameHdr; /* .eh_frame_hdr */
+	ELF_SHEntry *debugLink; /* .gnu_debuglink */
+	ELF_SHEntry *debugLine; /* .debug_line */
+} ELF_KnownSections;
+
+/* Open-addressed hash index over section names */
+typedef struct _ELF_SectIndex {
+	uint32_t *slots; /* Section index + 1, or 0 if the slot is empty */
+	uint32_t mask; /* Number of slots - 1 (always a power of two) */
+
+	ELF_KnownSections known;
+} ELF_SectIndex;
+
+/* Sorted interval index used for virtual address translation
+ * Kept as parallel arrays, so the binary search only touches 'start'
+ */
+typedef struct _ELF_AddrRanges {
+	uint64_t *start; /* First virtual address of each range, ascending */
+	uint64_t *end; /* One past the last file-backed virtual address */
+	uint64_t *offset; /* File offset 'start' maps to */
+	uint32_t num;
+} ELF_AddrRanges;
+
+typedef struct _ELF_AddrIndex {
+	ELF_AddrRanges segments; /* Built from PT_LOAD entries */
+	ELF_AddrRanges sections; /* Fallback, built from allocated sections */
+} ELF_AddrIndex;
+
+/* Every row of every line program in .debug_line, sorted by address
+ * A row covers the addresses up to the next one. Rows with a line of 0 (the
+ * end of a sequence, or code with no source line) cover nothing
+ */
+typedef struct _ELF_LineTable {
+	uint64_t *addr; /* Ascending */
+	uint32_t *line;
+	uint32_t *file; /* Index into 'files' */
+	uint32_t num;
+
+	char **files; /* Paths of the source files, each appearing once */
+	uint32_t fileNum;
+} ELF_LineTable;
+
+/* A symbol version, either defined by the ELF or required from a library
+ * Names are interned (see elfintern.h), so they're shared between ELFs, and
+ * outlive them
+ */
+typedef struct _ELF_SymVersion {
+	uint32_t nameId;
+	uint32_t libraryId; /* Library it's required from, 0 if defined here */
+	uint16_t index; /* As used in .gnu.version */
+	uint16_t flags; /* VER_FLG_* */
+} ELF_SymVersion;
+
+/* Symbol version flags */
+#define ELF_VER_FLG_BASE 1 /* Version of the ELF itself, not of its symbols */
+#define ELF_VER_FLG_WEAK 2
+
+/* An entry of .dynsym, along with its version */
+typedef struct _ELF_Symbol {
+	const char *name; /* Points into the ELF's image */
+	const ELF_SymVersion *version; /* NULL if the symbol isn't versioned */
+	bool hidden; /* Whether it's only visible as name@VER, not name@@VER */
+
+	uint64_t value;
+	uint64_t size;
+	uint16_t section;
+	uint8_t info; /* Binding in the high nibble, type in the low one */
+	uint8_t other; /* Visibility */
+} ELF_Symbol;
+
+/* The dynamic symbols of an ELF, and the versions they refer to */
+typedef struct _ELF_SymTable {
+	ELF_Symbol *symbols;
+	uint32_t num;
+
+	ELF_SymVersion *versions; /* Definitions first, then requirements */
+	uint32_t versionNum;
+	uint32_t defNum; /* Number of definitions in 'versions' */
+} ELF_SymTable;
+
+/* A column of addresses, offsets, sizes or flags
+ * Entries are 32 bits wide for ELF32 files, and 64 for ELF64 ones
+ */
+typedef union _ELF_Column {
+	uint32_t *u32;
+	uint64_t *u64;
+} ELF_Column;
+
+/* Section headers, one array per field */
+typedef struct _ELF_SectColumns {
+	uint32_t num;
+
+	uint32_t *type;
+	uint32_t *nameId;
+	ELF_Column flags;
+	ELF_Column addr;
+	ELF_Column offset;
+	ELF_Column size;
+} ELF_SectColumns;
+
+/* Program headers, one array per field */
+typedef struct _ELF_SegColumns {
+	uint16_t num;
+
+	uint32_t *type;
+	uint32_t *flags;
+	ELF_Column offset;
+	ELF_Column virtualAddr;
+	ELF_Column fileSize;
+	ELF_Column memSize;
+	ELF_Column align;
+} ELF_SegColumns;
+
+/* Section and program headers stored column by column, so that a pass over
+ * one field reads nothing else. See elfcolumns.h
+ */
+typedef struct _ELF_Columns {
+	bool wide; /* Whether ELF_Column entries are 64 bits wide */
+
+	ELF_SectColumns sections;
+	ELF_SegColumns segments;
+
+	void *block; /* Every column lives in this single allocation */
+	size_t blockSize;
+} ELF_Columns;
+
+/* Result of parsing a file
+ * Errors stop the parse. Warnings don't: the offending value is reset, or the
+ * offending data dropped, and the warning is recorded in the ELF
+ */
+typedef enum _ELF_Status {
+	ELF_OK = 0,
+
+	ELF_ERR_IO, /* File couldn't be read */
+	ELF_ERR_NOMEM, /* Out of memory */
+	ELF_ERR_TOO_SMALL, /* File is smaller than an Entry Header */
+	ELF_ERR_BAD_MAGIC, /* File doesn't start with "\x7FELF" */
+	ELF_ERR_BAD_PH_TABLE, /* Program Header table out of bounds/malformed */
+	ELF_ERR_BAD_SH_TABLE, /* Section Header table out of bounds/malformed */
+
+	ELF_WARN_CLASS, /* Invalid EI_CLASS */
+	ELF_WARN_ENDIANNESS, /* Invalid EI_DATA */
+	ELF_WARN_VERSION, /* Invalid EI_VERSION or e_version */
+	ELF_WARN_TYPE, /* Invalid e_type */
+	ELF_WARN_INTERP, /* PT_INTERP path out of bounds */
+	ELF_WARN_NOTE, /* Note out of bounds or truncated */
+	ELF_WARN_STRTAB, /* String table out of bounds */
+
+	ELF_STATUS_NUM,
+} ELF_Status;
+
+/* First warning in ELF_Status */
+#define ELF_WARN_FIRST ELF_WARN_CLASS
+
+/* Bit representing a warning in the 'warnings' field of an ELF */
+#define ELF_WARNING_BIT(W) (1u << (W))
+
+/* Diagnostics an ELF keeps; any raised past these are only counted */
+#define ELF_DIAGNOSTICS_MAX 8
+
+/* A warning raised while parsing, and where in the file it was raised */
+typedef struct _ELF_Diagnostic {
+	ELF_Status code;
+	uint64_t offset; /* Of the offending field, or data */
+	uint64_t value; /* Offending value before it was reset, or data size */
+} ELF_Diagnostic;
+
+/* Structure representing an ELF file
+ *
+ * None of the lookup functions are safe to call on the same ELF from many
+ * threads at once, as they build their indices on first use
+ */
 typedef struct _ELF {
 	ELF_Header header;
 	ELF_PHEntry *ph;
 	ELF_SHEntry *sh;
+
+	const char *image; /* The file's contents */
+	size_t imageSize;
+	FP *file; /* File owned by this ELF, NULL if 'image' is borrowed */
+
+	uint32_t warnings; /* Warnings raised while parsing, see ELF_WARNING_BIT */
+	uint32_t diagnosticNum; /* Ditto, counting each time one was raised */
+	ELF_Diagnostic diagnostics[ELF_DIAGNOSTICS_MAX]; /* The first of those */
+
+	ELF_SectIndex *sectIndex; /* Built on first lookup, NULL until then */
+	ELF_AddrIndex *addrIndex; /* Ditto, for address translation */
+	ELF_LineTable *lineTable; /* Ditto, for line lookups */
+	ELF_SymTable *dynSymbols; /* Ditto, for dynamic symbols */
+	ELF_Columns *columns; /* Ditto, for the columnar header tables */
 } ELF;
 
-/* Opens a file and parses into an ELF structure */
-ELF *elfParseFile(const char *FILENAME);
+/* Opens a file and parses into an ELF structure
+ * Returns NULL on failure, with the reason stored in 'status' (if not NULL)
+ */
+ELF_API ELF *elfParseFile(const char *FILENAME, ELF_Status *status);
+
+/* Parses a sequence of bytes into an ELF structure
+ * The ELF takes ownership of 'fp', freeing it with itself. If parsing fails,
+ * 'fp' is freed right away
+ */
+ELF_API ELF *elfParse(FP *fp, ELF_Status *status);
+
+/* Parses a caller-owned buffer into an ELF structure
+ * The buffer is borrowed, not copied: it must outlive the returned ELF
+ */
+ELF_API ELF *elfParseBuffer(
+	const void *BUFFER, size_t size, ELF_Status *status);
+
+/* Parses only the Entry Header at the start of a buffer, allocating nothing
+ * At most the first 64 bytes are read. Warnings about the header are stored
+ * in 'warnings', if not NULL
+ */
+ELF_API ELF_Status elfParseHeader(const void *BUFFER, size_t size,
+	ELF_Header *header, uint32_t *warnings);
+
+/* Returns a human-readable description of a status */
+ELF_API const char *elfStatusString(ELF_Status status);
+
+/* Renders a diagnostic as a line of text (without a newline), like
+ * snprintf: 'buffer' gets as much of it as fits, the full length is returned
+ */
+ELF_API int elfDiagnosticFormat(
+	const ELF_Diagnostic *DIAGNOSTIC, char *buffer, size_t size);
+
+/* Returns the name of a section, or an empty string if it has none */
+ELF_API const char *elfSectionName(ELF *elf, ELF_SHEntry *sh);
+
+/* Finds a section by its name
+ * Returns NULL if there's no such section. If many sections share the name,
+ * the one with the lowest index is returned
+ */
+ELF_API ELF_SHEntry *elfFindSection(ELF *elf, const char *NAME);
+
+/* Returns the well-known sections of an ELF */
+ELF_API const ELF_KnownSections *elfKnownSections(ELF *elf);
 
-/* Parses a sequence of bytes into an ELF structure */
-ELF *elfParse(FP *fp);
+/* Indices 'elfBuildIndices' can build */
+#define ELF_INDEX_SECTIONS 1 /* Sections by name, and the well-known ones */
+#define ELF_INDEX_ADDR 2 /* Address translation */
+#define ELF_INDEX_LINES 4 /* Source line lookups */
+#define ELF_INDEX_SYMBOLS 8 /* Dynamic symbols and their versions */
+#define ELF_INDEX_ALL 15
+
+/* Builds indices (ELF_INDEX_*) the lookup functions would otherwise build on
+ * first use. After this, lookups needing only those are safe to run from many
+ * threads at once. Returns false if memory runs out
+ */
+ELF_API bool elfBuildIndices(ELF *elf, unsigned indices);
+
+/* Returns roughly how many bytes of memory an ELF holds on to
+ * A mapped file isn't counted: its pages are page cache, which the kernel can
+ * take back
+ */
+ELF_API size_t elfFootprint(ELF *elf);
 
 /* Frees an allocated ELF file */
-void elfFree(ELF *elf);
+ELF_API void elfFree(ELF *elf);
 
 #endif // !GUARD_ELFP_ELFP_H_
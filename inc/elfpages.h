@@ -0,0 +1,56 @@
+#ifndef GUARD_ELFP_ELFPAGES_H_
+#define GUARD_ELFP_ELFPAGES_H_
+
+/* Page-level memory footprint
+ *
+ * Lays out each PT_LOAD segment the way the dynamic loader maps it, and
+ * estimates how its pages end up: shared with every other process mapping the
+ * file, copied on write because relocations (or the loader zeroing the start
+ * of .bss) dirty them, or anonymous. Nothing is run, so pages the program
+ * itself writes to (like .data) are counted as shared until proven otherwise
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Page counts of a segment, or of several of them added up */
+typedef struct _ELF_SegmentPages {
+	uint16_t index; /* Program Header entry, for a single segment */
+	uint32_t flags; /* ELF_PHF_* */
+
+	uint64_t pages; /* Pages mapped */
+	uint64_t filePages; /* Of those, the ones backed by the file */
+	uint64_t anonPages; /* ...and the anonymous ones, past the file's end */
+	uint64_t sharedPages; /* File-backed pages nothing writes to on load */
+	uint64_t dirtyPages; /* File-backed pages copied on write by the loader */
+	uint64_t relroPages; /* Pages made read-only after relocation */
+
+	uint64_t wasted; /* Bytes mapped without belonging to the segment */
+} ELF_SegmentPages;
+
+typedef struct _ELF_PageReport {
+	uint64_t pageSize;
+
+	ELF_SegmentPages *segments; /* One per PT_LOAD entry, in order */
+	uint16_t num;
+
+	ELF_SegmentPages total; /* All segments added up */
+	uint64_t relocations; /* Dynamic relocations found */
+} ELF_PageReport;
+
+/* Estimates the page footprint of an ELF's PT_LOAD segments
+ * A 'pageSize' of 0 stands for the page size of this system. Returns false if
+ * memory runs out
+ */
+ELF_API bool elfPageFootprint(
+	ELF *elf, uint64_t pageSize, ELF_PageReport *report);
+
+/* Adds the counts of 'FROM' to 'into' */
+ELF_API void elfPageAdd(ELF_SegmentPages *into, const ELF_SegmentPages *FROM);
+
+/* Frees the segments of a report */
+ELF_API void elfPageReportFree(ELF_PageReport *report);
+
+#endif // !GUARD_ELFP_ELFPAGES_H_
@@ -0,0 +1,76 @@
+#ifndef GUARD_ELFP_ELFSIZE_H_
+#define GUARD_ELFP_ELFSIZE_H_
+
+/* Size attribution
+ *
+ * Accounts for every byte of a file three ways: by the PT_LOAD segment holding
+ * it, by the section (or header table) holding it, and, when the file has a
+ * symbol table, by the symbol covering it. Bytes between sections are either
+ * alignment padding or unaccounted for; bytes outside every segment, section
+ * or symbol get a bracketed pseudo-name, like "[not loaded]"
+ *
+ * Reports are keyed by interned names (see elfintern.h), so the reports of
+ * many files merge cheaply into one
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Ways a file's bytes are accounted for */
+typedef enum _ELF_SizeKind {
+	ELF_SIZE_SEGMENT = 0,
+	ELF_SIZE_SECTION,
+	ELF_SIZE_SYMBOL,
+
+	ELF_SIZE_KIND_NUM,
+} ELF_SizeKind;
+
+/* Bytes attributed to a name */
+typedef struct _ELF_SizeEntry {
+	uint32_t nameId; /* Interned name, ELF_INTERN_NONE if the slot is empty */
+	uint64_t bytes;
+	uint64_t files; /* Number of files the name showed up in */
+} ELF_SizeEntry;
+
+/* Entries by name, with linear probing */
+typedef struct _ELF_SizeTable {
+	ELF_SizeEntry *entries;
+	uint32_t mask; /* Number of entries - 1 (always a power of two) */
+	uint32_t num; /* Entries in use */
+} ELF_SizeTable;
+
+typedef struct _ELF_SizeReport {
+	ELF_SizeTable tables[ELF_SIZE_KIND_NUM];
+	uint64_t files;
+	uint64_t bytes; /* Total size of the files */
+} ELF_SizeReport;
+
+/* Creates an empty report
+ * Returns NULL if memory runs out
+ */
+ELF_API ELF_SizeReport *elfSizeReportNew(void);
+
+/* Attributes the bytes of an ELF, in a report of its own
+ * Returns NULL if memory runs out
+ */
+ELF_API ELF_SizeReport *elfSizeReportOf(ELF *elf);
+
+/* Adds the figures of 'FROM' to 'into'
+ * Returns false if memory runs out, leaving 'into' partly merged
+ */
+ELF_API bool elfSizeReportMerge(
+	ELF_SizeReport *into, const ELF_SizeReport *FROM);
+
+/* Copies the 'num' largest entries of a kind into 'top', largest first
+ * Returns how many were copied
+ */
+ELF_API size_t elfSizeReportTop(const ELF_SizeReport *REPORT, ELF_SizeKind kind,
+	ELF_SizeEntry *top, size_t num);
+
+/* Frees a report */
+ELF_API void elfSizeReportFree(ELF_SizeReport *report);
+
+#endif // !GUARD_ELFP_ELFSIZE_H_
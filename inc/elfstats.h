@@ -0,0 +1,121 @@
+#ifndef GUARD_ELFP_ELFSTATS_H_
+#define GUARD_ELFP_ELFSTATS_H_
+
+/* Phase statistics
+ *
+ * Measures what reading, parsing and dumping a file costs, phase by phase:
+ * wall and CPU time, bytes read, page faults and allocations. Figures are
+ * gathered per thread, so files handled by different threads don't mix, and
+ * each thread takes its own with elfStatsTake once a file is done
+ *
+ * Collecting is off until elfStatsEnable is called. While it's off, phases
+ * cost a branch; while it's on, two clock reads and a getrusage call on either
+ * end, which is cheap enough to leave on
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfapi.h"
+
+/* Phases of handling a file */
+typedef enum _ELF_Phase {
+	ELF_PHASE_READ = 0, /* Reading the file into memory */
+	ELF_PHASE_ENTRY_HEADER,
+	ELF_PHASE_PROG_HEADERS,
+	ELF_PHASE_SECT_HEADERS,
+	ELF_PHASE_DUMP,
+
+	ELF_PHASE_NUM,
+} ELF_Phase;
+
+/* Figures measured for each phase */
+typedef enum _ELF_Stat {
+	ELF_STAT_WALL = 0, /* Elapsed time, in ns */
+	ELF_STAT_CPU, /* CPU time of the thread, in ns */
+	ELF_STAT_BYTES, /* Bytes read, or written by a dump */
+	ELF_STAT_FAULTS, /* Page faults, minor and major */
+	ELF_STAT_ALLOCS, /* Allocations, including reallocations */
+	ELF_STAT_ALLOC_BYTES, /* Bytes asked for by those allocations */
+
+	ELF_STAT_NUM,
+} ELF_Stat;
+
+typedef struct _ELF_Stats {
+	uint64_t values[ELF_PHASE_NUM][ELF_STAT_NUM];
+} ELF_Stats;
+
+/* A phase being measured, see elfPhaseBegin */
+typedef struct _ELF_PhaseMark {
+	int phase; /* -1 if nothing is being measured */
+	int outer; /* Phase that was running when this one began */
+
+	uint64_t wall;
+	uint64_t cpu;
+	uint64_t faults;
+} ELF_PhaseMark;
+
+/* Buckets of a histogram: exact up to 8, then 8 per power of two */
+#define ELF_HISTOGRAM_BUCKETS 496
+
+/* Distribution of a figure, with about 12% precision */
+typedef struct _ELF_Histogram {
+	uint64_t counts[ELF_HISTOGRAM_BUCKETS];
+	uint64_t num;
+	uint64_t sum;
+	uint64_t max;
+} ELF_Histogram;
+
+/* Distributions of every figure, per phase and per file (the last row) */
+typedef struct _ELF_StatsSummary {
+	ELF_Histogram histograms[ELF_PHASE_NUM + 1][ELF_STAT_NUM];
+	uint64_t files;
+} ELF_StatsSummary;
+
+/* Turns collecting on, for the whole process
+ * Call it before starting any thread that should be measured
+ */
+ELF_API void elfStatsEnable(void);
+
+ELF_API bool elfStatsEnabled(void);
+
+/* Starts measuring a phase on this thread
+ * Allocations are counted in the innermost phase running
+ */
+ELF_API void elfPhaseBegin(ELF_PhaseMark *mark, ELF_Phase phase);
+
+/* Stops measuring a phase, adding what it cost to this thread's figures */
+ELF_API void elfPhaseEnd(ELF_PhaseMark *mark, uint64_t bytes);
+
+/* Swaps this thread's figures for a phase with 'values'
+ * Lets a thread juggling many files at once (like reads in flight together)
+ * keep each file's figures apart, and hand them over once the file is done
+ */
+ELF_API void elfPhaseSwap(ELF_Phase phase, uint64_t values[ELF_STAT_NUM]);
+
+/* Counts an allocation in the phase running on this thread, if any */
+ELF_API void elfStatsAlloc(size_t bytes);
+
+/* Moves the figures gathered by this thread since it last took them into
+ * 'stats'
+ */
+ELF_API void elfStatsTake(ELF_Stats *stats);
+
+/* Adds the figures of a file to a summary */
+ELF_API void elfStatsSummaryAdd(
+	ELF_StatsSummary *summary, const ELF_Stats *STATS);
+
+ELF_API void elfHistogramAdd(ELF_Histogram *histogram, uint64_t value);
+
+/* Returns the value 'percent' percent of the samples are at or below
+ * The value is rounded up to the end of its bucket, without going past the
+ * largest sample
+ */
+ELF_API uint64_t elfHistogramPercentile(const ELF_Histogram *HISTOGRAM,
+	unsigned percent);
+
+/* Returns the name of a phase, like "read" */
+ELF_API const char *elfPhaseName(ELF_Phase phase);
+
+#endif // !GUARD_ELFP_ELFSTATS_H_
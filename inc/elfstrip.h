@@ -0,0 +1,80 @@
+#ifndef GUARD_ELFP_ELFSTRIP_H_
+#define GUARD_ELFP_ELFSTRIP_H_
+
+/* Section removal
+ *
+ * Writes a copy of an ELF without some of its sections (or, for a debug file,
+ * without the contents of its loaded ones). Everything the program headers
+ * cover stays where it is; the sections after it are packed, in file order,
+ * and a new Section Header table goes at the end
+ *
+ * Only metadata goes through memory: the headers, plus the symbol tables and
+ * section groups whose section indices shift. Every other byte is copied by
+ * the kernel with copy_file_range, which clones whole blocks instead on
+ * filesystems that support it (runs of sections long enough are placed so
+ * their blocks line up, for that). Where the kernel can't copy between the two
+ * files, bytes are written from the input's image instead
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+typedef enum _ELF_StripMode {
+	ELF_STRIP_NONE = 0, /* Only remove the sections asked for */
+	ELF_STRIP_DEBUG, /* ...and the debugging sections */
+	ELF_STRIP_KEEP_DEBUG, /* Empty loaded sections, leaving a debug file */
+} ELF_StripMode;
+
+typedef struct _ELF_StripOptions {
+	ELF_StripMode mode;
+
+	const char *const *remove; /* Names of sections to remove */
+	size_t removeNum;
+} ELF_StripOptions;
+
+typedef enum _ELF_StripError {
+	ELF_STRIP_OK = 0,
+
+	ELF_STRIP_ERR_IO, /* Reading or writing failed, see errno */
+	ELF_STRIP_ERR_NOMEM, /* Out of memory */
+	ELF_STRIP_ERR_LOADED, /* A section to remove is loaded by a segment */
+	ELF_STRIP_ERR_LINKED, /* A section kept refers to one removed */
+	ELF_STRIP_ERR_SYMBOL, /* A symbol is defined in a section removed */
+	ELF_STRIP_ERR_XINDEX, /* Extended symbol section indices would shift */
+	ELF_STRIP_ERR_BOUNDS, /* A section kept lies past the end of the file */
+
+	ELF_STRIP_ERR_NUM,
+} ELF_StripError;
+
+typedef struct _ELF_StripResult {
+	ELF_StripError error;
+	uint32_t section; /* Section the error is about, if any */
+
+	uint32_t removed; /* Sections removed */
+	uint32_t emptied; /* Sections whose contents were dropped */
+
+	uint64_t size; /* Size of the output */
+	uint64_t copied; /* Bytes copied by the kernel */
+	uint64_t written; /* Bytes written from memory */
+} ELF_StripResult;
+
+/* Writes a stripped copy of an ELF to 'out', which should be empty
+ * 'elf' must have been parsed from the whole of the file open as 'in'.
+ * Nothing is written unless the whole layout checks out. Returns false on
+ * failure, with the reason stored in 'result'
+ */
+ELF_API bool elfStrip(ELF *elf, int in, int out,
+	const ELF_StripOptions *OPTIONS, ELF_StripResult *result);
+
+/* Returns whether a section holds debugging information, judging by its name
+ * (like ".debug_info" or ".zdebug_line")
+ */
+ELF_API bool elfIsDebugSection(const char *NAME);
+
+/* Returns a human-readable description of a strip error */
+ELF_API const char *elfStripErrorString(ELF_StripError error);
+
+#endif // !GUARD_ELFP_ELFSTRIP_H_
@@ -0,0 +1,38 @@
+#ifndef GUARD_ELFP_ELFSYM_H_
+#define GUARD_ELFP_ELFSYM_H_
+
+/* Dynamic symbols
+ *
+ * Decodes .dynsym together with the GNU symbol versioning sections
+ * (.gnu.version, .gnu.version_d and .gnu.version_r), so each symbol comes with
+ * the version it defines or requires. Version and library names go through
+ * the intern table, so scanning many files keeps one copy of each
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+/* Returns the dynamic symbols of an ELF
+ * An ELF without .dynsym gets an empty table. Returns NULL if memory runs out
+ */
+ELF_API const ELF_SymTable *elfDynamicSymbols(ELF *elf);
+
+/* Decodes every symbol of a symbol table section, such as .symtab
+ * Symbols come without versions, in an array the caller frees. A section that
+ * can't be read gives no symbols. Returns false if memory runs out
+ */
+ELF_API bool elfReadSymbols(
+	ELF *elf, const ELF_SHEntry *SH, ELF_Symbol **symbols, uint32_t *num);
+
+/* Builds the dynamic symbol table of an ELF, if it wasn't built yet
+ * Lookups do this on their own; this is for building it ahead of time
+ */
+ELF_API bool elfSymTableBuild(ELF *elf);
+
+/* Frees the dynamic symbol table of an ELF, if one was built */
+ELF_API void elfSymTableFree(ELF_SymTable *table);
+
+#endif // !GUARD_ELFP_ELFSYM_H_
@@ -0,0 +1,70 @@
+#ifndef GUARD_ELFP_ELFSYMMAP_H_
+#define GUARD_ELFP_ELFSYMMAP_H_
+
+/* Symbol maps
+ *
+ * A symbol map holds the functions of an ELF in a form meant to be mapped and
+ * searched as is, with nothing to parse: a header, the functions sorted by
+ * address, then their names, each stored once and NUL-terminated. Symbol maps
+ * are named after the build ID of their ELF, which the header repeats
+ *
+ * Every field is little-endian, and laid out at its natural alignment:
+ *
+ *   0   magic        "ELFPSYM\0"
+ *   8   version      ELF_SYMMAP_VERSION
+ *   12  symbolNum
+ *   16  namesOffset  From the start of the file
+ *   20  namesSize
+ *   24  buildIdSize  Up to ELF_SYMMAP_BUILD_ID_MAX bytes
+ *   28  reserved     0
+ *   32  buildId      Zero-padded
+ *   64  symbols      symbolNum entries of 16 bytes
+ *
+ * Addresses are those the ELF was linked at; a profiler subtracts the load
+ * bias of the module from its samples before looking them up. Functions come
+ * from .symtab, or from .dynsym if the ELF was stripped
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elfp.h"
+
+#define ELF_SYMMAP_MAGIC "ELFPSYM"
+#define ELF_SYMMAP_VERSION 1
+#define ELF_SYMMAP_BUILD_ID_MAX 32
+
+typedef struct _ELF_SymmapHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t symbolNum;
+	uint32_t namesOffset;
+	uint32_t namesSize;
+	uint32_t buildIdSize;
+	uint32_t reserved;
+	uint8_t buildId[ELF_SYMMAP_BUILD_ID_MAX];
+} ELF_SymmapHeader;
+
+typedef struct _ELF_SymmapEntry {
+	uint64_t addr;
+	uint32_t size; /* 0 if unknown, in which case it runs up to the next */
+	uint32_t name; /* Offset in the names */
+} ELF_SymmapEntry;
+
+/* Builds the symbol map of an ELF, in a buffer the caller frees
+ * Returns ELF_ERR_NOMEM if memory runs out
+ */
+ELF_API ELF_Status elfSymmapBuild(ELF *elf, uint8_t **data, size_t *size);
+
+/* Checks that 'size' bytes at 'DATA' hold a symbol map of this version,
+ * whose symbols and names all fit
+ */
+ELF_API bool elfSymmapValid(const void *DATA, size_t size);
+
+/* Finds the function holding an address in a valid symbol map
+ * Returns NULL if there's none, or the name of the function otherwise
+ */
+ELF_API const char *elfSymmapLookup(const void *DATA, uint64_t addr);
+
+#endif // !GUARD_ELFP_ELFSYMMAP_H_
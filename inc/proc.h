@@ -0,0 +1,38 @@
+#ifndef GUARD_ELFP_PROC_H_
+#define GUARD_ELFP_PROC_H_
+
+/* Process mode
+ *
+ * Lists the ELF files running processes have mapped, read from
+ * /proc/PID/maps: for each module, its load bias, its build ID, and the
+ * mappings each of its PT_LOAD segments ended up in
+ *
+ * Most processes of a host map the same libraries, so files are told apart
+ * by the device and inode the maps give, and each one is parsed once (through
+ * a parse cache, see elfcache.h) however many processes map it. Maps are
+ * read, then files parsed, by several threads; the report is printed last,
+ * process by process
+ *
+ * Files are opened through /proc/PID/map_files when allowed to, which finds
+ * them even if they were deleted or live in another mount namespace, then
+ * through /proc/PID/root, then by their path
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct _ProcOptions {
+	const pid_t *pids; /* Processes to look at, unless 'all' is set */
+	size_t pidNum;
+	bool all; /* Look at every process */
+	unsigned threads; /* 0 for one per CPU */
+	size_t cacheBudget; /* Bytes */
+} ProcOptions;
+
+/* Reports on every process asked for
+ * Returns the process' exit code
+ */
+int procRun(const ProcOptions *OPTIONS);
+
+#endif // !GUARD_ELFP_PROC_H_
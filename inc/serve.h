@@ -0,0 +1,41 @@
+#ifndef GUARD_ELFP_SERVE_H_
+#define GUARD_ELFP_SERVE_H_
+
+/* Server mode
+ *
+ * Answers requests over stdin/stdout or a Unix socket, keeping parsed files
+ * in a cache between requests. Each request is a single line:
+ *
+ *     <id> <command> [<path>]
+ *
+ * where <id> is any token without spaces, echoed back in the response, and
+ * <command> is one of:
+ *
+ *     header, program, section, all... dump that part of the file at <path>
+ *     stats........................... report the cache statistics
+ *
+ * Each response is a line followed by exactly <length> bytes of payload:
+ *
+ *     <id> ok <length>
+ *     <id> error <length>
+ *
+ * Requests are served concurrently, so responses may come back in a different
+ * order than the requests were sent in. A request line longer than 16 KiB gets
+ * a "- error" response and the connection is closed
+ */
+
+#include <stddef.h>
+
+typedef struct _ServeOptions {
+	const char *socketPath; /* Unix socket to listen on, NULL for stdio */
+	size_t cacheBudget; /* Bytes the parse cache may hold on to */
+	size_t internBudget; /* Bytes of interned strings kept before a reset */
+	unsigned threads; /* Number of worker threads */
+} ServeOptions;
+
+/* Serves requests until stdin is closed, or forever when using a socket
+ * Returns the process' exit code
+ */
+int serveRun(const ServeOptions *OPTIONS);
+
+#endif // !GUARD_ELFP_SERVE_H_
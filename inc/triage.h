@@ -0,0 +1,31 @@
+#ifndef GUARD_ELFP_TRIAGE_H_
+#define GUARD_ELFP_TRIAGE_H_
+
+/* Triage mode
+ *
+ * Tells which files under a tree are ELF, and what kind: one line per ELF
+ * file, giving its class, data encoding, type and machine, then a summary
+ *
+ *     ELF64 LSB DYN  x86-64    /usr/lib/libc.so.6
+ *
+ * Nothing but the first 64 bytes of a file is read, with a single pread, so
+ * the cost of a file is that of opening it. Directories are walked by several
+ * threads at once, reading entries with getdents64 and opening files relative
+ * to their directory. Entries whose type the directory already gives are
+ * never stat'ed; only special files, symbolic links included, are skipped
+ */
+
+#include <stddef.h>
+
+typedef struct _TriageOptions {
+	char *const *roots; /* Directories (or files) to look at */
+	size_t rootNum;
+	unsigned threads; /* Walking threads, 0 for a default */
+} TriageOptions;
+
+/* Walks every root, then prints the summary
+ * Returns the process' exit code
+ */
+int triageRun(const TriageOptions *OPTIONS);
+
+#endif // !GUARD_ELFP_TRIAGE_H_
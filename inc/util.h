@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "elfapi.h"
+
 /* Structure representing an open file
  * Used for passing data around
  */
@@ -12,19 +14,77 @@ typedef struct _FP {
 	char *_start; /* Points to the start of the allocated memory segment */
 	char *data; /* Actual data pointer that should be used */
 	size_t size; /* Size of the file */
+	size_t _mapped; /* Length of the mapping if the file is mapped, 0 if not */
 } FP;
 
 /* Reads the file at 'FILEPATH' and returns its contents
- * Returns NULL on failure
+ * Files at least as large as the map threshold are mapped instead (read-only,
+ * and without a terminating NUL). Returns NULL on failure, with errno
+ * describing what went wrong
  */
-FP *utilReadFile(const char *FILEPATH);
+ELF_API FP *utilReadFile(const char *FILEPATH);
 
-/* Frees a file pointer returned by 'utilReadFile' */
-void utilFreeFile(FP *fp);
+/* Same, for the first 'size' bytes of a file already open
+ * The descriptor is left open, and its offset untouched
+ */
+ELF_API FP *utilReadFd(int fd, uint64_t size);
+
+/* Maps 'size' bytes of an open file, which must not be empty
+ * Returns NULL on failure, with errno describing what went wrong
+ */
+ELF_API FP *utilMapFile(int fd, uint64_t size);
+
+/* Sets the size from which files are mapped rather than copied into memory
+ * Mapped pages can be dropped and read again under memory pressure, copies
+ * can't; but a mapped file that shrinks while in use kills the process with
+ * SIGBUS. 0, the default, never maps
+ */
+ELF_API void utilSetMapThreshold(size_t size);
+ELF_API size_t utilMapThreshold(void);
+
+/* Frees a file pointer returned by 'utilReadFile' or 'utilMapFile' */
+ELF_API void utilFreeFile(FP *fp);
+
+/* What follows is only used inside the library, and isn't exported */
+
+/* malloc, calloc and realloc, counting each call towards the phase running on
+ * this thread (see elfstats.h). The library allocates through these
+ */
+void *utilMalloc(size_t size);
+void *utilCalloc(size_t num, size_t size);
+void *utilRealloc(void *ptr, size_t size);
+
+/* Checks whether 'size' bytes starting at 'offset' lie within the file
+ *
+ * None of the utilRead* functions check bounds, so callers validate a whole
+ * table's range with this first, then read its entries freely
+ */
+bool utilInBounds(FP *fp, uint64_t offset, uint64_t size);
+
+/* Bounds-checked reader over a piece of memory
+ * A read past the end clears 'ok' and reads zeroes, so a whole record can be
+ * read before checking for errors once
+ */
+typedef struct _Cursor {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool le; /* Whether multi-byte values are little-endian */
+	bool ok;
+} Cursor;
 
 uint8_t utilRead8(FP *fp);
 uint16_t utilRead16(bool le, FP *fp);
 uint32_t utilRead32(bool le, FP *fp);
 uint64_t utilRead64(bool le, FP *fp);
 
+/* Reads an unsigned value of 1 to 8 bytes; any other size fails the read */
+uint64_t utilCursorRead(Cursor *cursor, unsigned size);
+uint64_t utilCursorULEB(Cursor *cursor);
+int64_t utilCursorSLEB(Cursor *cursor);
+
+/* Reads a NUL-terminated string in place, or returns NULL if it's cut short */
+const char *utilCursorString(Cursor *cursor);
+
+void utilCursorSkip(Cursor *cursor, uint64_t size);
+
 #endif // !GUARD_ELFP_UTIL_H_
@@ -0,0 +1,39 @@
+#ifndef GUARD_ELFP_WATCH_H_
+#define GUARD_ELFP_WATCH_H_
+
+/* Watch mode
+ *
+ * Dumps every ELF file under a directory, then keeps watching it and dumps
+ * files again as they're written to. Each record is the file's dump, headed
+ * by a line holding its path:
+ *
+ *     File: <path>
+ *
+ * Files are only dumped again once they've been left alone for a while, so a
+ * linker writing its output in several passes yields a single record, and
+ * only when the dump actually changed
+ *
+ * Uses fanotify when allowed to (it needs CAP_SYS_ADMIN), and inotify watches
+ * on every directory of the tree otherwise
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "batch.h"
+
+typedef struct _WatchOptions {
+	const char *dir; /* Root of the tree to watch */
+	int flags; /* What to dump, see elfdump.h */
+	unsigned debounce; /* Milliseconds a file must stay untouched */
+	bool noFanotify; /* Use inotify even if fanotify is available */
+	size_t internBudget; /* Bytes of interned strings kept before a reset */
+	BatchOptions batch; /* How files get read */
+} WatchOptions;
+
+/* Watches the tree until killed, or until watching it fails
+ * Returns the process' exit code
+ */
+int watchRun(const WatchOptions *OPTIONS);
+
+#endif // !GUARD_ELFP_WATCH_H_
@@ -0,0 +1,796 @@
+/* elfp
+ * Batch file reader
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef ELFP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "budget.h"
+#include "elfp.h"
+#include "elfstats.h"
+#include "util.h"
+
+#include "batch.h"
+
+/* Bytes read before deciding whether to read the rest of a file
+ * Enough for the ident and the whole Entry Header of either class
+ */
+#define HEAD_SIZE 64
+
+#define DEFAULT_DEPTH 64
+
+/* Most bytes a single io_uring read asks for, which has to fit its 32-bit
+ * length
+ */
+#define READ_CHUNK (1u << 30)
+
+/* Memory a file is assumed to tie up on top of its contents and header tables,
+ * for whatever the callback makes of it (like a dump)
+ */
+#define FILE_OVERHEAD (64 * 1024)
+
+/* Bytes a dump of a program or section header entry takes, roughly twice over,
+ * as a memstream's buffer grows by doubling
+ */
+#define PH_DUMP_SIZE (2 * 160)
+#define SH_DUMP_SIZE (2 * 224)
+
+/* Shared state of the thread pool */
+typedef struct _Pool {
+	const char *const *PATHS;
+	size_t num;
+	size_t next; /* Next file to read, taken atomically */
+
+	Budget *budget;
+
+	BatchCallback callback;
+	void *ctx;
+} Pool;
+
+static int _statFile(int fd, uint64_t *size);
+static FP *_allocFile(uint64_t size);
+static bool _isElf(const char *START, uint64_t size);
+static size_t _cost(int fd, const char *HEAD, uint64_t headSize,
+	uint64_t size, bool mapped);
+static uint64_t _field(const uint8_t *BYTES, unsigned size, bool le);
+
+static void _poolRead(const char *const *PATHS, size_t first, size_t num,
+	unsigned threads, Budget *budget, BatchCallback callback, void *ctx);
+static void *_poolThread(void *arg);
+static FP *_readOne(
+	const char *PATH, Budget *budget, size_t *reserved, int *error);
+static bool _preadAll(int fd, char *buffer, uint64_t size, uint64_t offset);
+
+#ifdef ELFP_HAVE_IO_URING
+static size_t _uringRead(const char *const *PATHS, size_t num, unsigned depth,
+	BatchCallback callback, void *ctx);
+#endif
+
+void batchRead(const char *const *PATHS, size_t num,
+	const BatchOptions *OPTIONS, BatchCallback callback, void *ctx) {
+	const unsigned DEPTH = OPTIONS->depth > 0 ? OPTIONS->depth : DEFAULT_DEPTH;
+	size_t first = 0;
+
+	/* Whatever io_uring didn't get to, because it's unavailable or failed
+	 * along the way, is left to the thread pool
+	 */
+#ifdef ELFP_HAVE_IO_URING
+	if( !OPTIONS->noUring && OPTIONS->budget == NULL ) {
+		first = _uringRead(PATHS, num, DEPTH, callback, ctx);
+	}
+#endif
+
+	if( first == num ) {
+		return;
+	}
+
+	/* Blocking reads only overlap across threads, so without -j use as many
+	 * as io_uring would keep files in flight
+	 */
+	unsigned threads = OPTIONS->threads > 0 ? OPTIONS->threads : DEPTH;
+	if( threads > num - first ) {
+		threads = num - first;
+	}
+
+	_poolRead(PATHS, first, num, threads, OPTIONS->budget, callback, ctx);
+}
+
+/* Gets the size of an open file, checking that it can be read whole
+ * Returns 0 on success, an errno value otherwise
+ */
+static int _statFile(int fd, uint64_t *size) {
+	struct stat st;
+	if( fstat(fd, &st) != 0 ) {
+		return errno;
+	}
+
+	*size = st.st_size;
+	return S_ISDIR(st.st_mode) ? EISDIR : 0;
+}
+
+/* Allocates a file pointer, with room for a terminating NUL */
+static FP *_allocFile(uint64_t size) {
+	FP *fp = utilMalloc(sizeof(*fp));
+	if( fp == NULL ) {
+		return NULL;
+	}
+
+	fp->_start = utilMalloc(size + 1);
+	if( fp->_start == NULL ) {
+		free(fp);
+		return NULL;
+	}
+
+	fp->data = fp->_start;
+	fp->size = size;
+	fp->_mapped = 0;
+
+	return fp;
+}
+
+/* Checks whether the bytes read so far start with the ELF magic */
+static bool _isElf(const char *START, uint64_t size) {
+	return size >= 4 && START[0] == 0x7F && START[1] == 'E' && START[2] == 'L'
+		&& START[3] == 'F';
+}
+
+/* Estimates the memory a file ties up while it's handled: its contents, unless
+ * they're mapped, what its program and section headers parse into (going by
+ * the counts in its head), a dump of those, and FILE_OVERHEAD
+ */
+static size_t _cost(int fd, const char *HEAD, uint64_t headSize,
+	uint64_t size, bool mapped) {
+	uint64_t cost = FILE_OVERHEAD + (mapped ? 0 : size + 1);
+
+	if( headSize == HEAD_SIZE && _isElf(HEAD, headSize) ) {
+		const uint8_t *BYTES = (const uint8_t *)HEAD;
+		const bool IS64 = BYTES[4] == ELF_CLASS_64_BIT;
+		const bool LE = BYTES[5] == ELF_ENDIAN_LITTLE_ENDIAN;
+
+		/* e_phnum, e_shnum and e_shoff */
+		uint64_t phNum = _field(BYTES + (IS64 ? 56 : 44), 2, LE);
+		uint64_t shNum = _field(BYTES + (IS64 ? 60 : 48), 2, LE);
+		const uint64_t SH_OFFSET
+			= _field(BYTES + (IS64 ? 40 : 32), IS64 ? 8 : 4, LE);
+
+		/* Past 16 bits, the counts are kept in the first section header
+		 * entry: e_shnum in its sh_size, e_phnum in its sh_info
+		 */
+		uint8_t first[64];
+		if( (shNum == 0 || phNum == 0xFFFF) && SH_OFFSET != 0
+			&& _preadAll(fd, (char *)first, IS64 ? 64 : 40, SH_OFFSET) ) {
+			if( shNum == 0 ) {
+				shNum = _field(first + (IS64 ? 32 : 20), IS64 ? 8 : 4, LE);
+			}
+
+			if( phNum == 0xFFFF ) {
+				phNum = _field(first + (IS64 ? 44 : 28), 4, LE);
+			}
+		}
+
+		/* No file holds more entries than it has bytes */
+		phNum = phNum < size ? phNum : size;
+		shNum = shNum < size ? shNum : size;
+
+		/* Sections also get a slot in the name index */
+		cost += phNum * (sizeof(ELF_PHEntry) + PH_DUMP_SIZE)
+			+ shNum
+				* (sizeof(ELF_SHEntry) + 2 * sizeof(uint32_t)
+					+ SH_DUMP_SIZE);
+	}
+
+	return cost < SIZE_MAX ? cost : SIZE_MAX;
+}
+
+/* Reads an unsigned field of a header */
+static uint64_t _field(const uint8_t *BYTES, unsigned size, bool le) {
+	uint64_t value = 0;
+	for( unsigned i = 0; i < size; ++i ) {
+		value |= (uint64_t)BYTES[le ? i : size - 1 - i] << 8 * i;
+	}
+
+	return value;
+}
+
+/* Reads files 'first' to 'num' - 1 with a pool of threads doing blocking
+ * reads
+ */
+static void _poolRead(const char *const *PATHS, size_t first, size_t num,
+	unsigned threads, Budget *budget, BatchCallback callback, void *ctx) {
+	Pool pool;
+	pool.PATHS = PATHS;
+	pool.num = num;
+	pool.next = first;
+	pool.budget = budget;
+	pool.callback = callback;
+	pool.ctx = ctx;
+
+	pthread_t *ids = utilMalloc(sizeof(*ids) * (threads > 0 ? threads : 1));
+
+	unsigned started = 0;
+	while( ids != NULL && started < threads
+		&& pthread_create(&ids[started], NULL, _poolThread, &pool) == 0 ) {
+		++started;
+	}
+
+	/* Make do with the calling thread if no other could be started */
+	if( started == 0 ) {
+		_poolThread(&pool);
+	}
+
+	for( unsigned i = 0; i < started; ++i ) {
+		pthread_join(ids[i], NULL);
+	}
+
+	free(ids);
+}
+
+static void *_poolThread(void *arg) {
+	Pool *pool = arg;
+
+	for( ;; ) {
+		const size_t IDX = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+		if( IDX >= pool->num ) {
+			return NULL;
+		}
+
+		ELF_PhaseMark mark;
+		elfPhaseBegin(&mark, ELF_PHASE_READ);
+
+		int error = 0;
+		size_t reserved = 0;
+		FP *fp = _readOne(pool->PATHS[IDX], pool->budget, &reserved, &error);
+
+		elfPhaseEnd(&mark, fp != NULL ? fp->size : 0);
+
+		pool->callback(pool->ctx, IDX, pool->PATHS[IDX], fp, error);
+
+		if( reserved > 0 ) {
+			budgetRelease(pool->budget, reserved);
+		}
+	}
+}
+
+/* Reads a file with blocking reads, head first
+ * Files past the map threshold (see util.h) are mapped instead. With a budget,
+ * what the file is estimated to cost gets reserved first, and stored in
+ * 'reserved' for the caller to release; a file costing more than the whole
+ * budget fails with EFBIG
+ */
+static FP *_readOne(
+	const char *PATH, Budget *budget, size_t *reserved, int *error) {
+	const int FD = open(PATH, O_RDONLY | O_CLOEXEC);
+	if( FD < 0 ) {
+		*error = errno;
+		return NULL;
+	}
+
+	uint64_t size = 0;
+	const int ERROR = _statFile(FD, &size);
+	if( ERROR != 0 ) {
+		*error = ERROR;
+		close(FD);
+		return NULL;
+	}
+
+	char head[HEAD_SIZE];
+	const uint64_t HEAD = size < HEAD_SIZE ? size : HEAD_SIZE;
+
+	if( !_preadAll(FD, head, HEAD, 0) ) {
+		*error = errno != 0 ? errno : EIO;
+		close(FD);
+		return NULL;
+	}
+
+	/* Hand back just the head of other files, for the caller to reject */
+	if( !_isElf(head, HEAD) ) {
+		size = HEAD;
+	}
+
+	const size_t THRESHOLD = utilMapThreshold();
+	const bool MAP = size > HEAD && THRESHOLD > 0 && size >= THRESHOLD;
+
+	if( budget != NULL ) {
+		const size_t COST = _cost(FD, head, HEAD, size, MAP);
+		if( !budgetReserve(budget, COST) ) {
+			*error = EFBIG;
+			close(FD);
+			return NULL;
+		}
+
+		*reserved = COST;
+	}
+
+	FP *fp = MAP ? utilMapFile(FD, size) : _allocFile(size);
+	if( fp == NULL ) {
+		*error = MAP ? errno : ENOMEM;
+		close(FD);
+		return NULL;
+	}
+
+	bool ok = true;
+	if( !MAP ) {
+		memcpy(fp->_start, head, HEAD);
+		ok = _preadAll(FD, fp->_start + HEAD, size - HEAD, HEAD);
+		fp->_start[size] = '\0';
+	}
+
+	close(FD);
+
+	if( !ok ) {
+		*error = errno != 0 ? errno : EIO;
+		utilFreeFile(fp);
+		return NULL;
+	}
+
+	return fp;
+}
+
+/* Reads exactly 'size' bytes at 'offset', failing on a premature EOF */
+static bool _preadAll(int fd, char *buffer, uint64_t size, uint64_t offset) {
+	while( size > 0 ) {
+		const ssize_t READ = pread(fd, buffer, size, offset);
+		if( READ < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( READ <= 0 ) {
+			errno = READ == 0 ? EIO : errno;
+			return false;
+		}
+
+		buffer += READ;
+		size -= READ;
+		offset += READ;
+	}
+
+	return true;
+}
+
+#ifdef ELFP_HAVE_IO_URING
+
+/* Memory-mapped io_uring instance
+ * Set up by hand with raw system calls, so there's no dependency on liburing
+ */
+typedef struct _Ring {
+	int fd;
+
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned sqMask;
+	unsigned *sqArray;
+	struct io_uring_sqe *sqes;
+
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe *cqes;
+
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	size_t sqesSize;
+
+	unsigned pending; /* Queued, but not yet submitted */
+} Ring;
+
+/* Where a file is at */
+typedef enum _Stage {
+	STAGE_OPEN,
+	STAGE_HEAD,
+	STAGE_BODY,
+} Stage;
+
+/* A file in flight */
+typedef struct _Slot {
+	size_t idx;
+	bool busy; /* Whether a file is in flight in it */
+	Stage stage;
+	int fd;
+
+	FP *fp;
+	uint64_t size; /* Size of the whole file */
+	uint64_t done; /* Bytes read so far */
+	uint64_t want; /* Bytes to read in the current stage */
+
+	uint64_t start; /* When the file was queued, in ns, if collecting stats */
+	uint64_t stats[ELF_STAT_NUM]; /* Its read phase so far */
+} Slot;
+
+static bool _ringInit(Ring *ring, unsigned entries);
+static void _ringFree(Ring *ring);
+static struct io_uring_sqe *_ringGet(Ring *ring);
+static bool _ringSubmitAndWait(Ring *ring);
+
+static void _queueOpen(Ring *ring, Slot *slot, const char *PATH);
+static void _queueRead(Ring *ring, Slot *slot);
+static bool _advance(Ring *ring, Slot *slot, int res, int *error);
+static bool _readBody(Slot *slot, int *error);
+static void _finish(const char *const *PATHS, Slot *slot, int error,
+	BatchCallback callback, void *ctx);
+static uint64_t _now(void);
+
+/* Reads files through io_uring, handing each to the callback
+ * Returns how many files, from the first one, were handed over: all of them,
+ * unless io_uring is unavailable or fails along the way. Files that were in
+ * flight when it failed are handed over as failed
+ */
+static size_t _uringRead(const char *const *PATHS, size_t num, unsigned depth,
+	BatchCallback callback, void *ctx) {
+	Ring ring;
+	if( !_ringInit(&ring, depth) ) {
+		return 0;
+	}
+
+	Slot *slots = utilMalloc(sizeof(*slots) * depth);
+	Slot **free_ = utilMalloc(sizeof(*free_) * depth);
+	if( slots == NULL || free_ == NULL ) {
+		free(slots);
+		free(free_);
+		_ringFree(&ring);
+		return 0;
+	}
+
+	unsigned freeNum = depth;
+	for( unsigned i = 0; i < depth; ++i ) {
+		slots[i].busy = false;
+		free_[i] = &slots[i];
+	}
+
+	size_t next = 0;
+	size_t inFlight = 0;
+	int failure = 0; /* Why io_uring failed, 0 if it didn't */
+
+	while( next < num || inFlight > 0 ) {
+		/* Keep the ring full */
+		while( next < num && freeNum > 0 ) {
+			Slot *slot = free_[--freeNum];
+			slot->idx = next++;
+			slot->busy = true;
+
+			_queueOpen(&ring, slot, PATHS[slot->idx]);
+			++inFlight;
+		}
+
+		if( !_ringSubmitAndWait(&ring) ) {
+			failure = errno != 0 ? errno : EIO;
+			break;
+		}
+
+		/* Reap every completion, queueing the follow-up reads */
+		unsigned head = *ring.cqHead;
+		const unsigned TAIL = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+
+		for( ; head != TAIL; ++head ) {
+			struct io_uring_cqe *cqe = &ring.cqes[head & ring.cqMask];
+			Slot *slot = (Slot *)(uintptr_t)cqe->user_data;
+
+			/* The thread's read figures are set aside while it works on
+			 * this file's
+			 */
+			elfPhaseSwap(ELF_PHASE_READ, slot->stats);
+
+			ELF_PhaseMark mark;
+			elfPhaseBegin(&mark, ELF_PHASE_READ);
+
+			int error = 0;
+			const bool MORE = _advance(&ring, slot, cqe->res, &error);
+
+			elfPhaseEnd(&mark, 0);
+			elfPhaseSwap(ELF_PHASE_READ, slot->stats);
+
+			if( MORE ) {
+				continue;
+			}
+
+			_finish(PATHS, slot, error, callback, ctx);
+
+			slot->busy = false;
+			free_[freeNum++] = slot;
+			--inFlight;
+		}
+
+		__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	/* The ring goes first, so the kernel is done with the buffers of the
+	 * files still in flight by the time they're freed
+	 */
+	_ringFree(&ring);
+
+	for( unsigned i = 0; failure != 0 && i < depth; ++i ) {
+		if( slots[i].busy ) {
+			_finish(PATHS, &slots[i], failure, callback, ctx);
+		}
+	}
+
+	free(slots);
+	free(free_);
+
+	return next;
+}
+
+/* Hands a file over to the callback, once it's read or failed */
+static void _finish(const char *const *PATHS, Slot *slot, int error,
+	BatchCallback callback, void *ctx) {
+	if( slot->fd >= 0 ) {
+		close(slot->fd);
+	}
+
+	FP *fp = slot->fp;
+	if( error != 0 && fp != NULL ) {
+		utilFreeFile(fp);
+		fp = NULL;
+	}
+
+	/* The read phase spans the whole time the file was in flight, like a
+	 * blocking read's would
+	 */
+	if( slot->start != 0 ) {
+		slot->stats[ELF_STAT_WALL] = _now() - slot->start;
+		slot->stats[ELF_STAT_BYTES] = fp != NULL ? fp->size : 0;
+		elfPhaseSwap(ELF_PHASE_READ, slot->stats);
+	}
+
+	callback(ctx, slot->idx, PATHS[slot->idx], fp, error);
+}
+
+/* Returns the time on the monotonic clock, in ns */
+static uint64_t _now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/* Moves a file along after one of its requests completed
+ * Returns true if another request was queued for it, false once it's done
+ */
+static bool _advance(Ring *ring, Slot *slot, int res, int *error) {
+	if( res < 0 ) {
+		*error = -res;
+		return false;
+	}
+
+	if( slot->stage == STAGE_OPEN ) {
+		slot->fd = res;
+
+		*error = _statFile(slot->fd, &slot->size);
+		if( *error != 0 ) {
+			return false;
+		}
+
+		/* Only the head gets a buffer, until it shows the file is an ELF */
+		slot->fp = _allocFile(slot->size < HEAD_SIZE ? slot->size : HEAD_SIZE);
+		if( slot->fp == NULL ) {
+			*error = ENOMEM;
+			return false;
+		}
+
+		slot->stage = STAGE_HEAD;
+		slot->done = 0;
+		slot->want = slot->fp->size;
+	} else {
+		if( res == 0 ) {
+			/* The file shrank under us */
+			*error = EIO;
+			return false;
+		}
+
+		slot->done += res;
+	}
+
+	/* Files that aren't ELF files are handed back holding just the head,
+	 * for the caller to reject
+	 */
+	if( slot->done == slot->want && slot->stage == STAGE_HEAD
+		&& _isElf(slot->fp->_start, slot->done)
+		&& slot->size > slot->done && !_readBody(slot, error) ) {
+		return false;
+	}
+
+	/* A mapped file is whole already */
+	if( slot->fp->_mapped > 0 ) {
+		return false;
+	}
+
+	if( slot->done < slot->want ) {
+		_queueRead(ring, slot);
+		return true;
+	}
+
+	slot->fp->_start[slot->fp->size] = '\0';
+	return false;
+}
+
+/* Makes room for the rest of an ELF file once its head is read: files past
+ * the map threshold (see util.h) are mapped whole instead, like the thread
+ * pool does. Returns false on failure
+ */
+static bool _readBody(Slot *slot, int *error) {
+	slot->stage = STAGE_BODY;
+	slot->want = slot->size;
+
+	const size_t THRESHOLD = utilMapThreshold();
+	if( THRESHOLD > 0 && slot->size >= THRESHOLD ) {
+		FP *mapped = utilMapFile(slot->fd, slot->size);
+		if( mapped == NULL ) {
+			*error = errno;
+			return false;
+		}
+
+		utilFreeFile(slot->fp);
+		slot->fp = mapped;
+		slot->done = slot->size;
+		return true;
+	}
+
+	char *grown = slot->size < SIZE_MAX
+		? utilRealloc(slot->fp->_start, slot->size + 1)
+		: NULL;
+	if( grown == NULL ) {
+		*error = ENOMEM;
+		return false;
+	}
+
+	slot->fp->_start = grown;
+	slot->fp->data = grown;
+	slot->fp->size = slot->size;
+	return true;
+}
+
+static void _queueOpen(Ring *ring, Slot *slot, const char *PATH) {
+	slot->stage = STAGE_OPEN;
+	slot->fd = -1;
+	slot->fp = NULL;
+
+	memset(slot->stats, 0, sizeof(slot->stats));
+	slot->start = elfStatsEnabled() ? _now() : 0;
+
+	struct io_uring_sqe *sqe = _ringGet(ring);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)PATH;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	sqe->user_data = (uintptr_t)slot;
+}
+
+static void _queueRead(Ring *ring, Slot *slot) {
+	struct io_uring_sqe *sqe = _ringGet(ring);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = slot->fd;
+	sqe->addr = (uintptr_t)(slot->fp->_start + slot->done);
+	sqe->len = slot->want - slot->done < READ_CHUNK ? slot->want - slot->done
+													: READ_CHUNK;
+	sqe->off = slot->done;
+	sqe->user_data = (uintptr_t)slot;
+}
+
+/* Sets up a ring able to hold 'entries' requests */
+static bool _ringInit(Ring *ring, unsigned entries) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if( ring->fd < 0 ) {
+		return false;
+	}
+
+	ring->sqRingSize
+		= params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	const bool SINGLE_MMAP = params.features & IORING_FEAT_SINGLE_MMAP;
+	if( SINGLE_MMAP && ring->cqRingSize > ring->sqRingSize ) {
+		ring->sqRingSize = ring->cqRingSize;
+	}
+
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqRing = SINGLE_MMAP
+		? ring->sqRing
+		: mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+		ring->fd, IORING_OFF_SQES);
+
+	if( ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED
+		|| ring->sqes == MAP_FAILED ) {
+		_ringFree(ring);
+		return false;
+	}
+
+	char *sq = ring->sqRing;
+	ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+	ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+
+	char *cq = ring->cqRing;
+	ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	return true;
+}
+
+static void _ringFree(Ring *ring) {
+	if( ring->sqes != NULL && ring->sqes != MAP_FAILED ) {
+		munmap(ring->sqes, ring->sqesSize);
+	}
+
+	if( ring->cqRing != NULL && ring->cqRing != MAP_FAILED
+		&& ring->cqRing != ring->sqRing ) {
+		munmap(ring->cqRing, ring->cqRingSize);
+	}
+
+	if( ring->sqRing != NULL && ring->sqRing != MAP_FAILED ) {
+		munmap(ring->sqRing, ring->sqRingSize);
+	}
+
+	close(ring->fd);
+}
+
+/* Grabs the next submission queue entry
+ * Never runs out, as no more files are kept in flight than the ring holds
+ */
+static struct io_uring_sqe *_ringGet(Ring *ring) {
+	const unsigned TAIL = *ring->sqTail + ring->pending;
+	const unsigned IDX = TAIL & ring->sqMask;
+
+	struct io_uring_sqe *sqe = &ring->sqes[IDX];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ring->sqArray[IDX] = IDX;
+	++ring->pending;
+
+	return sqe;
+}
+
+/* Submits the queued requests and waits for at least one completion */
+static bool _ringSubmitAndWait(Ring *ring) {
+	__atomic_store_n(
+		ring->sqTail, *ring->sqTail + ring->pending, __ATOMIC_RELEASE);
+
+	unsigned toSubmit = ring->pending;
+	ring->pending = 0;
+
+	for( ;; ) {
+		const int RES = syscall(__NR_io_uring_enter, ring->fd, toSubmit, 1,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+		if( RES >= 0 ) {
+			return true;
+		}
+
+		if( errno != EINTR ) {
+			return false;
+		}
+
+		/* Whatever was consumed before the interruption is gone for good */
+		toSubmit = 0;
+	}
+}
+
+#endif
@@ -0,0 +1,57 @@
+/* elfp
+ * Memory budget
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "budget.h"
+
+void budgetInit(Budget *budget, size_t limit) {
+	budget->limit = limit;
+	budget->used = 0;
+	budget->next = 0;
+	budget->serving = 0;
+
+	pthread_mutex_init(&budget->lock, NULL);
+	pthread_cond_init(&budget->changed, NULL);
+}
+
+void budgetDestroy(Budget *budget) {
+	pthread_cond_destroy(&budget->changed);
+	pthread_mutex_destroy(&budget->lock);
+}
+
+bool budgetReserve(Budget *budget, size_t bytes) {
+	if( bytes > budget->limit ) {
+		return false;
+	}
+
+	pthread_mutex_lock(&budget->lock);
+
+	const uint64_t TICKET = budget->next++;
+	while( budget->serving != TICKET
+		|| bytes > budget->limit - budget->used ) {
+		pthread_cond_wait(&budget->changed, &budget->lock);
+	}
+
+	budget->used += bytes;
+	++budget->serving;
+
+	/* The next ticket may fit too */
+	pthread_cond_broadcast(&budget->changed);
+	pthread_mutex_unlock(&budget->lock);
+
+	return true;
+}
+
+void budgetRelease(Budget *budget, size_t bytes) {
+	pthread_mutex_lock(&budget->lock);
+
+	budget->used -= bytes;
+
+	pthread_cond_broadcast(&budget->changed);
+	pthread_mutex_unlock(&budget->lock);
+}
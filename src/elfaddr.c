@@ -0,0 +1,221 @@
+/* elfp
+ * Virtual address translation
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfaddr.h"
+
+/* Range an address was last found in, used to skip the binary search */
+typedef struct _Hint {
+	const ELF_AddrRanges *ranges;
+	uint32_t idx;
+} Hint;
+
+static bool _allocRanges(ELF_AddrRanges *ranges, uint32_t num);
+static void _addRange(
+	ELF_AddrRanges *ranges, uint64_t start, uint64_t size, uint64_t offset);
+static void _sortRanges(ELF_AddrRanges *ranges);
+static void _freeRanges(ELF_AddrRanges *ranges);
+
+static bool _translate(ELF_AddrIndex *index, uint64_t addr, uint64_t *offset,
+	Hint *hint);
+static bool _findRange(const ELF_AddrRanges *RANGES, uint64_t addr,
+	uint64_t *offset, Hint *hint);
+
+bool elfAddrToOffset(ELF *elf, uint64_t addr, uint64_t *offset) {
+	if( elf->addrIndex == NULL && !elfAddrIndexBuild(elf) ) {
+		return false;
+	}
+
+	Hint hint = { NULL, 0 };
+	return _translate(elf->addrIndex, addr, offset, &hint);
+}
+
+size_t elfAddrToOffsetBatch(
+	ELF *elf, const uint64_t *ADDRS, uint64_t *offsets, size_t num) {
+	if( elf->addrIndex == NULL && !elfAddrIndexBuild(elf) ) {
+		for( size_t i = 0; i < num; ++i ) {
+			offsets[i] = ELF_ADDR_INVALID;
+		}
+
+		return 0;
+	}
+
+	Hint hint = { NULL, 0 };
+	size_t found = 0;
+
+	for( size_t i = 0; i < num; ++i ) {
+		if( _translate(elf->addrIndex, ADDRS[i], &offsets[i], &hint) ) {
+			++found;
+		} else {
+			offsets[i] = ELF_ADDR_INVALID;
+		}
+	}
+
+	return found;
+}
+
+void elfAddrIndexFree(ELF_AddrIndex *index) {
+	if( index == NULL ) {
+		return;
+	}
+
+	_freeRanges(&index->segments);
+	_freeRanges(&index->sections);
+	free(index);
+}
+
+/* Builds the translation index from the program and section headers */
+bool elfAddrIndexBuild(ELF *elf) {
+	if( elf->addrIndex != NULL ) {
+		return true;
+	}
+
+	ELF_AddrIndex *index = utilMalloc(sizeof(*index));
+	if( index == NULL ) {
+		return false;
+	}
+
+	const uint16_t PH_NUM = elf->header.progHeaderEntryNum;
+	const uint32_t SH_NUM = elf->header.sectHeaderEntryNum;
+
+	if( !_allocRanges(&index->segments, PH_NUM)
+		|| !_allocRanges(&index->sections, SH_NUM) ) {
+		elfAddrIndexFree(index);
+		return false;
+	}
+
+	for( uint16_t i = 0; i < PH_NUM; ++i ) {
+		ELF_PHEntry *ph = &elf->ph[i];
+		if( ph->type == ELF_PHT_LOAD ) {
+			_addRange(
+				&index->segments, ph->virtualAddr, ph->fileSize, ph->offset);
+		}
+	}
+
+	for( uint32_t i = 0; i < SH_NUM; ++i ) {
+		ELF_SHEntry *sh = &elf->sh[i];
+		if( (sh->flags & ELF_SHF_ALLOC) && sh->type != ELF_SHT_NOBITS ) {
+			_addRange(&index->sections, sh->addr, sh->size, sh->offset);
+		}
+	}
+
+	_sortRanges(&index->segments);
+	_sortRanges(&index->sections);
+
+	elf->addrIndex = index;
+	return true;
+}
+
+/* Allocates room for 'num' ranges */
+static bool _allocRanges(ELF_AddrRanges *ranges, uint32_t num) {
+	const size_t SIZE = sizeof(uint64_t) * (num > 0 ? num : 1);
+
+	ranges->num = 0;
+	ranges->start = utilMalloc(SIZE);
+	ranges->end = utilMalloc(SIZE);
+	ranges->offset = utilMalloc(SIZE);
+
+	return ranges->start != NULL && ranges->end != NULL
+		&& ranges->offset != NULL;
+}
+
+/* Adds a range, skipping empty and wrapping ones */
+static void _addRange(
+	ELF_AddrRanges *ranges, uint64_t start, uint64_t size, uint64_t offset) {
+	if( size == 0 || start + size < start ) {
+		return;
+	}
+
+	ranges->start[ranges->num] = start;
+	ranges->end[ranges->num] = start + size;
+	ranges->offset[ranges->num] = offset;
+	++ranges->num;
+}
+
+/* Sorts ranges by their starting address
+ * Headers are almost always already in order, so insertion sort it is
+ */
+static void _sortRanges(ELF_AddrRanges *ranges) {
+	for( uint32_t i = 1; i < ranges->num; ++i ) {
+		const uint64_t START = ranges->start[i];
+		const uint64_t END = ranges->end[i];
+		const uint64_t OFFSET = ranges->offset[i];
+
+		uint32_t j = i;
+		for( ; j > 0 && ranges->start[j - 1] > START; --j ) {
+			ranges->start[j] = ranges->start[j - 1];
+			ranges->end[j] = ranges->end[j - 1];
+			ranges->offset[j] = ranges->offset[j - 1];
+		}
+
+		ranges->start[j] = START;
+		ranges->end[j] = END;
+		ranges->offset[j] = OFFSET;
+	}
+}
+
+/* Frees the arrays of a set of ranges */
+static void _freeRanges(ELF_AddrRanges *ranges) {
+	free(ranges->start);
+	free(ranges->end);
+	free(ranges->offset);
+}
+
+/* Translates an address, segments first */
+static bool _translate(
+	ELF_AddrIndex *index, uint64_t addr, uint64_t *offset, Hint *hint) {
+	/* Consecutive lookups tend to land in the same range */
+	if( hint->ranges != NULL ) {
+		const ELF_AddrRanges *RANGES = hint->ranges;
+		const uint32_t I = hint->idx;
+
+		if( addr >= RANGES->start[I] && addr < RANGES->end[I] ) {
+			*offset = RANGES->offset[I] + (addr - RANGES->start[I]);
+			return true;
+		}
+	}
+
+	return _findRange(&index->segments, addr, offset, hint)
+		|| _findRange(&index->sections, addr, offset, hint);
+}
+
+/* Binary searches for the range containing an address */
+static bool _findRange(const ELF_AddrRanges *RANGES, uint64_t addr,
+	uint64_t *offset, Hint *hint) {
+	/* Find the last range starting at or before 'addr' */
+	uint32_t lo = 0;
+	uint32_t hi = RANGES->num;
+
+	while( lo < hi ) {
+		const uint32_t MID = lo + (hi - lo) / 2;
+		if( RANGES->start[MID] <= addr ) {
+			lo = MID + 1;
+		} else {
+			hi = MID;
+		}
+	}
+
+	if( lo == 0 ) {
+		return false;
+	}
+
+	const uint32_t I = lo - 1;
+	if( addr >= RANGES->end[I] ) {
+		return false;
+	}
+
+	*offset = RANGES->offset[I] + (addr - RANGES->start[I]);
+
+	hint->ranges = RANGES;
+	hint->idx = I;
+
+	return true;
+}
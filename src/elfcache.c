@@ -0,0 +1,370 @@
+/* elfp
+ * Parse cache
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfcache.h"
+
+/* Number of hash buckets, must be a power of two */
+#define BUCKET_NUM 4096
+
+struct _ELF_Cache {
+	pthread_mutex_t lock;
+
+	ELF_CacheEntry *buckets[BUCKET_NUM];
+	ELF_CacheEntry *head; /* Most recently used */
+	ELF_CacheEntry *tail; /* Least recently used */
+
+	size_t used;
+	size_t budget;
+	size_t entries;
+
+	uint64_t hits;
+	uint64_t misses;
+};
+
+static void _key(const struct stat *ST, ELF_CacheEntry *key);
+static uint32_t _hashKey(const ELF_CacheEntry *KEY);
+static bool _sameKey(const ELF_CacheEntry *A, const ELF_CacheEntry *B);
+
+static ELF_CacheEntry *_lookup(ELF_Cache *cache, const ELF_CacheEntry *KEY);
+static void _insert(ELF_Cache *cache, ELF_CacheEntry *entry);
+static void _unlink(ELF_Cache *cache, ELF_CacheEntry *entry);
+static void _pushFront(ELF_Cache *cache, ELF_CacheEntry *entry);
+static void _evict(ELF_Cache *cache, size_t limit);
+static void _freeEntry(ELF_CacheEntry *entry);
+
+ELF_Cache *elfCacheNew(size_t budget) {
+	ELF_Cache *cache = utilCalloc(1, sizeof(*cache));
+	if( cache == NULL ) {
+		return NULL;
+	}
+
+	if( pthread_mutex_init(&cache->lock, NULL) != 0 ) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->budget = budget;
+	return cache;
+}
+
+void elfCacheFree(ELF_Cache *cache) {
+	ELF_CacheEntry *entry = cache->head;
+	while( entry != NULL ) {
+		ELF_CacheEntry *next = entry->next;
+		_freeEntry(entry);
+		entry = next;
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+ELF_CacheEntry *elfCacheAcquire(
+	ELF_Cache *cache, const char *PATH, ELF_Status *status) {
+	/* The key and the contents both come from the same descriptor, so a file
+	 * replaced under the path in between can't be cached under the wrong key
+	 */
+	const int FD = open(PATH, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if( FD < 0 || fstat(FD, &st) != 0 ) {
+		if( FD >= 0 ) {
+			close(FD);
+		}
+
+		if( status != NULL ) {
+			*status = ELF_ERR_IO;
+		}
+
+		return NULL;
+	}
+
+	ELF_CacheEntry key;
+	_key(&st, &key);
+
+	pthread_mutex_lock(&cache->lock);
+
+	ELF_CacheEntry *entry = _lookup(cache, &key);
+	if( entry != NULL ) {
+		++entry->refs;
+		++cache->hits;
+
+		_unlink(cache, entry);
+		_pushFront(cache, entry);
+
+		pthread_mutex_unlock(&cache->lock);
+		close(FD);
+
+		if( status != NULL ) {
+			*status = ELF_OK;
+		}
+
+		return entry;
+	}
+
+	++cache->misses;
+	pthread_mutex_unlock(&cache->lock);
+
+	/* Read and parse without holding the lock, so other files can be served */
+	FP *fp = utilReadFd(FD, st.st_size);
+	if( fp == NULL ) {
+		if( status != NULL ) {
+			*status = errno == ENOMEM ? ELF_ERR_NOMEM : ELF_ERR_IO;
+		}
+
+		close(FD);
+		return NULL;
+	}
+
+	/* A file written to in place while it was read may be torn: it's still
+	 * answered from, but not kept
+	 */
+	bool changed = fstat(FD, &st) != 0;
+	if( !changed ) {
+		ELF_CacheEntry now;
+		_key(&st, &now);
+		changed = !_sameKey(&now, &key);
+	}
+
+	close(FD);
+
+	ELF *elf = elfParse(fp, status);
+	if( elf == NULL ) {
+		return NULL;
+	}
+
+	entry = utilMalloc(sizeof(*entry));
+	if( entry == NULL || !elfBuildIndices(elf, ELF_INDEX_SECTIONS) ) {
+		free(entry);
+		elfFree(elf);
+
+		if( status != NULL ) {
+			*status = ELF_ERR_NOMEM;
+		}
+
+		return NULL;
+	}
+
+	*entry = key;
+	entry->elf = elf;
+	entry->cost = elfFootprint(elf) + sizeof(*entry);
+	entry->refs = 1;
+	entry->cached = false;
+	entry->indexed = ELF_INDEX_SECTIONS;
+	pthread_mutex_init(&entry->indexLock, NULL);
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Another thread may have parsed the same file in the meantime */
+	ELF_CacheEntry *other = _lookup(cache, &key);
+	if( other != NULL ) {
+		++other->refs;
+		pthread_mutex_unlock(&cache->lock);
+
+		_freeEntry(entry);
+		return other;
+	}
+
+	if( !changed && entry->cost <= cache->budget ) {
+		_insert(cache, entry);
+		_evict(cache, cache->budget);
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+	return entry;
+}
+
+bool elfCacheIndex(
+	ELF_Cache *cache, ELF_CacheEntry *entry, unsigned indices) {
+	pthread_mutex_lock(&entry->indexLock);
+
+	const unsigned MISSING = indices & ~entry->indexed;
+	if( MISSING == 0 ) {
+		pthread_mutex_unlock(&entry->indexLock);
+		return true;
+	}
+
+	const size_t BEFORE = elfFootprint(entry->elf);
+	const bool OK = elfBuildIndices(entry->elf, MISSING);
+	const size_t GROWTH = elfFootprint(entry->elf) - BEFORE;
+
+	if( OK ) {
+		entry->indexed |= MISSING;
+	}
+
+	pthread_mutex_unlock(&entry->indexLock);
+
+	pthread_mutex_lock(&cache->lock);
+
+	entry->cost += GROWTH;
+	if( entry->cached ) {
+		cache->used += GROWTH;
+		_evict(cache, cache->budget);
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+	return OK;
+}
+
+void elfCacheRelease(ELF_Cache *cache, ELF_CacheEntry *entry) {
+	pthread_mutex_lock(&cache->lock);
+
+	--entry->refs;
+
+	if( !entry->cached ) {
+		pthread_mutex_unlock(&cache->lock);
+
+		/* Nobody else can see an entry that was never cached */
+		_freeEntry(entry);
+		return;
+	}
+
+	_evict(cache, cache->budget);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void elfCacheClear(ELF_Cache *cache) {
+	pthread_mutex_lock(&cache->lock);
+	_evict(cache, 0);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void elfCacheGetStats(ELF_Cache *cache, ELF_CacheStats *stats) {
+	pthread_mutex_lock(&cache->lock);
+
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->entries = cache->entries;
+	stats->used = cache->used;
+	stats->budget = cache->budget;
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Fills in a key from a file's status */
+static void _key(const struct stat *ST, ELF_CacheEntry *key) {
+	key->dev = ST->st_dev;
+	key->ino = ST->st_ino;
+	key->mtimeSec = ST->st_mtim.tv_sec;
+	key->mtimeNsec = ST->st_mtim.tv_nsec;
+	key->size = ST->st_size;
+}
+
+/* Hashes the key of an entry */
+static uint32_t _hashKey(const ELF_CacheEntry *KEY) {
+	uint64_t hash = KEY->ino * 0x9E3779B97F4A7C15ull;
+	hash ^= KEY->dev + (hash << 6) + (hash >> 2);
+	hash ^= (uint64_t)KEY->mtimeNsec + (hash << 6) + (hash >> 2);
+
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* Compares the keys of two entries */
+static bool _sameKey(const ELF_CacheEntry *A, const ELF_CacheEntry *B) {
+	return A->dev == B->dev && A->ino == B->ino && A->mtimeSec == B->mtimeSec
+		&& A->mtimeNsec == B->mtimeNsec && A->size == B->size;
+}
+
+/* Looks up an entry by its key, with the lock held */
+static ELF_CacheEntry *_lookup(ELF_Cache *cache, const ELF_CacheEntry *KEY) {
+	ELF_CacheEntry *entry = cache->buckets[_hashKey(KEY) & (BUCKET_NUM - 1)];
+	while( entry != NULL && !_sameKey(entry, KEY) ) {
+		entry = entry->chain;
+	}
+
+	return entry;
+}
+
+/* Adds an entry to the cache, with the lock held */
+static void _insert(ELF_Cache *cache, ELF_CacheEntry *entry) {
+	const uint32_t BUCKET = _hashKey(entry) & (BUCKET_NUM - 1);
+
+	entry->chain = cache->buckets[BUCKET];
+	cache->buckets[BUCKET] = entry;
+
+	entry->cached = true;
+	cache->used += entry->cost;
+	++cache->entries;
+
+	_pushFront(cache, entry);
+}
+
+/* Removes an entry from the LRU list */
+static void _unlink(ELF_Cache *cache, ELF_CacheEntry *entry) {
+	if( entry->prev != NULL ) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+
+	if( entry->next != NULL ) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+}
+
+/* Adds an entry to the front of the LRU list */
+static void _pushFront(ELF_Cache *cache, ELF_CacheEntry *entry) {
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if( cache->head != NULL ) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+
+	cache->head = entry;
+}
+
+/* Evicts unused entries until the cache holds at most 'limit' bytes, with the
+ * lock held
+ */
+static void _evict(ELF_Cache *cache, size_t limit) {
+	ELF_CacheEntry *entry = cache->tail;
+
+	while( cache->used > limit && entry != NULL ) {
+		ELF_CacheEntry *prev = entry->prev;
+
+		if( entry->refs == 0 ) {
+			ELF_CacheEntry **link
+				= &cache->buckets[_hashKey(entry) & (BUCKET_NUM - 1)];
+			while( *link != entry ) {
+				link = &(*link)->chain;
+			}
+
+			*link = entry->chain;
+
+			_unlink(cache, entry);
+			cache->used -= entry->cost;
+			--cache->entries;
+
+			_freeEntry(entry);
+		}
+
+		entry = prev;
+	}
+}
+
+/* Frees an entry along with its ELF */
+static void _freeEntry(ELF_CacheEntry *entry) {
+	pthread_mutex_destroy(&entry->indexLock);
+	elfFree(entry->elf);
+	free(entry);
+}
@@ -0,0 +1,241 @@
+/* elfp
+ * Columnar header tables
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfcolumns.h"
+
+/* Wide columns per table, which take 8 bytes an entry in ELF64 files */
+#define SECT_WIDE 4
+#define SEG_WIDE 5
+
+/* Narrow columns per table, which always take 4 bytes an entry */
+#define SECT_NARROW 2
+#define SEG_NARROW 2
+
+static ELF_Column _carve(uint8_t **at, uint32_t num, bool wide);
+static uint32_t *_carve32(uint8_t **at, uint32_t num);
+static void _set(ELF_Column column, bool wide, uint32_t i, uint64_t value);
+
+const ELF_Columns *elfColumns(ELF *elf) {
+	if( elf->columns == NULL && !elfColumnsBuild(elf) ) {
+		return NULL;
+	}
+
+	return elf->columns;
+}
+
+uint64_t elfColumnAt(const ELF_Columns *COLUMNS, ELF_Column column,
+	uint32_t i) {
+	return COLUMNS->wide ? column.u64[i] : column.u32[i];
+}
+
+uint32_t elfSectionsOfType(
+	const ELF_Columns *COLUMNS, ELF_SH_Type type, uint32_t *indices) {
+	const uint32_t NUM = COLUMNS->sections.num;
+	const uint32_t *TYPES = COLUMNS->sections.type;
+
+	/* Always storing and only advancing on a match keeps the loop free of
+	 * branches that depend on the data
+	 */
+	uint32_t n = 0;
+	for( uint32_t i = 0; i < NUM; ++i ) {
+		indices[n] = i;
+		n += TYPES[i] == (uint32_t)type;
+	}
+
+	return n;
+}
+
+uint32_t elfSectionsWithFlags(
+	const ELF_Columns *COLUMNS, uint64_t flags, uint32_t *indices) {
+	const uint32_t NUM = COLUMNS->sections.num;
+	const ELF_Column FLAGS = COLUMNS->sections.flags;
+
+	uint32_t n = 0;
+	if( COLUMNS->wide ) {
+		for( uint32_t i = 0; i < NUM; ++i ) {
+			indices[n] = i;
+			n += (FLAGS.u64[i] & flags) == flags;
+		}
+	} else if( flags <= UINT32_MAX ) {
+		const uint32_t MASK = flags;
+		for( uint32_t i = 0; i < NUM; ++i ) {
+			indices[n] = i;
+			n += (FLAGS.u32[i] & MASK) == MASK;
+		}
+	}
+
+	return n;
+}
+
+uint32_t elfSectionsOfSize(const ELF_Columns *COLUMNS, uint64_t min,
+	uint64_t max, uint32_t *indices) {
+	const uint32_t NUM = COLUMNS->sections.num;
+	const ELF_Column SIZES = COLUMNS->sections.size;
+
+	if( min > max ) {
+		return 0;
+	}
+
+	/* One unsigned comparison covers both bounds */
+	const uint64_t SPAN = max - min;
+
+	uint32_t n = 0;
+	if( COLUMNS->wide ) {
+		for( uint32_t i = 0; i < NUM; ++i ) {
+			indices[n] = i;
+			n += SIZES.u64[i] - min <= SPAN;
+		}
+	} else {
+		for( uint32_t i = 0; i < NUM; ++i ) {
+			indices[n] = i;
+			n += (uint64_t)SIZES.u32[i] - min <= SPAN;
+		}
+	}
+
+	return n;
+}
+
+uint32_t elfSegmentsOfType(
+	const ELF_Columns *COLUMNS, ELF_PH_Type type, uint32_t *indices) {
+	const uint32_t NUM = COLUMNS->segments.num;
+	const uint32_t *TYPES = COLUMNS->segments.type;
+
+	uint32_t n = 0;
+	for( uint32_t i = 0; i < NUM; ++i ) {
+		indices[n] = i;
+		n += TYPES[i] == (uint32_t)type;
+	}
+
+	return n;
+}
+
+/* Builds the columns from the section and program headers */
+bool elfColumnsBuild(ELF *elf) {
+	if( elf->columns != NULL ) {
+		return true;
+	}
+
+	const uint32_t SH_NUM = elf->header.sectHeaderEntryNum;
+	const uint16_t PH_NUM = elf->header.progHeaderEntryNum;
+	const bool WIDE = elf->header.ident.class != ELF_CLASS_32_BIT;
+	const size_t WIDTH = WIDE ? sizeof(uint64_t) : sizeof(uint32_t);
+
+	/* Wide columns go first, so every column stays aligned to its width
+	 * (narrow ones are a multiple of 4 bytes long, wide ones of 8)
+	 */
+	const size_t SIZE = WIDTH * (SECT_WIDE * (size_t)SH_NUM + SEG_WIDE * PH_NUM)
+		+ sizeof(uint32_t) * (SECT_NARROW * (size_t)SH_NUM
+			+ SEG_NARROW * PH_NUM);
+
+	ELF_Columns *columns = utilMalloc(sizeof(*columns));
+	if( columns == NULL ) {
+		return false;
+	}
+
+	columns->block = utilMalloc(SIZE > 0 ? SIZE : 1);
+	if( columns->block == NULL ) {
+		free(columns);
+		return false;
+	}
+
+	columns->wide = WIDE;
+	columns->blockSize = SIZE;
+
+	ELF_SectColumns *sections = &columns->sections;
+	ELF_SegColumns *segments = &columns->segments;
+	sections->num = SH_NUM;
+	segments->num = PH_NUM;
+
+	uint8_t *at = columns->block;
+	sections->flags = _carve(&at, SH_NUM, WIDE);
+	sections->addr = _carve(&at, SH_NUM, WIDE);
+	sections->offset = _carve(&at, SH_NUM, WIDE);
+	sections->size = _carve(&at, SH_NUM, WIDE);
+	segments->offset = _carve(&at, PH_NUM, WIDE);
+	segments->virtualAddr = _carve(&at, PH_NUM, WIDE);
+	segments->fileSize = _carve(&at, PH_NUM, WIDE);
+	segments->memSize = _carve(&at, PH_NUM, WIDE);
+	segments->align = _carve(&at, PH_NUM, WIDE);
+	sections->type = _carve32(&at, SH_NUM);
+	sections->nameId = _carve32(&at, SH_NUM);
+	segments->type = _carve32(&at, PH_NUM);
+	segments->flags = _carve32(&at, PH_NUM);
+
+	for( uint32_t i = 0; i < SH_NUM; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+
+		sections->type[i] = SH->type;
+		sections->nameId[i] = SH->nameId;
+		_set(sections->flags, WIDE, i, SH->flags);
+		_set(sections->addr, WIDE, i, SH->addr);
+		_set(sections->offset, WIDE, i, SH->offset);
+		_set(sections->size, WIDE, i, SH->size);
+	}
+
+	for( uint16_t i = 0; i < PH_NUM; ++i ) {
+		const ELF_PHEntry *PH = &elf->ph[i];
+
+		segments->type[i] = PH->type;
+		segments->flags[i] = PH->flags;
+		_set(segments->offset, WIDE, i, PH->offset);
+		_set(segments->virtualAddr, WIDE, i, PH->virtualAddr);
+		_set(segments->fileSize, WIDE, i, PH->fileSize);
+		_set(segments->memSize, WIDE, i, PH->memSize);
+		_set(segments->align, WIDE, i, PH->align);
+	}
+
+	elf->columns = columns;
+	return true;
+}
+
+void elfColumnsFree(ELF_Columns *columns) {
+	if( columns == NULL ) {
+		return;
+	}
+
+	free(columns->block);
+	free(columns);
+}
+
+/* Takes a column of 'num' entries from the block, advancing 'at' past it */
+static ELF_Column _carve(uint8_t **at, uint32_t num, bool wide) {
+	ELF_Column column;
+
+	if( wide ) {
+		column.u64 = (uint64_t *)*at;
+		*at += sizeof(uint64_t) * (size_t)num;
+	} else {
+		column.u32 = (uint32_t *)*at;
+		*at += sizeof(uint32_t) * (size_t)num;
+	}
+
+	return column;
+}
+
+/* Ditto, for a column always 32 bits wide */
+static uint32_t *_carve32(uint8_t **at, uint32_t num) {
+	uint32_t *column = (uint32_t *)*at;
+	*at += sizeof(uint32_t) * (size_t)num;
+
+	return column;
+}
+
+/* Stores entry 'i' of a column
+ * ELF32 fields are 32 bits wide on disk, so narrowing loses nothing
+ */
+static void _set(ELF_Column column, bool wide, uint32_t i, uint64_t value) {
+	if( wide ) {
+		column.u64[i] = value;
+	} else {
+		column.u32[i] = (uint32_t)value;
+	}
+}
@@ -0,0 +1,325 @@
+/* elfp
+ * Debug links
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_PCLMUL
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfdebuglink.h"
+
+/* The CRC-32 polynomial, bit-reversed */
+#define POLY 0xEDB88320u
+
+/* The carry-less multiplication kernel folds 64 bytes at a time, and needs
+ * at least that many
+ */
+#define PCLMUL_MIN 64
+
+/* Bytes read at once from files that can't be mapped */
+#define READ_BLOCK ((size_t)1 << 20)
+
+typedef uint32_t (*Kernel)(uint32_t crc, const uint8_t *DATA, size_t size);
+
+static void _init(void);
+static uint32_t _crcBytewise(uint32_t crc, const uint8_t *DATA, size_t size);
+static uint32_t _crcSlice8(uint32_t crc, const uint8_t *DATA, size_t size);
+#ifdef HAVE_PCLMUL
+static uint32_t _crcPclmul(uint32_t crc, const uint8_t *DATA, size_t size);
+#endif
+
+/* _table[0] is the byte-at-a-time table; _table[k] gives the CRC of a byte
+ * followed by k zero bytes
+ */
+static uint32_t _table[8][256];
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+static bool _pclmul;
+
+static const Kernel KERNELS[ELF_CRC32_KERNEL_NUM] = {
+	[ELF_CRC32_BYTEWISE] = _crcBytewise,
+	[ELF_CRC32_SLICE8] = _crcSlice8,
+#ifdef HAVE_PCLMUL
+	[ELF_CRC32_PCLMUL] = _crcPclmul,
+#endif
+};
+
+static const char *const NAMES[ELF_CRC32_KERNEL_NUM] = {
+	[ELF_CRC32_BYTEWISE] = "bytewise",
+	[ELF_CRC32_SLICE8] = "slicing-by-8",
+	[ELF_CRC32_PCLMUL] = "pclmul",
+};
+
+bool elfDebugLink(ELF *elf, ELF_DebugLink *link) {
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+	const ELF_SHEntry *SH = KNOWN != NULL ? KNOWN->debugLink : NULL;
+
+	if( SH == NULL || SH->type == ELF_SHT_NOBITS || SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		return false;
+	}
+
+	/* The name, its NUL, padding up to 4 bytes, then the CRC */
+	const char *DATA = (const char *)elf->image + SH->offset;
+	const size_t LENGTH = strnlen(DATA, SH->size);
+	const uint64_t CRC_AT = (LENGTH + 4) & ~(uint64_t)3;
+
+	if( LENGTH == 0 || CRC_AT + 4 > SH->size ) {
+		return false;
+	}
+
+	Cursor cursor;
+	cursor.pos = (const uint8_t *)DATA + CRC_AT;
+	cursor.end = cursor.pos + 4;
+	cursor.le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor.ok = true;
+
+	link->name = DATA;
+	link->crc = utilCursorRead(&cursor, 4);
+	return true;
+}
+
+uint32_t elfCrc32(uint32_t crc, const void *DATA, size_t size) {
+	pthread_once(&_once, _init);
+
+	const ELF_Crc32Kernel KERNEL
+		= _pclmul ? ELF_CRC32_PCLMUL : ELF_CRC32_SLICE8;
+	return ~KERNELS[KERNEL](~crc, DATA, size);
+}
+
+uint32_t elfCrc32Using(
+	ELF_Crc32Kernel kernel, uint32_t crc, const void *DATA, size_t size) {
+	pthread_once(&_once, _init);
+	return ~KERNELS[kernel](~crc, DATA, size);
+}
+
+bool elfCrc32Supported(ELF_Crc32Kernel kernel) {
+	pthread_once(&_once, _init);
+	return kernel != ELF_CRC32_PCLMUL || _pclmul;
+}
+
+const char *elfCrc32KernelName(ELF_Crc32Kernel kernel) {
+	return NAMES[kernel];
+}
+
+bool elfCrc32File(const char *PATH, uint32_t *crc) {
+	const int FD = open(PATH, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if( FD < 0 || fstat(FD, &st) != 0 ) {
+		if( FD >= 0 ) {
+			close(FD);
+		}
+
+		return false;
+	}
+
+	*crc = 0;
+
+	/* Debug files run to gigabytes: they're mapped rather than copied, and
+	 * read ahead aggressively
+	 */
+	void *map = st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX
+		? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, FD, 0)
+		: MAP_FAILED;
+
+	if( map != MAP_FAILED ) {
+		posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+		*crc = elfCrc32(0, map, st.st_size);
+
+		munmap(map, st.st_size);
+		close(FD);
+		return true;
+	}
+
+	uint8_t *block = utilMalloc(READ_BLOCK);
+	if( block == NULL ) {
+		close(FD);
+		errno = ENOMEM;
+		return false;
+	}
+
+	ssize_t n;
+	while( (n = read(FD, block, READ_BLOCK)) != 0 ) {
+		if( n > 0 ) {
+			*crc = elfCrc32(*crc, block, n);
+		} else if( errno != EINTR ) {
+			break;
+		}
+	}
+
+	const int ERROR = errno;
+	free(block);
+	close(FD);
+
+	errno = ERROR;
+	return n == 0;
+}
+
+/* Builds the tables, and picks the kernel for this CPU */
+static void _init(void) {
+	for( unsigned b = 0; b < 256; ++b ) {
+		uint32_t crc = b;
+		for( unsigned bit = 0; bit < 8; ++bit ) {
+			crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+		}
+
+		_table[0][b] = crc;
+	}
+
+	for( unsigned b = 0; b < 256; ++b ) {
+		for( unsigned k = 1; k < 8; ++k ) {
+			const uint32_t PREV = _table[k - 1][b];
+			_table[k][b] = (PREV >> 8) ^ _table[0][PREV & 0xFF];
+		}
+	}
+
+#ifdef HAVE_PCLMUL
+	__builtin_cpu_init();
+	_pclmul = __builtin_cpu_supports("pclmul");
+#endif
+}
+
+static uint32_t _crcBytewise(uint32_t crc, const uint8_t *DATA, size_t size) {
+	for( size_t i = 0; i < size; ++i ) {
+		crc = (crc >> 8) ^ _table[0][(crc ^ DATA[i]) & 0xFF];
+	}
+
+	return crc;
+}
+
+/* Folds 8 bytes per step: each of them goes through the table for the
+ * number of bytes that follow it in the step
+ */
+static uint32_t _crcSlice8(uint32_t crc, const uint8_t *DATA, size_t size) {
+	while( size >= 8 ) {
+		const uint32_t LOW = crc
+			^ ((uint32_t)DATA[0] | (uint32_t)DATA[1] << 8
+				| (uint32_t)DATA[2] << 16 | (uint32_t)DATA[3] << 24);
+
+		crc = _table[7][LOW & 0xFF] ^ _table[6][(LOW >> 8) & 0xFF]
+			^ _table[5][(LOW >> 16) & 0xFF] ^ _table[4][LOW >> 24]
+			^ _table[3][DATA[4]] ^ _table[2][DATA[5]] ^ _table[1][DATA[6]]
+			^ _table[0][DATA[7]];
+
+		DATA += 8;
+		size -= 8;
+	}
+
+	return _crcBytewise(crc, DATA, size);
+}
+
+#ifdef HAVE_PCLMUL
+/* Folds four 128-bit lanes over 64 bytes at a time, then folds the lanes into
+ * one, then single 16-byte blocks into it, and reduces the last 128 bits to
+ * 32 with a Barrett reduction. The constants are powers of x modulo the
+ * (bit-reflected) polynomial, as in Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ". The tail left over goes through slicing-by-8
+ */
+__attribute__((target("pclmul,sse2"))) static uint32_t _crcPclmul(
+	uint32_t crc, const uint8_t *DATA, size_t size) {
+	if( size < PCLMUL_MIN ) {
+		return _crcSlice8(crc, DATA, size);
+	}
+
+	const __m128i K1K2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i K3K4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i K5K0 = _mm_set_epi64x(0, 0x0163CD6124);
+	const __m128i POLY_MU = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i LOW32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i *)DATA);
+	__m128i x2 = _mm_loadu_si128((const __m128i *)(DATA + 16));
+	__m128i x3 = _mm_loadu_si128((const __m128i *)(DATA + 32));
+	__m128i x4 = _mm_loadu_si128((const __m128i *)(DATA + 48));
+	__m128i x5;
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	DATA += 64;
+	size -= 64;
+
+	while( size >= 64 ) {
+		const __m128i X5 = _mm_clmulepi64_si128(x1, K1K2, 0x00);
+		const __m128i X6 = _mm_clmulepi64_si128(x2, K1K2, 0x00);
+		const __m128i X7 = _mm_clmulepi64_si128(x3, K1K2, 0x00);
+		const __m128i X8 = _mm_clmulepi64_si128(x4, K1K2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, K1K2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, K1K2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, K1K2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, K1K2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, X5),
+			_mm_loadu_si128((const __m128i *)DATA));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, X6),
+			_mm_loadu_si128((const __m128i *)(DATA + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, X7),
+			_mm_loadu_si128((const __m128i *)(DATA + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, X8),
+			_mm_loadu_si128((const __m128i *)(DATA + 48)));
+
+		DATA += 64;
+		size -= 64;
+	}
+
+	/* Four lanes into one */
+	x5 = _mm_clmulepi64_si128(x1, K3K4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, K3K4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, K3K4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, K3K4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, K3K4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, K3K4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while( size >= 16 ) {
+		x5 = _mm_clmulepi64_si128(x1, K3K4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, K3K4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			_mm_loadu_si128((const __m128i *)DATA));
+
+		DATA += 16;
+		size -= 16;
+	}
+
+	/* 128 bits down to 64 */
+	x2 = _mm_clmulepi64_si128(x1, K3K4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, LOW32);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, K5K0, 0x00), x2);
+
+	/* Barrett reduction down to 32 */
+	x2 = _mm_and_si128(x1, LOW32);
+	x2 = _mm_clmulepi64_si128(x2, POLY_MU, 0x10);
+	x2 = _mm_and_si128(x2, LOW32);
+	x2 = _mm_clmulepi64_si128(x2, POLY_MU, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	crc = _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	return _crcSlice8(crc, DATA, size);
+}
+#endif
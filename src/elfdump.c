@@ -2,22 +2,34 @@
  * ELF information dump
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "elfframe.h"
+#include "elfintern.h"
+#include "elfnote.h"
 #include "elfp.h"
+#include "elfpages.h"
+#include "elfstats.h"
+#include "elfsym.h"
 
 #include "elfdump.h"
 
 #define PCASE(C, S)                                                            \
 	case(C):                                                                   \
-		printf(S);                                                             \
+		fprintf(out, S);                                                       \
 		break
 
-#define PADS(s, S) printf("%-" s "s", S);
-#define PADT(s, T, N) printf("%-" s T, N);
+#define PADS(s, S) fprintf(out, "%-" s "s", S);
+#define PADT(s, T, N) fprintf(out, "%-" s T, N);
 
 #define PPADCASE(C, s, S)                                                      \
 	case(C):                                                                   \
@@ -29,183 +41,306 @@
 	"------\n"
 #define SH_SEP                                                                 \
 	"\n--------------------------------------------------------------------\n"
+#define UW_SEP                                                                 \
+	"\n----------------------------------------------------------------------" \
+	"--------\n"
 
-#define PHT_PAD "14"
-#define SHT_PAD "20"
+#define SYM_SEP                                                                \
+	"\n----------------------------------------------------------------------" \
+	"--------\n"
 
-static void _ehDump(ELF_Header *header);
-static void _phDump(ELF_PHEntry *ph, ELF_Class class, uint16_t num);
-static void _shDump(ELF_SHEntry *sh, int nidx, ELF_Class class, uint16_t num);
+#define PG_SEP                                                                 \
+	"\n----------------------------------------------------------------------" \
+	"---\n"
 
-static void _elfVersionDump(ELF_Version version);
-static void _elfAddrDump(ELF_Class class, uint64_t addr);
+#define PHT_PAD "14"
+#define SHT_PAD "20"
 
-static void _elfNoteDescDump(ELF_Note *note);
-static void _elfNoteDescABIDump(ELF_Note *note);
-static void _elfNoteDescBuildIDDump(ELF_Note *note);
+/* Section headers are formatted by several threads from this many on, in
+ * chunks of SH_CHUNK entries. Each thread may run SH_AHEAD chunks ahead of
+ * the one being written, which bounds the memory held by formatted chunks
+ */
+#define SH_PARALLEL_MIN 4096
+#define SH_CHUNK 1024
+#define SH_AHEAD 4
+
+/* A chunk of section headers, formatted on its own */
+typedef struct _ShChunk {
+	char *text; /* NULL if it couldn't be formatted on the side */
+	size_t length;
+	bool ready;
+} ShChunk;
+
+/* Section headers being formatted by several threads, and written in order
+ * by the dumping one
+ */
+typedef struct _ShDump {
+	ELF *elf;
+	uint32_t chunkNum;
+	uint32_t next; /* Next chunk to format */
+	uint32_t written; /* Chunks written so far */
+
+	uint32_t window; /* Chunks formatted but not yet written, at most */
+	ShChunk *slots; /* A chunk's slot is its index modulo the window */
+
+	pthread_mutex_t lock;
+	pthread_cond_t formatted; /* A chunk is ready */
+	pthread_cond_t drained; /* A chunk was written, freeing its slot */
+} ShDump;
+
+static void _dump(FILE *out, ELF *elf, int flags);
+static void _ehDump(FILE *out, ELF_Header *header);
+static void _phDump(FILE *out, ELF *elf);
+static void _shDump(FILE *out, ELF *elf);
+static void _shRangeDump(FILE *out, ELF *elf, uint32_t first, uint32_t end);
+static bool _shParallelDump(FILE *out, ELF *elf);
+static void *_shChunkThread(void *arg);
+static void _unwindDump(FILE *out, ELF *elf);
+static void _symDump(FILE *out, ELF *elf);
+static void _pagesDump(FILE *out, ELF *elf);
+
+static void _elfVersionDump(FILE *out, ELF_Version version);
+static void _elfAddrDump(FILE *out, ELF_Class class, uint64_t addr);
+
+static void _elfNotesDump(FILE *out, ELF *elf, ELF_NoteIter *iter);
+static void _elfNoteDescDump(FILE *out, ELF *elf, const ELF_NoteRef *NOTE);
+static void _elfNoteDescABIDump(
+	FILE *out, ELF *elf, const ELF_NoteRef *NOTE);
+static void _elfNoteDescBuildIDDump(FILE *out, const ELF_NoteRef *NOTE);
+static void _elfNoteDescPropertyDump(
+	FILE *out, ELF *elf, const ELF_NoteRef *NOTE);
+static void _elfBitsDump(FILE *out, const char *WHAT, uint32_t bits,
+	const char *const *NAMES, unsigned num, const char **separator);
+
+static void _ehIdentDump(FILE *out, ELF_Ident *ident);
+static void _ehTypeDump(FILE *out, ELF_Type type);
+static void _ehMachineDump(FILE *out, ELF_Machine machine);
+static void _ehFlagsDump(FILE *out, uint32_t flags);
+
+static void _eiClassDump(FILE *out, ELF_Class class);
+static void _eiEndiannessDump(FILE *out, ELF_Endianness endianness);
+static void _eiABIDump(FILE *out, ELF_ABI abi);
+
+static void _pheDump(FILE *out, ELF *elf, ELF_PHEntry *ph);
+static void _pheTypeDump(FILE *out, ELF_PH_Type type);
+static void _pheFlagsDump(FILE *out, uint32_t flags);
+
+static void _sheDump(FILE *out, ELF *elf, ELF_SHEntry *sh);
+static void _sheTypeDump(FILE *out, ELF_SH_Type type);
+static void _sheFlagsDumpUpper(FILE *out, uint64_t flags);
+static void _sheFlagsDumpLower(FILE *out, uint64_t flags);
+
+static void _symBindDump(FILE *out, uint8_t bind);
+static void _symTypeDump(FILE *out, uint8_t type);
+static void _symVersionsDump(FILE *out, const ELF_SymTable *TABLE);
+
+static void _pagesRowDump(FILE *out, const ELF_SegmentPages *SEGMENT);
 
-static void _ehIdentDump(ELF_Ident *ident);
-static void _ehTypeDump(ELF_Type type);
-static void _ehMachineDump(ELF_Machine machine);
-static void _ehFlagsDump(uint32_t flags);
+void elfDump(ELF *elf, int flags) {
+	elfDumpTo(stdout, elf, flags);
+}
 
-static void _eiClassDump(ELF_Class class);
-static void _eiEndiannessDump(ELF_Endianness endianness);
-static void _eiABIDump(ELF_ABI abi);
+void elfDumpTo(FILE *out, ELF *elf, int flags) {
+	ELF_PhaseMark mark;
+	elfPhaseBegin(&mark, ELF_PHASE_DUMP);
 
-static void _pheDump(ELF_PHEntry *ph, ELF_Class class);
-static void _pheTypeDump(ELF_PH_Type type);
-static void _pheFlagsDump(uint32_t flags);
+	/* Counts the bytes written, when the stream can tell */
+	const long START = elfStatsEnabled() ? ftell(out) : -1;
 
-static void _sheDump(ELF_SHEntry *sh, ELF_Class class);
-static void _sheTypeDump(ELF_SH_Type type);
-static void _sheFlagsDumpUpper(uint64_t flags);
-static void _sheFlagsDumpLower(uint64_t flags);
+	_dump(out, elf, flags);
 
-void elfDump(ELF *elf, int flags) {
-	ELF_Class class = elf->header.ident.class;
+	const long END = START >= 0 ? ftell(out) : -1;
+	elfPhaseEnd(&mark, END >= START ? END - START : 0);
+}
 
-	printf("=== ELF DUMP ===\n\n");
+static void _dump(FILE *out, ELF *elf, int flags) {
+	fprintf(out, "=== ELF DUMP ===\n\n");
 
 	if( flags & ELF_DUMP_EH ) {
-		_ehDump(&elf->header);
-		printf("\n");
+		_ehDump(out, &elf->header);
+		fprintf(out, "\n");
 	}
 
 	if( flags & ELF_DUMP_PH ) {
-		_phDump(elf->ph, class, elf->header.progHeaderEntryNum);
-		printf("\n");
+		_phDump(out, elf);
+		fprintf(out, "\n");
 	}
 
 	if( flags & ELF_DUMP_SH ) {
-		_shDump(elf->sh, elf->header.sectHeaderNameIndex, class,
-			elf->header.sectHeaderEntryNum);
-		printf("\n");
+		_shDump(out, elf);
+		fprintf(out, "\n");
+	}
+
+	if( flags & ELF_DUMP_UNWIND ) {
+		_unwindDump(out, elf);
+		fprintf(out, "\n");
+	}
+
+	if( flags & ELF_DUMP_DYNSYM ) {
+		_symDump(out, elf);
+		fprintf(out, "\n");
+	}
+
+	if( flags & ELF_DUMP_PAGES ) {
+		_pagesDump(out, elf);
+		fprintf(out, "\n");
 	}
 }
 
-static void _ehDump(ELF_Header *header) {
-	printf("* Header:\n");
-	_ehIdentDump(&header->ident);
+static void _ehDump(FILE *out, ELF_Header *header) {
+	fprintf(out, "* Header:\n");
+	_ehIdentDump(out, &header->ident);
 
-	printf("├── Type: ");
-	_ehTypeDump(header->type);
+	fprintf(out, "├── Type: ");
+	_ehTypeDump(out, header->type);
 
-	printf("├── Machine: ");
-	_ehMachineDump(header->machine);
+	fprintf(out, "├── Machine: ");
+	_ehMachineDump(out, header->machine);
 
-	printf("├── Version: ");
-	_elfVersionDump(header->version);
+	fprintf(out, "├── Version: ");
+	_elfVersionDump(out, header->version);
 
-	printf("├── Entry-point: ");
-	_elfAddrDump(header->ident.class, header->entryPointAddress);
+	fprintf(out, "├── Entry-point: ");
+	_elfAddrDump(out, header->ident.class, header->entryPointAddress);
 
-	printf("\n├── Program Header table start offset: ");
-	printf("%" PRIu64 " bytes from start of file\n", header->progHeaderOffset);
+	fprintf(out, "\n├── Program Header table start offset: ");
+	fprintf(out, "%" PRIu64 " bytes from start of file\n",
+		header->progHeaderOffset);
 
-	printf("├── Section Header table start offset: ");
-	printf("%" PRIu64 " bytes from start of file\n", header->sectHeaderOffset);
+	fprintf(out, "├── Section Header table start offset: ");
+	fprintf(out, "%" PRIu64 " bytes from start of file\n",
+		header->sectHeaderOffset);
 
-	printf("├── Flags: ");
-	_ehFlagsDump(header->flags);
+	fprintf(out, "├── Flags: ");
+	_ehFlagsDump(out, header->flags);
 
-	printf("├── Entry Header size: ");
-	printf("%" PRIu16 " bytes\n", header->headerSize);
+	fprintf(out, "├── Entry Header size: ");
+	fprintf(out, "%" PRIu16 " bytes\n", header->headerSize);
 
-	printf("├── Size of a Program Header entry: ");
-	printf("%" PRIu16 " bytes\n", header->progHeaderEntrySize);
+	fprintf(out, "├── Size of a Program Header entry: ");
+	fprintf(out, "%" PRIu16 " bytes\n", header->progHeaderEntrySize);
 
-	printf("├── Number of Program Header entries: ");
-	printf("%" PRIu16 "\n", header->progHeaderEntryNum);
+	fprintf(out, "├── Number of Program Header entries: ");
+	fprintf(out, "%" PRIu16 "\n", header->progHeaderEntryNum);
 
-	printf("├── Size of a Section Header entry: ");
-	printf("%" PRIu16 " bytes\n", header->sectHeaderEntrySize);
+	fprintf(out, "├── Size of a Section Header entry: ");
+	fprintf(out, "%" PRIu16 " bytes\n", header->sectHeaderEntrySize);
 
-	printf("├── Number of a Section Header entry: ");
-	printf("%" PRIu16 "\n", header->sectHeaderEntryNum);
+	fprintf(out, "├── Number of a Section Header entry: ");
+	fprintf(out, "%" PRIu32 "\n", header->sectHeaderEntryNum);
 
-	printf("└── Index of the Section Header entry with names: ");
-	printf("%" PRIu16 "\n", header->sectHeaderNameIndex);
+	fprintf(out, "└── Index of the Section Header entry with names: ");
+	fprintf(out, "%" PRIu32 "\n", header->sectHeaderNameIndex);
 }
 
-static void _ehIdentDump(ELF_Ident *ident) {
-	printf("├── Ident:\n");
+static void _ehIdentDump(FILE *out, ELF_Ident *ident) {
+	fprintf(out, "├── Ident:\n");
 
-	printf("├──── Class: ");
-	_eiClassDump(ident->class);
+	fprintf(out, "├──── Class: ");
+	_eiClassDump(out, ident->class);
 
-	printf("├──── Endianness: ");
-	_eiEndiannessDump(ident->endianness);
+	fprintf(out, "├──── Endianness: ");
+	_eiEndiannessDump(out, ident->endianness);
 
-	printf("├──── Version: ");
-	_elfVersionDump(ident->version);
+	fprintf(out, "├──── Version: ");
+	_elfVersionDump(out, ident->version);
 
-	printf("├──── ABI: ");
-	_eiABIDump(ident->abi);
+	fprintf(out, "├──── ABI: ");
+	_eiABIDump(out, ident->abi);
 
-	printf("├──── ABI Version: ");
-	printf("%" PRIu8 "\n│\n", ident->abiVersion);
+	fprintf(out, "├──── ABI Version: ");
+	fprintf(out, "%" PRIu8 "\n│\n", ident->abiVersion);
 }
 
-static void _eiClassDump(ELF_Class class) {
+static void _eiClassDump(FILE *out, ELF_Class class) {
 	switch( class ) {
 		PCASE(ELF_CLASS_INVALID, "invalid\n");
 		PCASE(ELF_CLASS_32_BIT, "32-bit\n");
 		PCASE(ELF_CLASS_64_BIT, "64-bit\n");
 	default:
-		printf("Unknown class '%d'\n", class);
+		fprintf(out, "Unknown class '%d'\n", class);
 	}
 }
 
-static void _eiEndiannessDump(ELF_Endianness endianness) {
+static void _eiEndiannessDump(FILE *out, ELF_Endianness endianness) {
 	switch( endianness ) {
 		PCASE(ELF_ENDIAN_INVALID, "invalid\n");
 		PCASE(ELF_ENDIAN_LITTLE_ENDIAN, "Little-endian\n");
 		PCASE(ELF_ENDIAN_BIG_ENDIAN, "Big-endian\n");
 	default:
-		printf("Unknown endianness '%d'\n", endianness);
+		fprintf(out, "Unknown endianness '%d'\n", endianness);
 	}
 }
 
-static void _elfVersionDump(ELF_Version version) {
-	printf(version == ELF_VERSION_CURRENT ? "1 (current)\n" : "invalid\n");
+static void _elfVersionDump(FILE *out, ELF_Version version) {
+	fprintf(
+		out, version == ELF_VERSION_CURRENT ? "1 (current)\n" : "invalid\n");
 }
 
-static void _elfAddrDump(ELF_Class class, uint64_t addr) {
+static void _elfAddrDump(FILE *out, ELF_Class class, uint64_t addr) {
 	if( class == ELF_CLASS_32_BIT ) {
-		printf("0x%08" PRIx32, (uint32_t)addr);
+		fprintf(out, "0x%08" PRIx32, (uint32_t)addr);
 	} else {
 		/* Assume 64-bit, even if class is invalid */
-		printf("0x%016" PRIx64, addr);
+		fprintf(out, "0x%016" PRIx64, addr);
 	}
 }
 
-static void _elfNoteDescDump(ELF_Note *note) {
-	if( strcmp(note->name, "GNU") == 0 ) {
-		switch( note->type ) {
+/* Dumps every note an iterator finds, on the current line */
+static void _elfNotesDump(FILE *out, ELF *elf, ELF_NoteIter *iter) {
+	ELF_NoteRef note;
+	const char *separator = " ";
+
+	while( elfNoteNext(iter, &note) ) {
+		/* Names are meant to be NUL-terminated, but don't rely on it */
+		const char *NUL = memchr(note.name, '\0', note.namesz);
+		const int LENGTH = NUL != NULL ? NUL - note.name : (int)note.namesz;
+
+		fprintf(out, "%sNote (%.*s): ", separator, LENGTH, note.name);
+		_elfNoteDescDump(out, elf, &note);
+		separator = "; ";
+	}
+}
+
+static void _elfNoteDescDump(FILE *out, ELF *elf, const ELF_NoteRef *NOTE) {
+	if( elfNoteIsNamed(NOTE, "GNU") ) {
+		switch( NOTE->type ) {
 		case ELF_NT_GNU_ABI:
-			_elfNoteDescABIDump(note);
+			_elfNoteDescABIDump(out, elf, NOTE);
 			break;
 		case ELF_NT_GNU_BUILDID:
-			_elfNoteDescBuildIDDump(note);
+			_elfNoteDescBuildIDDump(out, NOTE);
+			break;
+		case ELF_NT_GNU_PROPERTY_TYPE_0:
+			_elfNoteDescPropertyDump(out, elf, NOTE);
 			break;
 		default:
-			printf("Unknown GNU note type '%d'", note->type);
+			fprintf(out, "Unknown GNU note type '%d'", NOTE->type);
 		}
 	} else {
-		printf("Unknown");
+		fprintf(out, "Unknown");
 	}
 }
 
-static void _elfNoteDescABIDump(ELF_Note *note) {
-	printf("Expects ");
+static void _elfNoteDescABIDump(
+	FILE *out, ELF *elf, const ELF_NoteRef *NOTE) {
+	if( NOTE->descsz < 16 ) {
+		fprintf(out, "Truncated ABI tag");
+		return;
+	}
+
+	fprintf(out, "Expects ");
 
-	uint32_t *data = (uint32_t *)note->desc;
+	Cursor cursor;
+	cursor.pos = NOTE->desc;
+	cursor.end = NOTE->desc + NOTE->descsz;
+	cursor.le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor.ok = true;
 
-	const uint32_t OS = data[0];
-	const uint32_t MAJOR = data[1];
-	const uint32_t MINOR = data[2];
-	const uint32_t PATCH = data[3];
+	const uint32_t OS = utilCursorRead(&cursor, 4);
+	const uint32_t MAJOR = utilCursorRead(&cursor, 4);
+	const uint32_t MINOR = utilCursorRead(&cursor, 4);
+	const uint32_t PATCH = utilCursorRead(&cursor, 4);
 
 	switch( OS ) {
 		PCASE(ELF_NT_GNU_ABI_LINUX, "Linux");
@@ -215,20 +350,84 @@ static void _elfNoteDescABIDump(ELF_Note *note) {
 		PCASE(ELF_NT_GNU_ABI_SYLLABLE, "Syllable");
 		PCASE(ELF_NT_GNU_ABI_NACL, "NaCl");
 	default:
-		printf("unknown OS '%d'", OS);
+		fprintf(out, "unknown OS '%d'", OS);
+	}
+
+	fprintf(out, ", ABI v%" PRIu32 ".%" PRIu32 ".%" PRIu32, MAJOR, MINOR,
+		PATCH);
+}
+
+static void _elfNoteDescBuildIDDump(FILE *out, const ELF_NoteRef *NOTE) {
+	fprintf(out, "Build ID: ");
+	for( uint32_t i = 0; i < NOTE->descsz; ++i ) {
+		fprintf(out, "%02x", NOTE->desc[i]);
+	}
+}
+
+static void _elfNoteDescPropertyDump(
+	FILE *out, ELF *elf, const ELF_NoteRef *NOTE) {
+	static const char *const ISA[]
+		= { "x86-64-baseline", "x86-64-v2", "x86-64-v3", "x86-64-v4" };
+	static const char *const X86[] = { "IBT", "SHSTK" };
+	static const char *const AARCH64[] = { "BTI", "PAC" };
+
+	ELF_GnuProperties properties;
+	memset(&properties, 0, sizeof(properties));
+	elfGnuPropertiesAdd(elf, NOTE, &properties);
+
+	const uint32_t PRESENT = properties.present;
+	const char *separator = "";
+
+	fprintf(out, "Properties: ");
+
+	if( PRESENT & ELF_GNU_PROP_X86_ISA_NEEDED ) {
+		_elfBitsDump(out, "x86 ISA needed", properties.x86IsaNeeded, ISA, 4,
+			&separator);
+	}
+
+	if( PRESENT & ELF_GNU_PROP_X86_ISA_USED ) {
+		_elfBitsDump(out, "x86 ISA used", properties.x86IsaUsed, ISA, 4,
+			&separator);
+	}
+
+	if( PRESENT & ELF_GNU_PROP_X86_FEATURES ) {
+		_elfBitsDump(out, "x86 feature", properties.x86Features, X86, 2,
+			&separator);
+	}
+
+	if( PRESENT & ELF_GNU_PROP_AARCH64_FEATURES ) {
+		_elfBitsDump(out, "AArch64 feature", properties.aarch64Features,
+			AARCH64, 2, &separator);
 	}
 
-	printf(", ABI v%" PRIu32 ".%" PRIu32 ".%" PRIu32, MAJOR, MINOR, PATCH);
+	if( PRESENT == 0 ) {
+		fprintf(out, "none known");
+	}
 }
 
-static void _elfNoteDescBuildIDDump(ELF_Note *note) {
-	printf("Build ID: ");
-	for( uint32_t i = 0; i < note->descsz; ++i ) {
-		printf("%02x", (unsigned char)note->desc[i]);
+/* Dumps the names of the bits set in a property, then any unknown ones */
+static void _elfBitsDump(FILE *out, const char *WHAT, uint32_t bits,
+	const char *const *NAMES, unsigned num, const char **separator) {
+	fprintf(out, "%s%s: ", *separator, WHAT);
+	*separator = "; ";
+
+	const char *comma = "";
+	for( unsigned b = 0; b < num; ++b ) {
+		if( bits & (1u << b) ) {
+			fprintf(out, "%s%s", comma, NAMES[b]);
+			comma = ", ";
+		}
+	}
+
+	const uint32_t UNKNOWN = bits >> num << num;
+	if( UNKNOWN != 0 ) {
+		fprintf(out, "%s0x%" PRIx32, comma, UNKNOWN);
+	} else if( bits == 0 ) {
+		fprintf(out, "none");
 	}
 }
 
-static void _eiABIDump(ELF_ABI abi) {
+static void _eiABIDump(FILE *out, ELF_ABI abi) {
 	switch( abi ) {
 		PCASE(ELF_ABI_SYSTEM_V, "Unix System V\n");
 		PCASE(ELF_ABI_HP_UX, "HP-UX\n");
@@ -252,11 +451,11 @@ static void _eiABIDump(ELF_ABI abi) {
 		PCASE(ELF_ABI_ARM, "ARM\n");
 		PCASE(ELF_ABI_STANDALONE, "Standalone (embedded)\n");
 	default:
-		printf("Unknown ABI '%d'\n", abi);
+		fprintf(out, "Unknown ABI '%d'\n", abi);
 	}
 }
 
-static void _ehTypeDump(ELF_Type type) {
+static void _ehTypeDump(FILE *out, ELF_Type type) {
 	switch( type ) {
 		PCASE(ELF_ET_NONE, "None\n");
 		PCASE(ELF_ET_RELOCATABLE, "Relocatable\n");
@@ -265,16 +464,16 @@ static void _ehTypeDump(ELF_Type type) {
 		PCASE(ELF_ET_CORE, "Core\n");
 	default:
 		if( type >= ELF_ET_LOOS && type <= ELF_ET_HIOS ) {
-			printf("OS specific\n");
+			fprintf(out, "OS specific\n");
 		} else if( type >= ELF_ET_LOPROC && type <= ELF_ET_HIPROC ) {
-			printf("Processor specific\n");
+			fprintf(out, "Processor specific\n");
 		} else {
-			printf("Unknown type '%d'\n", type);
+			fprintf(out, "Unknown type '%d'\n", type);
 		}
 	}
 }
 
-static void _ehMachineDump(ELF_Machine machine) {
+static void _ehMachineDump(FILE *out, ELF_Machine machine) {
 	switch( machine ) {
 		PCASE(ELF_EM_NONE, "No machine specified\n");
 		PCASE(ELF_EM_WE32100, "AT&T WE 32100\n");
@@ -335,62 +534,71 @@ static void _ehMachineDump(ELF_Machine machine) {
 		PCASE(ELF_EM_SVX, "Silicon Graphics SVx\n");
 		PCASE(ELF_EM_ST19, "STMicroelectronics ST19 8-bit\n");
 		PCASE(ELF_EM_VAX, "Digital Equipment Corp. VAX\n");
+		PCASE(ELF_EM_AARCH64, "ARM AArch64\n");
+		PCASE(ELF_EM_RISCV, "RISC-V\n");
+		PCASE(ELF_EM_BPF, "Linux BPF\n");
+		PCASE(ELF_EM_LOONGARCH, "LoongArch\n");
 	default:
-		printf("Unknown machine %d\n", machine);
+		fprintf(out, "Unknown machine %d\n", machine);
 	}
 }
 
-static void _ehFlagsDump(uint32_t flags) {
+static void _ehFlagsDump(FILE *out, uint32_t flags) {
 	/* TODO: Do boring flag cross-referencing... */
-	printf("%" PRIu32 "\n", flags);
+	fprintf(out, "%" PRIu32 "\n", flags);
 }
 
-static void _phDump(ELF_PHEntry *ph, ELF_Class class, uint16_t num) {
-	printf("* Program Header entries\n");
-	printf("No.   Type          Offset             Virtual addr.      Physical "
-		   "addr.\n");
-	printf("                    File size          Memory size        Flags "
-		   "Align");
-	printf(PH_SEP);
-
-	for( uint16_t i = 0; i < num; ++i ) {
-		printf("%-5" PRIu16 " ", i);
-		_pheDump(&ph[i], class);
+static void _phDump(FILE *out, ELF *elf) {
+	fprintf(out, "* Program Header entries\n");
+	fprintf(out,
+		"No.   Type          Offset             Virtual addr.      Physical "
+		"addr.\n");
+	fprintf(out,
+		"                    File size          Memory size        Flags "
+		"Align");
+	fprintf(out, PH_SEP);
+
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		fprintf(out, "%-5" PRIu16 " ", i);
+		_pheDump(out, elf, &elf->ph[i]);
 	}
 }
 
-static void _pheDump(ELF_PHEntry *ph, ELF_Class class) {
-	_pheTypeDump(ph->type);
+static void _pheDump(FILE *out, ELF *elf, ELF_PHEntry *ph) {
+	const ELF_Class class = elf->header.ident.class;
+
+	_pheTypeDump(out, ph->type);
 
-	_elfAddrDump(class, ph->offset);
-	printf(" ");
+	_elfAddrDump(out, class, ph->offset);
+	fprintf(out, " ");
 
-	_elfAddrDump(class, ph->virtualAddr);
-	printf(" ");
+	_elfAddrDump(out, class, ph->virtualAddr);
+	fprintf(out, " ");
 
-	_elfAddrDump(class, ph->physicalAddr);
-	printf("\n                    ");
+	_elfAddrDump(out, class, ph->physicalAddr);
+	fprintf(out, "\n                    ");
 
-	printf("%-18" PRIu64 " ", ph->fileSize);
-	printf("%-18" PRIu64 " ", ph->memSize);
+	fprintf(out, "%-18" PRIu64 " ", ph->fileSize);
+	fprintf(out, "%-18" PRIu64 " ", ph->memSize);
 
-	_pheFlagsDump(ph->flags);
-	printf("   0x%-10" PRIx64, ph->align);
+	_pheFlagsDump(out, ph->flags);
+	fprintf(out, "   0x%-10" PRIx64, ph->align);
 
-	if( ph->type == ELF_PHT_INTERP ) {
-		printf(" (requests interpreter %s)", (char *)ph->data);
+	if( ph->type == ELF_PHT_INTERP && ph->interpId != ELF_INTERN_NONE ) {
+		fprintf(out, " (requests interpreter %s)",
+			elfInternString(ph->interpId));
 	}
 
 	if( ph->type == ELF_PHT_NOTE ) {
-		ELF_Note *note = ph->data;
-		printf(" Note (%s): ", note->name);
-		_elfNoteDescDump(note);
+		ELF_NoteIter iter;
+		elfNotesOfSegment(elf, ph, &iter);
+		_elfNotesDump(out, elf, &iter);
 	}
 
-	printf(PH_SEP);
+	fprintf(out, PH_SEP);
 }
 
-static void _pheTypeDump(ELF_PH_Type type) {
+static void _pheTypeDump(FILE *out, ELF_PH_Type type) {
 	switch( type ) {
 		PPADCASE(ELF_PHT_NULL, PHT_PAD, "Unused");
 		PPADCASE(ELF_PHT_LOAD, PHT_PAD, "Loadable");
@@ -413,75 +621,221 @@ static void _pheTypeDump(ELF_PH_Type type) {
 		} else if( type >= ELF_PHT_LOPROC && type <= ELF_PHT_HIPROC ) {
 			PADS(PHT_PAD, "Processor");
 		} else {
-			printf("Unknown %" PRIu32 " ", type);
+			fprintf(out, "Unknown %" PRIu32 " ", type);
 		}
 	}
 }
 
-static void _pheFlagsDump(uint32_t flags) {
-	printf("%c", (flags & ELF_PHF_R) ? 'R' : ' ');
-	printf("%c", (flags & ELF_PHF_W) ? 'W' : ' ');
-	printf("%c", (flags & ELF_PHF_X) ? 'X' : ' ');
+static void _pheFlagsDump(FILE *out, uint32_t flags) {
+	fprintf(out, "%c", (flags & ELF_PHF_R) ? 'R' : ' ');
+	fprintf(out, "%c", (flags & ELF_PHF_W) ? 'W' : ' ');
+	fprintf(out, "%c", (flags & ELF_PHF_X) ? 'X' : ' ');
 }
 
-static void _shDump(ELF_SHEntry *sh, int nidx, ELF_Class class, uint16_t num) {
-	printf("* Section Header entries\n");
-	printf("No.   Name             Type                Flags1 Offset\n");
-	printf("      Entry Size       Link Info Align     Flags2 Address");
-	printf(SH_SEP);
+static void _shDump(FILE *out, ELF *elf) {
+	fprintf(out, "* Section Header entries\n");
+	fprintf(out, "No.   Name             Type                Flags1 Offset\n");
+	fprintf(out, "      Entry Size       Link Info Align     Flags2 Address");
+	fprintf(out, SH_SEP);
 
-	char *strtab = sh[nidx].data;
+	const uint32_t NUM = elf->header.sectHeaderEntryNum;
+	if( NUM < SH_PARALLEL_MIN || !_shParallelDump(out, elf) ) {
+		_shRangeDump(out, elf, 0, NUM);
+	}
+
+	fprintf(out, "Flags key:\n");
+	fprintf(out,
+		"W: Write    S: Strings           G: Section group o: OS-specific\n");
+	fprintf(out,
+		"A: Allocate I: Info link         T: TLS           p: "
+		"Processor-specific\n");
+	fprintf(out, "X: Execute  L: Link order        O: Ordered\n");
+	fprintf(out, "M: Merge    N: OS non-conforming E: Exclude\n");
+}
 
-	for( uint16_t i = 0; i < num; ++i ) {
-		printf("%-5" PRIu16 " ", i);
+/* Dumps the section headers from 'first' up to 'end' */
+static void _shRangeDump(FILE *out, ELF *elf, uint32_t first, uint32_t end) {
+	for( uint32_t i = first; i < end; ++i ) {
+		fprintf(out, "%-5" PRIu32 " ", i);
 
-		ELF_SHEntry *she = &sh[i];
-		char *str = &strtab[she->nameIdx];
+		ELF_SHEntry *she = &elf->sh[i];
+		const char *str = elfSectionName(elf, she);
 		if( *str == '\0' ) {
-			printf("No name          ");
+			fprintf(out, "No name          ");
 		} else if( strlen(str) > 13 ) {
-			printf("%.*s... ", 13, str);
+			fprintf(out, "%.*s... ", 13, str);
 		} else {
-			printf("%-17s", str);
+			fprintf(out, "%-17s", str);
 		}
 
-		_sheDump(she, class);
+		_sheDump(out, elf, she);
 	}
+}
 
-	printf("Flags key:\n");
-	printf(
-		"W: Write    S: Strings           G: Section group o: OS-specific\n");
-	printf("A: Allocate I: Info link         T: TLS           p: "
-		   "Processor-specific\n");
-	printf("X: Execute  L: Link order        O: Ordered\n");
-	printf("M: Merge    N: OS non-conforming E: Exclude\n");
+/* Dumps the section headers with one thread per CPU formatting chunks into
+ * memory, while this one writes them out in order, so the output is the same
+ * as a plain dump's. Chunks a thread couldn't format are formatted here
+ *
+ * Returns false, having written nothing, if no thread could be started
+ */
+static bool _shParallelDump(FILE *out, ELF *elf) {
+	const long CPUS = sysconf(_SC_NPROCESSORS_ONLN);
+	const uint32_t NUM = elf->header.sectHeaderEntryNum;
+
+	ShDump dump;
+	dump.elf = elf;
+	dump.chunkNum = (NUM + SH_CHUNK - 1) / SH_CHUNK;
+	dump.next = 0;
+	dump.written = 0;
+
+	/* With a single CPU, formatting on the side only adds copies */
+	if( CPUS < 2 ) {
+		return false;
+	}
+
+	unsigned threads = CPUS;
+	if( threads > dump.chunkNum ) {
+		threads = dump.chunkNum;
+	}
+
+	dump.window = threads * SH_AHEAD;
+	dump.slots = calloc(dump.window, sizeof(*dump.slots));
+	pthread_t *ids = malloc(sizeof(*ids) * threads);
+
+	if( dump.slots == NULL || ids == NULL ) {
+		free(dump.slots);
+		free(ids);
+		return false;
+	}
+
+	pthread_mutex_init(&dump.lock, NULL);
+	pthread_cond_init(&dump.formatted, NULL);
+	pthread_cond_init(&dump.drained, NULL);
+
+	unsigned started = 0;
+	while( started < threads
+		&& pthread_create(&ids[started], NULL, _shChunkThread, &dump) == 0 ) {
+		++started;
+	}
+
+	for( uint32_t c = 0; started > 0 && c < dump.chunkNum; ++c ) {
+		ShChunk *slot = &dump.slots[c % dump.window];
+
+		pthread_mutex_lock(&dump.lock);
+		while( !slot->ready ) {
+			pthread_cond_wait(&dump.formatted, &dump.lock);
+		}
+
+		pthread_mutex_unlock(&dump.lock);
+
+		if( slot->text != NULL ) {
+			fwrite(slot->text, 1, slot->length, out);
+		} else {
+			const uint32_t FIRST = c * SH_CHUNK;
+			_shRangeDump(out, elf, FIRST,
+				NUM - FIRST > SH_CHUNK ? FIRST + SH_CHUNK : NUM);
+		}
+
+		free(slot->text);
+
+		pthread_mutex_lock(&dump.lock);
+		slot->text = NULL;
+		slot->ready = false;
+		++dump.written;
+		pthread_cond_broadcast(&dump.drained);
+		pthread_mutex_unlock(&dump.lock);
+	}
+
+	for( unsigned i = 0; i < started; ++i ) {
+		pthread_join(ids[i], NULL);
+	}
+
+	pthread_cond_destroy(&dump.drained);
+	pthread_cond_destroy(&dump.formatted);
+	pthread_mutex_destroy(&dump.lock);
+	free(dump.slots);
+	free(ids);
+
+	return started > 0;
 }
 
-static void _sheDump(ELF_SHEntry *sh, ELF_Class class) {
-	_sheTypeDump(sh->type);
-	_sheFlagsDumpUpper(sh->flags);
-	_elfAddrDump(class, sh->offset);
+static void *_shChunkThread(void *arg) {
+	ShDump *dump = arg;
+	const uint32_t NUM = dump->elf->header.sectHeaderEntryNum;
+
+	pthread_mutex_lock(&dump->lock);
 
-	printf("\n      ");
+	for( ;; ) {
+		/* A chunk can only be taken once the one before it in its slot has
+		 * been written
+		 */
+		while( dump->next < dump->chunkNum
+			&& dump->next >= dump->written + dump->window ) {
+			pthread_cond_wait(&dump->drained, &dump->lock);
+		}
 
-	printf("%016" PRIu64 " ", sh->entrySize);
-	printf("%04" PRIu32 " ", sh->link);
-	printf("%04" PRIu32 " ", sh->info);
-	printf("%08" PRIu64 "  ", sh->addrAlign);
+		if( dump->next >= dump->chunkNum ) {
+			break;
+		}
+
+		const uint32_t CHUNK = dump->next++;
+		pthread_mutex_unlock(&dump->lock);
+
+		const uint32_t FIRST = CHUNK * SH_CHUNK;
+		char *text = NULL;
+		size_t length = 0;
+
+		FILE *stream = open_memstream(&text, &length);
+		if( stream != NULL ) {
+			_shRangeDump(stream, dump->elf, FIRST,
+				NUM - FIRST > SH_CHUNK ? FIRST + SH_CHUNK : NUM);
+
+			if( fclose(stream) != 0 ) {
+				free(text);
+				text = NULL;
+			}
+		}
 
-	_sheFlagsDumpLower(sh->flags);
-	_elfAddrDump(class, sh->addr);
+		pthread_mutex_lock(&dump->lock);
+
+		ShChunk *slot = &dump->slots[CHUNK % dump->window];
+		slot->text = text;
+		slot->length = length;
+		slot->ready = true;
+		pthread_cond_broadcast(&dump->formatted);
+	}
+
+	pthread_mutex_unlock(&dump->lock);
+	return NULL;
+}
+
+static void _sheDump(FILE *out, ELF *elf, ELF_SHEntry *sh) {
+	const ELF_Class class = elf->header.ident.class;
+
+	_sheTypeDump(out, sh->type);
+	_sheFlagsDumpUpper(out, sh->flags);
+	_elfAddrDump(out, class, sh->offset);
+
+	fprintf(out, "\n      ");
+
+	fprintf(out, "%016" PRIu64 " ", sh->entrySize);
+	fprintf(out, "%04" PRIu32 " ", sh->link);
+	fprintf(out, "%04" PRIu32 " ", sh->info);
+	fprintf(out, "%08" PRIu64 "  ", sh->addrAlign);
+
+	_sheFlagsDumpLower(out, sh->flags);
+	_elfAddrDump(out, class, sh->addr);
 
 	if( sh->type == ELF_SHT_NOTE ) {
-		ELF_Note *note = sh->data;
-		printf(" Note (%s): ", note->name);
-		_elfNoteDescDump(note);
+		ELF_NoteIter iter;
+		elfNotesOfSection(elf, sh, &iter);
+		_elfNotesDump(out, elf, &iter);
 	}
 
-	printf(SH_SEP);
+	fprintf(out, SH_SEP);
 }
 
-static void _sheTypeDump(ELF_SH_Type type) {
+static void _sheTypeDump(FILE *out, ELF_SH_Type type) {
 	switch( type ) {
 		PPADCASE(ELF_SHT_NULL, SHT_PAD, "NULL");
 		PPADCASE(ELF_SHT_PROGBITS, SHT_PAD, "Program data");
@@ -501,6 +855,9 @@ static void _sheTypeDump(ELF_SH_Type type) {
 		PPADCASE(ELF_SHT_GROUP, SHT_PAD, "Section group");
 		PPADCASE(ELF_SHT_SYMTAB_EXT, SHT_PAD, "Ext section indices");
 		PPADCASE(ELF_SHT_RELR, SHT_PAD, "RELR");
+		PPADCASE(ELF_SHT_GNU_VERDEF, SHT_PAD, "Version definitions");
+		PPADCASE(ELF_SHT_GNU_VERNEED, SHT_PAD, "Version needs");
+		PPADCASE(ELF_SHT_GNU_VERSYM, SHT_PAD, "Version symbols");
 	default:
 		if( type >= ELF_SHT_LOOS && type <= ELF_SHT_HIOS ) {
 			PADS(SHT_PAD, "OS");
@@ -509,27 +866,288 @@ static void _sheTypeDump(ELF_SH_Type type) {
 		} else if( type >= ELF_SHT_LOUSER && type <= ELF_SHT_HIUSER ) {
 			PADS(SHT_PAD, "User");
 		} else {
-			printf("Unknown %" PRIu32 " ", type);
+			fprintf(out, "Unknown %" PRIu32 " ", type);
 		}
 	}
 }
 
-static void _sheFlagsDumpUpper(uint64_t flags) {
-	printf("%c", (flags & ELF_SHF_WRITE) ? 'W' : ' ');
-	printf("%c", (flags & ELF_SHF_ALLOC) ? 'A' : ' ');
-	printf("%c", (flags & ELF_SHF_EXEC) ? 'X' : ' ');
-	printf("%c", (flags & ELF_SHF_MERGE) ? 'M' : ' ');
-	printf("%c", (flags & ELF_SHF_STRINGS) ? 'S' : ' ');
-	printf("%c", (flags & ELF_SHF_INFO) ? 'I' : ' ');
-	printf("%c", (flags & ELF_SHF_LINK_ORDER) ? 'L' : ' ');
+static void _sheFlagsDumpUpper(FILE *out, uint64_t flags) {
+	fprintf(out, "%c", (flags & ELF_SHF_WRITE) ? 'W' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_ALLOC) ? 'A' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_EXEC) ? 'X' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_MERGE) ? 'M' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_STRINGS) ? 'S' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_INFO) ? 'I' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_LINK_ORDER) ? 'L' : ' ');
+}
+
+static void _sheFlagsDumpLower(FILE *out, uint64_t flags) {
+	fprintf(out, "%c", (flags & ELF_SHF_OS_NONCONFORMING) ? 'N' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_GROUP) ? 'G' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_TLS) ? 'T' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_ORDERERD) ? 'O' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_EXCLUDE) ? 'E' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_OS) ? 'o' : ' ');
+	fprintf(out, "%c", (flags & ELF_SHF_PROC) ? 'p' : ' ');
+}
+
+/* Dumps the .eh_frame_hdr search table, checking each entry against its FDE
+ * Entries whose FDE is missing or starts elsewhere, out-of-order entries and
+ * overlapping FDEs are flagged, as they all break unwinding
+ */
+static void _unwindDump(FILE *out, ELF *elf) {
+	const ELF_Class CLASS = elf->header.ident.class;
+
+	fprintf(out, "* Unwind table\n");
+
+	ELF_EhFrameHdr hdr;
+	if( !elfEhFrameHdr(elf, &hdr) ) {
+		fprintf(out, "└── No .eh_frame_hdr\n");
+		return;
+	}
+
+	fprintf(out, "├── Header address: ");
+	_elfAddrDump(out, CLASS, hdr.addr);
+	fprintf(out, "\n├── .eh_frame address: ");
+	_elfAddrDump(out, CLASS, hdr.ehFrame);
+	fprintf(out, "\n");
+
+	if( hdr.table == NULL ) {
+		fprintf(out, "└── No usable search table\n");
+		return;
+	}
+
+	fprintf(out,
+		"No.     Initial loc.       FDE                PC range end       "
+		"Augmentation");
+	fprintf(out, UW_SEP);
+
+	uint64_t bad = 0;
+	uint64_t prevEnd = 0;
+	uint64_t prevStart = 0;
+
+	for( uint64_t i = 0; i < hdr.tableNum; ++i ) {
+		uint64_t start;
+		uint64_t addr;
+		elfEhFrameHdrEntry(elf, &hdr, i, &start, &addr);
+
+		fprintf(out, "%-7" PRIu64 " ", i);
+		_elfAddrDump(out, CLASS, start);
+		fprintf(out, " ");
+		_elfAddrDump(out, CLASS, addr);
+		fprintf(out, " ");
+
+		ELF_FDE fde;
+		if( !elfFDEAt(elf, addr, &fde) ) {
+			fprintf(out, "(malformed FDE)\n");
+			++bad;
+			continue;
+		}
+
+		_elfAddrDump(out, CLASS, fde.pcEnd);
+		fprintf(out, " %s", fde.cie.augmentation);
+
+		if( fde.pcBegin != start ) {
+			fprintf(out, " (FDE starts at ");
+			_elfAddrDump(out, CLASS, fde.pcBegin);
+			fprintf(out, ")");
+			++bad;
+		} else if( i > 0 && start < prevStart ) {
+			fprintf(out, " (out of order)");
+			++bad;
+		} else if( i > 0 && start < prevEnd ) {
+			fprintf(out, " (overlaps previous FDE)");
+			++bad;
+		}
+
+		fprintf(out, "\n");
+
+		prevStart = start;
+		prevEnd = fde.pcEnd;
+	}
+
+	fprintf(out, "└── %" PRIu64 " entries, %" PRIu64 " with problems\n",
+		hdr.tableNum, bad);
+}
+
+/* Dumps .dynsym, with each symbol's version appended the way the dynamic
+ * linker spells it: name@@VER for the default version of a definition,
+ * name@VER for a hidden one or a requirement
+ */
+static void _symDump(FILE *out, ELF *elf) {
+	const ELF_Class CLASS = elf->header.ident.class;
+
+	fprintf(out, "* Dynamic symbols\n");
+
+	const ELF_SymTable *TABLE = elfDynamicSymbols(elf);
+	if( TABLE == NULL ) {
+		fprintf(out, "└── Couldn't decode the symbols\n");
+		return;
+	}
+
+	if( TABLE->num == 0 ) {
+		fprintf(out, "└── No .dynsym\n");
+		return;
+	}
+
+	fprintf(out,
+		"No.     Value              Size     Bind   Type    Ndx   Name");
+	fprintf(out, SYM_SEP);
+
+	for( uint32_t i = 0; i < TABLE->num; ++i ) {
+		const ELF_Symbol *SYM = &TABLE->symbols[i];
+
+		fprintf(out, "%-7" PRIu32 " ", i);
+		_elfAddrDump(out, CLASS, SYM->value);
+		if( CLASS == ELF_CLASS_32_BIT ) {
+			fprintf(out, "        ");
+		}
+
+		fprintf(out, " %-8" PRIu64 " ", SYM->size);
+		_symBindDump(out, SYM->info >> 4);
+		_symTypeDump(out, SYM->info & 0xF);
+
+		if( SYM->section == 0 ) {
+			fprintf(out, "UND  ");
+		} else if( SYM->section == 0xFFF1 ) {
+			fprintf(out, "ABS  ");
+		} else {
+			fprintf(out, "%-5" PRIu16, SYM->section);
+		}
+
+		if( *SYM->name != '\0' ) {
+			fprintf(out, " %s", SYM->name);
+		}
+
+		const ELF_SymVersion *VERSION = SYM->version;
+		if( VERSION != NULL && VERSION->libraryId != ELF_INTERN_NONE ) {
+			fprintf(out, "@%s (%s)", elfInternString(VERSION->nameId),
+				elfInternString(VERSION->libraryId));
+		} else if( VERSION != NULL ) {
+			fprintf(out, "%s%s", SYM->hidden ? "@" : "@@",
+				elfInternString(VERSION->nameId));
+		}
+
+		fprintf(out, "\n");
+	}
+
+	_symVersionsDump(out, TABLE);
+}
+
+static void _symBindDump(FILE *out, uint8_t bind) {
+	switch( bind ) {
+		PPADCASE(0, "7", "LOCAL");
+		PPADCASE(1, "7", "GLOBAL");
+		PPADCASE(2, "7", "WEAK");
+		PPADCASE(10, "7", "UNIQUE");
+	default:
+		fprintf(out, "%-7" PRIu8, bind);
+	}
+}
+
+static void _symTypeDump(FILE *out, uint8_t type) {
+	switch( type ) {
+		PPADCASE(0, "8", "NOTYPE");
+		PPADCASE(1, "8", "OBJECT");
+		PPADCASE(2, "8", "FUNC");
+		PPADCASE(3, "8", "SECTION");
+		PPADCASE(4, "8", "FILE");
+		PPADCASE(5, "8", "COMMON");
+		PPADCASE(6, "8", "TLS");
+		PPADCASE(10, "8", "IFUNC");
+	default:
+		fprintf(out, "%-8" PRIu8, type);
+	}
+}
+
+/* Dumps the versions defined by the ELF, then those it requires, grouped by
+ * library (the order .gnu.version_r lists them in)
+ */
+static void _symVersionsDump(FILE *out, const ELF_SymTable *TABLE) {
+	fprintf(out, "├── Version definitions:");
+	if( TABLE->defNum == 0 ) {
+		fprintf(out, " none");
+	}
+
+	for( uint32_t i = 0; i < TABLE->defNum; ++i ) {
+		const ELF_SymVersion *VERSION = &TABLE->versions[i];
+		fprintf(out, "\n│   %-5" PRIu16 " %s", VERSION->index,
+			elfInternString(VERSION->nameId));
+
+		if( VERSION->flags & ELF_VER_FLG_BASE ) {
+			fprintf(out, " (base)");
+		}
+	}
+
+	fprintf(out, "\n└── Version requirements:");
+	if( TABLE->versionNum == TABLE->defNum ) {
+		fprintf(out, " none");
+	}
+
+	uint32_t library = ELF_INTERN_NONE;
+	for( uint32_t i = TABLE->defNum; i < TABLE->versionNum; ++i ) {
+		const ELF_SymVersion *VERSION = &TABLE->versions[i];
+
+		if( VERSION->libraryId != library || i == TABLE->defNum ) {
+			library = VERSION->libraryId;
+			fprintf(out, "\n    %s:",
+				library != ELF_INTERN_NONE ? elfInternString(library) : "?");
+		}
+
+		fprintf(out, " %s", elfInternString(VERSION->nameId));
+		if( VERSION->flags & ELF_VER_FLG_WEAK ) {
+			fprintf(out, " (weak)");
+		}
+	}
+
+	fprintf(out, "\n");
+}
+
+/* Dumps how the loadable segments map to pages of this system, and which of
+ * those pages the loader dirties
+ */
+static void _pagesDump(FILE *out, ELF *elf) {
+	ELF_PageReport report;
+	if( !elfPageFootprint(elf, 0, &report) ) {
+		fprintf(out, "* Page footprint\n");
+		fprintf(out, "└── Couldn't read the relocations\n");
+		return;
+	}
+
+	fprintf(out, "* Page footprint (%" PRIu64 "-byte pages)\n",
+		report.pageSize);
+
+	if( report.num == 0 ) {
+		fprintf(out, "└── No loadable segments\n");
+		return;
+	}
+
+	fprintf(out,
+		"No.   Flags Pages    File     Anon     Shared   Dirty    RELRO    "
+		"Wasted");
+	fprintf(out, PG_SEP);
+
+	for( uint16_t i = 0; i < report.num; ++i ) {
+		fprintf(out, "%-5" PRIu16 " ", report.segments[i].index);
+		_pheFlagsDump(out, report.segments[i].flags);
+		fprintf(out, "   ");
+		_pagesRowDump(out, &report.segments[i]);
+	}
+
+	fprintf(out, "└── Total   ");
+	_pagesRowDump(out, &report.total);
+	fprintf(out, "    %" PRIu64 " bytes mapped, %" PRIu64
+				 " dynamic relocations\n",
+		report.total.pages * report.pageSize, report.relocations);
+
+	elfPageReportFree(&report);
 }
 
-static void _sheFlagsDumpLower(uint64_t flags) {
-	printf("%c", (flags & ELF_SHF_OS_NONCONFORMING) ? 'N' : ' ');
-	printf("%c", (flags & ELF_SHF_GROUP) ? 'G' : ' ');
-	printf("%c", (flags & ELF_SHF_TLS) ? 'T' : ' ');
-	printf("%c", (flags & ELF_SHF_ORDERERD) ? 'O' : ' ');
-	printf("%c", (flags & ELF_SHF_EXCLUDE) ? 'E' : ' ');
-	printf("%c", (flags & ELF_SHF_OS) ? 'o' : ' ');
-	printf("%c", (flags & ELF_SHF_PROC) ? 'p' : ' ');
+static void _pagesRowDump(FILE *out, const ELF_SegmentPages *SEGMENT) {
+	fprintf(out,
+		"%-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64
+		" %-8" PRIu64 " %" PRIu64 "\n",
+		SEGMENT->pages, SEGMENT->filePages, SEGMENT->anonPages,
+		SEGMENT->sharedPages, SEGMENT->dirtyPages, SEGMENT->relroPages,
+		SEGMENT->wasted);
 }
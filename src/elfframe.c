@@ -0,0 +1,405 @@
+/* elfp
+ * Call frame information
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "elfaddr.h"
+#include "elfp.h"
+#include "util.h"
+
+#include "elfframe.h"
+
+/* Reader that knows the virtual address of what it reads */
+typedef struct _Reader {
+	Cursor cursor;
+	const uint8_t *origin; /* Some position in the image... */
+	uint64_t originAddr; /* ...and its virtual address */
+	uint64_t dataBase; /* Base of ELF_EH_PE_DATAREL pointers */
+	unsigned addrSize;
+} Reader;
+
+static bool _reader(ELF *elf, uint64_t offset, uint64_t addr, Reader *reader);
+static bool _readPointer(Reader *reader, uint8_t encoding, uint64_t *value);
+static uint8_t _encodedSize(uint8_t encoding, unsigned addrSize);
+static bool _readRecord(ELF *elf, uint64_t addr, Reader *reader, bool *cie,
+	uint64_t *cieAddr);
+static bool _decodeCIE(ELF *elf, uint64_t addr, ELF_CIE *cie);
+
+bool elfEhFrameHdr(ELF *elf, ELF_EhFrameHdr *hdr) {
+	memset(hdr, 0, sizeof(*hdr));
+
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	bool found = false;
+
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		const ELF_PHEntry *PH = &elf->ph[i];
+		if( PH->type == ELF_PHT_GNU_EH_FRAME ) {
+			offset = PH->offset;
+			size = PH->fileSize;
+			hdr->addr = PH->virtualAddr;
+			found = true;
+			break;
+		}
+	}
+
+	/* Relocatable objects have the section, but no segment */
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+	if( !found && KNOWN != NULL && KNOWN->ehFrameHdr != NULL
+		&& KNOWN->ehFrameHdr->type != ELF_SHT_NOBITS ) {
+		offset = KNOWN->ehFrameHdr->offset;
+		size = KNOWN->ehFrameHdr->size;
+		hdr->addr = KNOWN->ehFrameHdr->addr;
+		found = true;
+	}
+
+	Reader reader;
+	if( !found || !_reader(elf, offset, hdr->addr, &reader)
+		|| size > (uint64_t)(reader.cursor.end - reader.cursor.pos) ) {
+		return false;
+	}
+
+	Cursor *cursor = &reader.cursor;
+	cursor->end = cursor->pos + size;
+	reader.dataBase = hdr->addr;
+
+	const uint8_t VERSION = utilCursorRead(cursor, 1);
+	const uint8_t EH_FRAME_ENCODING = utilCursorRead(cursor, 1);
+	const uint8_t NUM_ENCODING = utilCursorRead(cursor, 1);
+	hdr->tableEncoding = utilCursorRead(cursor, 1);
+
+	if( VERSION != 1 || !cursor->ok
+		|| !_readPointer(&reader, EH_FRAME_ENCODING, &hdr->ehFrame) ) {
+		return false;
+	}
+
+	/* The table is only usable if its entries have a fixed size, and are
+	 * either absolute or relative to the header
+	 */
+	const uint8_t APPLICATION = hdr->tableEncoding & 0x70;
+	hdr->tableEntrySize = 2 * _encodedSize(hdr->tableEncoding, reader.addrSize);
+
+	uint64_t num = 0;
+	if( NUM_ENCODING == ELF_EH_PE_OMIT || hdr->tableEncoding == ELF_EH_PE_OMIT
+		|| !_readPointer(&reader, NUM_ENCODING, &num)
+		|| hdr->tableEntrySize == 0
+		|| (APPLICATION != 0 && APPLICATION != ELF_EH_PE_DATAREL)
+		|| num > (uint64_t)(cursor->end - cursor->pos) / hdr->tableEntrySize ) {
+		return true;
+	}
+
+	hdr->table = cursor->pos;
+	hdr->tableNum = num;
+
+	return true;
+}
+
+bool elfEhFrameHdrEntry(ELF *elf, const ELF_EhFrameHdr *HDR, uint64_t idx,
+	uint64_t *pc, uint64_t *fde) {
+	if( HDR->table == NULL || idx >= HDR->tableNum ) {
+		return false;
+	}
+
+	Reader reader;
+	reader.cursor.pos = HDR->table + idx * HDR->tableEntrySize;
+	reader.cursor.end = reader.cursor.pos + HDR->tableEntrySize;
+	reader.cursor.le
+		= elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	reader.cursor.ok = true;
+	reader.origin = reader.cursor.pos;
+	reader.originAddr = 0; /* PC-relative entries were ruled out */
+	reader.dataBase = HDR->addr;
+	reader.addrSize = elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+
+	return _readPointer(&reader, HDR->tableEncoding, pc)
+		&& _readPointer(&reader, HDR->tableEncoding, fde);
+}
+
+bool elfFDEAt(ELF *elf, uint64_t addr, ELF_FDE *fde) {
+	memset(fde, 0, sizeof(*fde));
+
+	Reader reader;
+	bool isCIE;
+	uint64_t cieAddr;
+
+	if( !_readRecord(elf, addr, &reader, &isCIE, &cieAddr) || isCIE
+		|| !_decodeCIE(elf, cieAddr, &fde->cie) ) {
+		return false;
+	}
+
+	const ELF_CIE *CIE = &fde->cie;
+	fde->addr = addr;
+
+	/* The range has the same format as the address, but is never relative */
+	uint64_t range;
+	if( !_readPointer(&reader, CIE->fdeEncoding, &fde->pcBegin)
+		|| !_readPointer(&reader, CIE->fdeEncoding & 0x0F, &range) ) {
+		return false;
+	}
+
+	fde->pcEnd = fde->pcBegin + range;
+
+	Cursor *cursor = &reader.cursor;
+	if( CIE->augmentation[0] == 'z' ) {
+		const uint64_t LENGTH = utilCursorULEB(cursor);
+		const uint8_t *AUGMENTATION = cursor->pos;
+
+		if( CIE->lsdaEncoding != ELF_EH_PE_OMIT
+			&& !_readPointer(&reader, CIE->lsdaEncoding, &fde->lsda) ) {
+			return false;
+		}
+
+		cursor->pos = AUGMENTATION;
+		utilCursorSkip(cursor, LENGTH);
+	}
+
+	fde->instructions = cursor->pos;
+	fde->instructionsSize = cursor->end - cursor->pos;
+
+	return cursor->ok;
+}
+
+bool elfFindFDE(ELF *elf, uint64_t pc, ELF_FDE *fde) {
+	ELF_EhFrameHdr hdr;
+	if( !elfEhFrameHdr(elf, &hdr) || hdr.table == NULL ) {
+		return false;
+	}
+
+	/* Find the last entry starting at or before 'pc' */
+	uint64_t lo = 0;
+	uint64_t hi = hdr.tableNum;
+
+	while( lo < hi ) {
+		const uint64_t MID = lo + (hi - lo) / 2;
+
+		uint64_t start;
+		uint64_t addr;
+		elfEhFrameHdrEntry(elf, &hdr, MID, &start, &addr);
+
+		if( start <= pc ) {
+			lo = MID + 1;
+		} else {
+			hi = MID;
+		}
+	}
+
+	uint64_t start;
+	uint64_t addr;
+
+	return lo > 0 && elfEhFrameHdrEntry(elf, &hdr, lo - 1, &start, &addr)
+		&& elfFDEAt(elf, addr, fde) && pc >= fde->pcBegin && pc < fde->pcEnd;
+}
+
+/* Sets up a reader from a file offset to the end of the image */
+static bool _reader(ELF *elf, uint64_t offset, uint64_t addr, Reader *reader) {
+	if( offset >= elf->imageSize ) {
+		return false;
+	}
+
+	reader->cursor.pos = (const uint8_t *)elf->image + offset;
+	reader->cursor.end = (const uint8_t *)elf->image + elf->imageSize;
+	reader->cursor.le
+		= elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	reader->cursor.ok = true;
+
+	reader->origin = reader->cursor.pos;
+	reader->originAddr = addr;
+	reader->dataBase = 0;
+	reader->addrSize = elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+
+	return true;
+}
+
+/* Reads a pointer encoded as described by a DW_EH_PE_* value
+ * Indirect pointers aren't followed: the address of their slot is returned
+ */
+static bool _readPointer(Reader *reader, uint8_t encoding, uint64_t *value) {
+	Cursor *cursor = &reader->cursor;
+	const uint64_t ADDR = reader->originAddr + (cursor->pos - reader->origin);
+
+	const uint8_t FORMAT = encoding & 0x0F;
+	switch( FORMAT ) {
+	case ELF_EH_PE_ULEB128:
+		*value = utilCursorULEB(cursor);
+		break;
+	case ELF_EH_PE_SLEB128:
+		*value = utilCursorSLEB(cursor);
+		break;
+	case ELF_EH_PE_SDATA2:
+		*value = (int16_t)utilCursorRead(cursor, 2);
+		break;
+	case ELF_EH_PE_SDATA4:
+		*value = (int32_t)utilCursorRead(cursor, 4);
+		break;
+	default: {
+		const uint8_t SIZE = _encodedSize(encoding, reader->addrSize);
+		if( SIZE == 0 ) {
+			return false;
+		}
+
+		*value = utilCursorRead(cursor, SIZE);
+	} break;
+	}
+
+	switch( encoding & 0x70 ) {
+	case 0:
+		break;
+	case ELF_EH_PE_PCREL:
+		*value += ADDR;
+		break;
+	case ELF_EH_PE_DATAREL:
+		*value += reader->dataBase;
+		break;
+	default:
+		/* Text, function and alignment-relative pointers aren't used on any
+		 * target elfp knows
+		 */
+		return false;
+	}
+
+	if( reader->addrSize == 4 ) {
+		*value &= 0xFFFFFFFF;
+	}
+
+	return cursor->ok;
+}
+
+/* Size of a fixed-size pointer encoding, 0 for variable-size ones */
+static uint8_t _encodedSize(uint8_t encoding, unsigned addrSize) {
+	switch( encoding & 0x0F ) {
+	case ELF_EH_PE_ABSPTR:
+		return addrSize;
+	case ELF_EH_PE_UDATA2:
+	case ELF_EH_PE_SDATA2:
+		return 2;
+	case ELF_EH_PE_UDATA4:
+	case ELF_EH_PE_SDATA4:
+		return 4;
+	case ELF_EH_PE_UDATA8:
+	case ELF_EH_PE_SDATA8:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/* Reads the header of the .eh_frame record at a virtual address
+ * On success, the reader is limited to the record, and placed right after
+ * its CIE pointer (or ID, for a CIE)
+ */
+static bool _readRecord(ELF *elf, uint64_t addr, Reader *reader, bool *cie,
+	uint64_t *cieAddr) {
+	uint64_t offset;
+	if( !elfAddrToOffset(elf, addr, &offset)
+		|| !_reader(elf, offset, addr, reader) ) {
+		return false;
+	}
+
+	Cursor *cursor = &reader->cursor;
+
+	unsigned idSize = 4;
+	uint64_t length = utilCursorRead(cursor, 4);
+	if( length == 0xFFFFFFFF ) {
+		idSize = 8;
+		length = utilCursorRead(cursor, 8);
+	}
+
+	/* A zero length terminates .eh_frame */
+	if( !cursor->ok || length == 0
+		|| length > (uint64_t)(cursor->end - cursor->pos) ) {
+		return false;
+	}
+
+	cursor->end = cursor->pos + length;
+
+	/* An FDE points back to its CIE, relative to where the pointer sits */
+	const uint64_t ID_ADDR
+		= reader->originAddr + (cursor->pos - reader->origin);
+	const uint64_t ID = utilCursorRead(cursor, idSize);
+
+	*cie = ID == 0;
+	*cieAddr = ID_ADDR - ID;
+
+	return cursor->ok;
+}
+
+/* Decodes the CIE at a virtual address */
+static bool _decodeCIE(ELF *elf, uint64_t addr, ELF_CIE *cie) {
+	Reader reader;
+	bool isCIE;
+	uint64_t unused;
+
+	if( !_readRecord(elf, addr, &reader, &isCIE, &unused) || !isCIE ) {
+		return false;
+	}
+
+	Cursor *cursor = &reader.cursor;
+
+	cie->addr = addr;
+	cie->version = utilCursorRead(cursor, 1);
+	cie->augmentation = utilCursorString(cursor);
+	if( cie->augmentation == NULL ) {
+		return false;
+	}
+
+	/* GCC 2's "eh" augmentation carries a pointer nobody uses anymore */
+	if( strstr(cie->augmentation, "eh") != NULL ) {
+		utilCursorSkip(cursor, reader.addrSize);
+	}
+
+	if( cie->version >= 4 ) {
+		reader.addrSize = utilCursorRead(cursor, 1);
+		utilCursorRead(cursor, 1); /* segment_selector_size */
+
+		if( reader.addrSize == 0 || reader.addrSize > 8 ) {
+			return false;
+		}
+	}
+
+	cie->codeAlign = utilCursorULEB(cursor);
+	cie->dataAlign = utilCursorSLEB(cursor);
+	cie->returnReg = cie->version == 1 ? utilCursorRead(cursor, 1)
+									   : utilCursorULEB(cursor);
+
+	cie->fdeEncoding = ELF_EH_PE_ABSPTR;
+	cie->lsdaEncoding = ELF_EH_PE_OMIT;
+	cie->personality = 0;
+	cie->signalFrame = false;
+
+	if( cie->augmentation[0] == 'z' ) {
+		const uint64_t LENGTH = utilCursorULEB(cursor);
+		const uint8_t *AUGMENTATION = cursor->pos;
+
+		for( const char *c = cie->augmentation + 1; *c != '\0'; ++c ) {
+			if( *c == 'L' ) {
+				cie->lsdaEncoding = utilCursorRead(cursor, 1);
+			} else if( *c == 'R' ) {
+				cie->fdeEncoding = utilCursorRead(cursor, 1);
+			} else if( *c == 'P' ) {
+				const uint8_t ENCODING = utilCursorRead(cursor, 1);
+				if( !_readPointer(&reader, ENCODING, &cie->personality) ) {
+					return false;
+				}
+			} else if( *c == 'S' ) {
+				cie->signalFrame = true;
+			} else if( *c != 'B' && *c != 'G' ) {
+				/* The rest can't be made sense of, but the length says
+				 * where it ends
+				 */
+				break;
+			}
+		}
+
+		cursor->pos = AUGMENTATION;
+		utilCursorSkip(cursor, LENGTH);
+	}
+
+	cie->instructions = cursor->pos;
+	cie->instructionsSize = cursor->end - cursor->pos;
+
+	return cursor->ok;
+}
@@ -0,0 +1,139 @@
+/* elfp
+ * Hex dumps
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "elfhex.h"
+
+/* Bytes per line, and per group within a line */
+#define LINE_BYTES 16
+#define GROUP_BYTES 4
+
+static const char DIGITS[] = "0123456789abcdef";
+
+static char *_address(char *at, uint64_t addr);
+static char *_line(char *at, const uint8_t *DATA, size_t size);
+#ifdef __SSE2__
+static char *_lineSSE2(char *at, const uint8_t *DATA);
+#endif
+
+size_t elfHexFormat(
+	char *out, const uint8_t *DATA, size_t size, uint64_t addr) {
+	char *at = out;
+
+	for( size_t done = 0; done < size; done += LINE_BYTES ) {
+		const size_t LEFT = size - done;
+
+		at = _address(at, addr + done);
+
+#ifdef __SSE2__
+		if( LEFT >= LINE_BYTES ) {
+			at = _lineSSE2(at, DATA + done);
+			continue;
+		}
+#endif
+
+		at = _line(at, DATA + done, LEFT < LINE_BYTES ? LEFT : LINE_BYTES);
+	}
+
+	return at - out;
+}
+
+/* Writes "  0x" and an address of at least 8 digits, then a space */
+static char *_address(char *at, uint64_t addr) {
+	unsigned digits = 8;
+	while( digits < 16 && addr >> 4 * digits != 0 ) {
+		++digits;
+	}
+
+	memcpy(at, "  0x", 4);
+	at += 4;
+
+	for( unsigned d = 0; d < digits; ++d ) {
+		at[d] = DIGITS[(addr >> 4 * (digits - 1 - d)) & 0xF];
+	}
+
+	at[digits] = ' ';
+	return at + digits + 1;
+}
+
+/* Writes up to a line's worth of bytes, a byte at a time. Missing bytes are
+ * left blank, so the text of a short last line still lines up
+ */
+static char *_line(char *at, const uint8_t *DATA, size_t size) {
+	for( size_t b = 0; b < LINE_BYTES; ++b ) {
+		if( b < size ) {
+			at[0] = DIGITS[DATA[b] >> 4];
+			at[1] = DIGITS[DATA[b] & 0xF];
+		} else {
+			at[0] = ' ';
+			at[1] = ' ';
+		}
+
+		at += 2;
+		if( b % GROUP_BYTES == GROUP_BYTES - 1 ) {
+			*at++ = ' ';
+		}
+	}
+
+	for( size_t b = 0; b < size; ++b ) {
+		*at++ = DATA[b] >= 0x20 && DATA[b] < 0x7F ? (char)DATA[b] : '.';
+	}
+
+	*at = '\n';
+	return at + 1;
+}
+
+#ifdef __SSE2__
+/* Writes a whole line: each nibble becomes '0' plus itself, plus the gap
+ * between '9' and 'a' if it's above 9, and the high and low nibbles of each
+ * byte are then interleaved into two digits
+ */
+static char *_lineSSE2(char *at, const uint8_t *DATA) {
+	const __m128i BYTES = _mm_loadu_si128((const __m128i *)DATA);
+	const __m128i LOW_NIBBLE = _mm_set1_epi8(0x0F);
+	const __m128i NINE = _mm_set1_epi8(9);
+	const __m128i ZERO = _mm_set1_epi8('0');
+	const __m128i GAP = _mm_set1_epi8('a' - '9' - 1);
+
+	const __m128i HIGH
+		= _mm_and_si128(_mm_srli_epi16(BYTES, 4), LOW_NIBBLE);
+	const __m128i LOW = _mm_and_si128(BYTES, LOW_NIBBLE);
+
+	const __m128i HIGH_DIGITS = _mm_add_epi8(_mm_add_epi8(HIGH, ZERO),
+		_mm_and_si128(_mm_cmpgt_epi8(HIGH, NINE), GAP));
+	const __m128i LOW_DIGITS = _mm_add_epi8(_mm_add_epi8(LOW, ZERO),
+		_mm_and_si128(_mm_cmpgt_epi8(LOW, NINE), GAP));
+
+	char digits[2 * LINE_BYTES];
+	_mm_storeu_si128(
+		(__m128i *)digits, _mm_unpacklo_epi8(HIGH_DIGITS, LOW_DIGITS));
+	_mm_storeu_si128((__m128i *)(digits + LINE_BYTES),
+		_mm_unpackhi_epi8(HIGH_DIGITS, LOW_DIGITS));
+
+	for( unsigned g = 0; g < LINE_BYTES / GROUP_BYTES; ++g ) {
+		memcpy(at, digits + 2 * GROUP_BYTES * g, 2 * GROUP_BYTES);
+		at[2 * GROUP_BYTES] = ' ';
+		at += 2 * GROUP_BYTES + 1;
+	}
+
+	/* Bytes from 0x80 on compare as negative, so they fail the first test */
+	const __m128i PRINTABLE
+		= _mm_and_si128(_mm_cmpgt_epi8(BYTES, _mm_set1_epi8(0x1F)),
+			_mm_cmplt_epi8(BYTES, _mm_set1_epi8(0x7F)));
+	const __m128i TEXT = _mm_or_si128(_mm_and_si128(PRINTABLE, BYTES),
+		_mm_andnot_si128(PRINTABLE, _mm_set1_epi8('.')));
+
+	_mm_storeu_si128((__m128i *)at, TEXT);
+	at[LINE_BYTES] = '\n';
+
+	return at + LINE_BYTES + 1;
+}
+#endif
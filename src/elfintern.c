@@ -0,0 +1,346 @@
+/* elfp
+ * String interning
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#include "elfintern.h"
+
+/* Number of shards, each with its own lock and table
+ * The low bits of an ID say which shard the string lives in
+ */
+#define SHARD_BITS 4
+#define SHARD_NUM (1u << SHARD_BITS)
+
+/* Strings are kept by index in chunks that never move, so looking one up
+ * needs no lock. The first chunk of a shard holds CHUNK_BASE strings, and each
+ * one after that holds twice as many as the one before
+ */
+#define CHUNK_BASE 64
+#define CHUNK_NUM 22
+
+/* Most strings an ID can address in a shard, given its width and the chunks */
+#define SHARD_CAP (CHUNK_BASE * ((1u << CHUNK_NUM) - 1))
+
+/* Strings are carved out of blocks this large, rather than allocated one by
+ * one. Longer strings get a block of their own
+ */
+#define BLOCK_SIZE 65536
+
+/* A block of string data
+ * Blocks are only freed when the whole pool is reset
+ */
+typedef struct _Block {
+	struct _Block *next;
+	size_t used;
+	size_t size;
+	char data[];
+} Block;
+
+typedef struct _Shard {
+	pthread_mutex_t lock;
+
+	/* Strings by hash, with linear probing */
+	uint32_t *slots; /* Index of the string + 1, or 0 if the slot is empty */
+	uint32_t *hashes; /* Hash of the string in each slot */
+	uint32_t mask;
+
+	const char **chunks[CHUNK_NUM]; /* Strings by index */
+	uint32_t num;
+
+	Block *blocks; /* Block strings are currently being carved out of */
+	size_t bytes;
+	size_t footprint; /* Bytes allocated for the shard */
+} Shard;
+
+static Shard _shards[SHARD_NUM];
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+static void _init(void);
+static uint32_t _hash(const char *STRING, size_t length);
+static uint32_t _chunk(uint32_t index, uint32_t *offset);
+static uint32_t _lookup(Shard *shard, uint32_t hash, const char *STRING,
+	size_t length, bool add);
+static const char *_copy(Shard *shard, const char *STRING, size_t length);
+static bool _grow(Shard *shard);
+
+uint32_t elfInternId(const char *STRING, size_t length) {
+	if( length == 0 ) {
+		return ELF_INTERN_NONE;
+	}
+
+	pthread_once(&_once, _init);
+
+	const uint32_t HASH = _hash(STRING, length);
+	Shard *shard = &_shards[HASH & (SHARD_NUM - 1)];
+
+	pthread_mutex_lock(&shard->lock);
+	const uint32_t ID = _lookup(shard, HASH, STRING, length, true);
+	pthread_mutex_unlock(&shard->lock);
+
+	return ID;
+}
+
+uint32_t elfInternFind(const char *STRING, size_t length) {
+	if( length == 0 ) {
+		return ELF_INTERN_NONE;
+	}
+
+	pthread_once(&_once, _init);
+
+	const uint32_t HASH = _hash(STRING, length);
+	Shard *shard = &_shards[HASH & (SHARD_NUM - 1)];
+
+	pthread_mutex_lock(&shard->lock);
+	const uint32_t ID = _lookup(shard, HASH, STRING, length, false);
+	pthread_mutex_unlock(&shard->lock);
+
+	return ID;
+}
+
+/* Whoever handed out the ID already made the string visible to this thread,
+ * so there's nothing to lock
+ */
+const char *elfInternString(uint32_t id) {
+	if( id == ELF_INTERN_NONE ) {
+		return "";
+	}
+
+	Shard *shard = &_shards[id & (SHARD_NUM - 1)];
+
+	uint32_t offset;
+	const uint32_t CHUNK = _chunk((id >> SHARD_BITS) - 1, &offset);
+
+	const char **chunk
+		= __atomic_load_n(&shard->chunks[CHUNK], __ATOMIC_ACQUIRE);
+	return chunk[offset];
+}
+
+void elfInternGetStats(ELF_InternStats *stats) {
+	pthread_once(&_once, _init);
+
+	stats->strings = 0;
+	stats->bytes = 0;
+	stats->footprint = 0;
+
+	for( uint32_t i = 0; i < SHARD_NUM; ++i ) {
+		Shard *shard = &_shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+		stats->strings += shard->num;
+		stats->bytes += shard->bytes;
+		stats->footprint += shard->footprint;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+void elfInternReset(void) {
+	pthread_once(&_once, _init);
+
+	for( uint32_t i = 0; i < SHARD_NUM; ++i ) {
+		Shard *shard = &_shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+
+		for( Block *block = shard->blocks; block != NULL; ) {
+			Block *next = block->next;
+			free(block);
+			block = next;
+		}
+
+		for( uint32_t c = 0; c < CHUNK_NUM; ++c ) {
+			free(shard->chunks[c]);
+			shard->chunks[c] = NULL;
+		}
+
+		free(shard->slots);
+		free(shard->hashes);
+
+		shard->slots = NULL;
+		shard->hashes = NULL;
+		shard->mask = 0;
+		shard->num = 0;
+		shard->blocks = NULL;
+		shard->bytes = 0;
+		shard->footprint = 0;
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+static void _init(void) {
+	for( uint32_t i = 0; i < SHARD_NUM; ++i ) {
+		pthread_mutex_init(&_shards[i].lock, NULL);
+	}
+}
+
+/* FNV-1a hash of a string */
+static uint32_t _hash(const char *STRING, size_t length) {
+	uint32_t hash = 2166136261u;
+	for( size_t i = 0; i < length; ++i ) {
+		hash ^= (unsigned char)STRING[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Returns the chunk the string with an index is kept in, and its offset there
+ * Chunk k starts at index CHUNK_BASE * (2^k - 1)
+ */
+static uint32_t _chunk(uint32_t index, uint32_t *offset) {
+	const uint32_t CHUNK = 31 - __builtin_clz(index / CHUNK_BASE + 1);
+
+	*offset = index - CHUNK_BASE * ((1u << CHUNK) - 1);
+	return CHUNK;
+}
+
+/* Finds a string in a shard, optionally adding it, with the lock held
+ * Returns its ID, or ELF_INTERN_NONE if it's not there (or couldn't be added)
+ */
+static uint32_t _lookup(Shard *shard, uint32_t hash, const char *STRING,
+	size_t length, bool add) {
+	/* Keep the table at most half full. The hash's low bits pick the shard,
+	 * so the slot comes from the bits above them
+	 */
+	if( add && (shard->num + 1) * 2 > shard->mask && !_grow(shard) ) {
+		return ELF_INTERN_NONE;
+	}
+
+	if( shard->slots == NULL ) {
+		return ELF_INTERN_NONE;
+	}
+
+	uint32_t i = (hash >> SHARD_BITS) & shard->mask;
+	for( ; shard->slots[i] != 0; i = (i + 1) & shard->mask ) {
+		uint32_t offset;
+		const uint32_t CHUNK = _chunk(shard->slots[i] - 1, &offset);
+
+		const char *SLOT = shard->chunks[CHUNK][offset];
+		if( shard->hashes[i] == hash && strncmp(SLOT, STRING, length) == 0
+			&& SLOT[length] == '\0' ) {
+			return (shard->slots[i] << SHARD_BITS) | (hash & (SHARD_NUM - 1));
+		}
+	}
+
+	if( !add || shard->num >= SHARD_CAP ) {
+		return ELF_INTERN_NONE;
+	}
+
+	const uint32_t INDEX = shard->num;
+	uint32_t offset;
+	const uint32_t CHUNK = _chunk(INDEX, &offset);
+
+	/* The chunk is published before any ID pointing into it is handed out */
+	if( shard->chunks[CHUNK] == NULL ) {
+		const char **chunk
+			= utilMalloc(sizeof(*chunk) * ((size_t)CHUNK_BASE << CHUNK));
+		if( chunk == NULL ) {
+			return ELF_INTERN_NONE;
+		}
+
+		shard->footprint += sizeof(*chunk) * ((size_t)CHUNK_BASE << CHUNK);
+		__atomic_store_n(&shard->chunks[CHUNK], chunk, __ATOMIC_RELEASE);
+	}
+
+	const char *COPY = _copy(shard, STRING, length);
+	if( COPY == NULL ) {
+		return ELF_INTERN_NONE;
+	}
+
+	shard->chunks[CHUNK][offset] = COPY;
+
+	shard->slots[i] = INDEX + 1;
+	shard->hashes[i] = hash;
+
+	++shard->num;
+	shard->bytes += length + 1;
+
+	return ((INDEX + 1) << SHARD_BITS) | (hash & (SHARD_NUM - 1));
+}
+
+/* Copies a string into a block, with the lock held */
+static const char *_copy(Shard *shard, const char *STRING, size_t length) {
+	Block *block = shard->blocks;
+
+	if( block == NULL || block->size - block->used < length + 1 ) {
+		const size_t SIZE = length + 1 > BLOCK_SIZE ? length + 1 : BLOCK_SIZE;
+
+		Block *fresh = utilMalloc(sizeof(*fresh) + SIZE);
+		if( fresh == NULL ) {
+			return NULL;
+		}
+
+		fresh->used = 0;
+		fresh->size = SIZE;
+		shard->footprint += sizeof(*fresh) + SIZE;
+
+		/* Oversized strings don't take the place of the current block */
+		if( SIZE > BLOCK_SIZE && block != NULL ) {
+			fresh->next = block->next;
+			block->next = fresh;
+		} else {
+			fresh->next = block;
+			shard->blocks = fresh;
+		}
+
+		block = fresh;
+	}
+
+	char *copy = block->data + block->used;
+	memcpy(copy, STRING, length);
+	copy[length] = '\0';
+
+	block->used += length + 1;
+	return copy;
+}
+
+/* Doubles the number of slots of a shard, with the lock held */
+static bool _grow(Shard *shard) {
+	const uint32_t MASK = shard->mask > 0 ? shard->mask * 2 + 1 : 255;
+
+	uint32_t *slots = utilCalloc((size_t)MASK + 1, sizeof(*slots));
+	uint32_t *hashes = utilMalloc(((size_t)MASK + 1) * sizeof(*hashes));
+	if( slots == NULL || hashes == NULL ) {
+		free(slots);
+		free(hashes);
+		return false;
+	}
+
+	for( uint32_t i = 0; shard->slots != NULL && i <= shard->mask; ++i ) {
+		if( shard->slots[i] == 0 ) {
+			continue;
+		}
+
+		uint32_t j = (shard->hashes[i] >> SHARD_BITS) & MASK;
+		while( slots[j] != 0 ) {
+			j = (j + 1) & MASK;
+		}
+
+		slots[j] = shard->slots[i];
+		hashes[j] = shard->hashes[i];
+	}
+
+	/* A slot takes an index and a hash */
+	if( shard->slots != NULL ) {
+		shard->footprint -= ((size_t)shard->mask + 1) * 2 * sizeof(uint32_t);
+	}
+
+	shard->footprint += ((size_t)MASK + 1) * 2 * sizeof(uint32_t);
+
+	free(shard->slots);
+	free(shard->hashes);
+
+	shard->slots = slots;
+	shard->hashes = hashes;
+	shard->mask = MASK;
+
+	return true;
+}
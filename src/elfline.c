@@ -0,0 +1,820 @@
+/* elfp
+ * Source line lookup
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfline.h"
+
+/* Standard opcodes (DW_LNS_*) */
+#define DW_LNS_COPY 1
+#define DW_LNS_ADVANCE_PC 2
+#define DW_LNS_ADVANCE_LINE 3
+#define DW_LNS_SET_FILE 4
+#define DW_LNS_CONST_ADD_PC 8
+#define DW_LNS_FIXED_ADVANCE_PC 9
+
+/* Extended opcodes (DW_LNE_*) */
+#define DW_LNE_END_SEQUENCE 1
+#define DW_LNE_SET_ADDRESS 2
+
+/* Line header entry contents (DW_LNCT_*), DWARF 5 */
+#define DW_LNCT_PATH 1
+#define DW_LNCT_DIRECTORY_INDEX 2
+
+/* Attribute forms (DW_FORM_*) that may appear in a line header */
+#define DW_FORM_BLOCK2 0x03
+#define DW_FORM_BLOCK4 0x04
+#define DW_FORM_DATA2 0x05
+#define DW_FORM_DATA4 0x06
+#define DW_FORM_DATA8 0x07
+#define DW_FORM_STRING 0x08
+#define DW_FORM_BLOCK 0x09
+#define DW_FORM_BLOCK1 0x0A
+#define DW_FORM_DATA1 0x0B
+#define DW_FORM_SDATA 0x0D
+#define DW_FORM_STRP 0x0E
+#define DW_FORM_UDATA 0x0F
+#define DW_FORM_DATA16 0x1E
+#define DW_FORM_LINE_STRP 0x1F
+
+/* A row, while the table is being built */
+typedef struct _Row {
+	uint64_t addr;
+	uint32_t line;
+	uint32_t file;
+	uint32_t order; /* Position in .debug_line, to keep sorting stable */
+} Row;
+
+typedef struct _Builder {
+	Row *rows;
+	uint32_t num;
+	uint32_t cap;
+
+	char **files;
+	uint32_t fileNum;
+	uint32_t fileCap;
+
+	/* Paths already in 'files', with linear probing */
+	uint32_t *slots; /* File index + 1, or 0 if the slot is empty */
+	uint32_t mask;
+
+	bool relocatable; /* Whether address 0 is a real address */
+	bool ok; /* Cleared when running out of memory */
+} Builder;
+
+/* Where DW_FORM_line_strp and DW_FORM_strp offsets point to */
+typedef struct _Strings {
+	Cursor lineStr; /* .debug_line_str */
+	Cursor str; /* .debug_str */
+} Strings;
+
+/* What a unit's header says about its line program */
+typedef struct _Header {
+	unsigned addrSize;
+	uint8_t minInstLength;
+	int8_t lineBase;
+	uint8_t lineRange;
+	uint8_t opcodeBase;
+	const uint8_t *opcodeLengths; /* Operand count of each standard opcode */
+
+	const char **dirs;
+	uint32_t dirNum;
+
+	uint32_t *files; /* Index into the builder's files */
+	uint32_t fileNum;
+	uint32_t fileBase; /* Number of the first file: 1 before DWARF 5 */
+} Header;
+
+static bool _sectionCursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor);
+static const char *_stringAt(const Cursor *SECTION, uint64_t offset);
+
+static bool _decodeUnit(Builder *builder, Cursor *cursor,
+	const Strings *STRINGS, unsigned addrSize);
+static bool _decodeEntries(Builder *builder, Header *header, Cursor *cursor,
+	const Strings *STRINGS, bool dwarf64, bool dirs);
+static bool _readForm(Cursor *cursor, uint64_t form, bool dwarf64,
+	const Strings *STRINGS, const char **string, uint64_t *value);
+static void _decodeProgram(
+	Builder *builder, const Header *HEADER, Cursor *cursor);
+
+static bool _grow(void *array, uint32_t num, uint32_t *cap, size_t size);
+static uint32_t _addFile(
+	Builder *builder, const char *DIR, const char *NAME);
+static void _addRow(Builder *builder, uint64_t addr, uint32_t line,
+	uint32_t file);
+static int _compareRows(const void *A, const void *B);
+static uint32_t _hashPath(const char *PATH);
+
+static bool _find(const ELF_LineTable *TABLE, uint64_t addr,
+	ELF_LineInfo *info, uint32_t *hint);
+
+bool elfAddrToLine(ELF *elf, uint64_t addr, ELF_LineInfo *info) {
+	info->file = NULL;
+	info->line = 0;
+
+	if( elf->lineTable == NULL && !elfLineTableBuild(elf) ) {
+		return false;
+	}
+
+	uint32_t hint = UINT32_MAX;
+	return _find(elf->lineTable, addr, info, &hint);
+}
+
+size_t elfAddrToLineBatch(
+	ELF *elf, const uint64_t *ADDRS, ELF_LineInfo *infos, size_t num) {
+	for( size_t i = 0; i < num; ++i ) {
+		infos[i].file = NULL;
+		infos[i].line = 0;
+	}
+
+	if( elf->lineTable == NULL && !elfLineTableBuild(elf) ) {
+		return 0;
+	}
+
+	uint32_t hint = UINT32_MAX;
+	size_t found = 0;
+
+	for( size_t i = 0; i < num; ++i ) {
+		found += _find(elf->lineTable, ADDRS[i], &infos[i], &hint);
+	}
+
+	return found;
+}
+
+void elfLineTableFree(ELF_LineTable *table) {
+	if( table == NULL ) {
+		return;
+	}
+
+	for( uint32_t i = 0; i < table->fileNum; ++i ) {
+		free(table->files[i]);
+	}
+
+	free(table->files);
+	free(table->addr);
+	free(table->line);
+	free(table->file);
+	free(table);
+}
+
+/* Decodes every line program, then sorts and splits the rows */
+bool elfLineTableBuild(ELF *elf) {
+	if( elf->lineTable != NULL ) {
+		return true;
+	}
+
+	ELF_LineTable *table = utilCalloc(1, sizeof(*table));
+	if( table == NULL ) {
+		return false;
+	}
+
+	Builder builder;
+	memset(&builder, 0, sizeof(builder));
+	builder.relocatable = elf->header.type == ELF_ET_RELOCATABLE;
+	builder.ok = true;
+	builder.mask = 255;
+	builder.slots = utilCalloc(builder.mask + 1, sizeof(*builder.slots));
+	if( builder.slots == NULL ) {
+		free(table);
+		return false;
+	}
+
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+
+	Cursor cursor;
+	Strings strings;
+	if( KNOWN != NULL && _sectionCursor(elf, KNOWN->debugLine, &cursor) ) {
+		_sectionCursor(
+			elf, elfFindSection(elf, ".debug_line_str"), &strings.lineStr);
+		_sectionCursor(elf, elfFindSection(elf, ".debug_str"), &strings.str);
+
+		/* Address size of units before DWARF 5, which don't record it */
+		const unsigned ADDR_SIZE
+			= elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+
+		while( builder.ok && cursor.pos < cursor.end
+			&& _decodeUnit(&builder, &cursor, &strings, ADDR_SIZE) ) {
+		}
+	}
+
+	free(builder.slots);
+
+	if( builder.num > 0 ) {
+		qsort(builder.rows, builder.num, sizeof(*builder.rows), _compareRows);
+	}
+
+	/* Of the rows sharing an address, only the last one covers anything */
+	uint32_t kept = 0;
+	for( uint32_t i = 0; i < builder.num; ++i ) {
+		if( i + 1 < builder.num
+			&& builder.rows[i + 1].addr == builder.rows[i].addr ) {
+			continue;
+		}
+
+		builder.rows[kept++] = builder.rows[i];
+	}
+
+	const size_t NUM = kept > 0 ? kept : 1;
+
+	table->addr = utilMalloc(sizeof(*table->addr) * NUM);
+	table->line = utilMalloc(sizeof(*table->line) * NUM);
+	table->file = utilMalloc(sizeof(*table->file) * NUM);
+	table->files = builder.files;
+	table->fileNum = builder.fileNum;
+
+	if( !builder.ok || table->addr == NULL || table->line == NULL
+		|| table->file == NULL ) {
+		free(builder.rows);
+		elfLineTableFree(table);
+		return false;
+	}
+
+	for( uint32_t i = 0; i < kept; ++i ) {
+		table->addr[i] = builder.rows[i].addr;
+		table->line[i] = builder.rows[i].line;
+		table->file[i] = builder.rows[i].file;
+	}
+
+	table->num = kept;
+	free(builder.rows);
+
+	elf->lineTable = table;
+	return true;
+}
+
+/* Points a cursor at a section's contents
+ * Returns false, leaving the cursor empty, if there's nothing to read
+ */
+static bool _sectionCursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor) {
+	cursor->pos = NULL;
+	cursor->end = NULL;
+	cursor->le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor->ok = true;
+
+	if( SH == NULL || SH->type == ELF_SHT_NOBITS
+		|| (SH->flags & ELF_SHF_COMPRESSED) || SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		return false;
+	}
+
+	cursor->pos = (const uint8_t *)elf->image + SH->offset;
+	cursor->end = cursor->pos + SH->size;
+
+	return SH->size > 0;
+}
+
+/* Returns the NUL-terminated string at an offset of a section, if it's there */
+static const char *_stringAt(const Cursor *SECTION, uint64_t offset) {
+	if( SECTION->pos == NULL
+		|| offset >= (uint64_t)(SECTION->end - SECTION->pos) ) {
+		return NULL;
+	}
+
+	Cursor cursor = *SECTION;
+	cursor.pos += offset;
+
+	return utilCursorString(&cursor);
+}
+
+/* Decodes the unit at the cursor, moving it to the next one
+ * Returns false when the units can't be walked any further
+ */
+static bool _decodeUnit(Builder *builder, Cursor *cursor,
+	const Strings *STRINGS, unsigned addrSize) {
+	bool dwarf64 = false;
+
+	uint64_t length = utilCursorRead(cursor, 4);
+	if( length == 0xFFFFFFFF ) {
+		dwarf64 = true;
+		length = utilCursorRead(cursor, 8);
+	}
+
+	if( !cursor->ok || length > (uint64_t)(cursor->end - cursor->pos) ) {
+		return false;
+	}
+
+	Cursor unit = *cursor;
+	unit.end = unit.pos + length;
+	cursor->pos = unit.end;
+
+	/* Units that can't be decoded are skipped, since their length is known */
+	const uint16_t VERSION = utilCursorRead(&unit, 2);
+	if( VERSION < 2 || VERSION > 5 ) {
+		return true;
+	}
+
+	if( VERSION >= 5 ) {
+		addrSize = utilCursorRead(&unit, 1);
+		utilCursorRead(&unit, 1); /* segment_selector_size */
+	}
+
+	const uint64_t HEADER_LENGTH = utilCursorRead(&unit, dwarf64 ? 8 : 4);
+	if( !unit.ok || HEADER_LENGTH > (uint64_t)(unit.end - unit.pos) ) {
+		return true;
+	}
+
+	Cursor program = unit;
+	program.pos += HEADER_LENGTH;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	header.addrSize = addrSize;
+
+	header.minInstLength = utilCursorRead(&unit, 1);
+	if( VERSION >= 4 ) {
+		utilCursorRead(&unit, 1); /* maximum_operations_per_instruction */
+	}
+
+	utilCursorRead(&unit, 1); /* default_is_stmt */
+	header.lineBase = (int8_t)utilCursorRead(&unit, 1);
+	header.lineRange = utilCursorRead(&unit, 1);
+	header.opcodeBase = utilCursorRead(&unit, 1);
+
+	header.opcodeLengths = unit.pos;
+	utilCursorSkip(&unit, header.opcodeBase > 0 ? header.opcodeBase - 1 : 0);
+
+	if( !unit.ok || header.lineRange == 0 || addrSize == 0 || addrSize > 8 ) {
+		return true;
+	}
+
+	bool ok;
+	if( VERSION >= 5 ) {
+		ok = _decodeEntries(builder, &header, &unit, STRINGS, dwarf64, true)
+			&& _decodeEntries(builder, &header, &unit, STRINGS, dwarf64, false);
+	} else {
+		/* Directory 0 is the compilation directory, which only .debug_info
+		 * knows about, so those paths are left relative
+		 */
+		header.fileBase = 1;
+
+		uint32_t dirCap = 0;
+		ok = _grow(&header.dirs, header.dirNum, &dirCap, sizeof(char *));
+		if( ok ) {
+			header.dirs[header.dirNum++] = "";
+		}
+
+		const char *dir;
+		while( ok && (dir = utilCursorString(&unit)) != NULL && *dir != '\0' ) {
+			ok = _grow(&header.dirs, header.dirNum, &dirCap, sizeof(dir));
+			if( ok ) {
+				header.dirs[header.dirNum++] = dir;
+			}
+		}
+
+		uint32_t fileCap = 0;
+		const char *name;
+		while( ok && (name = utilCursorString(&unit)) != NULL
+			&& *name != '\0' ) {
+			const uint64_t DIR = utilCursorULEB(&unit);
+			utilCursorULEB(&unit); /* Modification time */
+			utilCursorULEB(&unit); /* Length */
+
+			ok = _grow(
+				&header.files, header.fileNum, &fileCap, sizeof(uint32_t));
+			if( ok ) {
+				header.files[header.fileNum++] = _addFile(builder,
+					DIR < header.dirNum ? header.dirs[DIR] : "", name);
+			}
+		}
+	}
+
+	if( ok && unit.ok ) {
+		_decodeProgram(builder, &header, &program);
+	}
+
+	builder->ok &= ok;
+
+	free(header.dirs);
+	free(header.files);
+
+	return true;
+}
+
+/* Decodes a DWARF 5 directory or file name table */
+static bool _decodeEntries(Builder *builder, Header *header, Cursor *cursor,
+	const Strings *STRINGS, bool dwarf64, bool dirs) {
+	uint64_t types[256];
+	uint64_t forms[256];
+
+	const uint8_t FORMAT_NUM = utilCursorRead(cursor, 1);
+	for( uint8_t i = 0; i < FORMAT_NUM; ++i ) {
+		types[i] = utilCursorULEB(cursor);
+		forms[i] = utilCursorULEB(cursor);
+	}
+
+	const uint64_t NUM = utilCursorULEB(cursor);
+
+	/* Every entry takes up at least a byte */
+	if( !cursor->ok || NUM > (uint64_t)(cursor->end - cursor->pos) ) {
+		cursor->ok = false;
+		return true;
+	}
+
+	uint32_t cap = 0;
+	for( uint64_t i = 0; i < NUM && cursor->ok; ++i ) {
+		const char *path = NULL;
+		uint64_t dir = 0;
+
+		for( uint8_t j = 0; j < FORMAT_NUM; ++j ) {
+			const char *string = NULL;
+			uint64_t value = 0;
+
+			if( !_readForm(
+					cursor, forms[j], dwarf64, STRINGS, &string, &value) ) {
+				cursor->ok = false;
+				return true;
+			}
+
+			if( types[j] == DW_LNCT_PATH ) {
+				path = string;
+			} else if( types[j] == DW_LNCT_DIRECTORY_INDEX ) {
+				dir = value;
+			}
+		}
+
+		if( path == NULL ) {
+			path = "";
+		}
+
+		if( dirs ) {
+			if( !_grow(&header->dirs, header->dirNum, &cap, sizeof(path)) ) {
+				return false;
+			}
+
+			header->dirs[header->dirNum++] = path;
+		} else {
+			if( !_grow(&header->files, header->fileNum, &cap,
+					sizeof(uint32_t)) ) {
+				return false;
+			}
+
+			header->files[header->fileNum++] = _addFile(
+				builder, dir < header->dirNum ? header->dirs[dir] : "", path);
+		}
+	}
+
+	return true;
+}
+
+/* Reads an attribute of a line header entry
+ * Returns false for forms a line header has no business using
+ */
+static bool _readForm(Cursor *cursor, uint64_t form, bool dwarf64,
+	const Strings *STRINGS, const char **string, uint64_t *value) {
+	switch( form ) {
+	case DW_FORM_STRING:
+		*string = utilCursorString(cursor);
+		break;
+	case DW_FORM_LINE_STRP:
+		*string = _stringAt(
+			&STRINGS->lineStr, utilCursorRead(cursor, dwarf64 ? 8 : 4));
+		break;
+	case DW_FORM_STRP:
+		*string = _stringAt(
+			&STRINGS->str, utilCursorRead(cursor, dwarf64 ? 8 : 4));
+		break;
+	case DW_FORM_DATA1:
+		*value = utilCursorRead(cursor, 1);
+		break;
+	case DW_FORM_DATA2:
+		*value = utilCursorRead(cursor, 2);
+		break;
+	case DW_FORM_DATA4:
+		*value = utilCursorRead(cursor, 4);
+		break;
+	case DW_FORM_DATA8:
+		*value = utilCursorRead(cursor, 8);
+		break;
+	case DW_FORM_UDATA:
+		*value = utilCursorULEB(cursor);
+		break;
+	case DW_FORM_SDATA:
+		*value = utilCursorSLEB(cursor);
+		break;
+	case DW_FORM_DATA16:
+		utilCursorSkip(cursor, 16);
+		break;
+	case DW_FORM_BLOCK:
+		utilCursorSkip(cursor, utilCursorULEB(cursor));
+		break;
+	case DW_FORM_BLOCK1:
+		utilCursorSkip(cursor, utilCursorRead(cursor, 1));
+		break;
+	case DW_FORM_BLOCK2:
+		utilCursorSkip(cursor, utilCursorRead(cursor, 2));
+		break;
+	case DW_FORM_BLOCK4:
+		utilCursorSkip(cursor, utilCursorRead(cursor, 4));
+		break;
+	default:
+		return false;
+	}
+
+	return cursor->ok;
+}
+
+/* Runs a line program, adding a row for each one it emits
+ * VLIW operation indices aren't tracked: every instruction is assumed to hold
+ * a single operation
+ */
+static void _decodeProgram(
+	Builder *builder, const Header *HEADER, Cursor *cursor) {
+	const uint8_t OPCODE_BASE = HEADER->opcodeBase;
+	const uint8_t LINE_RANGE = HEADER->lineRange;
+	const uint8_t MIN_INST_LENGTH = HEADER->minInstLength;
+
+	/* Index of '??' in the builder's files, for file numbers out of range */
+	const uint32_t UNKNOWN = _addFile(builder, "", "??");
+
+	/* Addresses the linker gives to code it discarded: -2 (or -1) */
+	const uint64_t TOMBSTONE = HEADER->addrSize >= 8
+		? UINT64_MAX - 1
+		: ((uint64_t)1 << (8 * HEADER->addrSize)) - 2;
+
+	uint64_t addr = 0;
+	uint64_t file = 1;
+	int64_t line = 1;
+	uint32_t sequence = builder->num; /* First row of the current sequence */
+
+	while( cursor->ok && cursor->pos < cursor->end && builder->ok ) {
+		const uint8_t OPCODE = utilCursorRead(cursor, 1);
+		bool emit = false;
+
+		if( OPCODE >= OPCODE_BASE ) {
+			const uint8_t ADJUSTED = OPCODE - OPCODE_BASE;
+			addr += (uint64_t)(ADJUSTED / LINE_RANGE) * MIN_INST_LENGTH;
+			line += HEADER->lineBase + ADJUSTED % LINE_RANGE;
+			emit = true;
+		} else if( OPCODE == 0 ) {
+			const uint64_t LENGTH = utilCursorULEB(cursor);
+			if( LENGTH == 0
+				|| LENGTH > (uint64_t)(cursor->end - cursor->pos) ) {
+				return;
+			}
+
+			Cursor op = *cursor;
+			op.end = op.pos + LENGTH;
+			cursor->pos = op.end;
+
+			switch( utilCursorRead(&op, 1) ) {
+			case DW_LNE_END_SEQUENCE: {
+				const uint64_t START = sequence < builder->num
+					? builder->rows[sequence].addr
+					: 0;
+
+				/* Drop sequences of discarded code, so they don't shadow the
+				 * code that really sits at their addresses
+				 */
+				if( START >= TOMBSTONE
+					|| (START == 0 && !builder->relocatable) ) {
+					builder->num = sequence;
+				} else {
+					/* Rows at the very end cover nothing, and must not outlive
+					 * the end of the sequence when sorting
+					 */
+					while( builder->num > sequence
+						&& builder->rows[builder->num - 1].addr >= addr ) {
+						--builder->num;
+					}
+
+					_addRow(builder, addr, 0, 0);
+				}
+
+				addr = 0;
+				file = 1;
+				line = 1;
+				sequence = builder->num;
+			} break;
+			case DW_LNE_SET_ADDRESS:
+				addr = utilCursorRead(&op, LENGTH - 1 <= 8 ? LENGTH - 1 : 8);
+				break;
+			default:
+				/* DW_LNE_define_file is long gone, and nobody emits it */
+				break;
+			}
+		} else if( OPCODE == DW_LNS_COPY ) {
+			emit = true;
+		} else if( OPCODE == DW_LNS_ADVANCE_PC ) {
+			addr += utilCursorULEB(cursor) * MIN_INST_LENGTH;
+		} else if( OPCODE == DW_LNS_ADVANCE_LINE ) {
+			line += utilCursorSLEB(cursor);
+		} else if( OPCODE == DW_LNS_SET_FILE ) {
+			file = utilCursorULEB(cursor);
+		} else if( OPCODE == DW_LNS_CONST_ADD_PC ) {
+			addr += (uint64_t)((255 - OPCODE_BASE) / LINE_RANGE)
+				* MIN_INST_LENGTH;
+		} else if( OPCODE == DW_LNS_FIXED_ADVANCE_PC ) {
+			addr += utilCursorRead(cursor, 2);
+		} else {
+			/* Skip the operands of opcodes that don't affect the table */
+			for( uint8_t i = 0; i < HEADER->opcodeLengths[OPCODE - 1]; ++i ) {
+				utilCursorULEB(cursor);
+			}
+		}
+
+		/* Rows without a line (0) cover nothing, like sequence ends */
+		if( emit ) {
+			const uint64_t IDX = file - HEADER->fileBase;
+			_addRow(builder, addr, line > 0 && line <= UINT32_MAX ? line : 0,
+				file >= HEADER->fileBase && IDX < HEADER->fileNum
+					? HEADER->files[IDX]
+					: UNKNOWN);
+		}
+	}
+
+	/* A sequence that never ended covers nothing */
+	builder->num = sequence;
+}
+
+/* Makes room for one more element in a growable array */
+static bool _grow(void *array, uint32_t num, uint32_t *cap, size_t size) {
+	if( num < *cap ) {
+		return true;
+	}
+
+	void **items = array;
+	const uint32_t CAP = *cap > 0 ? *cap * 2 : 16;
+
+	void *grown = utilRealloc(*items, size * CAP);
+	if( grown == NULL ) {
+		return false;
+	}
+
+	*items = grown;
+	*cap = CAP;
+
+	return true;
+}
+
+/* Adds a file's path to the table, unless it's already there
+ * Returns its index in the table
+ */
+static uint32_t _addFile(Builder *builder, const char *DIR, const char *NAME) {
+	if( DIR == NULL ) {
+		DIR = "";
+	}
+
+	if( NAME == NULL ) {
+		NAME = "??";
+	}
+
+	const bool JOIN = *DIR != '\0' && *NAME != '/';
+	const size_t DIR_LEN = JOIN ? strlen(DIR) : 0;
+	const size_t NAME_LEN = strlen(NAME);
+
+	char *path = utilMalloc(DIR_LEN + NAME_LEN + 2);
+	if( path == NULL ) {
+		builder->ok = false;
+		return 0;
+	}
+
+	if( JOIN ) {
+		memcpy(path, DIR, DIR_LEN);
+		path[DIR_LEN] = '/';
+	}
+
+	memcpy(path + DIR_LEN + JOIN, NAME, NAME_LEN + 1);
+
+	uint32_t i = _hashPath(path) & builder->mask;
+	for( ; builder->slots[i] != 0; i = (i + 1) & builder->mask ) {
+		const uint32_t IDX = builder->slots[i] - 1;
+		if( strcmp(builder->files[IDX], path) == 0 ) {
+			free(path);
+			return IDX;
+		}
+	}
+
+	if( !_grow(&builder->files, builder->fileNum, &builder->fileCap,
+			sizeof(*builder->files)) ) {
+		free(path);
+		builder->ok = false;
+		return 0;
+	}
+
+	const uint32_t IDX = builder->fileNum++;
+	builder->files[IDX] = path;
+	builder->slots[i] = IDX + 1;
+
+	/* Keep the index at most half full */
+	if( builder->fileNum * 2 > builder->mask ) {
+		const uint32_t MASK = builder->mask * 2 + 1;
+
+		uint32_t *slots = utilCalloc(MASK + 1, sizeof(*slots));
+		if( slots == NULL ) {
+			builder->ok = false;
+			return IDX;
+		}
+
+		for( uint32_t j = 0; j < builder->fileNum; ++j ) {
+			uint32_t k = _hashPath(builder->files[j]) & MASK;
+			while( slots[k] != 0 ) {
+				k = (k + 1) & MASK;
+			}
+
+			slots[k] = j + 1;
+		}
+
+		free(builder->slots);
+		builder->slots = slots;
+		builder->mask = MASK;
+	}
+
+	return IDX;
+}
+
+static void _addRow(
+	Builder *builder, uint64_t addr, uint32_t line, uint32_t file) {
+	if( builder->num == UINT32_MAX
+		|| !_grow(&builder->rows, builder->num, &builder->cap,
+			sizeof(*builder->rows)) ) {
+		builder->ok = false;
+		return;
+	}
+
+	Row *row = &builder->rows[builder->num];
+	row->addr = addr;
+	row->line = line;
+	row->file = file;
+	row->order = builder->num++;
+}
+
+/* Orders rows by address, then by position in .debug_line
+ * At equal addresses, a sequence's end comes before the start of the next
+ */
+static int _compareRows(const void *A, const void *B) {
+	const Row *ROW_A = A;
+	const Row *ROW_B = B;
+
+	if( ROW_A->addr != ROW_B->addr ) {
+		return ROW_A->addr < ROW_B->addr ? -1 : 1;
+	}
+
+	const bool END_A = ROW_A->line == 0;
+	const bool END_B = ROW_B->line == 0;
+	if( END_A != END_B ) {
+		return END_A ? -1 : 1;
+	}
+
+	return ROW_A->order < ROW_B->order ? -1 : ROW_A->order > ROW_B->order;
+}
+
+/* FNV-1a hash of a path */
+static uint32_t _hashPath(const char *PATH) {
+	uint32_t hash = 2166136261u;
+	for( ; *PATH != '\0'; ++PATH ) {
+		hash ^= (unsigned char)*PATH;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Finds the row covering an address
+ * 'hint' is the row the previous lookup landed on, or UINT32_MAX
+ */
+static bool _find(const ELF_LineTable *TABLE, uint64_t addr,
+	ELF_LineInfo *info, uint32_t *hint) {
+	uint32_t i = *hint;
+
+	/* Consecutive lookups tend to land on the same row */
+	if( i >= TABLE->num || addr < TABLE->addr[i]
+		|| (i + 1 < TABLE->num && addr >= TABLE->addr[i + 1]) ) {
+		/* Find the last row starting at or before 'addr' */
+		uint32_t lo = 0;
+		uint32_t hi = TABLE->num;
+
+		while( lo < hi ) {
+			const uint32_t MID = lo + (hi - lo) / 2;
+			if( TABLE->addr[MID] <= addr ) {
+				lo = MID + 1;
+			} else {
+				hi = MID;
+			}
+		}
+
+		if( lo == 0 ) {
+			return false;
+		}
+
+		i = lo - 1;
+	}
+
+	*hint = i;
+
+	if( TABLE->line[i] == 0 ) {
+		return false;
+	}
+
+	info->file = TABLE->files[TABLE->file[i]];
+	info->line = TABLE->line[i];
+
+	return true;
+}
@@ -0,0 +1,264 @@
+/* elfp
+ * Notes
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+
+#include "elfp.h"
+
+#include "elfnote.h"
+
+/* Size of a note's namesz, descsz and type fields */
+#define NOTE_HEADER_SIZE 12
+
+/* Property types, generic then processor-specific (whose meaning depends on
+ * the machine)
+ */
+#define GNU_PROPERTY_AARCH64_FEATURE_1_AND 0xC0000000u
+#define GNU_PROPERTY_X86_FEATURE_1_AND 0xC0000002u
+#define GNU_PROPERTY_X86_ISA_1_NEEDED 0xC0008002u
+#define GNU_PROPERTY_X86_ISA_1_USED 0xC0010002u
+
+static bool _addNotes(
+	ELF *elf, ELF_NoteIter *iter, ELF_GnuProperties *properties);
+static uint64_t _alignUp(uint64_t value, uint32_t align);
+static uint32_t _propertyBits(
+	Cursor *cursor, uint32_t size, uint32_t *present, uint32_t bit);
+
+void elfNotesAt(ELF *elf, uint64_t offset, uint64_t size, uint64_t align,
+	ELF_NoteIter *iter) {
+	iter->offset = offset;
+	iter->align = align == 8 ? 8 : 4;
+	iter->truncated = false;
+
+	iter->cursor.le
+		= elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	iter->cursor.ok = true;
+
+	/* Notes that don't fit in the file read as none at all */
+	if( offset > elf->imageSize || size > elf->imageSize - offset ) {
+		iter->truncated = true;
+		size = 0;
+		offset = 0;
+	}
+
+	iter->cursor.pos = (const uint8_t *)elf->image + offset;
+	iter->cursor.end = iter->cursor.pos + size;
+}
+
+void elfNotesOfSegment(ELF *elf, const ELF_PHEntry *PH, ELF_NoteIter *iter) {
+	elfNotesAt(elf, PH->offset, PH->fileSize, PH->align, iter);
+}
+
+void elfNotesOfSection(ELF *elf, const ELF_SHEntry *SH, ELF_NoteIter *iter) {
+	elfNotesAt(elf, SH->offset, SH->type == ELF_SHT_NOBITS ? 0 : SH->size,
+		SH->addrAlign, iter);
+}
+
+bool elfNoteNext(ELF_NoteIter *iter, ELF_NoteRef *note) {
+	Cursor *cursor = &iter->cursor;
+	const uint64_t LEFT = cursor->end - cursor->pos;
+
+	if( LEFT == 0 ) {
+		return false;
+	}
+
+	const uint8_t *START = cursor->pos;
+	note->namesz = utilCursorRead(cursor, 4);
+	note->descsz = utilCursorRead(cursor, 4);
+	note->type = utilCursorRead(cursor, 4);
+
+	/* The name follows the header, the descriptor follows the name, and the
+	 * next note follows the descriptor, each starting on the alignment
+	 */
+	const uint64_t DESC_AT
+		= _alignUp(NOTE_HEADER_SIZE + (uint64_t)note->namesz, iter->align);
+	const uint64_t END = DESC_AT + note->descsz;
+
+	if( !cursor->ok || END > LEFT ) {
+		iter->truncated = true;
+		cursor->pos = cursor->end;
+		return false;
+	}
+
+	note->name = (const char *)START + NOTE_HEADER_SIZE;
+	note->desc = START + DESC_AT;
+	note->offset = iter->offset;
+
+	/* Padding after the last descriptor may be missing */
+	const uint64_t NEXT = _alignUp(END, iter->align);
+	const uint64_t STEP = NEXT < LEFT ? NEXT : LEFT;
+
+	cursor->pos = START + STEP;
+	iter->offset += STEP;
+	return true;
+}
+
+bool elfNoteIsNamed(const ELF_NoteRef *NOTE, const char *NAME) {
+	const size_t LENGTH = strlen(NAME);
+
+	/* The size counts the terminating NUL, when there is one */
+	return (NOTE->namesz == LENGTH
+			   || (NOTE->namesz == LENGTH + 1 && NOTE->name[LENGTH] == '\0'))
+		&& memcmp(NOTE->name, NAME, LENGTH) == 0;
+}
+
+uint32_t elfBuildId(ELF *elf, const uint8_t **id) {
+	const uint16_t PH_NUM = elf->header.progHeaderEntryNum;
+	const uint32_t NUM = PH_NUM > 0 ? PH_NUM : elf->header.sectHeaderEntryNum;
+
+	for( uint32_t i = 0; i < NUM; ++i ) {
+		ELF_NoteIter iter;
+		if( PH_NUM > 0 && elf->ph[i].type == ELF_PHT_NOTE ) {
+			elfNotesOfSegment(elf, &elf->ph[i], &iter);
+		} else if( PH_NUM == 0 && elf->sh[i].type == ELF_SHT_NOTE ) {
+			elfNotesOfSection(elf, &elf->sh[i], &iter);
+		} else {
+			continue;
+		}
+
+		ELF_NoteRef note;
+		while( elfNoteNext(&iter, &note) ) {
+			if( note.type == ELF_NT_GNU_BUILDID && note.descsz > 0
+				&& elfNoteIsNamed(&note, "GNU") ) {
+				*id = note.desc;
+				return note.descsz;
+			}
+		}
+	}
+
+	return 0;
+}
+
+bool elfGnuPropertiesAdd(
+	ELF *elf, const ELF_NoteRef *NOTE, ELF_GnuProperties *properties) {
+	if( NOTE->type != ELF_NT_GNU_PROPERTY_TYPE_0
+		|| !elfNoteIsNamed(NOTE, "GNU") ) {
+		return false;
+	}
+
+	const ELF_Machine MACHINE = elf->header.machine;
+	const bool X86 = MACHINE == ELF_EM_X86_64 || MACHINE == ELF_EM_I386;
+	const bool AARCH64 = MACHINE == ELF_EM_AARCH64;
+
+	/* Properties are padded to 8 bytes in ELF64 files, to 4 in ELF32 ones */
+	const uint32_t ALIGN
+		= elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+
+	Cursor cursor;
+	cursor.pos = NOTE->desc;
+	cursor.end = NOTE->desc + NOTE->descsz;
+	cursor.le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor.ok = true;
+
+	while( cursor.ok && cursor.end - cursor.pos >= 8 ) {
+		const uint32_t TYPE = utilCursorRead(&cursor, 4);
+		const uint32_t SIZE = utilCursorRead(&cursor, 4);
+
+		if( (uint64_t)(cursor.end - cursor.pos) < SIZE ) {
+			break;
+		}
+
+		Cursor data = cursor;
+		data.end = cursor.pos + SIZE;
+
+		if( X86 && TYPE == GNU_PROPERTY_X86_ISA_1_NEEDED ) {
+			properties->x86IsaNeeded |= _propertyBits(&data, SIZE,
+				&properties->present, ELF_GNU_PROP_X86_ISA_NEEDED);
+		} else if( X86 && TYPE == GNU_PROPERTY_X86_ISA_1_USED ) {
+			properties->x86IsaUsed |= _propertyBits(&data, SIZE,
+				&properties->present, ELF_GNU_PROP_X86_ISA_USED);
+		} else if( X86 && TYPE == GNU_PROPERTY_X86_FEATURE_1_AND ) {
+			properties->x86Features |= _propertyBits(&data, SIZE,
+				&properties->present, ELF_GNU_PROP_X86_FEATURES);
+		} else if( AARCH64 && TYPE == GNU_PROPERTY_AARCH64_FEATURE_1_AND ) {
+			properties->aarch64Features |= _propertyBits(&data, SIZE,
+				&properties->present, ELF_GNU_PROP_AARCH64_FEATURES);
+		}
+
+		const uint64_t STEP = _alignUp(SIZE, ALIGN);
+		utilCursorSkip(&cursor,
+			STEP < (uint64_t)(cursor.end - cursor.pos)
+				? STEP
+				: (uint64_t)(cursor.end - cursor.pos));
+	}
+
+	return true;
+}
+
+bool elfGnuProperties(ELF *elf, ELF_GnuProperties *properties) {
+	memset(properties, 0, sizeof(*properties));
+
+	const uint16_t PH_NUM = elf->header.progHeaderEntryNum;
+	bool property = false;
+	bool found = false;
+
+	for( uint16_t i = 0; i < PH_NUM; ++i ) {
+		property |= elf->ph[i].type == ELF_PHT_GNU_PROPERTY;
+	}
+
+	ELF_NoteIter iter;
+
+	for( uint16_t i = 0; i < PH_NUM; ++i ) {
+		const ELF_PH_Type TYPE = elf->ph[i].type;
+		if( TYPE == (property ? ELF_PHT_GNU_PROPERTY : ELF_PHT_NOTE) ) {
+			elfNotesOfSegment(elf, &elf->ph[i], &iter);
+			found |= _addNotes(elf, &iter, properties);
+		}
+	}
+
+	if( PH_NUM > 0 ) {
+		return found;
+	}
+
+	for( uint32_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
+		if( elf->sh[i].type == ELF_SHT_NOTE ) {
+			elfNotesOfSection(elf, &elf->sh[i], &iter);
+			found |= _addNotes(elf, &iter, properties);
+		}
+	}
+
+	return found;
+}
+
+unsigned elfX86IsaLevel(uint32_t isa) {
+	isa &= ELF_X86_ISA_BASELINE | ELF_X86_ISA_V2 | ELF_X86_ISA_V3
+		| ELF_X86_ISA_V4;
+
+	return isa != 0 ? 32 - __builtin_clz(isa) : 0;
+}
+
+/* Adds the property notes an iterator finds; returns whether there were any */
+static bool _addNotes(
+	ELF *elf, ELF_NoteIter *iter, ELF_GnuProperties *properties) {
+	ELF_NoteRef note;
+	bool found = false;
+
+	while( elfNoteNext(iter, &note) ) {
+		found |= elfGnuPropertiesAdd(elf, &note, properties);
+	}
+
+	return found;
+}
+
+static uint64_t _alignUp(uint64_t value, uint32_t align) {
+	return (value + align - 1) & ~(uint64_t)(align - 1);
+}
+
+/* Reads a 32-bit property value, flagging it as present in 'present'
+ * Values of any other size are ignored
+ */
+static uint32_t _propertyBits(
+	Cursor *cursor, uint32_t size, uint32_t *present, uint32_t bit) {
+	if( size != 4 ) {
+		return 0;
+	}
+
+	*present |= bit;
+	return utilCursorRead(cursor, 4);
+}
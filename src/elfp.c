@@ -2,6 +2,10 @@
  * ELF parser
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,26 +13,51 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "fault.h"
 #include "util.h"
 
 #include "elfp.h"
 
+#include "elfaddr.h"
+#include "elfcolumns.h"
+#include "elfintern.h"
+#include "elfline.h"
+#include "elfnote.h"
+#include "elfstats.h"
+#include "elfsym.h"
+
 /* A 32-bit ELF header is at least 52 bytes long
  * Let's make that our cut-off point (even though it could be larger)
  */
 #define SMALLEST_POSSIBLE_ELF 52
 
-/* Small utility for warning users about invalid values */
-#define WARN_INVALID(S, V, I)                                                  \
-	WARN("ELF has unknown or invalid " S " %d\n", (V));                        \
+/* ...while a 64-bit one is 64 bytes long */
+#define SMALLEST_POSSIBLE_ELF64 64
+
+/* Smallest possible Program/Section Header entries, per class */
+#define PH_ENTRY_SIZE(C) ((C) == ELF_CLASS_32_BIT ? 32 : 56)
+#define SH_ENTRY_SIZE(C) ((C) == ELF_CLASS_32_BIT ? 40 : 64)
+
+/* Small utility for flagging invalid values
+ * 'S' is the size of the field just read, which held the value
+ */
+#define WARN_INVALID(W, V, I, S)                                               \
+	_diagnose(elf, (W), (uint64_t)(fp->data - fp->_start) - (S), (V));         \
 	(V) = (I)
 
 /* Small utility for validating values */
-#define CHECK(V, M, S, I)                                                      \
+#define CHECK(V, M, W, I, S)                                                   \
 	do {                                                                       \
 		if( (V) > (M) ) {                                                      \
-			WARN_INVALID(S, (V), (I));                                         \
+			WARN_INVALID(W, (V), (I), (S));                                    \
+		}                                                                      \
+	} while( 0 )
+
+/* Propagates a non-OK status */
+#define TRY(E)                                                                 \
+	do {                                                                       \
+		const ELF_Status _STATUS = (E);                                        \
+		if( _STATUS != ELF_OK ) {                                              \
+			return _STATUS;                                                    \
 		}                                                                      \
 	} while( 0 )
 
@@ -47,87 +76,229 @@
 		? utilRead32(ident->endianness == ELF_ENDIAN_LITTLE_ENDIAN, fp)        \
 		: utilRead64(ident->endianness == ELF_ENDIAN_LITTLE_ENDIAN, fp)
 
-static bool _parseEntryHeader(ELF_Header *header, FP *fp);
-static bool _parseElfIdent(ELF_Ident *ident, FP *fp);
+static ELF *_parse(FP *fp, FP *owned, ELF_Status *status);
+
+static ELF_Status _parseEntryHeader(ELF *elf, FP *fp);
+static void _diagnose(
+	ELF *elf, ELF_Status code, uint64_t offset, uint64_t value);
+static ELF_Status _parseElfIdent(ELF *elf, FP *fp);
+
+static ELF_Status _parseNoteSection(ELF *elf, void **data, uint64_t offset,
+	uint64_t size, uint64_t align);
 
-static void _parseNoteSection(void **data, uint64_t addr, FP *fp);
+static ELF_Status _parseProgHeaders(ELF *elf, FP *fp);
+static ELF_Status _parseProgHeaderEntry(ELF *elf, ELF_PHEntry *ph, FP *fp);
 
-static bool _parseProgHeaders(ELF *elf, FP *fp);
-static bool _parseProgHeaderEntry(ELF_PHEntry *ph, ELF_Ident *ident, FP *fp);
+static ELF_Status _parseSectHeaders(ELF *elf, FP *fp);
+static ELF_Status _parseSectHeaderEntry(ELF *elf, ELF_SHEntry *sh, FP *fp);
 
-static bool _parseSectHeaders(ELF *elf, FP *fp);
-static bool _parseSectHeaderEntry(ELF_SHEntry *sh, ELF_Ident *ident, FP *fp);
+static ELF_Status _parseSHEStringTable(ELF *elf, ELF_SHEntry *sh, FP *fp);
+static ELF_Status _parseSectNames(ELF *elf, FP *fp);
+static ELF_Status _intern(const char *STRING, uint64_t size, uint32_t *id);
 
-static void _parseSHEStringTable(ELF_SHEntry *sh, FP *fp);
+static bool _checkTable(FP *fp, uint64_t offset, uint32_t num,
+	uint16_t entrySize, uint16_t minEntrySize);
+
+static bool _buildSectIndex(ELF *elf);
+static uint32_t _hashId(uint32_t id);
 
 static void _freePHEntry(ELF_PHEntry *ph);
 static void _freeSHEntry(ELF_SHEntry *sh);
 
-ELF *elfParseFile(const char *FILEPATH) {
+ELF *elfParseFile(const char *FILEPATH, ELF_Status *status) {
 	FP *fp = utilReadFile(FILEPATH);
 	if( fp == NULL ) {
+		if( status != NULL ) {
+			*status = errno == ENOMEM ? ELF_ERR_NOMEM : ELF_ERR_IO;
+		}
+
 		return NULL;
 	}
 
-	return elfParse(fp);
+	return elfParse(fp, status);
 }
 
-ELF *elfParse(FP *fp) {
+ELF *elfParse(FP *fp, ELF_Status *status) {
+	ELF *elf = _parse(fp, fp, status);
+	if( elf == NULL ) {
+		utilFreeFile(fp);
+	}
+
+	return elf;
+}
+
+ELF *elfParseBuffer(const void *BUFFER, size_t size, ELF_Status *status) {
+	/* The parser never writes through the file pointer */
+	FP fp;
+	fp._start = (char *)BUFFER;
+	fp.data = fp._start;
+	fp.size = size;
+	fp._mapped = 0;
+
+	return _parse(&fp, NULL, status);
+}
+
+ELF_Status elfParseHeader(const void *BUFFER, size_t size,
+	ELF_Header *header, uint32_t *warnings) {
+	if( size < SMALLEST_POSSIBLE_ELF ) {
+		return ELF_ERR_TOO_SMALL;
+	}
+
+	FP fp;
+	fp._start = (char *)BUFFER;
+	fp.data = fp._start;
+	fp.size = size;
+	fp._mapped = 0;
+
+	/* Only the header and warnings are touched, so nothing else is set up */
+	ELF elf;
+	elf.warnings = 0;
+	elf.diagnosticNum = 0;
+
+	const ELF_Status STATUS = _parseEntryHeader(&elf, &fp);
+	if( STATUS == ELF_OK ) {
+		*header = elf.header;
+	}
+
+	if( warnings != NULL ) {
+		*warnings = elf.warnings;
+	}
+
+	return STATUS;
+}
+
+int elfDiagnosticFormat(
+	const ELF_Diagnostic *DIAGNOSTIC, char *buffer, size_t size) {
+	return snprintf(buffer, size, "offset 0x%" PRIx64 ": %s (0x%" PRIx64 ")",
+		DIAGNOSTIC->offset, elfStatusString(DIAGNOSTIC->code),
+		DIAGNOSTIC->value);
+}
+
+const char *elfStatusString(ELF_Status status) {
+	switch( status ) {
+	case ELF_OK:
+		return "no error";
+	case ELF_ERR_IO:
+		return "couldn't read the file";
+	case ELF_ERR_NOMEM:
+		return "an error occurred while allocating memory";
+	case ELF_ERR_TOO_SMALL:
+		return "file too small: can't possibly be an ELF file";
+	case ELF_ERR_BAD_MAGIC:
+		return "file is not a valid ELF binary (wrong magic)";
+	case ELF_ERR_BAD_PH_TABLE:
+		return "Program Header table is out of bounds or malformed";
+	case ELF_ERR_BAD_SH_TABLE:
+		return "Section Header table is out of bounds or malformed";
+	case ELF_WARN_CLASS:
+		return "ELF has unknown or invalid class";
+	case ELF_WARN_ENDIANNESS:
+		return "ELF has unknown or invalid endianness";
+	case ELF_WARN_VERSION:
+		return "ELF has unknown or invalid version";
+	case ELF_WARN_TYPE:
+		return "ELF has unknown or invalid type";
+	case ELF_WARN_INTERP:
+		return "interpreter path is out of bounds";
+	case ELF_WARN_NOTE:
+		return "note is out of bounds or truncated";
+	case ELF_WARN_STRTAB:
+		return "string table is out of bounds";
+	default:
+		return "unknown status";
+	}
+}
+
+/* Parses a file
+ * 'owned' is the file pointer the ELF takes over, or NULL if it's borrowed.
+ * On failure, ownership stays with the caller
+ */
+static ELF *_parse(FP *fp, FP *owned, ELF_Status *status) {
+	ELF_Status result = ELF_OK;
+	ELF *elf = NULL;
+
 	if( fp->size < SMALLEST_POSSIBLE_ELF ) {
-		ERR("file too small: can't possibly be an ELF file\n");
-		return NULL;
+		result = ELF_ERR_TOO_SMALL;
+		goto done;
 	}
 
-	ELF *elf = malloc(sizeof(*elf));
+	/* Zeroed, so that a half-parsed ELF can be safely freed */
+	elf = utilCalloc(1, sizeof(*elf));
 	if( elf == NULL ) {
-		FATAL("an error occurred while allocating memory\n");
+		result = ELF_ERR_NOMEM;
+		goto done;
 	}
 
-	if( !_parseEntryHeader(&elf->header, fp) ) {
-		elfFree(elf);
-		return NULL;
+	elf->image = fp->_start;
+	elf->imageSize = fp->size;
+
+	/* Each phase counts the bytes of the header or table it decodes */
+	const ELF_Header *HEADER = &elf->header;
+	ELF_PhaseMark mark;
+
+	elfPhaseBegin(&mark, ELF_PHASE_ENTRY_HEADER);
+	result = _parseEntryHeader(elf, fp);
+	elfPhaseEnd(&mark, result == ELF_OK ? HEADER->headerSize : 0);
+
+	if( result == ELF_OK ) {
+		elfPhaseBegin(&mark, ELF_PHASE_PROG_HEADERS);
+		result = _parseProgHeaders(elf, fp);
+		elfPhaseEnd(&mark,
+			(uint64_t)HEADER->progHeaderEntryNum * HEADER->progHeaderEntrySize);
 	}
 
-	if( !_parseProgHeaders(elf, fp) ) {
-		elfFree(elf);
-		return NULL;
+	if( result == ELF_OK ) {
+		elfPhaseBegin(&mark, ELF_PHASE_SECT_HEADERS);
+		result = _parseSectHeaders(elf, fp);
+		elfPhaseEnd(&mark,
+			(uint64_t)HEADER->sectHeaderEntryNum * HEADER->sectHeaderEntrySize);
 	}
 
-	if( !_parseSectHeaders(elf, fp) ) {
+	if( result != ELF_OK ) {
 		elfFree(elf);
-		return NULL;
+		elf = NULL;
+	} else {
+		elf->file = owned;
+	}
+
+done:
+	if( status != NULL ) {
+		*status = result;
 	}
 
-	utilFreeFile(fp);
 	return elf;
 }
 
 /* Parses the Entry Header */
-static bool _parseEntryHeader(ELF_Header *header, FP *fp) {
+static ELF_Status _parseEntryHeader(ELF *elf, FP *fp) {
 	if( fp->data[0] != 0x7F || fp->data[1] != 'E' || fp->data[2] != 'L'
 		|| fp->data[3] != 'F' ) {
-		ERR("file is not a valid ELF binary (wrong magic)\n");
-		return false;
+		return ELF_ERR_BAD_MAGIC;
 	}
 
 	fp->data += 4;
 
-	if( !_parseElfIdent(&header->ident, fp) ) {
-		return false;
-	}
+	TRY(_parseElfIdent(elf, fp));
 
+	ELF_Header *header = &elf->header;
 	ELF_Ident *ident = &header->ident;
 
+	if( ident->class != ELF_CLASS_32_BIT
+		&& fp->size < SMALLEST_POSSIBLE_ELF64 ) {
+		return ELF_ERR_TOO_SMALL;
+	}
+
 	header->type = READ16();
 	if( header->type > ELF_ET_CORE && header->type < ELF_ET_LOOS ) {
-		WARN_INVALID("type", header->type, header->type);
+		WARN_INVALID(ELF_WARN_TYPE, header->type, header->type, 2);
 	}
 
 	header->machine = READ16();
 
 	header->version = READ32();
 	if( header->version != ELF_VERSION_CURRENT ) {
-		WARN_INVALID("version", header->version, ELF_VERSION_INVALID);
+		WARN_INVALID(
+			ELF_WARN_VERSION, header->version, ELF_VERSION_INVALID, 4);
 	}
 
 	header->entryPointAddress = READ64();
@@ -145,21 +316,24 @@ static bool _parseEntryHeader(ELF_Header *header, FP *fp) {
 	header->sectHeaderEntryNum = READ16();
 	header->sectHeaderNameIndex = READ16();
 
-	return true;
+	return ELF_OK;
 }
 
 /* Parses the ident section of the Entry Header */
-static bool _parseElfIdent(ELF_Ident *ident, FP *fp) {
+static ELF_Status _parseElfIdent(ELF *elf, FP *fp) {
+	ELF_Ident *ident = &elf->header.ident;
+
 	ident->class = READ8();
-	CHECK(ident->class, ELF_CLASS_64_BIT, "class", ELF_CLASS_INVALID);
+	CHECK(
+		ident->class, ELF_CLASS_64_BIT, ELF_WARN_CLASS, ELF_CLASS_INVALID, 1);
 
 	ident->endianness = READ8();
-	CHECK(ident->endianness, ELF_ENDIAN_BIG_ENDIAN, "endianness",
-		ELF_ENDIAN_INVALID);
+	CHECK(ident->endianness, ELF_ENDIAN_BIG_ENDIAN, ELF_WARN_ENDIANNESS,
+		ELF_ENDIAN_INVALID, 1);
 
 	ident->version = READ8();
 	if( ident->version != ELF_VERSION_CURRENT ) {
-		WARN_INVALID("version", ident->version, ELF_VERSION_INVALID);
+		WARN_INVALID(ELF_WARN_VERSION, ident->version, ELF_VERSION_INVALID, 1);
 	}
 
 	ident->abi = READ8();
@@ -168,52 +342,91 @@ static bool _parseElfIdent(ELF_Ident *ident, FP *fp) {
 	/* Skip over padding */
 	fp->data += 7;
 
-	return true;
+	return ELF_OK;
 }
 
-/* Loads the contents of a note */
-static void _parseNoteSection(void **data, uint64_t addr, FP *fp) {
-	ELF_Note *note = malloc(sizeof(*note));
+/* Records a warning, keeping where it was raised while there's room */
+static void _diagnose(
+	ELF *elf, ELF_Status code, uint64_t offset, uint64_t value) {
+	elf->warnings |= ELF_WARNING_BIT(code);
+
+	if( elf->diagnosticNum < ELF_DIAGNOSTICS_MAX ) {
+		ELF_Diagnostic *diagnostic = &elf->diagnostics[elf->diagnosticNum];
+		diagnostic->code = code;
+		diagnostic->offset = offset;
+		diagnostic->value = value;
+	}
 
-	memcpy(&note->namesz, fp->_start + addr, 4);
-	memcpy(&note->descsz, fp->_start + addr + 4, 4);
-	memcpy(&note->type, fp->_start + addr + 8, 4);
+	++elf->diagnosticNum;
+}
 
-	note->name = malloc(note->namesz);
-	memcpy(note->name, fp->_start + addr + 12, note->namesz);
+/* Reads the first note of a segment/section, in place
+ * Leaves 'data' as NULL if the note doesn't fit in its segment/section, or its
+ * segment/section doesn't fit in the file
+ */
+static ELF_Status _parseNoteSection(ELF *elf, void **data, uint64_t offset,
+	uint64_t size, uint64_t align) {
+	*data = NULL;
 
-	if( note->descsz > 0 ) {
-		char *descAddr = (fp->_start + addr + 16);
+	ELF_NoteIter iter;
+	elfNotesAt(elf, offset, size, align, &iter);
 
-		note->desc = malloc(note->descsz);
-		memcpy(note->desc, descAddr, note->descsz);
-	} else {
-		note->desc = NULL;
+	ELF_NoteRef ref;
+	if( !elfNoteNext(&iter, &ref) ) {
+		_diagnose(elf, ELF_WARN_NOTE, offset, size);
+		return ELF_OK;
+	}
+
+	ELF_Note *note = utilMalloc(sizeof(*note));
+	if( note == NULL ) {
+		return ELF_ERR_NOMEM;
+	}
+
+	note->namesz = ref.namesz;
+	note->descsz = ref.descsz;
+	note->type = ref.type;
+	note->desc = ref.descsz > 0 ? (const char *)ref.desc : NULL;
+
+	/* Names should be NUL-terminated, but don't rely on it */
+	if( _intern(ref.name, ref.namesz, &note->nameId) != ELF_OK ) {
+		free(note);
+		return ELF_ERR_NOMEM;
 	}
 
 	*data = note;
+	return ELF_OK;
 }
 
 /* Parses the Program Header */
-static bool _parseProgHeaders(ELF *elf, FP *fp) {
-	fp->data = fp->_start + elf->header.progHeaderOffset;
-	elf->ph = malloc(sizeof(*elf->ph) * elf->header.progHeaderEntryNum);
+static ELF_Status _parseProgHeaders(ELF *elf, FP *fp) {
+	ELF_Header *header = &elf->header;
 
-	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
-		char *start = fp->data;
+	if( !_checkTable(fp, header->progHeaderOffset, header->progHeaderEntryNum,
+			header->progHeaderEntrySize, PH_ENTRY_SIZE(header->ident.class)) ) {
+		return ELF_ERR_BAD_PH_TABLE;
+	}
 
-		if( !_parseProgHeaderEntry(&elf->ph[i], &elf->header.ident, fp) ) {
-			return false;
-		}
+	elf->ph = utilCalloc(
+		elf->header.progHeaderEntryNum ? elf->header.progHeaderEntryNum : 1,
+		sizeof(*elf->ph));
+	if( elf->ph == NULL ) {
+		return ELF_ERR_NOMEM;
+	}
 
-		fp->data = start + elf->header.progHeaderEntrySize;
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		fp->data = fp->_start + header->progHeaderOffset
+			+ (uint64_t)i * header->progHeaderEntrySize;
+
+		TRY(_parseProgHeaderEntry(elf, &elf->ph[i], fp));
 	}
 
-	return true;
+	return ELF_OK;
 }
 
 /* Parses an entry in the Program Header */
-static bool _parseProgHeaderEntry(ELF_PHEntry *ph, ELF_Ident *ident, FP *fp) {
+static ELF_Status _parseProgHeaderEntry(ELF *elf, ELF_PHEntry *ph, FP *fp) {
+	ELF_Ident *ident = &elf->header.ident;
+
 	ph->type = READ32();
 
 	if( ident->class == ELF_CLASS_64_BIT ) {
@@ -230,44 +443,88 @@ static bool _parseProgHeaderEntry(ELF_PHEntry *ph, ELF_Ident *ident, FP *fp) {
 		ph->flags = READ32();
 	}
 
-	ph->align = READ32();
+	ph->align = READ64();
 
 	switch( ph->type ) {
 	case ELF_PHT_INTERP:
-		ph->data = malloc(ph->fileSize);
-		strncpy(ph->data, fp->_start + ph->virtualAddr, ph->fileSize);
-		break;
+		if( !utilInBounds(fp, ph->offset, ph->fileSize) ) {
+			_diagnose(elf, ELF_WARN_INTERP, ph->offset, ph->fileSize);
+			ph->data = NULL;
+			break;
+		}
+
+		/* Every binary linked against the same loader shares its path */
+		ph->data = NULL;
+		return _intern(fp->_start + ph->offset, ph->fileSize, &ph->interpId);
 	case ELF_PHT_NOTE:
-		_parseNoteSection(&ph->data, ph->offset, fp);
-		break;
+		return _parseNoteSection(
+			elf, &ph->data, ph->offset, ph->fileSize, ph->align);
 	default:
 		ph->data = NULL;
 		break;
 	}
 
-	return true;
+	return ELF_OK;
 }
 
 /* Parses the Section Header */
-static bool _parseSectHeaders(ELF *elf, FP *fp) {
-	fp->data = fp->_start + elf->header.sectHeaderOffset;
-	elf->sh = malloc(sizeof(*elf->sh) * elf->header.sectHeaderEntryNum);
+static ELF_Status _parseSectHeaders(ELF *elf, FP *fp) {
+	ELF_Header *header = &elf->header;
+
+	/* A file with too many sections to count in 16 bits stores its real
+	 * section count and name table index in the first entry instead
+	 */
+	if( header->sectHeaderOffset != 0
+		&& (header->sectHeaderEntryNum == 0
+			|| header->sectHeaderNameIndex == ELF_SHN_XINDEX) ) {
+		ELF_SHEntry first;
+
+		if( !_checkTable(fp, header->sectHeaderOffset, 1,
+				header->sectHeaderEntrySize,
+				SH_ENTRY_SIZE(header->ident.class)) ) {
+			return ELF_ERR_BAD_SH_TABLE;
+		}
 
-	for( uint16_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
-		char *start = fp->data;
+		fp->data = fp->_start + header->sectHeaderOffset;
+		TRY(_parseSectHeaderEntry(elf, &first, fp));
 
-		if( !_parseSectHeaderEntry(&elf->sh[i], &elf->header.ident, fp) ) {
-			return false;
+		if( header->sectHeaderEntryNum == 0 ) {
+			header->sectHeaderEntryNum = first.size;
 		}
 
-		fp->data = start + elf->header.sectHeaderEntrySize;
+		if( header->sectHeaderNameIndex == ELF_SHN_XINDEX ) {
+			header->sectHeaderNameIndex = first.link;
+		}
+
+		_freeSHEntry(&first);
 	}
 
-	return true;
+	if( !_checkTable(fp, header->sectHeaderOffset, header->sectHeaderEntryNum,
+			header->sectHeaderEntrySize, SH_ENTRY_SIZE(header->ident.class)) ) {
+		return ELF_ERR_BAD_SH_TABLE;
+	}
+
+	elf->sh = utilCalloc(
+		header->sectHeaderEntryNum ? header->sectHeaderEntryNum : 1,
+		sizeof(*elf->sh));
+	if( elf->sh == NULL ) {
+		return ELF_ERR_NOMEM;
+	}
+
+	for( uint32_t i = 0; i < header->sectHeaderEntryNum; ++i ) {
+		fp->data = fp->_start + header->sectHeaderOffset
+			+ (uint64_t)i * header->sectHeaderEntrySize;
+
+		TRY(_parseSectHeaderEntry(elf, &elf->sh[i], fp));
+	}
+
+	return _parseSectNames(elf, fp);
 }
 
 /* Parses an entry in the Section Header */
-static bool _parseSectHeaderEntry(ELF_SHEntry *sh, ELF_Ident *ident, FP *fp) {
+static ELF_Status _parseSectHeaderEntry(ELF *elf, ELF_SHEntry *sh, FP *fp) {
+	ELF_Ident *ident = &elf->header.ident;
+
 	sh->nameIdx = READ32();
 	sh->type = READ32();
 
@@ -284,33 +541,289 @@ static bool _parseSectHeaderEntry(ELF_SHEntry *sh, ELF_Ident *ident, FP *fp) {
 
 	switch( sh->type ) {
 	case ELF_SHT_STRTAB:
-		_parseSHEStringTable(sh, fp);
-		break;
+		return _parseSHEStringTable(elf, sh, fp);
 	case ELF_SHT_NOTE:
-		_parseNoteSection(&sh->data, sh->offset, fp);
-		break;
+		return _parseNoteSection(
+			elf, &sh->data, sh->offset, sh->size, sh->addrAlign);
 	default:
 		sh->data = NULL;
 	}
 
+	return ELF_OK;
+}
+
+/* Checks a string table
+ * Its strings are read in place (from the image) when needed, not copied
+ */
+static ELF_Status _parseSHEStringTable(ELF *elf, ELF_SHEntry *sh, FP *fp) {
+	sh->data = NULL;
+
+	if( !utilInBounds(fp, sh->offset, sh->size) ) {
+		_diagnose(elf, ELF_WARN_STRTAB, sh->offset, sh->size);
+	}
+
+	return ELF_OK;
+}
+
+/* Interns the names of all sections
+ * Sections are left nameless if the name table is missing or out of bounds
+ */
+static ELF_Status _parseSectNames(ELF *elf, FP *fp) {
+	const uint32_t NIDX = elf->header.sectHeaderNameIndex;
+	if( NIDX >= elf->header.sectHeaderEntryNum ) {
+		return ELF_OK;
+	}
+
+	const ELF_SHEntry *STRTAB = &elf->sh[NIDX];
+	if( STRTAB->type != ELF_SHT_STRTAB
+		|| !utilInBounds(fp, STRTAB->offset, STRTAB->size) ) {
+		return ELF_OK;
+	}
+
+	const char *TABLE = fp->_start + STRTAB->offset;
+
+	for( uint32_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
+		ELF_SHEntry *sh = &elf->sh[i];
+		if( sh->nameIdx >= STRTAB->size ) {
+			continue;
+		}
+
+		TRY(_intern(TABLE + sh->nameIdx, STRTAB->size - sh->nameIdx,
+			&sh->nameId));
+	}
+
+	return ELF_OK;
+}
+
+/* Interns a string that may or may not be NUL-terminated within 'size' */
+static ELF_Status _intern(const char *STRING, uint64_t size, uint32_t *id) {
+	const size_t LENGTH = strnlen(STRING, size);
+
+	*id = elfInternId(STRING, LENGTH);
+	return *id == ELF_INTERN_NONE && LENGTH > 0 ? ELF_ERR_NOMEM : ELF_OK;
+}
+
+/* Validates a whole header table at once
+ * Once this passes, every entry can be decoded without further checks
+ */
+static bool _checkTable(FP *fp, uint64_t offset, uint32_t num,
+	uint16_t entrySize, uint16_t minEntrySize) {
+	if( num == 0 ) {
+		return true;
+	}
+
+	return entrySize >= minEntrySize
+		&& utilInBounds(fp, offset, (uint64_t)num * entrySize);
+}
+
+const char *elfSectionName(ELF *elf, ELF_SHEntry *sh) {
+	(void)elf;
+	return elfInternString(sh->nameId);
+}
+
+ELF_SHEntry *elfFindSection(ELF *elf, const char *NAME) {
+	if( elf->sectIndex == NULL && !_buildSectIndex(elf) ) {
+		return NULL;
+	}
+
+	/* A name nobody interned can't belong to any section */
+	const uint32_t ID = elfInternFind(NAME, strlen(NAME));
+	if( ID == ELF_INTERN_NONE ) {
+		return NULL;
+	}
+
+	const ELF_SectIndex *INDEX = elf->sectIndex;
+
+	uint32_t i = _hashId(ID) & INDEX->mask;
+	for( ;; i = (i + 1) & INDEX->mask ) {
+		const uint32_t SLOT = INDEX->slots[i];
+		if( SLOT == 0 ) {
+			return NULL;
+		}
+
+		ELF_SHEntry *sh = &elf->sh[SLOT - 1];
+		if( sh->nameId == ID ) {
+			return sh;
+		}
+	}
+}
+
+const ELF_KnownSections *elfKnownSections(ELF *elf) {
+	if( elf->sectIndex == NULL && !_buildSectIndex(elf) ) {
+		return NULL;
+	}
+
+	return &elf->sectIndex->known;
+}
+
+bool elfBuildIndices(ELF *elf, unsigned indices) {
+	return (!(indices & ELF_INDEX_SECTIONS) || elfKnownSections(elf) != NULL)
+		&& (!(indices & ELF_INDEX_ADDR) || elfAddrIndexBuild(elf))
+		&& (!(indices & ELF_INDEX_LINES) || elfLineTableBuild(elf))
+		&& (!(indices & ELF_INDEX_SYMBOLS) || elfSymTableBuild(elf));
+}
+
+size_t elfFootprint(ELF *elf) {
+	const ELF_Header *HEADER = &elf->header;
+
+	size_t size = sizeof(*elf) + sizeof(*elf->ph) * HEADER->progHeaderEntryNum
+		+ sizeof(*elf->sh) * HEADER->sectHeaderEntryNum;
+
+	if( elf->file != NULL ) {
+		size += sizeof(*elf->file)
+			+ (elf->file->_mapped == 0 ? elf->imageSize : 0);
+	}
+
+	/* Entries only hold data for notes, which point into the image */
+	for( uint16_t i = 0; i < HEADER->progHeaderEntryNum; ++i ) {
+		if( elf->ph[i].data != NULL ) {
+			size += sizeof(ELF_Note);
+		}
+	}
+
+	for( uint32_t i = 0; i < HEADER->sectHeaderEntryNum; ++i ) {
+		if( elf->sh[i].data != NULL ) {
+			size += sizeof(ELF_Note);
+		}
+	}
+
+	if( elf->sectIndex != NULL ) {
+		size += sizeof(*elf->sectIndex)
+			+ sizeof(uint32_t) * (elf->sectIndex->mask + 1);
+	}
+
+	if( elf->addrIndex != NULL ) {
+		size += sizeof(*elf->addrIndex)
+			+ 3 * sizeof(uint64_t)
+				* (HEADER->progHeaderEntryNum + HEADER->sectHeaderEntryNum);
+	}
+
+	if( elf->lineTable != NULL ) {
+		const ELF_LineTable *TABLE = elf->lineTable;
+
+		size += sizeof(*TABLE)
+			+ (sizeof(uint64_t) + 2 * sizeof(uint32_t)) * TABLE->num
+			+ sizeof(char *) * TABLE->fileNum;
+
+		for( uint32_t i = 0; i < TABLE->fileNum; ++i ) {
+			size += strlen(TABLE->files[i]) + 1;
+		}
+	}
+
+	/* Version names are interned, so they aren't this ELF's to count */
+	if( elf->dynSymbols != NULL ) {
+		const ELF_SymTable *TABLE = elf->dynSymbols;
+
+		size += sizeof(*TABLE) + sizeof(*TABLE->symbols) * TABLE->num
+			+ sizeof(*TABLE->versions) * TABLE->versionNum;
+	}
+
+	if( elf->columns != NULL ) {
+		size += sizeof(*elf->columns) + elf->columns->blockSize;
+	}
+
+	return size;
+}
+
+/* Builds the section name index
+ * Slots are sized to keep the load factor under 50%, so probe chains stay
+ * short even for objects with hundreds of thousands of sections
+ */
+static bool _buildSectIndex(ELF *elf) {
+	ELF_SectIndex *index = utilMalloc(sizeof(*index));
+	if( index == NULL ) {
+		return false;
+	}
+
+	const uint32_t NUM = elf->header.sectHeaderEntryNum;
+
+	uint32_t cap = 16;
+	while( cap < NUM * 2 ) {
+		cap <<= 1;
+	}
+
+	index->slots = utilCalloc(cap, sizeof(*index->slots));
+	if( index->slots == NULL ) {
+		free(index);
+		return false;
+	}
+
+	index->mask = cap - 1;
+
+	/* Section 0 is always the null section, so there's nothing to index */
+	for( uint32_t s = 1; s < NUM; ++s ) {
+		const uint32_t ID = elf->sh[s].nameId;
+		if( ID == ELF_INTERN_NONE ) {
+			continue;
+		}
+
+		uint32_t i = _hashId(ID) & index->mask;
+		while( index->slots[i] != 0 ) {
+			if( elf->sh[index->slots[i] - 1].nameId == ID ) {
+				break;
+			}
+
+			i = (i + 1) & index->mask;
+		}
+
+		/* Keep the first of many sections sharing a name */
+		if( index->slots[i] == 0 ) {
+			index->slots[i] = s + 1;
+		}
+	}
+
+	elf->sectIndex = index;
+
+	ELF_KnownSections *known = &index->known;
+	known->interp = elfFindSection(elf, ".interp");
+	known->dynamic = elfFindSection(elf, ".dynamic");
+	known->dynsym = elfFindSection(elf, ".dynsym");
+	known->dynstr = elfFindSection(elf, ".dynstr");
+	known->symtab = elfFindSection(elf, ".symtab");
+	known->strtab = elfFindSection(elf, ".strtab");
+	known->buildId = elfFindSection(elf, ".note.gnu.build-id");
+	known->ehFrame = elfFindSection(elf, ".eh_frame");
+	known->ehFrameHdr = elfFindSection(elf, ".eh_frame_hdr");
+	known->debugLink = elfFindSection(elf, ".gnu_debuglink");
+	known->debugLine = elfFindSection(elf, ".debug_line");
+
 	return true;
 }
 
-/* Loads the contents of a string table */
-static void _parseSHEStringTable(ELF_SHEntry *sh, FP *fp) {
-	sh->data = malloc(sh->size);
-	memcpy(sh->data, fp->_start + sh->offset, sh->size);
+/* Hash of an interned section name's ID
+ * IDs from the same shard differ in their high bits only, so mix them down
+ */
+static uint32_t _hashId(uint32_t id) {
+	id ^= id >> 16;
+	id *= 0x45D9F3Bu;
+	id ^= id >> 16;
+
+	return id;
 }
 
 void elfFree(ELF *elf) {
-	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+	for( uint16_t i = 0; elf->ph && i < elf->header.progHeaderEntryNum; ++i ) {
 		_freePHEntry(&elf->ph[i]);
 	}
 
-	for( uint16_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
+	for( uint32_t i = 0; elf->sh && i < elf->header.sectHeaderEntryNum; ++i ) {
 		_freeSHEntry(&elf->sh[i]);
 	}
 
+	if( elf->sectIndex != NULL ) {
+		free(elf->sectIndex->slots);
+		free(elf->sectIndex);
+	}
+
+	elfAddrIndexFree(elf->addrIndex);
+	elfLineTableFree(elf->lineTable);
+	elfSymTableFree(elf->dynSymbols);
+	elfColumnsFree(elf->columns);
+
+	if( elf->file != NULL ) {
+		utilFreeFile(elf->file);
+	}
+
 	free(elf->ph);
 	free(elf->sh);
 	free(elf);
@@ -318,38 +831,10 @@ void elfFree(ELF *elf) {
 
 /* Frees a Program Header entry */
 static void _freePHEntry(ELF_PHEntry *ph) {
-	if( ph->data == NULL ) {
-		return;
-	}
-
-	switch( ph->type ) {
-	case ELF_PHT_NOTE: {
-		ELF_Note *note = ph->data;
-		free(note->name);
-		free(note->desc);
-	} break;
-	default:
-		break;
-	}
-
 	free(ph->data);
 }
 
 /* Frees a Section Header entry */
 static void _freeSHEntry(ELF_SHEntry *sh) {
-	if( sh->data == NULL ) {
-		return;
-	}
-
-	switch( sh->type ) {
-	case ELF_SHT_NOTE: {
-		ELF_Note *note = sh->data;
-		free(note->name);
-		free(note->desc);
-	} break;
-	default:
-		break;
-	}
-
 	free(sh->data);
 }
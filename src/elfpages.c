@@ -0,0 +1,365 @@
+/* elfp
+ * Page-level memory footprint
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elfp.h"
+#include "util.h"
+
+#include "elfpages.h"
+
+/* Page size assumed when the system won't tell */
+#define DEFAULT_PAGE_SIZE 4096
+
+/* Pages written to by relocations, growing as they're found */
+typedef struct _Dirty {
+	uint64_t *pages;
+	size_t num;
+	size_t cap;
+	uint64_t relocations;
+
+	bool ok; /* Cleared when running out of memory */
+} Dirty;
+
+static uint64_t _floor(uint64_t value, uint64_t pageSize);
+static uint64_t _ceil(uint64_t value, uint64_t pageSize);
+static uint64_t _end(uint64_t start, uint64_t size);
+
+static void _mark(Dirty *dirty, uint64_t addr, uint64_t pageSize);
+static bool _cursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor);
+static void _relocations(Dirty *dirty, ELF *elf, const ELF_SHEntry *SH,
+	uint64_t pageSize);
+static void _relr(Dirty *dirty, ELF *elf, const ELF_SHEntry *SH,
+	uint64_t pageSize);
+static size_t _countPages(const Dirty *DIRTY, uint64_t first, uint64_t end);
+static bool _hasPage(const Dirty *DIRTY, uint64_t page);
+static int _comparePages(const void *A, const void *B);
+
+static void _layout(ELF_SegmentPages *segment, ELF *elf, const ELF_PHEntry *PH,
+	const Dirty *DIRTY, uint64_t pageSize);
+
+bool elfPageFootprint(ELF *elf, uint64_t pageSize, ELF_PageReport *report) {
+	memset(report, 0, sizeof(*report));
+
+	if( pageSize == 0 ) {
+		const long SYSTEM = sysconf(_SC_PAGESIZE);
+		pageSize = SYSTEM > 0 ? (uint64_t)SYSTEM : DEFAULT_PAGE_SIZE;
+	}
+
+	report->pageSize = pageSize;
+
+	uint16_t loads = 0;
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		if( elf->ph[i].type == ELF_PHT_LOAD ) {
+			++loads;
+		}
+	}
+
+	if( loads == 0 ) {
+		return true;
+	}
+
+	report->segments = utilCalloc(loads, sizeof(*report->segments));
+	if( report->segments == NULL ) {
+		return false;
+	}
+
+	/* Only relocations the dynamic linker applies (those of allocated
+	 * sections) dirty pages; a relocatable object has no segments anyway
+	 */
+	Dirty dirty = { NULL, 0, 0, 0, true };
+
+	for( uint32_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		if( !(SH->flags & ELF_SHF_ALLOC) ) {
+			continue;
+		}
+
+		if( SH->type == ELF_SHT_RELOC_A || SH->type == ELF_SHT_RELOC ) {
+			_relocations(&dirty, elf, SH, pageSize);
+		} else if( SH->type == ELF_SHT_RELR ) {
+			_relr(&dirty, elf, SH, pageSize);
+		}
+	}
+
+	if( !dirty.ok ) {
+		free(dirty.pages);
+		elfPageReportFree(report);
+		return false;
+	}
+
+	if( dirty.num > 0 ) {
+		qsort(dirty.pages, dirty.num, sizeof(*dirty.pages), _comparePages);
+
+		size_t unique = 1;
+		for( size_t i = 1; i < dirty.num; ++i ) {
+			if( dirty.pages[i] != dirty.pages[unique - 1] ) {
+				dirty.pages[unique++] = dirty.pages[i];
+			}
+		}
+
+		dirty.num = unique;
+	}
+
+	report->relocations = dirty.relocations;
+
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		const ELF_PHEntry *PH = &elf->ph[i];
+		if( PH->type != ELF_PHT_LOAD ) {
+			continue;
+		}
+
+		ELF_SegmentPages *segment = &report->segments[report->num++];
+		segment->index = i;
+		_layout(segment, elf, PH, &dirty, pageSize);
+
+		elfPageAdd(&report->total, segment);
+	}
+
+	free(dirty.pages);
+	return true;
+}
+
+void elfPageAdd(ELF_SegmentPages *into, const ELF_SegmentPages *FROM) {
+	into->flags |= FROM->flags;
+
+	into->pages += FROM->pages;
+	into->filePages += FROM->filePages;
+	into->anonPages += FROM->anonPages;
+	into->sharedPages += FROM->sharedPages;
+	into->dirtyPages += FROM->dirtyPages;
+	into->relroPages += FROM->relroPages;
+
+	into->wasted += FROM->wasted;
+}
+
+void elfPageReportFree(ELF_PageReport *report) {
+	free(report->segments);
+	report->segments = NULL;
+	report->num = 0;
+}
+
+static uint64_t _floor(uint64_t value, uint64_t pageSize) {
+	return value - value % pageSize;
+}
+
+/* Rounds up to a page, saturating instead of wrapping around */
+static uint64_t _ceil(uint64_t value, uint64_t pageSize) {
+	const uint64_t REST = value % pageSize;
+	if( REST == 0 ) {
+		return value;
+	}
+
+	return value > UINT64_MAX - (pageSize - REST)
+		? _floor(UINT64_MAX, pageSize)
+		: value + (pageSize - REST);
+}
+
+/* End of a range, clipped to the address space */
+static uint64_t _end(uint64_t start, uint64_t size) {
+	return size > UINT64_MAX - start ? UINT64_MAX : start + size;
+}
+
+/* Records that a relocation writes to an address
+ * Relocations come mostly in address order, so runs on the same page are
+ * folded right away
+ */
+static void _mark(Dirty *dirty, uint64_t addr, uint64_t pageSize) {
+	const uint64_t PAGE = addr / pageSize;
+
+	++dirty->relocations;
+
+	if( !dirty->ok
+		|| (dirty->num > 0 && dirty->pages[dirty->num - 1] == PAGE) ) {
+		return;
+	}
+
+	if( dirty->num == dirty->cap ) {
+		const size_t CAP = dirty->cap > 0 ? dirty->cap * 2 : 64;
+
+		uint64_t *grown = utilRealloc(dirty->pages, sizeof(*grown) * CAP);
+		if( grown == NULL ) {
+			dirty->ok = false;
+			return;
+		}
+
+		dirty->pages = grown;
+		dirty->cap = CAP;
+	}
+
+	dirty->pages[dirty->num++] = PAGE;
+}
+
+/* Points a cursor at a section's contents, if they're in the file */
+static bool _cursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor) {
+	cursor->le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor->ok = true;
+
+	if( SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		cursor->pos = NULL;
+		cursor->end = NULL;
+		return false;
+	}
+
+	cursor->pos = (const uint8_t *)elf->image + SH->offset;
+	cursor->end = cursor->pos + SH->size;
+
+	return true;
+}
+
+/* Marks the targets of a .rel or .rela section, whose entries start with the
+ * address they write to
+ */
+static void _relocations(Dirty *dirty, ELF *elf, const ELF_SHEntry *SH,
+	uint64_t pageSize) {
+	const unsigned WORD = elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+	const uint64_t ENTRY = WORD * (SH->type == ELF_SHT_RELOC_A ? 3 : 2);
+
+	Cursor cursor;
+	if( !_cursor(elf, SH, &cursor) ) {
+		return;
+	}
+
+	for( uint64_t i = 0; i < SH->size / ENTRY; ++i ) {
+		_mark(dirty, utilCursorRead(&cursor, WORD), pageSize);
+		utilCursorSkip(&cursor, ENTRY - WORD);
+	}
+}
+
+/* Marks the targets of a .relr section
+ * An even entry is an address to relocate, and moves past it. An odd entry
+ * is a bitmap of the words that follow: bit n (from 1) stands for the word n-1
+ * words further on
+ */
+static void _relr(Dirty *dirty, ELF *elf, const ELF_SHEntry *SH,
+	uint64_t pageSize) {
+	const unsigned WORD = elf->header.ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+	const unsigned BITS = WORD * 8 - 1;
+
+	Cursor cursor;
+	if( !_cursor(elf, SH, &cursor) ) {
+		return;
+	}
+
+	uint64_t where = 0;
+
+	for( uint64_t i = 0; i < SH->size / WORD; ++i ) {
+		const uint64_t ENTRY = utilCursorRead(&cursor, WORD);
+
+		if( (ENTRY & 1) == 0 ) {
+			_mark(dirty, ENTRY, pageSize);
+			where = ENTRY + WORD;
+			continue;
+		}
+
+		for( unsigned bit = 1; bit <= BITS; ++bit ) {
+			if( ENTRY >> bit & 1 ) {
+				_mark(dirty, where + (uint64_t)(bit - 1) * WORD, pageSize);
+			}
+		}
+
+		where += (uint64_t)BITS * WORD;
+	}
+}
+
+/* Counts the dirty pages in [first, end) */
+static size_t _countPages(const Dirty *DIRTY, uint64_t first, uint64_t end) {
+	size_t low = 0;
+	size_t high = DIRTY->num;
+
+	while( low < high ) {
+		const size_t MID = low + (high - low) / 2;
+		if( DIRTY->pages[MID] < first ) {
+			low = MID + 1;
+		} else {
+			high = MID;
+		}
+	}
+
+	size_t count = 0;
+	for( size_t i = low; i < DIRTY->num && DIRTY->pages[i] < end; ++i ) {
+		++count;
+	}
+
+	return count;
+}
+
+static bool _hasPage(const Dirty *DIRTY, uint64_t page) {
+	return _countPages(DIRTY, page, page + 1) > 0;
+}
+
+static int _comparePages(const void *A, const void *B) {
+	const uint64_t PA = *(const uint64_t *)A;
+	const uint64_t PB = *(const uint64_t *)B;
+
+	return PA < PB ? -1 : PA > PB;
+}
+
+/* Lays out a PT_LOAD segment the way the loader maps it: whole pages from the
+ * one holding its first byte, the file mapped up to the page holding its last
+ * file byte, and anonymous pages past that. The rest of that last file page
+ * is zeroed when .bss starts in it, which copies it
+ */
+static void _layout(ELF_SegmentPages *segment, ELF *elf, const ELF_PHEntry *PH,
+	const Dirty *DIRTY, uint64_t pageSize) {
+	const uint64_t START = PH->virtualAddr;
+	const uint64_t MEM_END = _end(START, PH->memSize);
+	const uint64_t FILE_END = _end(START,
+		PH->fileSize < PH->memSize ? PH->fileSize : PH->memSize);
+
+	const uint64_t MAP_START = _floor(START, pageSize);
+	const uint64_t MAP_END = _ceil(MEM_END, pageSize);
+	const uint64_t FILE_MAP_END = _ceil(FILE_END, pageSize);
+
+	segment->flags = PH->flags;
+	segment->pages = (MAP_END - MAP_START) / pageSize;
+	segment->filePages = FILE_END > START
+		? (FILE_MAP_END - MAP_START) / pageSize
+		: 0;
+	segment->anonPages = segment->pages - segment->filePages;
+	segment->wasted = (START - MAP_START) + (MAP_END - MEM_END);
+
+	if( segment->filePages > 0 ) {
+		const uint64_t FIRST = MAP_START / pageSize;
+		const uint64_t END = FIRST + segment->filePages;
+
+		segment->dirtyPages = _countPages(DIRTY, FIRST, END);
+
+		if( MEM_END > FILE_END && FILE_END % pageSize != 0
+			&& !_hasPage(DIRTY, FILE_END / pageSize) ) {
+			++segment->dirtyPages;
+		}
+
+		segment->sharedPages = segment->filePages - segment->dirtyPages;
+	}
+
+	/* The loader makes [floor(start), floor(end)) of PT_GNU_RELRO read-only,
+	 * so a page the range only partly covers stays writable
+	 */
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		const ELF_PHEntry *RELRO = &elf->ph[i];
+		if( RELRO->type != ELF_PHT_GNU_RELRO ) {
+			continue;
+		}
+
+		uint64_t from = _floor(RELRO->virtualAddr, pageSize);
+		uint64_t to = _floor(_end(RELRO->virtualAddr, RELRO->memSize),
+			pageSize);
+
+		from = from > MAP_START ? from : MAP_START;
+		to = to < MAP_END ? to : MAP_END;
+
+		if( to > from ) {
+			segment->relroPages += (to - from) / pageSize;
+		}
+	}
+}
@@ -0,0 +1,493 @@
+/* elfp
+ * Size attribution
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfintern.h"
+#include "elfp.h"
+#include "elfsym.h"
+#include "util.h"
+
+#include "elfsize.h"
+
+/* Symbol types (STT_*) whose value isn't a place in their section */
+#define STT_SECTION 3
+#define STT_FILE 4
+#define STT_TLS 6
+
+/* First reserved section index (SHN_LORESERVE) */
+#define SHN_LORESERVE 0xFF00
+
+/* Largest name of a segment, like "LOAD RWX" */
+#define SEGMENT_NAME_SIZE 16
+
+/* A range of the file attributed to a name, while sweeping */
+typedef struct _Piece {
+	uint64_t start;
+	uint64_t end;
+	uint64_t align; /* Alignment the start of the piece must honour */
+	uint32_t nameId;
+
+	/* Whether it starts a PT_LOAD segment, whose offset only has to match its
+	 * address modulo the alignment
+	 */
+	bool segment;
+} Piece;
+
+/* Pieces of a file, growing as they're found */
+typedef struct _Pieces {
+	Piece *items;
+	uint32_t num;
+	uint32_t cap;
+
+	bool ok; /* Cleared when running out of memory */
+} Pieces;
+
+static uint32_t _name(const char *NAME, bool *ok);
+static Piece *_push(Pieces *pieces, uint64_t start, uint64_t size,
+	uint64_t align, uint32_t nameId, uint64_t fileSize);
+static bool _sweep(ELF_SizeTable *table, Pieces *pieces, uint64_t fileSize,
+	uint32_t gap, uint32_t padding);
+static int _comparePieces(const void *A, const void *B);
+
+static bool _segments(ELF_SizeReport *report, ELF *elf);
+static bool _sections(ELF_SizeReport *report, ELF *elf);
+static bool _symbols(ELF_SizeReport *report, ELF *elf);
+
+static ELF_SizeEntry *_entry(ELF_SizeTable *table, uint32_t nameId);
+static bool _grow(ELF_SizeTable *table);
+static int _compareEntries(const void *A, const void *B);
+
+ELF_SizeReport *elfSizeReportNew(void) {
+	return utilCalloc(1, sizeof(ELF_SizeReport));
+}
+
+ELF_SizeReport *elfSizeReportOf(ELF *elf) {
+	ELF_SizeReport *report = elfSizeReportNew();
+	if( report == NULL ) {
+		return NULL;
+	}
+
+	report->files = 1;
+	report->bytes = elf->imageSize;
+
+	if( !_segments(report, elf) || !_sections(report, elf)
+		|| !_symbols(report, elf) ) {
+		elfSizeReportFree(report);
+		return NULL;
+	}
+
+	return report;
+}
+
+bool elfSizeReportMerge(ELF_SizeReport *into, const ELF_SizeReport *FROM) {
+	for( int k = 0; k < ELF_SIZE_KIND_NUM; ++k ) {
+		const ELF_SizeTable *TABLE = &FROM->tables[k];
+
+		for( uint32_t i = 0; TABLE->num > 0 && i <= TABLE->mask; ++i ) {
+			const ELF_SizeEntry *FROM_ENTRY = &TABLE->entries[i];
+			if( FROM_ENTRY->nameId == ELF_INTERN_NONE ) {
+				continue;
+			}
+
+			ELF_SizeEntry *entry = _entry(&into->tables[k], FROM_ENTRY->nameId);
+			if( entry == NULL ) {
+				return false;
+			}
+
+			entry->bytes += FROM_ENTRY->bytes;
+			entry->files += FROM_ENTRY->files;
+		}
+	}
+
+	into->files += FROM->files;
+	into->bytes += FROM->bytes;
+
+	return true;
+}
+
+size_t elfSizeReportTop(const ELF_SizeReport *REPORT, ELF_SizeKind kind,
+	ELF_SizeEntry *top, size_t num) {
+	const ELF_SizeTable *TABLE = &REPORT->tables[kind];
+	if( TABLE->num == 0 || num == 0 ) {
+		return 0;
+	}
+
+	ELF_SizeEntry *all = utilMalloc(sizeof(*all) * TABLE->num);
+	if( all == NULL ) {
+		return 0;
+	}
+
+	uint32_t n = 0;
+	for( uint32_t i = 0; i <= TABLE->mask; ++i ) {
+		if( TABLE->entries[i].nameId != ELF_INTERN_NONE ) {
+			all[n++] = TABLE->entries[i];
+		}
+	}
+
+	qsort(all, n, sizeof(*all), _compareEntries);
+
+	if( num > n ) {
+		num = n;
+	}
+
+	memcpy(top, all, sizeof(*top) * num);
+	free(all);
+
+	return num;
+}
+
+void elfSizeReportFree(ELF_SizeReport *report) {
+	if( report == NULL ) {
+		return;
+	}
+
+	for( int k = 0; k < ELF_SIZE_KIND_NUM; ++k ) {
+		free(report->tables[k].entries);
+	}
+
+	free(report);
+}
+
+/* Interns a name, clearing 'ok' if memory runs out */
+static uint32_t _name(const char *NAME, bool *ok) {
+	const uint32_t ID = elfInternId(NAME, strlen(NAME));
+	if( ID == ELF_INTERN_NONE && *NAME != '\0' ) {
+		*ok = false;
+	}
+
+	return ID;
+}
+
+/* Adds a piece, clipped to the file
+ * Empty pieces, or pieces starting past the end of the file, are dropped
+ * (returning NULL)
+ */
+static Piece *_push(Pieces *pieces, uint64_t start, uint64_t size,
+	uint64_t align, uint32_t nameId, uint64_t fileSize) {
+	if( !pieces->ok || size == 0 || start >= fileSize ) {
+		return NULL;
+	}
+
+	if( pieces->num == pieces->cap ) {
+		const uint32_t CAP = pieces->cap > 0 ? pieces->cap * 2 : 64;
+
+		Piece *grown = utilRealloc(pieces->items, sizeof(*grown) * CAP);
+		if( grown == NULL ) {
+			pieces->ok = false;
+			return NULL;
+		}
+
+		pieces->items = grown;
+		pieces->cap = CAP;
+	}
+
+	Piece *piece = &pieces->items[pieces->num++];
+	piece->start = start;
+	piece->end = size > fileSize - start ? fileSize : start + size;
+	piece->align = align;
+	piece->nameId = nameId;
+	piece->segment = false;
+
+	return piece;
+}
+
+/* Attributes every byte of the file to a piece, in order of their start
+ * Bytes claimed by several pieces go to the first one. Bytes claimed by none
+ * go to 'padding' if they only serve to align the next piece (and 'padding'
+ * isn't ELF_INTERN_NONE), and to 'gap' otherwise
+ */
+static bool _sweep(ELF_SizeTable *table, Pieces *pieces, uint64_t fileSize,
+	uint32_t gap, uint32_t padding) {
+	if( pieces->num > 0 ) {
+		qsort(pieces->items, pieces->num, sizeof(*pieces->items),
+			_comparePieces);
+	}
+
+	uint64_t pos = 0;
+
+	for( uint32_t i = 0; i <= pieces->num; ++i ) {
+		const bool LAST = i == pieces->num;
+		const uint64_t START = LAST ? fileSize : pieces->items[i].start;
+
+		if( START > pos ) {
+			const Piece *NEXT = LAST ? NULL : &pieces->items[i];
+			const bool PADDING = padding != ELF_INTERN_NONE && NEXT != NULL
+				&& NEXT->align > 1 && START - pos < NEXT->align
+				&& (NEXT->segment || START % NEXT->align == 0);
+
+			ELF_SizeEntry *entry = _entry(table, PADDING ? padding : gap);
+			if( entry == NULL ) {
+				return false;
+			}
+
+			entry->bytes += START - pos;
+			entry->files = 1;
+			pos = START;
+		}
+
+		if( LAST || pieces->items[i].end <= pos ) {
+			continue;
+		}
+
+		ELF_SizeEntry *entry = _entry(table, pieces->items[i].nameId);
+		if( entry == NULL ) {
+			return false;
+		}
+
+		entry->bytes += pieces->items[i].end - pos;
+		entry->files = 1;
+		pos = pieces->items[i].end;
+	}
+
+	return true;
+}
+
+/* Orders pieces by start, longest first, then by name */
+static int _comparePieces(const void *A, const void *B) {
+	const Piece *PA = A;
+	const Piece *PB = B;
+
+	if( PA->start != PB->start ) {
+		return PA->start < PB->start ? -1 : 1;
+	}
+
+	if( PA->end != PB->end ) {
+		return PA->end > PB->end ? -1 : 1;
+	}
+
+	return strcmp(elfInternString(PA->nameId), elfInternString(PB->nameId));
+}
+
+/* Attributes the file to its PT_LOAD segments, named after their flags */
+static bool _segments(ELF_SizeReport *report, ELF *elf) {
+	Pieces pieces = { NULL, 0, 0, true };
+
+	for( uint16_t i = 0; i < elf->header.progHeaderEntryNum; ++i ) {
+		const ELF_PHEntry *PH = &elf->ph[i];
+		if( PH->type != ELF_PHT_LOAD ) {
+			continue;
+		}
+
+		char name[SEGMENT_NAME_SIZE];
+		snprintf(name, sizeof(name), "LOAD %c%c%c",
+			(PH->flags & ELF_PHF_R) ? 'R' : '-',
+			(PH->flags & ELF_PHF_W) ? 'W' : '-',
+			(PH->flags & ELF_PHF_X) ? 'X' : '-');
+
+		_push(&pieces, PH->offset, PH->fileSize, 0, _name(name, &pieces.ok),
+			elf->imageSize);
+	}
+
+	bool ok = pieces.ok;
+	const uint32_t GAP = _name("[not loaded]", &ok);
+
+	ok = ok
+		&& _sweep(&report->tables[ELF_SIZE_SEGMENT], &pieces, elf->imageSize,
+			GAP, ELF_INTERN_NONE);
+
+	free(pieces.items);
+	return ok;
+}
+
+/* Attributes the file to its sections and header tables
+ * A section's start must honour its own alignment, or its segment's if it's
+ * the first one in it
+ */
+static bool _sections(ELF_SizeReport *report, ELF *elf) {
+	const ELF_Header *HEADER = &elf->header;
+	Pieces pieces = { NULL, 0, 0, true };
+
+	const uint64_t WORD = HEADER->ident.class == ELF_CLASS_32_BIT ? 4 : 8;
+
+	_push(&pieces, 0, HEADER->headerSize, 0,
+		_name("[ELF header]", &pieces.ok), elf->imageSize);
+	_push(&pieces, HEADER->progHeaderOffset,
+		(uint64_t)HEADER->progHeaderEntryNum * HEADER->progHeaderEntrySize,
+		WORD, _name("[program headers]", &pieces.ok), elf->imageSize);
+	_push(&pieces, HEADER->sectHeaderOffset,
+		(uint64_t)HEADER->sectHeaderEntryNum * HEADER->sectHeaderEntrySize,
+		WORD, _name("[section headers]", &pieces.ok), elf->imageSize);
+
+	const uint32_t UNNAMED = _name("[unnamed]", &pieces.ok);
+
+	for( uint32_t i = 0; i < HEADER->sectHeaderEntryNum; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		if( SH->type == ELF_SHT_NULL || SH->type == ELF_SHT_NOBITS ) {
+			continue;
+		}
+
+		Piece *piece = _push(&pieces, SH->offset, SH->size, SH->addrAlign,
+			SH->nameId != ELF_INTERN_NONE ? SH->nameId : UNNAMED,
+			elf->imageSize);
+
+		for( uint16_t p = 0; piece != NULL && p < HEADER->progHeaderEntryNum;
+			 ++p ) {
+			const ELF_PHEntry *PH = &elf->ph[p];
+			if( PH->type == ELF_PHT_LOAD && PH->offset == SH->offset
+				&& PH->align > piece->align ) {
+				piece->align = PH->align;
+				piece->segment = true;
+			}
+		}
+	}
+
+	bool ok = pieces.ok;
+	const uint32_t GAP = _name("[unaccounted]", &ok);
+	const uint32_t PADDING = _name("[padding]", &ok);
+
+	ok = ok
+		&& _sweep(&report->tables[ELF_SIZE_SECTION], &pieces, elf->imageSize,
+			GAP, PADDING);
+
+	free(pieces.items);
+	return ok;
+}
+
+/* Attributes the file to the symbols of .symtab, or of .dynsym if it's been
+ * stripped. Files without either are left out of the symbol table
+ */
+static bool _symbols(ELF_SizeReport *report, ELF *elf) {
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+	if( KNOWN == NULL ) {
+		return false;
+	}
+
+	const ELF_SHEntry *TABLE = KNOWN->symtab != NULL ? KNOWN->symtab
+													 : KNOWN->dynsym;
+	if( TABLE == NULL ) {
+		return true;
+	}
+
+	ELF_Symbol *symbols;
+	uint32_t num;
+	if( !elfReadSymbols(elf, TABLE, &symbols, &num) ) {
+		return false;
+	}
+
+	const bool RELOCATABLE = elf->header.type == ELF_ET_RELOCATABLE;
+	Pieces pieces = { NULL, 0, 0, true };
+
+	for( uint32_t i = 0; i < num && pieces.ok; ++i ) {
+		const ELF_Symbol *SYM = &symbols[i];
+		const uint8_t TYPE = SYM->info & 0xF;
+
+		if( SYM->size == 0 || *SYM->name == '\0' || TYPE == STT_SECTION
+			|| TYPE == STT_FILE || TYPE == STT_TLS || SYM->section == 0
+			|| SYM->section >= SHN_LORESERVE
+			|| SYM->section >= elf->header.sectHeaderEntryNum ) {
+			continue;
+		}
+
+		const ELF_SHEntry *SH = &elf->sh[SYM->section];
+		if( SH->type == ELF_SHT_NOBITS ) {
+			continue;
+		}
+
+		/* Values are addresses, except in relocatable objects */
+		const uint64_t BASE = RELOCATABLE ? 0 : SH->addr;
+		if( SYM->value < BASE || SYM->value - BASE >= SH->size ) {
+			continue;
+		}
+
+		const uint64_t OFFSET = SYM->value - BASE;
+		const uint64_t SIZE = SYM->size < SH->size - OFFSET
+			? SYM->size
+			: SH->size - OFFSET;
+
+		_push(&pieces, SH->offset + OFFSET, SIZE, 0,
+			_name(SYM->name, &pieces.ok), elf->imageSize);
+	}
+
+	free(symbols);
+
+	bool ok = pieces.ok;
+	const uint32_t GAP = _name("[no symbol]", &ok);
+
+	if( ok && pieces.num > 0 ) {
+		ok = _sweep(&report->tables[ELF_SIZE_SYMBOL], &pieces, elf->imageSize,
+			GAP, ELF_INTERN_NONE);
+	}
+
+	free(pieces.items);
+	return ok;
+}
+
+/* Finds the entry of a name, adding an empty one if there's none
+ * Returns NULL if memory runs out
+ */
+static ELF_SizeEntry *_entry(ELF_SizeTable *table, uint32_t nameId) {
+	/* Keep the table at most half full */
+	if( (table->num + 1) * 2 > table->mask && !_grow(table) ) {
+		return NULL;
+	}
+
+	/* IDs from the same shard of the intern pool differ in their high bits
+	 * only, so mix them down
+	 */
+	uint32_t hash = nameId;
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3Bu;
+	hash ^= hash >> 16;
+
+	uint32_t i = hash & table->mask;
+	for( ; table->entries[i].nameId != ELF_INTERN_NONE;
+		 i = (i + 1) & table->mask ) {
+		if( table->entries[i].nameId == nameId ) {
+			return &table->entries[i];
+		}
+	}
+
+	ELF_SizeEntry *entry = &table->entries[i];
+	entry->nameId = nameId;
+	entry->bytes = 0;
+	entry->files = 0;
+
+	++table->num;
+	return entry;
+}
+
+/* Doubles the number of entries of a table */
+static bool _grow(ELF_SizeTable *table) {
+	const uint32_t MASK = table->mask > 0 ? table->mask * 2 + 1 : 63;
+
+	ELF_SizeEntry *entries = utilCalloc((size_t)MASK + 1, sizeof(*entries));
+	if( entries == NULL ) {
+		return false;
+	}
+
+	ELF_SizeTable grown = { entries, MASK, 0 };
+
+	for( uint32_t i = 0; table->entries != NULL && i <= table->mask; ++i ) {
+		const ELF_SizeEntry *OLD = &table->entries[i];
+		if( OLD->nameId == ELF_INTERN_NONE ) {
+			continue;
+		}
+
+		/* Can't fail, the new table has room to spare */
+		*_entry(&grown, OLD->nameId) = *OLD;
+	}
+
+	free(table->entries);
+	*table = grown;
+
+	return true;
+}
+
+/* Orders entries by size, largest first, then by name */
+static int _compareEntries(const void *A, const void *B) {
+	const ELF_SizeEntry *EA = A;
+	const ELF_SizeEntry *EB = B;
+
+	if( EA->bytes != EB->bytes ) {
+		return EA->bytes > EB->bytes ? -1 : 1;
+	}
+
+	return strcmp(elfInternString(EA->nameId), elfInternString(EB->nameId));
+}
@@ -0,0 +1,225 @@
+/* elfp
+ * Phase statistics
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "elfstats.h"
+
+/* RUSAGE_THREAD is Linux's; elsewhere, faults of concurrent files mix */
+#ifdef RUSAGE_THREAD
+#define USAGE_WHO RUSAGE_THREAD
+#else
+#define USAGE_WHO RUSAGE_SELF
+#endif
+
+/* Values below this get a bucket each */
+#define EXACT 8
+
+/* Bits of a value kept past its leading one, for picking a bucket */
+#define SUB_BITS 3
+
+static bool _enabled = false;
+
+static __thread ELF_Stats _stats;
+
+/* Innermost phase running on this thread, plus one (0 if none is) */
+static __thread int _current;
+
+static uint64_t _faults(void);
+static uint64_t _clock(clockid_t clock);
+static unsigned _bucket(uint64_t value);
+static uint64_t _bucketEnd(unsigned bucket);
+
+void elfStatsEnable(void) {
+	_enabled = true;
+}
+
+bool elfStatsEnabled(void) {
+	return _enabled;
+}
+
+void elfPhaseBegin(ELF_PhaseMark *mark, ELF_Phase phase) {
+	if( !_enabled ) {
+		mark->phase = -1;
+		return;
+	}
+
+	mark->phase = phase;
+	mark->outer = _current;
+	_current = phase + 1;
+
+	mark->faults = _faults();
+	mark->cpu = _clock(CLOCK_THREAD_CPUTIME_ID);
+	mark->wall = _clock(CLOCK_MONOTONIC);
+}
+
+void elfPhaseEnd(ELF_PhaseMark *mark, uint64_t bytes) {
+	if( mark->phase < 0 ) {
+		return;
+	}
+
+	const uint64_t WALL = _clock(CLOCK_MONOTONIC);
+	const uint64_t CPU = _clock(CLOCK_THREAD_CPUTIME_ID);
+	const uint64_t FAULTS = _faults();
+
+	uint64_t *values = _stats.values[mark->phase];
+	values[ELF_STAT_WALL] += WALL - mark->wall;
+	values[ELF_STAT_CPU] += CPU - mark->cpu;
+	values[ELF_STAT_FAULTS] += FAULTS - mark->faults;
+	values[ELF_STAT_BYTES] += bytes;
+
+	_current = mark->outer;
+}
+
+void elfPhaseSwap(ELF_Phase phase, uint64_t values[ELF_STAT_NUM]) {
+	uint64_t *current = _stats.values[phase];
+
+	for( int s = 0; s < ELF_STAT_NUM; ++s ) {
+		const uint64_t VALUE = current[s];
+		current[s] = values[s];
+		values[s] = VALUE;
+	}
+}
+
+void elfStatsAlloc(size_t bytes) {
+	if( _current == 0 ) {
+		return;
+	}
+
+	uint64_t *values = _stats.values[_current - 1];
+	++values[ELF_STAT_ALLOCS];
+	values[ELF_STAT_ALLOC_BYTES] += bytes;
+}
+
+void elfStatsTake(ELF_Stats *stats) {
+	*stats = _stats;
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+void elfStatsSummaryAdd(ELF_StatsSummary *summary, const ELF_Stats *STATS) {
+	uint64_t file[ELF_STAT_NUM] = { 0 };
+
+	for( int p = 0; p < ELF_PHASE_NUM; ++p ) {
+		for( int s = 0; s < ELF_STAT_NUM; ++s ) {
+			elfHistogramAdd(&summary->histograms[p][s], STATS->values[p][s]);
+			file[s] += STATS->values[p][s];
+		}
+	}
+
+	for( int s = 0; s < ELF_STAT_NUM; ++s ) {
+		elfHistogramAdd(&summary->histograms[ELF_PHASE_NUM][s], file[s]);
+	}
+
+	++summary->files;
+}
+
+void elfHistogramAdd(ELF_Histogram *histogram, uint64_t value) {
+	++histogram->counts[_bucket(value)];
+	++histogram->num;
+	histogram->sum += value;
+
+	if( value > histogram->max ) {
+		histogram->max = value;
+	}
+}
+
+uint64_t elfHistogramPercentile(const ELF_Histogram *HISTOGRAM,
+	unsigned percent) {
+	if( HISTOGRAM->num == 0 ) {
+		return 0;
+	}
+
+	/* Rank of the sample wanted, from 1 */
+	uint64_t rank = (HISTOGRAM->num * percent + 99) / 100;
+	if( rank == 0 ) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for( unsigned b = 0; b < ELF_HISTOGRAM_BUCKETS; ++b ) {
+		seen += HISTOGRAM->counts[b];
+		if( seen >= rank ) {
+			const uint64_t END = _bucketEnd(b);
+			return END < HISTOGRAM->max ? END : HISTOGRAM->max;
+		}
+	}
+
+	return HISTOGRAM->max;
+}
+
+const char *elfPhaseName(ELF_Phase phase) {
+	switch( phase ) {
+	case ELF_PHASE_READ:
+		return "read";
+	case ELF_PHASE_ENTRY_HEADER:
+		return "entry header";
+	case ELF_PHASE_PROG_HEADERS:
+		return "program headers";
+	case ELF_PHASE_SECT_HEADERS:
+		return "section headers";
+	case ELF_PHASE_DUMP:
+		return "dump";
+	default:
+		return "?";
+	}
+}
+
+/* Returns the page faults of this thread so far */
+static uint64_t _faults(void) {
+	struct rusage usage;
+	if( getrusage(USAGE_WHO, &usage) != 0 ) {
+		return 0;
+	}
+
+	return (uint64_t)usage.ru_minflt + usage.ru_majflt;
+}
+
+/* Reads a clock, in ns
+ * getrusage has CPU times too, but only as fine as the scheduler's tick
+ */
+static uint64_t _clock(clockid_t clock) {
+	struct timespec now;
+	if( clock_gettime(clock, &now) != 0 ) {
+		return 0;
+	}
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/* Buckets past the exact ones come EXACT per power of two, telling values
+ * apart by the SUB_BITS bits after their leading one
+ */
+static unsigned _bucket(uint64_t value) {
+	if( value < EXACT ) {
+		return value;
+	}
+
+	const unsigned LOG = 63 - __builtin_clzll(value);
+	const unsigned SUB = (value >> (LOG - SUB_BITS)) & (EXACT - 1);
+
+	return EXACT + (LOG - SUB_BITS) * EXACT + SUB;
+}
+
+/* Returns the largest value falling in a bucket */
+static uint64_t _bucketEnd(unsigned bucket) {
+	if( bucket < EXACT ) {
+		return bucket;
+	}
+
+	const unsigned SHIFT = (bucket - EXACT) / EXACT;
+	const uint64_t SUB = (bucket - EXACT) % EXACT;
+
+	if( SHIFT == 64 - SUB_BITS - 1 && SUB == EXACT - 1 ) {
+		return UINT64_MAX;
+	}
+
+	return ((EXACT + SUB + 1) << SHIFT) - 1;
+}
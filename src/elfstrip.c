@@ -0,0 +1,1032 @@
+/* elfp
+ * Section removal
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "elfintern.h"
+#include "elfp.h"
+#include "util.h"
+
+#include "elfstrip.h"
+
+/* Sizes of the Entry Header, and of Section Header and symbol entries, for
+ * 64-bit (wide) or 32-bit files
+ */
+#define EH_SIZE(W) ((W) ? 64 : 52)
+#define SH_SIZE(W) ((W) ? 64 : 40)
+#define SYM_SIZE(W) ((W) ? 24 : 16)
+
+/* Offsets of st_info and st_shndx in a symbol entry */
+#define SYM_INFO(W) ((W) ? 4 : 12)
+#define SYM_SHNDX(W) ((W) ? 6 : 14)
+
+/* Symbol type standing for a section, in the low nibble of st_info */
+#define STT_SECTION 3
+
+/* Runs of sections from this long on are placed so that their blocks line up
+ * with the input's, letting the filesystem clone them rather than copy
+ */
+#define CLONE_MIN ((uint64_t)64 << 10)
+#define CLONE_BLOCK 4096
+
+/* Most bytes handed to copy_file_range at once */
+#define COPY_CHUNK ((size_t)1 << 30)
+
+/* What becomes of a section */
+enum {
+	KEEP = 0,
+	REMOVE,
+	EMPTY, /* Kept, but as SHT_NOBITS */
+};
+
+/* Range of the input copied as it is */
+typedef struct _Copy {
+	uint64_t from;
+	uint64_t to;
+	uint64_t size;
+} Copy;
+
+/* Bytes written from memory */
+typedef struct _Patch {
+	uint64_t to;
+	uint8_t *data;
+	uint64_t size;
+} Patch;
+
+/* Stretch of the input past its fixed start that belongs to a section, or to
+ * the old Section Header table. Only kept ones are carried over
+ */
+typedef struct _Piece {
+	uint64_t offset;
+	uint64_t size;
+	uint64_t align;
+	uint32_t index;
+	bool kept;
+} Piece;
+
+/* Layout of the output, worked out in full before anything is written */
+typedef struct _Plan {
+	ELF *elf;
+	bool wide;
+	bool le;
+	uint32_t num; /* Sections of the input */
+
+	uint8_t *actions; /* KEEP, REMOVE or EMPTY, per section */
+	uint32_t *indices; /* New index of each section not removed */
+	uint32_t kept; /* Sections not removed */
+
+	uint64_t *offsets; /* New offset of each section */
+	uint64_t *sizes; /* New size of each section */
+
+	uint64_t fixedEnd; /* The input up to here is copied as it is */
+	uint64_t shOffset; /* Where the new Section Header table goes */
+	uint64_t size;
+
+	Copy *copies;
+	size_t copyNum;
+	size_t copyCap;
+
+	Patch *patches;
+	size_t patchNum;
+	size_t patchCap;
+
+	bool noCopy; /* Whether copy_file_range failed for good */
+} Plan;
+
+static void _mark(
+	Plan *plan, const ELF_StripOptions *OPTIONS, ELF_StripResult *result);
+static bool _groupGone(Plan *plan, uint32_t idx);
+static ELF_StripError _check(Plan *plan, ELF_StripResult *result);
+static bool _refersToRemoved(Plan *plan, uint32_t index);
+static bool _infoIsIndex(const ELF_SHEntry *SH);
+
+static ELF_StripError _layout(
+	Plan *plan, ELF_StripMode mode, ELF_StripResult *result);
+static uint64_t _fixedEnd(Plan *plan, ELF_StripMode mode);
+static Piece *_pieces(Plan *plan, size_t *num);
+static int _comparePieces(const void *A, const void *B);
+static uint64_t _alignOf(uint64_t align);
+
+static ELF_StripError _rewriteSymbols(
+	Plan *plan, uint32_t idx, ELF_StripResult *result);
+static ELF_StripError _rewriteGroup(Plan *plan, uint32_t idx);
+static ELF_StripError _rewriteHeaders(Plan *plan, ELF_StripMode mode);
+static uint8_t *_putSection(Plan *plan, uint8_t *at, uint32_t idx);
+
+static bool _addCopy(Plan *plan, uint64_t from, uint64_t to, uint64_t size);
+static bool _addPatch(Plan *plan, uint64_t to, uint8_t *data, uint64_t size);
+
+static ELF_StripError _write(
+	Plan *plan, int in, int out, ELF_StripResult *result);
+static bool _copy(Plan *plan, int in, int out, const Copy *COPY,
+	ELF_StripResult *result);
+static bool _writeAll(int fd, const void *DATA, uint64_t size, uint64_t to);
+
+static uint8_t *_put(uint8_t *at, uint64_t value, unsigned size, bool le);
+static uint64_t _get(const uint8_t *AT, unsigned size, bool le);
+
+static void _freePlan(Plan *plan);
+
+bool elfStrip(ELF *elf, int in, int out, const ELF_StripOptions *OPTIONS,
+	ELF_StripResult *result) {
+	memset(result, 0, sizeof(*result));
+
+	Plan plan;
+	memset(&plan, 0, sizeof(plan));
+	plan.elf = elf;
+	plan.wide = elf->header.ident.class != ELF_CLASS_32_BIT;
+	plan.le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	plan.num = elf->header.sectHeaderEntryNum;
+
+	const uint32_t NUM = plan.num > 0 ? plan.num : 1;
+	plan.actions = utilCalloc(NUM, sizeof(*plan.actions));
+	plan.indices = utilCalloc(NUM, sizeof(*plan.indices));
+	plan.offsets = utilCalloc(NUM, sizeof(*plan.offsets));
+	plan.sizes = utilCalloc(NUM, sizeof(*plan.sizes));
+
+	ELF_StripError error = ELF_STRIP_OK;
+	if( plan.actions == NULL || plan.indices == NULL || plan.offsets == NULL
+		|| plan.sizes == NULL ) {
+		error = ELF_STRIP_ERR_NOMEM;
+	} else if( elf->imageSize < (size_t)EH_SIZE(plan.wide) ) {
+		error = ELF_STRIP_ERR_BOUNDS;
+	}
+
+	/* Without sections, there's nothing to strip */
+	if( error == ELF_STRIP_OK && plan.num == 0 ) {
+		plan.size = elf->imageSize;
+		error = _addCopy(&plan, 0, 0, plan.size) ? ELF_STRIP_OK
+												 : ELF_STRIP_ERR_NOMEM;
+	} else if( error == ELF_STRIP_OK ) {
+		_mark(&plan, OPTIONS, result);
+		error = _check(&plan, result);
+
+		if( error == ELF_STRIP_OK ) {
+			error = _layout(&plan, OPTIONS->mode, result);
+		}
+	}
+
+	if( error == ELF_STRIP_OK ) {
+		error = _write(&plan, in, out, result);
+	}
+
+	result->error = error;
+	_freePlan(&plan);
+
+	return error == ELF_STRIP_OK;
+}
+
+bool elfIsDebugSection(const char *NAME) {
+	static const char *const PREFIXES[] = {
+		".debug",
+		".zdebug",
+		".gnu.linkonce.wi.",
+		".line",
+		".stab",
+		".gdb_index",
+	};
+
+	for( size_t i = 0; i < sizeof(PREFIXES) / sizeof(*PREFIXES); ++i ) {
+		if( strncmp(NAME, PREFIXES[i], strlen(PREFIXES[i])) == 0 ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char *elfStripErrorString(ELF_StripError error) {
+	switch( error ) {
+	case ELF_STRIP_OK:
+		return "no error";
+	case ELF_STRIP_ERR_IO:
+		return "couldn't copy the file";
+	case ELF_STRIP_ERR_NOMEM:
+		return "an error occurred while allocating memory";
+	case ELF_STRIP_ERR_LOADED:
+		return "section is loaded by a segment, it can't be removed";
+	case ELF_STRIP_ERR_LINKED:
+		return "section refers to a section being removed";
+	case ELF_STRIP_ERR_SYMBOL:
+		return "symbols are defined in a section being removed";
+	case ELF_STRIP_ERR_XINDEX:
+		return "extended section indices can't be renumbered";
+	case ELF_STRIP_ERR_BOUNDS:
+		return "section lies past the end of the file";
+	default:
+		return "unknown error";
+	}
+}
+
+/* Decides what becomes of each section */
+static void _mark(
+	Plan *plan, const ELF_StripOptions *OPTIONS, ELF_StripResult *result) {
+	ELF *elf = plan->elf;
+
+	/* Names are compared as interned IDs; one nobody interned matches
+	 * nothing
+	 */
+	for( size_t n = 0; n < OPTIONS->removeNum; ++n ) {
+		const char *NAME = OPTIONS->remove[n];
+		const uint32_t ID = elfInternFind(NAME, strlen(NAME));
+
+		for( uint32_t i = 1; ID != ELF_INTERN_NONE && i < plan->num; ++i ) {
+			if( elf->sh[i].nameId == ID ) {
+				plan->actions[i] = REMOVE;
+			}
+		}
+	}
+
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		const bool DEBUG = elfIsDebugSection(elfInternString(SH->nameId));
+
+		if( OPTIONS->mode == ELF_STRIP_DEBUG && DEBUG
+			&& !(SH->flags & ELF_SHF_ALLOC) ) {
+			plan->actions[i] = REMOVE;
+		} else if( OPTIONS->mode == ELF_STRIP_KEEP_DEBUG
+			&& plan->actions[i] == KEEP && (SH->flags & ELF_SHF_ALLOC)
+			&& SH->type != ELF_SHT_NOBITS && SH->type != ELF_SHT_NOTE ) {
+			plan->actions[i] = EMPTY;
+		}
+	}
+
+	/* Relocations go with the section they apply to... */
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		if( (SH->type == ELF_SHT_RELOC || SH->type == ELF_SHT_RELOC_A)
+			&& SH->info != 0 && SH->info < plan->num
+			&& plan->actions[SH->info] == REMOVE ) {
+			plan->actions[i] = REMOVE;
+		}
+	}
+
+	/* ...and groups, with the last of their members */
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		if( elf->sh[i].type == ELF_SHT_GROUP && plan->actions[i] == KEEP
+			&& _groupGone(plan, i) ) {
+			plan->actions[i] = REMOVE;
+		}
+	}
+
+	for( uint32_t i = 0; i < plan->num; ++i ) {
+		if( plan->actions[i] == REMOVE ) {
+			++result->removed;
+			continue;
+		}
+
+		result->emptied += plan->actions[i] == EMPTY;
+		plan->indices[i] = plan->kept++;
+	}
+}
+
+/* Returns whether every member of a group is being removed */
+static bool _groupGone(Plan *plan, uint32_t idx) {
+	const ELF_SHEntry *SH = &plan->elf->sh[idx];
+	if( SH->size < 8 || SH->offset > plan->elf->imageSize
+		|| SH->size > plan->elf->imageSize - SH->offset ) {
+		return false;
+	}
+
+	/* The first word holds the group's flags, the rest its members */
+	const uint8_t *WORDS = (const uint8_t *)plan->elf->image + SH->offset;
+	for( uint64_t w = 1; w < SH->size / 4; ++w ) {
+		const uint64_t MEMBER = _get(WORDS + w * 4, 4, plan->le);
+		if( MEMBER >= plan->num || plan->actions[MEMBER] != REMOVE ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Checks that what's left still holds together */
+static ELF_StripError _check(Plan *plan, ELF_StripResult *result) {
+	ELF *elf = plan->elf;
+	const bool LOADED = elf->header.progHeaderEntryNum > 0;
+
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		result->section = i;
+
+		if( plan->actions[i] == REMOVE ) {
+			if( LOADED && (SH->flags & ELF_SHF_ALLOC) ) {
+				return ELF_STRIP_ERR_LOADED;
+			}
+
+			continue;
+		}
+
+		if( _refersToRemoved(plan, SH->link)
+			|| (_infoIsIndex(SH) && _refersToRemoved(plan, SH->info)) ) {
+			return ELF_STRIP_ERR_LINKED;
+		}
+
+		/* Symbols are renumbered in place, but their extended indices
+		 * would have to be too
+		 */
+		if( SH->type == ELF_SHT_SYMTAB_EXT && result->removed > 0 ) {
+			return ELF_STRIP_ERR_XINDEX;
+		}
+	}
+
+	const uint32_t NAMES = elf->header.sectHeaderNameIndex;
+	if( _refersToRemoved(plan, NAMES) ) {
+		result->section = NAMES;
+		return ELF_STRIP_ERR_LINKED;
+	}
+
+	result->section = 0;
+	return ELF_STRIP_OK;
+}
+
+/* Returns whether a section index refers to a section being removed */
+static bool _refersToRemoved(Plan *plan, uint32_t index) {
+	return index != 0 && index < plan->num && plan->actions[index] == REMOVE;
+}
+
+/* Returns whether sh_info holds a section index */
+static bool _infoIsIndex(const ELF_SHEntry *SH) {
+	return SH->type == ELF_SHT_RELOC || SH->type == ELF_SHT_RELOC_A
+		|| (SH->flags & ELF_SHF_INFO);
+}
+
+/* Places each section in the output, and lists what to copy and write */
+static ELF_StripError _layout(
+	Plan *plan, ELF_StripMode mode, ELF_StripResult *result) {
+	ELF *elf = plan->elf;
+
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		if( plan->actions[i] == KEEP && SH->type != ELF_SHT_NOBITS
+			&& (SH->offset > elf->imageSize
+				|| SH->size > elf->imageSize - SH->offset) ) {
+			result->section = i;
+			return ELF_STRIP_ERR_BOUNDS;
+		}
+	}
+
+	plan->fixedEnd = _fixedEnd(plan, mode);
+
+	if( !_addCopy(plan, 0, 0, plan->fixedEnd) ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	/* Whatever isn't moved below stays where it is. Sections losing their
+	 * bytes are put no further than the fixed start
+	 */
+	for( uint32_t i = 0; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+
+		plan->offsets[i] = SH->offset;
+		plan->sizes[i] = SH->size;
+
+		if( plan->actions[i] == EMPTY && SH->offset > plan->fixedEnd ) {
+			plan->offsets[i] = plan->fixedEnd;
+		}
+	}
+
+	size_t pieceNum;
+	Piece *pieces = _pieces(plan, &pieceNum);
+	if( pieces == NULL ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	/* Sections that were contiguous in the input form a run, which moves as
+	 * one piece: a single copy, keeping the padding between them
+	 */
+	uint64_t cursor = plan->fixedEnd;
+	for( size_t p = 0; p < pieceNum; ) {
+		if( !pieces[p].kept ) {
+			++p;
+			continue;
+		}
+
+		const uint64_t FIRST = pieces[p].offset;
+		uint64_t end = FIRST + pieces[p].size;
+		uint64_t align = pieces[p].align;
+
+		size_t last = p;
+		while( last + 1 < pieceNum && pieces[last + 1].kept
+			&& pieces[last + 1].offset >= end
+			&& pieces[last + 1].offset - end < pieces[last + 1].align ) {
+			++last;
+			end = pieces[last].offset + pieces[last].size;
+			align = pieces[last].align > align ? pieces[last].align : align;
+		}
+
+		if( end - FIRST >= CLONE_MIN ) {
+			align = CLONE_BLOCK;
+		}
+
+		/* The run keeps its offset modulo its alignment, so whatever was
+		 * aligned in the input still is
+		 */
+		const uint64_t TO
+			= cursor + (FIRST % align + align - cursor % align) % align;
+
+		for( size_t q = p; q <= last; ++q ) {
+			plan->offsets[pieces[q].index] = pieces[q].offset - FIRST + TO;
+		}
+
+		if( end > FIRST && !_addCopy(plan, FIRST, TO, end - FIRST) ) {
+			free(pieces);
+			return ELF_STRIP_ERR_NOMEM;
+		}
+
+		cursor = TO + (end - FIRST);
+		p = last + 1;
+	}
+
+	free(pieces);
+
+	const uint64_t TABLE_ALIGN = plan->wide ? 8 : 4;
+	plan->shOffset = (cursor + TABLE_ALIGN - 1) & ~(TABLE_ALIGN - 1);
+	plan->size = plan->shOffset + (uint64_t)plan->kept * SH_SIZE(plan->wide);
+
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		if( plan->actions[i] != KEEP ) {
+			continue;
+		}
+
+		ELF_StripError error = ELF_STRIP_OK;
+		switch( elf->sh[i].type ) {
+		case ELF_SHT_SYMTAB:
+		case ELF_SHT_DYNSYM:
+			error = _rewriteSymbols(plan, i, result);
+			break;
+		case ELF_SHT_GROUP:
+			error = _rewriteGroup(plan, i);
+			break;
+		default:
+			break;
+		}
+
+		if( error != ELF_STRIP_OK ) {
+			return error;
+		}
+	}
+
+	return _rewriteHeaders(plan, mode);
+}
+
+/* Returns where the part of the input copied as it is ends
+ * That's past the headers and, unless they're being emptied, everything the
+ * segments load: those bytes can't move
+ */
+static uint64_t _fixedEnd(Plan *plan, ELF_StripMode mode) {
+	ELF *elf = plan->elf;
+	const ELF_Header *HEADER = &elf->header;
+	const uint64_t SIZE = elf->imageSize;
+
+	uint64_t end = EH_SIZE(plan->wide);
+
+	if( HEADER->progHeaderEntryNum > 0 ) {
+		const uint64_t TABLE_END = HEADER->progHeaderOffset
+			+ (uint64_t)HEADER->progHeaderEntryNum
+				* HEADER->progHeaderEntrySize;
+		end = TABLE_END > end ? TABLE_END : end;
+	}
+
+	for( uint16_t i = 0; mode != ELF_STRIP_KEEP_DEBUG
+		&& i < HEADER->progHeaderEntryNum; ++i ) {
+		const ELF_PHEntry *PH = &elf->ph[i];
+		const uint64_t PH_END = PH->offset < SIZE && PH->fileSize < SIZE
+			? PH->offset + PH->fileSize
+			: SIZE;
+
+		end = PH_END > end ? PH_END : end;
+	}
+
+	/* Loaded sections outside any segment (which would be odd) stay put
+	 * too. Without segments, nothing is loaded from a fixed offset
+	 */
+	for( uint32_t i = 1; HEADER->progHeaderEntryNum > 0 && i < plan->num;
+		++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		if( plan->actions[i] != KEEP || !(SH->flags & ELF_SHF_ALLOC)
+			|| SH->type == ELF_SHT_NOBITS ) {
+			continue;
+		}
+
+		const uint64_t SH_END = SH->offset < SIZE && SH->size < SIZE
+			? SH->offset + SH->size
+			: SIZE;
+		end = SH_END > end ? SH_END : end;
+	}
+
+	return end < SIZE ? end : SIZE;
+}
+
+/* Lists, by offset, the sections with bytes past the fixed start, along with
+ * the old Section Header table. Sections dropped are listed too, so that no
+ * run of kept ones spans them
+ */
+static Piece *_pieces(Plan *plan, size_t *num) {
+	ELF *elf = plan->elf;
+
+	Piece *pieces = utilMalloc(sizeof(*pieces) * ((size_t)plan->num + 1));
+	if( pieces == NULL ) {
+		return NULL;
+	}
+
+	/* Sections without bytes (like .bss) are listed too, so that they move
+	 * along with the run they sit in
+	 */
+	size_t n = 0;
+	for( uint32_t i = 1; i < plan->num; ++i ) {
+		const ELF_SHEntry *SH = &elf->sh[i];
+		const uint64_t SIZE = SH->type != ELF_SHT_NOBITS ? SH->size : 0;
+
+		const bool KEPT = plan->actions[i] == KEEP;
+		const bool FIXED = SH->offset <= plan->fixedEnd
+			&& SIZE <= plan->fixedEnd - SH->offset;
+
+		if( FIXED || (!KEPT && SIZE == 0) ) {
+			continue;
+		}
+
+		Piece *piece = &pieces[n++];
+		piece->offset = SH->offset;
+		piece->size = SIZE;
+		piece->align = _alignOf(SH->addrAlign);
+		piece->index = i;
+		piece->kept = KEPT;
+	}
+
+	const ELF_Header *HEADER = &elf->header;
+
+	Piece *table = &pieces[n++];
+	table->offset = HEADER->sectHeaderOffset;
+	table->size
+		= (uint64_t)HEADER->sectHeaderEntryNum * HEADER->sectHeaderEntrySize;
+	table->align = 1;
+	table->index = 0;
+	table->kept = false;
+
+	qsort(pieces, n, sizeof(*pieces), _comparePieces);
+
+	*num = n;
+	return pieces;
+}
+
+/* Orders pieces by offset, then by section index */
+static int _comparePieces(const void *A, const void *B) {
+	const Piece *PA = A;
+	const Piece *PB = B;
+
+	if( PA->offset != PB->offset ) {
+		return PA->offset < PB->offset ? -1 : 1;
+	}
+
+	return PA->index < PB->index ? -1 : PA->index > PB->index;
+}
+
+/* Returns the alignment a section's bytes are placed with
+ * Past a block, alignment buys a reader nothing, and a bogus sh_addralign
+ * could otherwise pad the output without bound
+ */
+static uint64_t _alignOf(uint64_t align) {
+	if( align <= 1 || (align & (align - 1)) != 0 ) {
+		return 1;
+	}
+
+	return align < CLONE_BLOCK ? align : CLONE_BLOCK;
+}
+
+/* Renumbers the section indices of a symbol table
+ * Symbols standing for a section being removed, or naming a group being
+ * removed, are left undefined; any other symbol defined in one is an error
+ */
+static ELF_StripError _rewriteSymbols(
+	Plan *plan, uint32_t idx, ELF_StripResult *result) {
+	ELF *elf = plan->elf;
+	const ELF_SHEntry *SH = &elf->sh[idx];
+
+	if( result->removed == 0 ) {
+		return ELF_STRIP_OK;
+	}
+
+	if( SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		result->section = idx;
+		return ELF_STRIP_ERR_BOUNDS;
+	}
+
+	const uint8_t *SYMBOLS = (const uint8_t *)elf->image + SH->offset;
+	const uint64_t NUM = SH->size / SYM_SIZE(plan->wide);
+	uint8_t *copy = NULL;
+
+	for( uint64_t s = 0; s < NUM; ++s ) {
+		const uint64_t AT = s * SYM_SIZE(plan->wide);
+		const uint64_t SHNDX
+			= _get(SYMBOLS + AT + SYM_SHNDX(plan->wide), 2, plan->le);
+
+		if( SHNDX == ELF_SHN_UNDEF || SHNDX >= ELF_SHN_LORESERVE
+			|| SHNDX >= plan->num ) {
+			continue;
+		}
+
+		uint64_t index = plan->indices[SHNDX];
+		if( plan->actions[SHNDX] == REMOVE ) {
+			if( (SYMBOLS[AT + SYM_INFO(plan->wide)] & 0xF) != STT_SECTION
+				&& elf->sh[SHNDX].type != ELF_SHT_GROUP ) {
+				free(copy);
+				result->section = SHNDX;
+				return ELF_STRIP_ERR_SYMBOL;
+			}
+
+			index = ELF_SHN_UNDEF;
+		}
+
+		/* Indices past the reserved ones would need SHT_SYMTAB_SHNDX */
+		if( index >= ELF_SHN_LORESERVE ) {
+			free(copy);
+			result->section = idx;
+			return ELF_STRIP_ERR_XINDEX;
+		}
+
+		if( index == SHNDX ) {
+			continue;
+		}
+
+		if( copy == NULL ) {
+			copy = utilMalloc(SH->size);
+			if( copy == NULL ) {
+				return ELF_STRIP_ERR_NOMEM;
+			}
+
+			memcpy(copy, SYMBOLS, SH->size);
+		}
+
+		_put(copy + AT + SYM_SHNDX(plan->wide), index, 2, plan->le);
+	}
+
+	if( copy != NULL && !_addPatch(plan, plan->offsets[idx], copy, SH->size) ) {
+		free(copy);
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	return ELF_STRIP_OK;
+}
+
+/* Renumbers the members of a section group, dropping those being removed */
+static ELF_StripError _rewriteGroup(Plan *plan, uint32_t idx) {
+	ELF *elf = plan->elf;
+	const ELF_SHEntry *SH = &elf->sh[idx];
+
+	if( SH->size < 4 || SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		return ELF_STRIP_OK;
+	}
+
+	const uint8_t *WORDS = (const uint8_t *)elf->image + SH->offset;
+	const uint64_t NUM = SH->size / 4;
+
+	uint8_t *copy = utilMalloc(SH->size);
+	if( copy == NULL ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	memcpy(copy, WORDS, 4);
+
+	bool changed = false;
+	uint64_t kept = 1;
+	for( uint64_t w = 1; w < NUM; ++w ) {
+		const uint64_t MEMBER = _get(WORDS + w * 4, 4, plan->le);
+		uint64_t index = MEMBER;
+
+		if( MEMBER < plan->num ) {
+			if( plan->actions[MEMBER] == REMOVE ) {
+				changed = true;
+				continue;
+			}
+
+			index = plan->indices[MEMBER];
+		}
+
+		changed |= index != MEMBER;
+		_put(copy + kept++ * 4, index, 4, plan->le);
+	}
+
+	if( !changed ) {
+		free(copy);
+		return ELF_STRIP_OK;
+	}
+
+	plan->sizes[idx] = kept * 4;
+	if( !_addPatch(plan, plan->offsets[idx], copy, kept * 4) ) {
+		free(copy);
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	return ELF_STRIP_OK;
+}
+
+/* Writes the new Entry Header and Section Header table, and the Program
+ * Header table of a debug file, whose segments lost their bytes
+ */
+static ELF_StripError _rewriteHeaders(Plan *plan, ELF_StripMode mode) {
+	ELF *elf = plan->elf;
+	const bool WIDE = plan->wide;
+	const bool LE = plan->le;
+
+	/* Section counts and indices too large for the Entry Header go in the
+	 * first section header instead
+	 */
+	const uint32_t NAMES_OLD = elf->header.sectHeaderNameIndex;
+	const uint32_t NAMES = NAMES_OLD < plan->num ? plan->indices[NAMES_OLD]
+												 : NAMES_OLD;
+	const bool MANY = plan->kept >= ELF_SHN_LORESERVE;
+	const bool FAR_NAMES = NAMES >= ELF_SHN_LORESERVE;
+
+	uint8_t *header = utilMalloc(EH_SIZE(WIDE));
+	if( header == NULL ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	memcpy(header, elf->image, EH_SIZE(WIDE));
+
+	uint8_t *at = header + (WIDE ? 0x28 : 0x20);
+	at = _put(at, plan->shOffset, WIDE ? 8 : 4, LE);
+	at += 6; /* e_flags, e_ehsize */
+	at += 4; /* e_phentsize, e_phnum */
+	at = _put(at, SH_SIZE(WIDE), 2, LE);
+	at = _put(at, MANY ? 0 : plan->kept, 2, LE);
+	_put(at, FAR_NAMES ? ELF_SHN_XINDEX : NAMES, 2, LE);
+
+	if( !_addPatch(plan, 0, header, EH_SIZE(WIDE)) ) {
+		free(header);
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	const uint64_t TABLE_SIZE = (uint64_t)plan->kept * SH_SIZE(WIDE);
+	uint8_t *table = utilMalloc(TABLE_SIZE);
+	if( table == NULL ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	at = table;
+	for( uint32_t i = 0; i < plan->num; ++i ) {
+		if( plan->actions[i] != REMOVE ) {
+			at = _putSection(plan, at, i);
+		}
+	}
+
+	/* The first entry holds the count and name index, if they didn't fit */
+	_put(table + (WIDE ? 0x20 : 0x14), MANY ? plan->kept : 0, WIDE ? 8 : 4, LE);
+	_put(table + (WIDE ? 0x28 : 0x18), FAR_NAMES ? NAMES : 0, 4, LE);
+
+	if( !_addPatch(plan, plan->shOffset, table, TABLE_SIZE) ) {
+		free(table);
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	const ELF_Header *HEADER = &elf->header;
+	if( mode != ELF_STRIP_KEEP_DEBUG || HEADER->progHeaderEntryNum == 0 ) {
+		return ELF_STRIP_OK;
+	}
+
+	/* Segments keep whatever bytes of theirs the fixed start holds (like
+	 * notes), and lose the rest
+	 */
+	const uint64_t PH_TABLE_SIZE
+		= (uint64_t)HEADER->progHeaderEntryNum * HEADER->progHeaderEntrySize;
+	uint8_t *phTable = utilMalloc(PH_TABLE_SIZE);
+	if( phTable == NULL ) {
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	memcpy(phTable, elf->image + HEADER->progHeaderOffset, PH_TABLE_SIZE);
+
+	for( uint16_t i = 0; i < HEADER->progHeaderEntryNum; ++i ) {
+		ELF_PHEntry ph = elf->ph[i];
+		const uint64_t END = ph.fileSize <= plan->fixedEnd
+				&& ph.offset <= plan->fixedEnd - ph.fileSize
+			? ph.offset + ph.fileSize
+			: plan->fixedEnd;
+
+		if( ph.offset >= plan->fixedEnd ) {
+			ph.offset = plan->fixedEnd;
+			ph.fileSize = 0;
+		} else {
+			ph.fileSize = END - ph.offset;
+		}
+
+		at = phTable + (uint64_t)i * HEADER->progHeaderEntrySize;
+		at = _put(at, ph.type, 4, LE);
+		if( WIDE ) {
+			at = _put(at, ph.flags, 4, LE);
+		}
+
+		at = _put(at, ph.offset, WIDE ? 8 : 4, LE);
+		at = _put(at, ph.virtualAddr, WIDE ? 8 : 4, LE);
+		at = _put(at, ph.physicalAddr, WIDE ? 8 : 4, LE);
+		at = _put(at, ph.fileSize, WIDE ? 8 : 4, LE);
+		at = _put(at, ph.memSize, WIDE ? 8 : 4, LE);
+		if( !WIDE ) {
+			at = _put(at, ph.flags, 4, LE);
+		}
+
+		_put(at, ph.align, WIDE ? 8 : 4, LE);
+	}
+
+	if( !_addPatch(plan, HEADER->progHeaderOffset, phTable, PH_TABLE_SIZE) ) {
+		free(phTable);
+		return ELF_STRIP_ERR_NOMEM;
+	}
+
+	return ELF_STRIP_OK;
+}
+
+/* Writes the new header of a section, returning where the next one goes */
+static uint8_t *_putSection(Plan *plan, uint8_t *at, uint32_t idx) {
+	const ELF_SHEntry *SH = &plan->elf->sh[idx];
+	const unsigned WORD = plan->wide ? 8 : 4;
+	const bool LE = plan->le;
+
+	const uint32_t TYPE
+		= plan->actions[idx] == EMPTY ? (uint32_t)ELF_SHT_NOBITS : SH->type;
+	const uint32_t LINK
+		= SH->link < plan->num ? plan->indices[SH->link] : SH->link;
+	const uint32_t INFO = _infoIsIndex(SH) && SH->info < plan->num
+		? plan->indices[SH->info]
+		: SH->info;
+
+	at = _put(at, SH->nameIdx, 4, LE);
+	at = _put(at, TYPE, 4, LE);
+	at = _put(at, SH->flags, WORD, LE);
+	at = _put(at, SH->addr, WORD, LE);
+	at = _put(at, plan->offsets[idx], WORD, LE);
+	at = _put(at, plan->sizes[idx], WORD, LE);
+	at = _put(at, LINK, 4, LE);
+	at = _put(at, INFO, 4, LE);
+	at = _put(at, SH->addrAlign, WORD, LE);
+	return _put(at, SH->entrySize, WORD, LE);
+}
+
+static bool _addCopy(Plan *plan, uint64_t from, uint64_t to, uint64_t size) {
+	if( plan->copyNum == plan->copyCap ) {
+		const size_t CAP = plan->copyCap > 0 ? plan->copyCap * 2 : 16;
+		Copy *copies = utilRealloc(plan->copies, sizeof(*copies) * CAP);
+		if( copies == NULL ) {
+			return false;
+		}
+
+		plan->copies = copies;
+		plan->copyCap = CAP;
+	}
+
+	plan->copies[plan->copyNum++] = (Copy){ from, to, size };
+	return true;
+}
+
+/* Adds bytes to write, which the plan takes ownership of on success */
+static bool _addPatch(Plan *plan, uint64_t to, uint8_t *data, uint64_t size) {
+	if( plan->patchNum == plan->patchCap ) {
+		const size_t CAP = plan->patchCap > 0 ? plan->patchCap * 2 : 8;
+		Patch *patches = utilRealloc(plan->patches, sizeof(*patches) * CAP);
+		if( patches == NULL ) {
+			return false;
+		}
+
+		plan->patches = patches;
+		plan->patchCap = CAP;
+	}
+
+	plan->patches[plan->patchNum++] = (Patch){ to, data, size };
+	return true;
+}
+
+/* Copies the ranges of the plan, then writes its patches over them */
+static ELF_StripError _write(
+	Plan *plan, int in, int out, ELF_StripResult *result) {
+	for( size_t c = 0; c < plan->copyNum; ++c ) {
+		if( !_copy(plan, in, out, &plan->copies[c], result) ) {
+			return ELF_STRIP_ERR_IO;
+		}
+	}
+
+	for( size_t p = 0; p < plan->patchNum; ++p ) {
+		const Patch *PATCH = &plan->patches[p];
+		if( !_writeAll(out, PATCH->data, PATCH->size, PATCH->to) ) {
+			return ELF_STRIP_ERR_IO;
+		}
+
+		result->written += PATCH->size;
+	}
+
+	if( ftruncate(out, plan->size) != 0 ) {
+		return ELF_STRIP_ERR_IO;
+	}
+
+	result->size = plan->size;
+	return ELF_STRIP_OK;
+}
+
+/* Copies a range kernel-side, or from the input's image if the kernel can't
+ * copy between these two files
+ */
+static bool _copy(Plan *plan, int in, int out, const Copy *COPY,
+	ELF_StripResult *result) {
+	uint64_t done = 0;
+
+	while( !plan->noCopy && done < COPY->size ) {
+		const uint64_t LEFT = COPY->size - done;
+		off64_t from = COPY->from + done;
+		off64_t to = COPY->to + done;
+
+		const ssize_t N = copy_file_range(in, &from, out, &to,
+			LEFT < COPY_CHUNK ? LEFT : COPY_CHUNK, 0);
+
+		if( N > 0 ) {
+			done += N;
+			result->copied += N;
+		} else if( N == 0 ) {
+			/* The input shrank since it was parsed */
+			errno = EIO;
+			return false;
+		} else if( errno == EXDEV || errno == EINVAL || errno == ENOSYS
+			|| errno == EOPNOTSUPP || errno == EBADF || errno == ETXTBSY ) {
+			plan->noCopy = true;
+		} else if( errno != EINTR ) {
+			return false;
+		}
+	}
+
+	const uint64_t LEFT = COPY->size - done;
+	if( LEFT > 0 ) {
+		if( !_writeAll(out, plan->elf->image + COPY->from + done, LEFT,
+				COPY->to + done) ) {
+			return false;
+		}
+
+		result->written += LEFT;
+	}
+
+	return true;
+}
+
+static bool _writeAll(int fd, const void *DATA, uint64_t size, uint64_t to) {
+	const char *AT = DATA;
+
+	while( size > 0 ) {
+		const ssize_t N = pwrite(fd, AT, size < COPY_CHUNK ? size : COPY_CHUNK,
+			to);
+		if( N < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( N <= 0 ) {
+			return false;
+		}
+
+		AT += N;
+		to += N;
+		size -= N;
+	}
+
+	return true;
+}
+
+/* Stores an unsigned value of 1 to 8 bytes, returning the end of it */
+static uint8_t *_put(uint8_t *at, uint64_t value, unsigned size, bool le) {
+	for( unsigned b = 0; b < size; ++b ) {
+		const unsigned SHIFT = 8 * (le ? b : size - 1 - b);
+		at[b] = (value >> SHIFT) & 0xFF;
+	}
+
+	return at + size;
+}
+
+static uint64_t _get(const uint8_t *AT, unsigned size, bool le) {
+	uint64_t value = 0;
+	for( unsigned b = 0; b < size; ++b ) {
+		value |= (uint64_t)AT[b] << 8 * (le ? b : size - 1 - b);
+	}
+
+	return value;
+}
+
+static void _freePlan(Plan *plan) {
+	for( size_t p = 0; p < plan->patchNum; ++p ) {
+		free(plan->patches[p].data);
+	}
+
+	free(plan->patches);
+	free(plan->copies);
+	free(plan->actions);
+	free(plan->indices);
+	free(plan->offsets);
+	free(plan->sizes);
+}
@@ -0,0 +1,458 @@
+/* elfp
+ * Dynamic symbols
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfintern.h"
+#include "elfp.h"
+#include "util.h"
+
+#include "elfsym.h"
+
+/* Sizes of the records in .dynsym and the versioning sections */
+#define SYM32_SIZE 16
+#define SYM64_SIZE 24
+#define VERDEF_SIZE 20
+#define VERDAUX_SIZE 8
+#define VERNEED_SIZE 16
+#define VERNAUX_SIZE 16
+
+/* Bits of a .gnu.version entry */
+#define VERSYM_HIDDEN 0x8000
+#define VERSYM_INDEX 0x7FFF
+
+/* First index of a real version; 0 and 1 mean local and global */
+#define VERSYM_FIRST 2
+
+typedef struct _Builder {
+	ELF_SymVersion *versions;
+	uint32_t num;
+	uint32_t cap;
+
+	bool ok; /* Cleared when running out of memory */
+} Builder;
+
+static bool _sectionCursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor);
+static const ELF_SHEntry *_findLinked(
+	ELF *elf, ELF_SH_Type type, const ELF_SHEntry *TO);
+static const ELF_SHEntry *_linked(ELF *elf, const ELF_SHEntry *SH);
+static const char *_stringAt(const Cursor *SECTION, uint64_t offset);
+static uint32_t _internAt(Builder *builder, const Cursor *SECTION,
+	uint64_t offset);
+
+static void _decodeDefs(Builder *builder, ELF *elf, const ELF_SHEntry *SH);
+static void _decodeNeeds(Builder *builder, ELF *elf, const ELF_SHEntry *SH);
+static void _addVersion(Builder *builder, uint32_t name, uint32_t library,
+	uint16_t index, uint16_t flags);
+static bool _decodeSymbols(ELF *elf, ELF_SymTable *table,
+	const ELF_SHEntry *SH);
+
+const ELF_SymTable *elfDynamicSymbols(ELF *elf) {
+	if( elf->dynSymbols == NULL && !elfSymTableBuild(elf) ) {
+		return NULL;
+	}
+
+	return elf->dynSymbols;
+}
+
+void elfSymTableFree(ELF_SymTable *table) {
+	if( table == NULL ) {
+		return;
+	}
+
+	/* Names are interned, so only the arrays belong to the table */
+	free(table->symbols);
+	free(table->versions);
+	free(table);
+}
+
+bool elfReadSymbols(
+	ELF *elf, const ELF_SHEntry *SH, ELF_Symbol **symbols, uint32_t *num) {
+	*symbols = NULL;
+	*num = 0;
+
+	Cursor section;
+	Cursor strings;
+	if( !_sectionCursor(elf, SH, &section) ) {
+		return true;
+	}
+
+	_sectionCursor(elf, _linked(elf, SH), &strings);
+
+	const bool IS_32 = elf->header.ident.class == ELF_CLASS_32_BIT;
+	const uint32_t ENTRY_SIZE = IS_32 ? SYM32_SIZE : SYM64_SIZE;
+	const uint64_t NUM = (uint64_t)(section.end - section.pos) / ENTRY_SIZE;
+
+	if( NUM == 0 || NUM > UINT32_MAX ) {
+		return true;
+	}
+
+	ELF_Symbol *read = utilMalloc(sizeof(*read) * NUM);
+	if( read == NULL ) {
+		return false;
+	}
+
+	for( uint64_t i = 0; i < NUM; ++i ) {
+		ELF_Symbol *symbol = &read[i];
+		uint32_t name;
+
+		if( IS_32 ) {
+			name = utilCursorRead(&section, 4);
+			symbol->value = utilCursorRead(&section, 4);
+			symbol->size = utilCursorRead(&section, 4);
+			symbol->info = utilCursorRead(&section, 1);
+			symbol->other = utilCursorRead(&section, 1);
+			symbol->section = utilCursorRead(&section, 2);
+		} else {
+			name = utilCursorRead(&section, 4);
+			symbol->info = utilCursorRead(&section, 1);
+			symbol->other = utilCursorRead(&section, 1);
+			symbol->section = utilCursorRead(&section, 2);
+			symbol->value = utilCursorRead(&section, 8);
+			symbol->size = utilCursorRead(&section, 8);
+		}
+
+		symbol->name = _stringAt(&strings, name);
+		if( symbol->name == NULL ) {
+			symbol->name = "";
+		}
+
+		symbol->version = NULL;
+		symbol->hidden = false;
+	}
+
+	*symbols = read;
+	*num = NUM;
+
+	return true;
+}
+
+/* Decodes the versions first, as symbols point to them */
+bool elfSymTableBuild(ELF *elf) {
+	if( elf->dynSymbols != NULL ) {
+		return true;
+	}
+
+	ELF_SymTable *table = utilCalloc(1, sizeof(*table));
+	if( table == NULL ) {
+		return false;
+	}
+
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+	const ELF_SHEntry *DYNSYM = KNOWN != NULL ? KNOWN->dynsym : NULL;
+
+	/* Version definitions and needs share the symbols' string table */
+	const ELF_SHEntry *STRINGS
+		= DYNSYM != NULL ? _linked(elf, DYNSYM) : NULL;
+
+	Builder builder;
+	memset(&builder, 0, sizeof(builder));
+	builder.ok = true;
+
+	_decodeDefs(
+		&builder, elf, _findLinked(elf, ELF_SHT_GNU_VERDEF, STRINGS));
+	table->defNum = builder.num;
+	_decodeNeeds(
+		&builder, elf, _findLinked(elf, ELF_SHT_GNU_VERNEED, STRINGS));
+
+	table->versions = builder.versions;
+	table->versionNum = builder.num;
+
+	if( !builder.ok || KNOWN == NULL
+		|| !_decodeSymbols(elf, table, DYNSYM) ) {
+		elfSymTableFree(table);
+		return false;
+	}
+
+	elf->dynSymbols = table;
+	return true;
+}
+
+/* Points a cursor at a section's contents
+ * Returns false, leaving the cursor empty, if there's nothing to read
+ */
+static bool _sectionCursor(ELF *elf, const ELF_SHEntry *SH, Cursor *cursor) {
+	cursor->pos = NULL;
+	cursor->end = NULL;
+	cursor->le = elf->header.ident.endianness == ELF_ENDIAN_LITTLE_ENDIAN;
+	cursor->ok = true;
+
+	if( SH == NULL || SH->type == ELF_SHT_NOBITS
+		|| SH->offset > elf->imageSize
+		|| SH->size > elf->imageSize - SH->offset ) {
+		return false;
+	}
+
+	cursor->pos = (const uint8_t *)elf->image + SH->offset;
+	cursor->end = cursor->pos + SH->size;
+
+	return SH->size > 0;
+}
+
+/* Finds the first section of a type whose sh_link points to 'TO'
+ * Returns NULL if there's none, or if 'TO' is NULL
+ */
+static const ELF_SHEntry *_findLinked(
+	ELF *elf, ELF_SH_Type type, const ELF_SHEntry *TO) {
+	if( TO == NULL ) {
+		return NULL;
+	}
+
+	const uint32_t LINK = TO - elf->sh;
+	for( uint32_t i = 0; i < elf->header.sectHeaderEntryNum; ++i ) {
+		if( elf->sh[i].type == type && elf->sh[i].link == LINK ) {
+			return &elf->sh[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the section that sh_link points to, or NULL if it's out of range */
+static const ELF_SHEntry *_linked(ELF *elf, const ELF_SHEntry *SH) {
+	if( SH->link == 0 || SH->link >= elf->header.sectHeaderEntryNum ) {
+		return NULL;
+	}
+
+	return &elf->sh[SH->link];
+}
+
+/* Returns the NUL-terminated string at an offset of a section, if it's there */
+static const char *_stringAt(const Cursor *SECTION, uint64_t offset) {
+	if( SECTION->pos == NULL
+		|| offset >= (uint64_t)(SECTION->end - SECTION->pos) ) {
+		return NULL;
+	}
+
+	Cursor cursor = *SECTION;
+	cursor.pos += offset;
+
+	return utilCursorString(&cursor);
+}
+
+/* Interns the string at an offset of a section
+ * Returns ELF_INTERN_NONE if it's not there (or is empty), or clears 'ok' if
+ * memory runs out
+ */
+static uint32_t _internAt(Builder *builder, const Cursor *SECTION,
+	uint64_t offset) {
+	const char *STRING = _stringAt(SECTION, offset);
+	if( STRING == NULL ) {
+		return ELF_INTERN_NONE;
+	}
+
+	const size_t LENGTH = strlen(STRING);
+
+	const uint32_t ID = elfInternId(STRING, LENGTH);
+	if( ID == ELF_INTERN_NONE && LENGTH > 0 ) {
+		builder->ok = false;
+	}
+
+	return ID;
+}
+
+/* Decodes the version definitions in .gnu.version_d
+ * Walks at most sh_info records, as the spec says, and stops at the first
+ * malformed one
+ */
+static void _decodeDefs(Builder *builder, ELF *elf, const ELF_SHEntry *SH) {
+	Cursor section;
+	Cursor strings;
+	if( SH == NULL || !_sectionCursor(elf, SH, &section)
+		|| !_sectionCursor(elf, _linked(elf, SH), &strings) ) {
+		return;
+	}
+
+	const uint64_t SIZE = section.end - section.pos;
+	uint64_t offset = 0;
+
+	for( uint32_t i = 0; i < SH->info && builder->ok; ++i ) {
+		if( offset > SIZE || SIZE - offset < VERDEF_SIZE ) {
+			return;
+		}
+
+		Cursor cursor = section;
+		cursor.pos += offset;
+
+		utilCursorSkip(&cursor, 2); /* vd_version */
+		const uint16_t FLAGS = utilCursorRead(&cursor, 2);
+		const uint16_t INDEX = utilCursorRead(&cursor, 2);
+		const uint16_t AUX_NUM = utilCursorRead(&cursor, 2);
+		utilCursorSkip(&cursor, 4); /* vd_hash */
+		const uint32_t AUX = utilCursorRead(&cursor, 4);
+		const uint32_t NEXT = utilCursorRead(&cursor, 4);
+
+		/* The first auxiliary entry names the version, the rest name the
+		 * versions it inherits from
+		 */
+		if( AUX_NUM > 0 && SIZE - offset >= (uint64_t)AUX + VERDAUX_SIZE ) {
+			Cursor aux = section;
+			aux.pos += offset + AUX;
+
+			const uint32_t NAME
+				= _internAt(builder, &strings, utilCursorRead(&aux, 4));
+			if( NAME != ELF_INTERN_NONE ) {
+				_addVersion(builder, NAME, ELF_INTERN_NONE, INDEX, FLAGS);
+			}
+		}
+
+		if( NEXT == 0 ) {
+			return;
+		}
+
+		offset += NEXT;
+	}
+}
+
+/* Decodes the version requirements in .gnu.version_r
+ * Walks at most sh_info files, and vn_cnt versions for each
+ */
+static void _decodeNeeds(Builder *builder, ELF *elf, const ELF_SHEntry *SH) {
+	Cursor section;
+	Cursor strings;
+	if( SH == NULL || !_sectionCursor(elf, SH, &section)
+		|| !_sectionCursor(elf, _linked(elf, SH), &strings) ) {
+		return;
+	}
+
+	const uint64_t SIZE = section.end - section.pos;
+	uint64_t offset = 0;
+
+	for( uint32_t i = 0; i < SH->info && builder->ok; ++i ) {
+		if( offset > SIZE || SIZE - offset < VERNEED_SIZE ) {
+			return;
+		}
+
+		Cursor cursor = section;
+		cursor.pos += offset;
+
+		utilCursorSkip(&cursor, 2); /* vn_version */
+		const uint16_t AUX_NUM = utilCursorRead(&cursor, 2);
+		const uint32_t FILE = utilCursorRead(&cursor, 4);
+		const uint32_t AUX = utilCursorRead(&cursor, 4);
+		const uint32_t NEXT = utilCursorRead(&cursor, 4);
+
+		const uint32_t LIBRARY = _internAt(builder, &strings, FILE);
+
+		uint64_t auxOffset = offset + AUX;
+		for( uint16_t j = 0; j < AUX_NUM && builder->ok; ++j ) {
+			if( auxOffset > SIZE || SIZE - auxOffset < VERNAUX_SIZE ) {
+				break;
+			}
+
+			Cursor aux = section;
+			aux.pos += auxOffset;
+
+			utilCursorSkip(&aux, 4); /* vna_hash */
+			const uint16_t FLAGS = utilCursorRead(&aux, 2);
+			const uint16_t INDEX = utilCursorRead(&aux, 2);
+			const uint32_t NAME_OFFSET = utilCursorRead(&aux, 4);
+			const uint32_t AUX_NEXT = utilCursorRead(&aux, 4);
+
+			const uint32_t NAME = _internAt(builder, &strings, NAME_OFFSET);
+			if( NAME != ELF_INTERN_NONE ) {
+				_addVersion(builder, NAME, LIBRARY, INDEX, FLAGS);
+			}
+
+			if( AUX_NEXT == 0 ) {
+				break;
+			}
+
+			auxOffset += AUX_NEXT;
+		}
+
+		if( NEXT == 0 ) {
+			return;
+		}
+
+		offset += NEXT;
+	}
+}
+
+/* Appends a version to the builder */
+static void _addVersion(Builder *builder, uint32_t name, uint32_t library,
+	uint16_t index, uint16_t flags) {
+	if( !builder->ok ) {
+		return;
+	}
+
+	if( builder->num == builder->cap ) {
+		const uint32_t CAP = builder->cap > 0 ? builder->cap * 2 : 16;
+
+		ELF_SymVersion *grown
+			= utilRealloc(builder->versions, sizeof(*grown) * CAP);
+		if( grown == NULL ) {
+			builder->ok = false;
+			return;
+		}
+
+		builder->versions = grown;
+		builder->cap = CAP;
+	}
+
+	ELF_SymVersion *version = &builder->versions[builder->num++];
+	version->nameId = name;
+	version->libraryId = library;
+	version->index = index & VERSYM_INDEX;
+	version->flags = flags;
+}
+
+/* Decodes .dynsym, and matches each symbol to its version through
+ * .gnu.version, which holds one entry per symbol
+ * Returns false if memory runs out
+ */
+static bool _decodeSymbols(ELF *elf, ELF_SymTable *table,
+	const ELF_SHEntry *SH) {
+	if( SH == NULL ) {
+		return true;
+	}
+
+	if( !elfReadSymbols(elf, SH, &table->symbols, &table->num) ) {
+		return false;
+	}
+
+	if( table->num == 0 ) {
+		return true;
+	}
+
+	/* Versions by index, so each symbol's is a single lookup */
+	uint16_t maxIndex = 0;
+	for( uint32_t i = 0; i < table->versionNum; ++i ) {
+		if( table->versions[i].index > maxIndex ) {
+			maxIndex = table->versions[i].index;
+		}
+	}
+
+	const ELF_SymVersion **byIndex = utilCalloc(maxIndex + 1, sizeof(*byIndex));
+	if( byIndex == NULL ) {
+		return false;
+	}
+
+	for( uint32_t i = 0; i < table->versionNum; ++i ) {
+		byIndex[table->versions[i].index] = &table->versions[i];
+	}
+
+	Cursor versyms;
+	_sectionCursor(elf, _findLinked(elf, ELF_SHT_GNU_VERSYM, SH), &versyms);
+
+	for( uint32_t i = 0; i < table->num; ++i ) {
+		ELF_Symbol *symbol = &table->symbols[i];
+
+		/* A missing or short .gnu.version reads as zeroes: unversioned */
+		const uint16_t VERSYM = utilCursorRead(&versyms, 2);
+		const uint16_t INDEX = VERSYM & VERSYM_INDEX;
+
+		symbol->version = INDEX >= VERSYM_FIRST && INDEX <= maxIndex
+			? byIndex[INDEX]
+			: NULL;
+		symbol->hidden = symbol->version != NULL && (VERSYM & VERSYM_HIDDEN);
+	}
+
+	free(byIndex);
+	return true;
+}
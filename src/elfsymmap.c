@@ -0,0 +1,337 @@
+/* elfp
+ * Symbol maps
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfnote.h"
+#include "elfp.h"
+#include "elfsym.h"
+#include "util.h"
+
+#include "elfsymmap.h"
+
+/* Symbol types (STT_*) that are functions */
+#define STT_FUNC 2
+#define STT_GNU_IFUNC 10
+
+/* Symbol bindings (STB_*) */
+#define STB_GLOBAL 1
+#define STB_WEAK 2
+
+/* A function bound for the map */
+typedef struct _Function {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+	unsigned rank; /* Among aliases, the lowest is kept */
+	uint32_t nameAt; /* Offset of the name among the names */
+} Function;
+
+/* Names already stored, by hash, so each is stored once */
+typedef struct _Names {
+	const char **names;
+	uint32_t *offsets;
+	size_t cap;
+	uint64_t size; /* Bytes taken by the names stored so far */
+} Names;
+
+static uint32_t _functions(ELF *elf, const ELF_Symbol *SYMBOLS, uint32_t num,
+	Function *functions);
+static unsigned _rank(const ELF_Symbol *SYM);
+static int _compare(const void *A, const void *B);
+static uint32_t _name(Names *names, const char *NAME);
+static uint8_t *_put(uint8_t *at, uint64_t value, unsigned size);
+
+ELF_Status elfSymmapBuild(ELF *elf, uint8_t **data, size_t *size) {
+	const ELF_KnownSections *KNOWN = elfKnownSections(elf);
+	if( KNOWN == NULL ) {
+		return ELF_ERR_NOMEM;
+	}
+
+	/* .symtab is read on its own; .dynsym is taken from the dynamic symbol
+	 * table, so that its symbols come with their versions
+	 */
+	ELF_Symbol *symbols = NULL;
+	const ELF_Symbol *SYMBOLS = NULL;
+	uint32_t num = 0;
+
+	if( KNOWN->symtab != NULL ) {
+		if( !elfReadSymbols(elf, KNOWN->symtab, &symbols, &num) ) {
+			return ELF_ERR_NOMEM;
+		}
+
+		SYMBOLS = symbols;
+	} else if( KNOWN->dynsym != NULL ) {
+		const ELF_SymTable *TABLE = elfDynamicSymbols(elf);
+		if( TABLE == NULL ) {
+			return ELF_ERR_NOMEM;
+		}
+
+		SYMBOLS = TABLE->symbols;
+		num = TABLE->num;
+	}
+
+	Function *functions = utilMalloc(sizeof(*functions) * (num + 1));
+	Names names;
+	names.cap = 16;
+	while( names.cap < 2 * (size_t)num ) {
+		names.cap *= 2;
+	}
+
+	names.names = utilCalloc(names.cap, sizeof(*names.names));
+	names.offsets = utilMalloc(sizeof(*names.offsets) * names.cap);
+	names.size = 0;
+
+	if( functions == NULL || names.names == NULL || names.offsets == NULL ) {
+		free(symbols);
+		free(functions);
+		free(names.names);
+		free(names.offsets);
+		return ELF_ERR_NOMEM;
+	}
+
+	num = _functions(elf, SYMBOLS, num, functions);
+
+	/* Names are given their offsets first, and copied once the size of the
+	 * whole map is known
+	 */
+	for( uint32_t i = 0; i < num; ++i ) {
+		functions[i].nameAt = _name(&names, functions[i].name);
+	}
+
+	const uint64_t NAMES_AT
+		= sizeof(ELF_SymmapHeader) + (uint64_t)num * sizeof(ELF_SymmapEntry);
+	const uint64_t SIZE = NAMES_AT + names.size;
+
+	/* Offsets are 32-bit, which no real symbol table comes near */
+	uint8_t *map = SIZE <= UINT32_MAX ? utilCalloc(1, SIZE) : NULL;
+	if( map == NULL ) {
+		free(symbols);
+		free(functions);
+		free(names.names);
+		free(names.offsets);
+		return ELF_ERR_NOMEM;
+	}
+
+	const uint8_t *ID = NULL;
+	uint32_t idSize = elfBuildId(elf, &ID);
+	if( idSize > ELF_SYMMAP_BUILD_ID_MAX ) {
+		idSize = ELF_SYMMAP_BUILD_ID_MAX;
+	}
+
+	uint8_t *at = map;
+	memcpy(at, ELF_SYMMAP_MAGIC, sizeof(ELF_SYMMAP_MAGIC));
+	at = _put(at + 8, ELF_SYMMAP_VERSION, 4);
+	at = _put(at, num, 4);
+	at = _put(at, NAMES_AT, 4);
+	at = _put(at, names.size, 4);
+	at = _put(at, idSize, 4);
+	at = _put(at, 0, 4);
+	if( idSize > 0 ) {
+		memcpy(at, ID, idSize);
+	}
+
+	at = map + sizeof(ELF_SymmapHeader);
+	for( uint32_t i = 0; i < num; ++i ) {
+		const uint64_t FUNCTION_SIZE = functions[i].size;
+
+		at = _put(at, functions[i].addr, 8);
+		at = _put(at, FUNCTION_SIZE < UINT32_MAX ? FUNCTION_SIZE : UINT32_MAX,
+			4);
+		at = _put(at, functions[i].nameAt, 4);
+	}
+
+	for( size_t n = 0; n < names.cap; ++n ) {
+		if( names.names[n] != NULL ) {
+			strcpy((char *)map + NAMES_AT + names.offsets[n], names.names[n]);
+		}
+	}
+
+	free(symbols);
+	free(functions);
+	free(names.names);
+	free(names.offsets);
+
+	*data = map;
+	*size = SIZE;
+	return ELF_OK;
+}
+
+bool elfSymmapValid(const void *DATA, size_t size) {
+	const ELF_SymmapHeader *HEADER = DATA;
+
+	/* Fields are read in place, which a big-endian host can't do: there, the
+	 * version reads wrong and the map is turned down
+	 */
+	if( size < sizeof(*HEADER)
+		|| memcmp(HEADER->magic, ELF_SYMMAP_MAGIC, sizeof(HEADER->magic)) != 0
+		|| HEADER->version != ELF_SYMMAP_VERSION
+		|| HEADER->buildIdSize > ELF_SYMMAP_BUILD_ID_MAX ) {
+		return false;
+	}
+
+	const uint64_t SYMBOLS_END = sizeof(*HEADER)
+		+ (uint64_t)HEADER->symbolNum * sizeof(ELF_SymmapEntry);
+	if( SYMBOLS_END > HEADER->namesOffset
+		|| (uint64_t)HEADER->namesOffset + HEADER->namesSize > size ) {
+		return false;
+	}
+
+	const char *NAMES = (const char *)DATA + HEADER->namesOffset;
+	if( HEADER->namesSize > 0 && NAMES[HEADER->namesSize - 1] != '\0' ) {
+		return false;
+	}
+
+	const ELF_SymmapEntry *ENTRIES = (const ELF_SymmapEntry *)(HEADER + 1);
+	for( uint32_t i = 0; i < HEADER->symbolNum; ++i ) {
+		if( ENTRIES[i].name >= HEADER->namesSize
+			|| (i > 0 && ENTRIES[i].addr < ENTRIES[i - 1].addr) ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const char *elfSymmapLookup(const void *DATA, uint64_t addr) {
+	const ELF_SymmapHeader *HEADER = DATA;
+	const ELF_SymmapEntry *ENTRIES = (const ELF_SymmapEntry *)(HEADER + 1);
+
+	/* Finds the last function starting at or before the address */
+	size_t low = 0;
+	size_t high = HEADER->symbolNum;
+	while( low < high ) {
+		const size_t MID = low + (high - low) / 2;
+		if( ENTRIES[MID].addr <= addr ) {
+			low = MID + 1;
+		} else {
+			high = MID;
+		}
+	}
+
+	if( low == 0 ) {
+		return NULL;
+	}
+
+	const ELF_SymmapEntry *ENTRY = &ENTRIES[low - 1];
+	if( ENTRY->size != 0 && addr - ENTRY->addr >= ENTRY->size ) {
+		return NULL;
+	}
+
+	return (const char *)DATA + HEADER->namesOffset + ENTRY->name;
+}
+
+/* Keeps the named functions defined in the file, sorted by address, one per
+ * address. Returns how many there are
+ */
+static uint32_t _functions(ELF *elf, const ELF_Symbol *SYMBOLS, uint32_t num,
+	Function *functions) {
+	/* The low bit of a Thumb function's address only tells it's Thumb */
+	const uint64_t MASK = elf->header.machine == ELF_EM_ARM ? ~(uint64_t)1
+															: ~(uint64_t)0;
+	uint32_t kept = 0;
+
+	for( uint32_t i = 0; i < num; ++i ) {
+		const ELF_Symbol *SYM = &SYMBOLS[i];
+		const unsigned TYPE = SYM->info & 0xF;
+
+		if( (TYPE == STT_FUNC || TYPE == STT_GNU_IFUNC) && *SYM->name != '\0'
+			&& SYM->section != ELF_SHN_UNDEF && SYM->section != ELF_SHN_ABS
+			&& SYM->section != ELF_SHN_COMMON ) {
+			functions[kept].addr = SYM->value & MASK;
+			functions[kept].size = SYM->size;
+			functions[kept].name = SYM->name;
+			functions[kept].rank = _rank(SYM);
+			++kept;
+		}
+	}
+
+	qsort(functions, kept, sizeof(*functions), _compare);
+
+	/* Aliases share an address; the first one sorted stays */
+	uint32_t unique = 0;
+	for( uint32_t i = 0; i < kept; ++i ) {
+		if( unique == 0 || functions[i].addr != functions[unique - 1].addr ) {
+			functions[unique++] = functions[i];
+		}
+	}
+
+	return unique;
+}
+
+/* Ranks an alias: default versions beat the ones only kept for old binaries
+ * (free@@GLIBC_2.2.5 over cfree@GLIBC_2.2.5), then global names beat weak
+ * ones, which beat local ones, and then the fewer leading underscores the
+ * better (malloc over __libc_malloc)
+ * A .symtab has no versions of its own, but may spell them in the names
+ */
+static unsigned _rank(const ELF_Symbol *SYM) {
+	const char *AT = strchr(SYM->name, '@');
+	const unsigned OLD = SYM->hidden || (AT != NULL && AT[1] != '@');
+
+	const unsigned BIND = SYM->info >> 4;
+	const unsigned SCOPE = BIND == STB_GLOBAL ? 0 : BIND == STB_WEAK ? 1 : 2;
+
+	return OLD << 10 | SCOPE << 8 | (strspn(SYM->name, "_") & 0xFF);
+}
+
+/* Orders functions by address, then by decreasing size, then by rank, then
+ * by name
+ */
+static int _compare(const void *A, const void *B) {
+	const Function *FA = A;
+	const Function *FB = B;
+
+	if( FA->addr != FB->addr ) {
+		return FA->addr < FB->addr ? -1 : 1;
+	}
+
+	if( FA->size != FB->size ) {
+		return FA->size > FB->size ? -1 : 1;
+	}
+
+	if( FA->rank != FB->rank ) {
+		return FA->rank < FB->rank ? -1 : 1;
+	}
+
+	return strcmp(FA->name, FB->name);
+}
+
+/* Returns the offset of a name among the names, giving it one if it's new
+ * The table never fills up: it has twice as many slots as there are symbols
+ */
+static uint32_t _name(Names *names, const char *NAME) {
+	uint64_t hash = 0xCBF29CE484222325u;
+	for( const char *c = NAME; *c != '\0'; ++c ) {
+		hash = (hash ^ (uint8_t)*c) * 0x100000001B3u;
+	}
+
+	size_t at = hash & (names->cap - 1);
+	while( names->names[at] != NULL ) {
+		if( strcmp(names->names[at], NAME) == 0 ) {
+			return names->offsets[at];
+		}
+
+		at = (at + 1) & (names->cap - 1);
+	}
+
+	names->names[at] = NAME;
+	names->offsets[at] = names->size;
+	names->size += strlen(NAME) + 1;
+
+	return names->offsets[at];
+}
+
+/* Stores a little-endian value of 1 to 8 bytes, returning the end of it */
+static uint8_t *_put(uint8_t *at, uint64_t value, unsigned size) {
+	for( unsigned b = 0; b < size; ++b ) {
+		at[b] = (value >> 8 * b) & 0xFF;
+	}
+
+	return at + size;
+}
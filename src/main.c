@@ -2,22 +2,945 @@
  * Entry point
  */
 
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "batch.h"
+#include "budget.h"
+#include "elfdebuglink.h"
 #include "elfdump.h"
+#include "elfhex.h"
+#include "elfline.h"
+#include "elfnote.h"
+#include "elfintern.h"
 #include "elfp.h"
+#include "elfpages.h"
+#include "elfsize.h"
+#include "elfstats.h"
+#include "elfstrip.h"
+#include "elfsymmap.h"
+#include "proc.h"
+#include "serve.h"
+#include "triage.h"
+#include "watch.h"
 
 #include "fault.h"
 
+/* Default memory budget of the parse cache, in MiB */
+#define DEFAULT_CACHE_SIZE 256
+
+/* Default size the intern pool may grow to before a server or a watch resets
+ * it, in MiB (or an eighth of --max-memory, if that's smaller)
+ */
+#define DEFAULT_INTERN_SIZE 64
+
+/* Default time a watched file must stay untouched before it's dumped, in ms */
+#define DEFAULT_DEBOUNCE 200
+
+/* Input bytes formatted at once by a hex dump */
+#define HEX_BLOCK ((size_t)64 << 10)
+
+/* Most bytes handed to sendfile at once */
+#define SENDFILE_CHUNK ((size_t)1 << 30)
+
+/* Default number of entries listed per table of a size report */
+#define DEFAULT_TOP 20
+
+/* Under a memory budget, files from this size on are mapped, not copied
+ * (or from a sixteenth of the budget, if that's smaller)
+ */
+#define MAP_THRESHOLD ((size_t)1 << 20)
+
+/* State shared by the files of a batch */
+typedef struct _Batch {
+	int flags;
+	ELF_SizeReport *sizeReport; /* Files are added to it, rather than dumped */
+	const char *symmapDir; /* Symbol maps are written there, if not NULL */
+	ELF_PageReport pages; /* Page footprint of every file, added up */
+	size_t pageFiles;
+
+	ELF_StatsSummary *stats; /* NULL unless --stats was given */
+	const char *slowestPath;
+	uint64_t slowest; /* Wall time of the slowest file, in ns */
+
+	/* Files that raised each status, errors included. Counted atomically,
+	 * since every file adds to them
+	 */
+	uint64_t diagnosed[ELF_STATUS_NUM];
+
+	pthread_mutex_t outLock;
+	size_t failed;
+} Batch;
+
 static void _usage(void) {
-	printf("usage: elfp [OPTIONS] (file)\n");
+	printf("usage: elfp [OPTIONS] (file...)\n");
 	printf("       -a, --all....... Print all information\n");
 	printf("       -h, --help...... Prints this message\n");
 	printf("       -H, --header.... Print the Entry Header\n");
 	printf("       -p, --program... Print the Program Header\n");
 	printf("       -s, --section... Print the Section Header\n");
+	printf("       -u, --unwind.... Print and check the unwind table\n");
+	printf("       -d, --dyn-syms.. Print the dynamic symbols and their "
+		   "versions\n");
+	printf("       -P, --pages..... Print the page footprint of the loadable "
+		   "segments\n");
+	printf("       --addr2line..... Print the source line of each address "
+		   "read from stdin\n");
+	printf("       --size-report... Print where the bytes of all files go\n");
+	printf("       --stats......... Print what each phase cost to stderr\n");
+	printf("\n");
+	printf("       --remove-section NAME Write the file without this "
+		   "section\n");
+	printf("       --strip-debug........ Write the file without debugging "
+		   "sections\n");
+	printf("       --only-keep-debug.... Write only what a debug file "
+		   "needs\n");
+	printf("       -o, --output PATH.... Write there rather than over the "
+		   "file\n");
+	printf("       -x, --hex-dump WHAT.. Print the bytes of a section or "
+		   "segment in hex\n");
+	printf("       --dump-bytes WHAT.... Write them to stdout as they are\n");
+	printf("       --export-symmap DIR.. Write the symbol map of each file "
+		   "there\n");
+	printf("       --debuglink.......... Check the debug file a file links "
+		   "to\n");
+	printf("       --debug-file PATH.... Check this debug file against the "
+		   "link\n");
+	printf("\n");
+	printf("       -j, --jobs N......... Use N worker threads\n");
+	printf("       --serve.............. Serve requests from stdin (see "
+		   "inc/serve.h)\n");
+	printf("       --socket PATH........ Serve requests from a Unix socket\n");
+	printf("       --cache-size MIB..... Memory budget of the parse cache\n");
+	printf("       --max-memory MIB..... Keep files in flight and the parse "
+		   "cache under this\n");
+	printf("       --no-uring........... Read files without io_uring\n");
+	printf("       --watch DIR.......... Dump ELF files under DIR as they "
+		   "change\n");
+	printf("       --debounce MS........ Wait for writes to settle this "
+		   "long\n");
+	printf("       --no-fanotify........ Watch with inotify only\n");
+	printf("       --triage............. List the ELF files under each "
+		   "directory given\n");
+	printf("       --pid PID............ List the ELF files a process has "
+		   "mapped\n");
+	printf("       --all-pids........... Do so for every process\n");
+	printf("       --top N.............. List N entries per size report "
+		   "table\n");
+}
+
+/* Parses a positive number given as an option's argument */
+static unsigned long _number(const char *ARG, const char *OPT) {
+	char *end;
+	const unsigned long N = strtoul(ARG, &end, 10);
+
+	if( *ARG == '\0' || *end != '\0' || N == 0 ) {
+		ERR("expected a positive number for '%s', got '%s'\n", OPT, ARG);
+		exit(EXIT_FAILURE);
+	}
+
+	return N;
+}
+
+/* Reports the warnings raised while parsing an ELF, with where they were */
+static void _warnings(FILE *out, ELF *elf) {
+	const uint32_t KEPT = elf->diagnosticNum < ELF_DIAGNOSTICS_MAX
+		? elf->diagnosticNum
+		: ELF_DIAGNOSTICS_MAX;
+
+	for( uint32_t i = 0; i < KEPT; ++i ) {
+		char line[128];
+		elfDiagnosticFormat(&elf->diagnostics[i], line, sizeof(line));
+		fprintf(out, WARNING_MSG "%s\n", line);
+	}
+
+	if( elf->diagnosticNum > KEPT ) {
+		fprintf(out, WARNING_MSG "%" PRIu32 " more warnings\n",
+			elf->diagnosticNum - KEPT);
+	}
+}
+
+/* Counts the statuses a file of a batch raised */
+static void _batchDiagnosed(Batch *batch, ELF *elf, ELF_Status status) {
+	if( elf == NULL ) {
+		__atomic_fetch_add(&batch->diagnosed[status], 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	for( int w = ELF_WARN_FIRST; w < ELF_STATUS_NUM; ++w ) {
+		if( elf->warnings & ELF_WARNING_BIT(w) ) {
+			__atomic_fetch_add(&batch->diagnosed[w], 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* Adds what the file just handled by this thread cost to a batch's stats */
+static void _batchStats(Batch *batch, const char *PATH) {
+	if( batch->stats == NULL ) {
+		return;
+	}
+
+	ELF_Stats stats;
+	elfStatsTake(&stats);
+
+	uint64_t wall = 0;
+	for( int p = 0; p < ELF_PHASE_NUM; ++p ) {
+		wall += stats.values[p][ELF_STAT_WALL];
+	}
+
+	pthread_mutex_lock(&batch->outLock);
+
+	elfStatsSummaryAdd(batch->stats, &stats);
+	if( wall >= batch->slowest ) {
+		batch->slowest = wall;
+		batch->slowestPath = PATH;
+	}
+
+	pthread_mutex_unlock(&batch->outLock);
+}
+
+/* Writes the symbol map of an ELF to DIR/<build ID>.symmap
+ * The map is written under a temporary name and renamed into place, so a
+ * profiler mapping it never sees it half written
+ */
+static bool _exportSymmap(const char *DIR, const char *PATH, ELF *elf) {
+	const uint8_t *ID;
+	const uint32_t ID_SIZE = elfBuildId(elf, &ID);
+	if( ID_SIZE == 0 || ID_SIZE > ELF_SYMMAP_BUILD_ID_MAX ) {
+		ERR("%s: no build ID to name its symbol map after\n", PATH);
+		return false;
+	}
+
+	uint8_t *map;
+	size_t size;
+	if( elfSymmapBuild(elf, &map, &size) != ELF_OK ) {
+		ERR("%s: %s\n", PATH, strerror(ENOMEM));
+		return false;
+	}
+
+	char *dest = malloc(strlen(DIR) + 2 * ID_SIZE + sizeof("/.symmap.XXXXXX"));
+	if( dest == NULL ) {
+		ERR("%s: %s\n", PATH, strerror(ENOMEM));
+		free(map);
+		return false;
+	}
+
+	char *at = dest + sprintf(dest, "%s/", DIR);
+	for( uint32_t b = 0; b < ID_SIZE; ++b ) {
+		at += sprintf(at, "%02x", ID[b]);
+	}
+
+	at += sprintf(at, ".symmap");
+
+	char *temp = malloc(at - dest + sizeof(".XXXXXX"));
+	if( temp == NULL ) {
+		ERR("%s: %s\n", PATH, strerror(ENOMEM));
+		free(map);
+		free(dest);
+		return false;
+	}
+
+	sprintf(temp, "%s.XXXXXX", dest);
+
+	const int OUT = mkstemp(temp);
+	FILE *out = OUT >= 0 ? fdopen(OUT, "w") : NULL;
+	bool ok = out != NULL && fchmod(OUT, 0644) == 0
+		&& fwrite(map, 1, size, out) == size;
+
+	/* Errors writing can surface as late as close */
+	if( out != NULL ) {
+		ok &= fclose(out) == 0;
+	} else if( OUT >= 0 ) {
+		close(OUT);
+	}
+
+	if( !ok ) {
+		ERR("couldn't write '%s': %s\n", temp, strerror(errno));
+	} else if( rename(temp, dest) != 0 ) {
+		ERR("couldn't replace '%s': %s\n", dest, strerror(errno));
+		ok = false;
+	}
+
+	if( !ok && OUT >= 0 ) {
+		unlink(temp);
+	}
+
+	free(map);
+	free(temp);
+	free(dest);
+
+	return ok;
+}
+
+/* Reports why a file of a batch couldn't be parsed */
+static void _batchError(const char *PATH, ELF_Status status, int error) {
+	if( status == ELF_ERR_IO && error == EFBIG ) {
+		ERR("%s: too large for --max-memory\n", PATH);
+	} else if( status == ELF_ERR_IO ) {
+		ERR("couldn't read the file at '%s': %s\n", PATH, strerror(error));
+	} else {
+		ERR("%s: %s\n", PATH, elfStatusString(status));
+	}
+}
+
+/* Dumps one file of a batch
+ * Each file is rendered on its own, then printed in one go, so the output of
+ * files finishing at the same time doesn't interleave. For size reports, the
+ * file's own report is built the same way, then merged in
+ */
+static void _batchFile(
+	void *ctx, size_t idx, const char *PATH, FP *fp, int error) {
+	Batch *batch = ctx;
+	(void)idx;
+
+	ELF_Status status = ELF_ERR_IO;
+	ELF *elf = fp != NULL ? elfParse(fp, &status) : NULL;
+	_batchDiagnosed(batch, elf, status);
+
+	if( batch->symmapDir != NULL ) {
+		bool ok = elf != NULL && _exportSymmap(batch->symmapDir, PATH, elf);
+
+		if( elf == NULL ) {
+			_batchError(PATH, status, error);
+		}
+
+		pthread_mutex_lock(&batch->outLock);
+		batch->failed += !ok;
+		pthread_mutex_unlock(&batch->outLock);
+
+		if( elf != NULL ) {
+			elfFree(elf);
+		}
+
+		_batchStats(batch, PATH);
+		return;
+	}
+
+	/* Running out of memory costs the file, not the whole batch */
+	if( elf != NULL && batch->sizeReport != NULL ) {
+		ELF_SizeReport *report = elfSizeReportOf(elf);
+
+		pthread_mutex_lock(&batch->outLock);
+
+		if( report == NULL
+			|| !elfSizeReportMerge(batch->sizeReport, report) ) {
+			ERR("%s: %s\n", PATH, strerror(ENOMEM));
+			++batch->failed;
+		}
+
+		pthread_mutex_unlock(&batch->outLock);
+
+		elfSizeReportFree(report);
+		elfFree(elf);
+		_batchStats(batch, PATH);
+		return;
+	}
+
+	char *text = NULL;
+	size_t length = 0;
+	FILE *out = elf != NULL && batch->sizeReport == NULL
+		? open_memstream(&text, &length)
+		: NULL;
+
+	if( out != NULL ) {
+		fprintf(out, "File: %s\n", PATH);
+		_warnings(out, elf);
+		elfDumpTo(out, elf, batch->flags);
+		fclose(out);
+	}
+
+	ELF_PageReport pages = { 0 };
+	const bool PAGES = out != NULL && (batch->flags & ELF_DUMP_PAGES)
+		&& elfPageFootprint(elf, 0, &pages);
+
+	pthread_mutex_lock(&batch->outLock);
+
+	if( PAGES ) {
+		elfPageAdd(&batch->pages.total, &pages.total);
+		batch->pages.relocations += pages.relocations;
+		batch->pages.pageSize = pages.pageSize;
+		++batch->pageFiles;
+	}
+
+	if( out != NULL ) {
+		fwrite(text, 1, length, stdout);
+		printf("\n");
+	} else if( elf != NULL ) {
+		ERR("%s: %s\n", PATH, strerror(ENOMEM));
+	} else {
+		_batchError(PATH, status, error);
+	}
+
+	batch->failed += out == NULL;
+
+	pthread_mutex_unlock(&batch->outLock);
+
+	elfPageReportFree(&pages);
+	free(text);
+	if( elf != NULL ) {
+		elfFree(elf);
+	}
+
+	_batchStats(batch, PATH);
+}
+
+/* Prints the page footprint of every file of a batch, added up, as if one
+ * process loaded them all
+ */
+static void _pageTotals(const ELF_PageReport *PAGES, size_t files) {
+	const ELF_SegmentPages *TOTAL = &PAGES->total;
+
+	printf("=== PAGE FOOTPRINT ===\n\n");
+	printf("%zu files, %" PRIu64 "-byte pages, %" PRIu64
+		   " dynamic relocations\n\n",
+		files, PAGES->pageSize, PAGES->relocations);
+
+	printf("Pages    File     Anon     Shared   Dirty    RELRO    Wasted\n");
+	printf("--------------------------------------------------------------\n");
+	printf("%-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64 " %-8" PRIu64
+		   " %-8" PRIu64 " %" PRIu64 "\n\n",
+		TOTAL->pages, TOTAL->filePages, TOTAL->anonPages, TOTAL->sharedPages,
+		TOTAL->dirtyPages, TOTAL->relroPages, TOTAL->wasted);
+
+	/* Dirty and anonymous pages are private to each process; shared ones are
+	 * paid for once, however many processes map the files
+	 */
+	printf("Private per process: %" PRIu64 " bytes\n",
+		(TOTAL->dirtyPages + TOTAL->anonPages) * PAGES->pageSize);
+	printf("Shared:              %" PRIu64 " bytes\n\n",
+		TOTAL->sharedPages * PAGES->pageSize);
+}
+
+/* Prints how many files of a batch raised each status, if any did */
+static void _diagnosed(const uint64_t DIAGNOSED[ELF_STATUS_NUM]) {
+	bool any = false;
+	for( int s = ELF_OK + 1; s < ELF_STATUS_NUM; ++s ) {
+		any |= DIAGNOSED[s] > 0;
+	}
+
+	if( !any ) {
+		return;
+	}
+
+	printf("=== DIAGNOSTICS ===\n\n");
+	printf("Files    Diagnostic\n");
+	printf("--------------------------------------------------------------\n");
+
+	for( int s = ELF_OK + 1; s < ELF_STATUS_NUM; ++s ) {
+		if( DIAGNOSED[s] > 0 ) {
+			printf("%-8" PRIu64 " %s\n", DIAGNOSED[s], elfStatusString(s));
+		}
+	}
+
+	printf("\n");
+}
+
+/* Prints one table of a size report */
+static void _sizeTable(const ELF_SizeReport *REPORT, ELF_SizeKind kind,
+	const char *TITLE, size_t top) {
+	ELF_SizeEntry *entries = malloc(sizeof(*entries) * top);
+	if( entries == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	const size_t NUM = elfSizeReportTop(REPORT, kind, entries, top);
+
+	printf("* %s (%" PRIu32 " distinct, top %zu)\n", TITLE,
+		REPORT->tables[kind].num, NUM);
+	printf("Bytes            Share   Files    Name\n");
+	printf("--------------------------------------------------------------\n");
+
+	for( size_t i = 0; i < NUM; ++i ) {
+		const double SHARE = REPORT->bytes > 0
+			? 100.0 * entries[i].bytes / REPORT->bytes
+			: 0;
+
+		printf("%-16" PRIu64 " %5.1f%%  %-8" PRIu64 " %s\n", entries[i].bytes,
+			SHARE, entries[i].files, elfInternString(entries[i].nameId));
+	}
+
+	printf("\n");
+	free(entries);
+}
+
+/* Prints where the bytes of every file in a report went */
+static void _sizeReport(const ELF_SizeReport *REPORT, size_t top) {
+	printf("=== SIZE REPORT ===\n\n");
+	printf("%" PRIu64 " files, %" PRIu64 " bytes\n\n", REPORT->files,
+		REPORT->bytes);
+
+	_sizeTable(REPORT, ELF_SIZE_SEGMENT, "Segments", top);
+	_sizeTable(REPORT, ELF_SIZE_SECTION, "Sections", top);
+	_sizeTable(REPORT, ELF_SIZE_SYMBOL, "Symbols", top);
+}
+
+/* Prints one row of stats: times in microseconds, then counts */
+static void _statsRow(const char *PHASE, const char *WHAT,
+	const uint64_t VALUES[ELF_STAT_NUM]) {
+	fprintf(stderr,
+		"%-16s %-6s %-11.1f %-11.1f %-12" PRIu64 " %-8" PRIu64 " %-8" PRIu64
+		" %" PRIu64 "\n",
+		PHASE, WHAT, VALUES[ELF_STAT_WALL] / 1000.0,
+		VALUES[ELF_STAT_CPU] / 1000.0, VALUES[ELF_STAT_BYTES],
+		VALUES[ELF_STAT_FAULTS], VALUES[ELF_STAT_ALLOCS],
+		VALUES[ELF_STAT_ALLOC_BYTES]);
+}
+
+static void _statsHeader(void) {
+	fprintf(stderr, "Phase                   Wall (us)   CPU (us)    Bytes"
+					"        Faults   Allocs   Alloc bytes\n");
+	fprintf(stderr, "-------------------------------------------------------"
+					"-------------------------------\n");
+}
+
+/* Prints what each phase of handling a single file cost */
+static void _stats(const ELF_Stats *STATS) {
+	uint64_t total[ELF_STAT_NUM] = { 0 };
+
+	fprintf(stderr, "=== STATS ===\n\n");
+	_statsHeader();
+
+	for( int p = 0; p < ELF_PHASE_NUM; ++p ) {
+		_statsRow(elfPhaseName(p), "", STATS->values[p]);
+
+		for( int s = 0; s < ELF_STAT_NUM; ++s ) {
+			total[s] += STATS->values[p][s];
+		}
+	}
+
+	_statsRow("total", "", total);
+}
+
+/* Prints what each phase cost over a batch: the sum, then the median and
+ * 99th percentile over files. The last rows are for whole files
+ */
+static void _statsSummary(const ELF_StatsSummary *SUMMARY,
+	const char *SLOWEST_PATH, uint64_t slowest) {
+	fprintf(stderr, "=== STATS ===\n\n");
+	fprintf(stderr, "%" PRIu64 " files", SUMMARY->files);
+	if( SLOWEST_PATH != NULL ) {
+		fprintf(stderr, ", slowest: %s (%.1f us)", SLOWEST_PATH,
+			slowest / 1000.0);
+	}
+
+	fprintf(stderr, "\n\n");
+	_statsHeader();
+
+	for( int p = 0; p <= ELF_PHASE_NUM; ++p ) {
+		const ELF_Histogram *ROW = SUMMARY->histograms[p];
+		const char *NAME = p < ELF_PHASE_NUM ? elfPhaseName(p) : "per file";
+
+		uint64_t sum[ELF_STAT_NUM];
+		uint64_t p50[ELF_STAT_NUM];
+		uint64_t p99[ELF_STAT_NUM];
+
+		for( int s = 0; s < ELF_STAT_NUM; ++s ) {
+			sum[s] = ROW[s].sum;
+			p50[s] = elfHistogramPercentile(&ROW[s], 50);
+			p99[s] = elfHistogramPercentile(&ROW[s], 99);
+		}
+
+		_statsRow(NAME, "total", sum);
+		_statsRow("", "p50", p50);
+		_statsRow("", "p99", p99);
+	}
+}
+
+/* Parses a file mapped from a descriptor left open, for the kernel to copy
+ * from. Returns NULL, having reported why, if the file can't be parsed
+ */
+static ELF *_openMapped(const char *PATH, int *in, struct stat *st) {
+	const int IN = open(PATH, O_RDONLY | O_CLOEXEC);
+	if( IN < 0 || fstat(IN, st) != 0 ) {
+		ERR("couldn't read the file at '%s': %s\n", PATH, strerror(errno));
+		if( IN >= 0 ) {
+			close(IN);
+		}
+
+		return NULL;
+	}
+
+	ELF_Status status = ELF_ERR_TOO_SMALL;
+	FP *fp = st->st_size > 0 ? utilMapFile(IN, st->st_size) : NULL;
+	ELF *elf = fp != NULL ? elfParse(fp, &status) : NULL;
+
+	if( st->st_size > 0 && fp == NULL ) {
+		ERR("couldn't read the file at '%s': %s\n", PATH, strerror(errno));
+	} else if( elf == NULL ) {
+		ERR("%s: %s\n", PATH, elfStatusString(status));
+	}
+
+	if( elf == NULL ) {
+		close(IN);
+		return NULL;
+	}
+
+	*in = IN;
+	return elf;
+}
+
+/* Writes a stripped copy of a file to 'OUTPUT', or over the file if NULL
+ * The file is mapped rather than read: the parser only touches its headers,
+ * and the kernel copies the rest. The copy is made next to its destination,
+ * then renamed over it, so the destination is never left half-written
+ */
+static bool _strip(
+	const char *PATH, const char *OUTPUT, const ELF_StripOptions *OPTIONS) {
+	const char *DEST = OUTPUT != NULL ? OUTPUT : PATH;
+
+	int IN;
+	struct stat st;
+	ELF *elf = _openMapped(PATH, &IN, &st);
+	if( elf == NULL ) {
+		return false;
+	}
+
+	char *temp = malloc(strlen(DEST) + sizeof(".XXXXXX"));
+	if( temp == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	sprintf(temp, "%s.XXXXXX", DEST);
+
+	const int OUT = mkstemp(temp);
+	if( OUT < 0 ) {
+		ERR("couldn't create '%s': %s\n", temp, strerror(errno));
+		elfFree(elf);
+		close(IN);
+		free(temp);
+		return false;
+	}
+
+	ELF_StripResult result = { 0 };
+	bool ok = fchmod(OUT, st.st_mode & 07777) == 0
+		&& elfStrip(elf, IN, OUT, OPTIONS, &result);
+
+	if( !ok && result.error == ELF_STRIP_OK ) {
+		ERR("couldn't write '%s': %s\n", temp, strerror(errno));
+	} else if( !ok && result.error == ELF_STRIP_ERR_IO ) {
+		ERR("%s: %s: %s\n", PATH, elfStripErrorString(result.error),
+			strerror(errno));
+	} else if( !ok && result.section != 0 ) {
+		ERR("%s: %s: %s\n", PATH,
+			elfSectionName(elf, &elf->sh[result.section]),
+			elfStripErrorString(result.error));
+	} else if( !ok ) {
+		ERR("%s: %s\n", PATH, elfStripErrorString(result.error));
+	}
+
+	/* Errors writing back can surface as late as close */
+	if( close(OUT) != 0 && ok ) {
+		ERR("couldn't write '%s': %s\n", temp, strerror(errno));
+		ok = false;
+	}
+
+	if( ok && rename(temp, DEST) != 0 ) {
+		ERR("couldn't replace '%s': %s\n", DEST, strerror(errno));
+		ok = false;
+	}
+
+	if( !ok ) {
+		unlink(temp);
+	}
+
+	elfFree(elf);
+	close(IN);
+	free(temp);
+
+	return ok;
+}
+
+/* Finds the bytes 'WHAT' names in an ELF: a section, by name or number, or a
+ * segment, as "segment:N". 'name' is set to the section's name, or to NULL
+ * for a segment. Returns false if there's nothing by that name
+ */
+static bool _range(ELF *elf, const char *WHAT, uint64_t *offset,
+	uint64_t *size, uint64_t *addr, const char **name) {
+	const bool SEGMENT = strncmp(WHAT, "segment:", 8) == 0;
+
+	const char *NUMBER = SEGMENT ? WHAT + 8 : WHAT;
+	char *end;
+	const unsigned long IDX = strtoul(NUMBER, &end, 10);
+	const bool IS_NUMBER = *NUMBER != '\0' && *end == '\0';
+
+	*name = NULL;
+
+	if( SEGMENT ) {
+		if( !IS_NUMBER || IDX >= elf->header.progHeaderEntryNum ) {
+			return false;
+		}
+
+		const ELF_PHEntry *PH = &elf->ph[IDX];
+		*offset = PH->offset;
+		*size = PH->fileSize;
+		*addr = PH->virtualAddr;
+		return true;
+	}
+
+	ELF_SHEntry *sh = NULL;
+	if( IS_NUMBER && IDX < elf->header.sectHeaderEntryNum ) {
+		sh = &elf->sh[IDX];
+	} else if( !IS_NUMBER ) {
+		sh = elfFindSection(elf, WHAT);
+	}
+
+	if( sh == NULL ) {
+		return false;
+	}
+
+	*offset = sh->offset;
+	*size = sh->type == ELF_SHT_NOBITS ? 0 : sh->size;
+	*addr = sh->addr;
+	*name = elfSectionName(elf, sh);
+	return true;
+}
+
+/* Writes the bytes of a section or segment to stdout, in hex or as they are
+ * Raw bytes go from the file to stdout in the kernel, with sendfile, unless
+ * stdout can't take them that way; hex is formatted a block at a time
+ */
+static bool _dumpBytes(const char *PATH, const char *WHAT, bool hex) {
+	int in;
+	struct stat st;
+	ELF *elf = _openMapped(PATH, &in, &st);
+	if( elf == NULL ) {
+		return false;
+	}
+
+	uint64_t offset;
+	uint64_t size;
+	uint64_t addr;
+	const char *name;
+	bool ok = _range(elf, WHAT, &offset, &size, &addr, &name);
+
+	if( !ok ) {
+		ERR("%s: no section or segment '%s'\n", PATH, WHAT);
+	} else if( offset > elf->imageSize || size > elf->imageSize - offset ) {
+		ERR("%s: '%s' lies past the end of the file\n", PATH, WHAT);
+		ok = false;
+	}
+
+	if( ok && hex ) {
+		if( name != NULL ) {
+			printf("Hex dump of section '%s':\n", name);
+		} else {
+			printf("Hex dump of segment %s:\n", WHAT + 8);
+		}
+
+		if( size == 0 ) {
+			printf("  no data\n");
+		}
+
+		char *text = malloc(ELF_HEX_LINE_MAX * (HEX_BLOCK / 16));
+		if( text == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		for( uint64_t done = 0; done < size; done += HEX_BLOCK ) {
+			const uint64_t LEFT = size - done;
+			const size_t LENGTH = elfHexFormat(text,
+				(const uint8_t *)elf->image + offset + done,
+				LEFT < HEX_BLOCK ? LEFT : HEX_BLOCK, addr + done);
+
+			if( fwrite(text, 1, LENGTH, stdout) != LENGTH ) {
+				ok = false;
+				break;
+			}
+		}
+
+		/* A full disk may only show once the buffer is flushed */
+		ok = ok && printf("\n") > 0 && fflush(stdout) == 0;
+		if( !ok ) {
+			ERR("couldn't write the bytes of '%s': %s\n", WHAT,
+				strerror(errno));
+		}
+
+		free(text);
+	} else if( ok ) {
+		fflush(stdout);
+
+		off_t from = offset;
+		uint64_t left = size;
+
+		while( left > 0 ) {
+			const ssize_t N = sendfile(STDOUT_FILENO, in, &from,
+				left < SENDFILE_CHUNK ? left : SENDFILE_CHUNK);
+
+			if( N > 0 ) {
+				left -= N;
+			} else if( N == 0 || (errno != EINTR && errno != EINVAL
+									 && errno != ENOSYS) ) {
+				ERR("couldn't write the bytes of '%s': %s\n", WHAT,
+					strerror(N == 0 ? EIO : errno));
+				ok = false;
+				break;
+			} else if( errno != EINTR ) {
+				/* Not a descriptor sendfile writes to, like a terminal in
+				 * append mode: write the bytes from the image instead
+				 */
+				ok = fwrite((const uint8_t *)elf->image + from, 1, left, stdout)
+						== left
+					&& fflush(stdout) == 0;
+				if( !ok ) {
+					ERR("couldn't write the bytes of '%s': %s\n", WHAT,
+						strerror(errno));
+				}
+
+				break;
+			}
+		}
+	}
+
+	elfFree(elf);
+	close(in);
+
+	return ok;
+}
+
+/* Checks a debug file's CRC against an ELF's debug link, printing both
+ * Returns whether it matches
+ */
+static bool _debugFileMatches(const char *CANDIDATE, uint32_t crc) {
+	uint32_t actual;
+	if( !elfCrc32File(CANDIDATE, &actual) ) {
+		ERR("couldn't read the file at '%s': %s\n", CANDIDATE, strerror(errno));
+		return false;
+	}
+
+	printf("%s: CRC 0x%08" PRIx32 ", %s\n", CANDIDATE, actual,
+		actual == crc ? "matches" : "doesn't match");
+	return actual == crc;
+}
+
+/* Prints the debug link of a file, and checks the debug file it names
+ * Without a candidate, the file is looked for where GDB looks: next to the
+ * ELF, in .debug next to it, and under /usr/lib/debug. Returns whether a
+ * debug file matched
+ */
+static bool _debugLink(const char *PATH, const char *CANDIDATE) {
+	ELF_Status status;
+	ELF *elf = elfParseFile(PATH, &status);
+	if( elf == NULL ) {
+		if( status == ELF_ERR_IO ) {
+			ERR("couldn't read the file at '%s': %s\n", PATH, strerror(errno));
+		} else {
+			ERR("%s: %s\n", PATH, elfStatusString(status));
+		}
+
+		return false;
+	}
+
+	ELF_DebugLink link;
+	if( !elfDebugLink(elf, &link) ) {
+		ERR("%s: no debug link\n", PATH);
+		elfFree(elf);
+		return false;
+	}
+
+	printf("Debug link: %s, CRC 0x%08" PRIx32 "\n", link.name, link.crc);
+
+	bool found = false;
+	bool matched = false;
+
+	if( CANDIDATE != NULL ) {
+		found = true;
+		matched = _debugFileMatches(CANDIDATE, link.crc);
+	}
+
+	struct stat self;
+	char *dir = CANDIDATE == NULL && stat(PATH, &self) == 0
+		? realpath(PATH, NULL)
+		: NULL;
+
+	if( dir != NULL ) {
+		*strrchr(dir, '/') = '\0';
+
+		const char *const FORMATS[] = {
+			"%s/%s",
+			"%s/.debug/%s",
+			"/usr/lib/debug%s/%s",
+		};
+
+		for( size_t f = 0; !matched && f < sizeof(FORMATS) / sizeof(*FORMATS);
+			 ++f ) {
+			const int LENGTH = snprintf(NULL, 0, FORMATS[f], dir, link.name);
+			char *path = malloc(LENGTH + 1);
+			if( path == NULL ) {
+				FATAL("an error occurred while allocating memory\n");
+			}
+
+			sprintf(path, FORMATS[f], dir, link.name);
+
+			/* The ELF names itself when it's kept next to its debug file */
+			struct stat st;
+			if( stat(path, &st) == 0 && S_ISREG(st.st_mode)
+				&& (st.st_dev != self.st_dev || st.st_ino != self.st_ino) ) {
+				found = true;
+				matched = _debugFileMatches(path, link.crc);
+			}
+
+			free(path);
+		}
+
+		free(dir);
+	}
+
+	if( !found ) {
+		ERR("%s: no debug file '%s' found\n", PATH, link.name);
+	}
+
+	elfFree(elf);
+	return matched;
+}
+
+/* Looks up the source line of every address read from stdin
+ * Prints them in order, one per line, as "file:line" ("??:?" if unknown)
+ */
+static void _addr2line(ELF *elf) {
+	uint64_t *addrs = NULL;
+	size_t num = 0;
+	size_t cap = 0;
+
+	char token[64];
+	while( scanf("%63s", token) == 1 ) {
+		if( num == cap ) {
+			cap = cap > 0 ? cap * 2 : 1024;
+			addrs = realloc(addrs, sizeof(*addrs) * cap);
+			if( addrs == NULL ) {
+				FATAL("an error occurred while allocating memory\n");
+			}
+		}
+
+		addrs[num++] = strtoull(token, NULL, 16);
+	}
+
+	ELF_LineInfo *infos = malloc(sizeof(*infos) * (num > 0 ? num : 1));
+	if( infos == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	elfAddrToLineBatch(elf, addrs, infos, num);
+
+	for( size_t i = 0; i < num; ++i ) {
+		if( infos[i].file != NULL ) {
+			printf("%s:%" PRIu32 "\n", infos[i].file, infos[i].line);
+		} else {
+			printf("??:?\n");
+		}
+	}
+
+	free(addrs);
+	free(infos);
 }
 
 #define NEXT()                                                                 \
@@ -31,7 +954,7 @@ static bool _isOpt(char *argv[], char argS, char *argL) {
 		exit(EXIT_FAILURE);
 	}
 
-	if( cmd[1] == argS && cmd[2] == '\0' ) {
+	if( argS != '\0' && cmd[1] == argS && cmd[2] == '\0' ) {
 		return true;
 	}
 
@@ -59,18 +982,84 @@ int main(int argc, char *argv[]) {
 		exit(EXIT_FAILURE);
 	}
 
-	char *file = NULL;
+	char **files = NULL;
+	int fileNum = 0;
 	int flags = 0;
+	bool addr2line = false;
+	bool sizeReport = false;
+	const char *symmapDir = NULL;
+
+	bool debugLink = false;
+	const char *debugFile = NULL;
+
+	/* Section or segment whose bytes are dumped, in hex or as they are */
+	const char *bytes = NULL;
+	bool hex = false;
+	bool stats = false;
+	size_t top = DEFAULT_TOP;
+	size_t maxMemory = 0;
+
+	bool strip = false;
+	const char *output = NULL;
+	ELF_StripOptions stripOptions;
+	stripOptions.mode = ELF_STRIP_NONE;
+	stripOptions.removeNum = 0;
+
+	/* Names to remove are kept as they are found, there can't be more than
+	 * there are arguments
+	 */
+	const char **removeNames = malloc(sizeof(*removeNames) * argc);
+	if( removeNames == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	stripOptions.remove = removeNames;
+
+	BatchOptions batchOptions;
+	batchOptions.depth = 0;
+	batchOptions.threads = 0;
+	batchOptions.noUring = false;
+	batchOptions.budget = NULL;
+
+	WatchOptions watchOptions;
+	watchOptions.dir = NULL;
+	watchOptions.debounce = DEFAULT_DEBOUNCE;
+	watchOptions.noFanotify = false;
+	watchOptions.internBudget = (size_t)DEFAULT_INTERN_SIZE << 20;
+
+	bool triage = false;
+	TriageOptions triageOptions;
+	triageOptions.threads = 0;
+
+	/* PIDs are kept as they are found, like the names to remove */
+	pid_t *pids = malloc(sizeof(*pids) * argc);
+	if( pids == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	ProcOptions procOptions;
+	procOptions.pids = pids;
+	procOptions.pidNum = 0;
+	procOptions.all = false;
+	procOptions.threads = 0;
+
+	bool serve = false;
+	ServeOptions serveOptions;
+	serveOptions.socketPath = NULL;
+	serveOptions.cacheBudget = (size_t)DEFAULT_CACHE_SIZE << 20;
+	serveOptions.internBudget = (size_t)DEFAULT_INTERN_SIZE << 20;
+	serveOptions.threads = sysconf(_SC_NPROCESSORS_ONLN);
 
 	NEXT();
 	while( argc > 0 ) {
 		if( *argv[0] != '-' ) {
-			file = *argv;
+			files = argv;
+			fileNum = argc;
 			break;
 		}
 
 		CHECK('a', "all") {
-			flags = ELF_DUMP_ALL;
+			flags |= ELF_DUMP_ALL;
 		}
 		else CHECK('h', "help") {
 			_usage();
@@ -85,6 +1074,125 @@ int main(int argc, char *argv[]) {
 		else CHECK('s', "section") {
 			flags |= ELF_DUMP_SH;
 		}
+		else CHECK('u', "unwind") {
+			flags |= ELF_DUMP_UNWIND;
+		}
+		else CHECK('d', "dyn-syms") {
+			flags |= ELF_DUMP_DYNSYM;
+		}
+		else CHECK('P', "pages") {
+			flags |= ELF_DUMP_PAGES;
+		}
+		else CHECK('\0', "addr2line") {
+			addr2line = true;
+		}
+		else CHECK('\0', "size-report") {
+			sizeReport = true;
+		}
+		else CHECK('x', "hex-dump") {
+			EXPECT("a section or segment");
+			bytes = *argv;
+			hex = true;
+		}
+		else CHECK('\0', "dump-bytes") {
+			EXPECT("a section or segment");
+			bytes = *argv;
+			hex = false;
+		}
+		else CHECK('\0', "debuglink") {
+			debugLink = true;
+		}
+		else CHECK('\0', "debug-file") {
+			EXPECT("a debug file");
+			debugLink = true;
+			debugFile = *argv;
+		}
+		else CHECK('\0', "export-symmap") {
+			EXPECT("a directory");
+			symmapDir = *argv;
+		}
+		else CHECK('\0', "stats") {
+			stats = true;
+		}
+		else CHECK('\0', "remove-section") {
+			EXPECT("a section name");
+			strip = true;
+			removeNames[stripOptions.removeNum++] = *argv;
+		}
+		else CHECK('\0', "strip-debug") {
+			if( stripOptions.mode == ELF_STRIP_KEEP_DEBUG ) {
+				ERR("--strip-debug and --only-keep-debug are exclusive\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strip = true;
+			stripOptions.mode = ELF_STRIP_DEBUG;
+		}
+		else CHECK('\0', "only-keep-debug") {
+			if( stripOptions.mode == ELF_STRIP_DEBUG ) {
+				ERR("--strip-debug and --only-keep-debug are exclusive\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strip = true;
+			stripOptions.mode = ELF_STRIP_KEEP_DEBUG;
+		}
+		else CHECK('o', "output") {
+			EXPECT("an output path");
+			output = *argv;
+		}
+		else CHECK('\0', "top") {
+			EXPECT("a number of entries");
+			top = _number(*argv, "--top");
+		}
+		else CHECK('j', "jobs") {
+			EXPECT("a number of threads");
+			serveOptions.threads = _number(*argv, "--jobs");
+			batchOptions.threads = serveOptions.threads;
+			triageOptions.threads = serveOptions.threads;
+			procOptions.threads = serveOptions.threads;
+		}
+		else CHECK('\0', "serve") {
+			serve = true;
+		}
+		else CHECK('\0', "socket") {
+			EXPECT("a socket path");
+			serve = true;
+			serveOptions.socketPath = *argv;
+		}
+		else CHECK('\0', "cache-size") {
+			EXPECT("a size in MiB");
+			serveOptions.cacheBudget = (size_t)_number(*argv, "--cache-size")
+				<< 20;
+		}
+		else CHECK('\0', "max-memory") {
+			EXPECT("a size in MiB");
+			maxMemory = (size_t)_number(*argv, "--max-memory") << 20;
+		}
+		else CHECK('\0', "no-uring") {
+			batchOptions.noUring = true;
+		}
+		else CHECK('\0', "watch") {
+			EXPECT("a directory");
+			watchOptions.dir = *argv;
+		}
+		else CHECK('\0', "debounce") {
+			EXPECT("a delay in milliseconds");
+			watchOptions.debounce = _number(*argv, "--debounce");
+		}
+		else CHECK('\0', "no-fanotify") {
+			watchOptions.noFanotify = true;
+		}
+		else CHECK('\0', "triage") {
+			triage = true;
+		}
+		else CHECK('\0', "pid") {
+			EXPECT("a process ID");
+			pids[procOptions.pidNum++] = _number(*argv, "--pid");
+		}
+		else CHECK('\0', "all-pids") {
+			procOptions.all = true;
+		}
 		else {
 			ERR("unknown option '%s'\n\n", *argv);
 			_usage();
@@ -94,26 +1202,289 @@ int main(int argc, char *argv[]) {
 		NEXT();
 	}
 
-	if( file == NULL ) {
+	/* Only stripping needs the names */
+	if( !strip ) {
+		free(removeNames);
+	}
+
+	if( procOptions.pidNum == 0 && !procOptions.all ) {
+		free(pids);
+	}
+
+	/* Files in flight get three quarters of the budget, the rest is left for
+	 * what outlives them (interned names, reports) and the process itself.
+	 * A server has no files in flight but those of its requests, so its parse
+	 * cache gets half instead. Servers and watches reset the intern pool past
+	 * an eighth. Files are mapped from a size that always fits
+	 */
+	Budget budget;
+	if( maxMemory > 0 ) {
+		const size_t IN_FLIGHT = maxMemory - maxMemory / 4;
+
+		budgetInit(&budget, IN_FLIGHT);
+		batchOptions.budget = &budget;
+
+		if( serveOptions.cacheBudget > maxMemory / 2 ) {
+			serveOptions.cacheBudget = maxMemory / 2;
+		}
+
+		if( serveOptions.internBudget > maxMemory / 8 ) {
+			serveOptions.internBudget = maxMemory / 8;
+			watchOptions.internBudget = maxMemory / 8;
+		}
+
+		utilSetMapThreshold(
+			MAP_THRESHOLD < IN_FLIGHT / 16 ? MAP_THRESHOLD : IN_FLIGHT / 16);
+	}
+
+	if( serve ) {
+		return serveRun(&serveOptions);
+	}
+
+	const bool PROC = procOptions.pidNum > 0 || procOptions.all;
+	if( PROC
+		&& (files != NULL || flags != 0 || addr2line || sizeReport || stats
+			|| strip || output || triage || symmapDir != NULL || bytes != NULL
+			|| debugLink || watchOptions.dir != NULL) ) {
+		ERR("--pid and --all-pids can't be combined with other options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( PROC ) {
+		procOptions.cacheBudget = serveOptions.cacheBudget;
+		const int CODE = procRun(&procOptions);
+		free(pids);
+		return CODE;
+	}
+
+	if( files == NULL && watchOptions.dir == NULL ) {
 		ERR("must specify a file as input\n\n");
 		_usage();
 		exit(EXIT_FAILURE);
 	}
 
-	if( flags == 0 ) {
+	if( debugLink
+		&& (flags != 0 || addr2line || sizeReport || stats || strip || output
+			|| triage || symmapDir != NULL || bytes != NULL
+			|| watchOptions.dir != NULL) ) {
+		ERR("--debuglink can't be combined with other options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( debugLink && fileNum != 1 ) {
+		ERR("--debuglink takes a single file\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( debugLink ) {
+		return _debugLink(files[0], debugFile) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if( bytes != NULL
+		&& (flags != 0 || addr2line || sizeReport || stats || strip || output
+			|| triage || symmapDir != NULL || watchOptions.dir != NULL) ) {
+		ERR("--hex-dump and --dump-bytes can't be combined with other "
+			"options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( bytes != NULL && fileNum != 1 ) {
+		ERR("--hex-dump and --dump-bytes take a single file\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( bytes != NULL ) {
+		return _dumpBytes(files[0], bytes, hex) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if( triage
+		&& (flags != 0 || addr2line || sizeReport || stats || strip || output
+			|| symmapDir != NULL || watchOptions.dir != NULL) ) {
+		ERR("--triage can't be combined with other options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( triage ) {
+		triageOptions.roots = files;
+		triageOptions.rootNum = fileNum;
+		return triageRun(&triageOptions);
+	}
+
+	if( output != NULL && !strip ) {
+		ERR("--output goes with --remove-section, --strip-debug or "
+			"--only-keep-debug\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( strip
+		&& (flags != 0 || addr2line || sizeReport || stats
+			|| symmapDir != NULL || watchOptions.dir != NULL) ) {
+		ERR("stripping can't be combined with other options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( strip && output != NULL && fileNum != 1 ) {
+		ERR("--output takes a single file\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	/* Files are stripped one after the other: each costs a few system calls,
+	 * the copying itself happens in the kernel
+	 */
+	if( strip ) {
+		size_t failed = 0;
+		for( int i = 0; i < fileNum; ++i ) {
+			failed += !_strip(files[i], output, &stripOptions);
+		}
+
+		free(removeNames);
+		return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if( addr2line && (fileNum != 1 || watchOptions.dir != NULL) ) {
+		ERR("--addr2line takes a single file\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( sizeReport && (addr2line || watchOptions.dir != NULL) ) {
+		ERR("--size-report can't be combined with --addr2line or --watch\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( stats && watchOptions.dir != NULL ) {
+		ERR("--stats can't be combined with --watch\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( symmapDir != NULL
+		&& (flags != 0 || addr2line || sizeReport
+			|| watchOptions.dir != NULL) ) {
+		ERR("--export-symmap can't be combined with other options\n\n");
+		_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( flags == 0 && !addr2line && !sizeReport && symmapDir == NULL ) {
 		ERR("must specify what information to print\n\n");
 		_usage();
 		exit(EXIT_FAILURE);
 	}
 
-	ELF *elf = elfParseFile(file);
+	if( stats ) {
+		elfStatsEnable();
+	}
+
+	if( watchOptions.dir != NULL ) {
+		watchOptions.flags = flags;
+		watchOptions.batch = batchOptions;
+		return watchRun(&watchOptions);
+	}
+
+	if( fileNum > 1 || sizeReport || symmapDir != NULL ) {
+		Batch batch;
+		batch.flags = flags;
+		batch.sizeReport = NULL;
+		batch.symmapDir = symmapDir;
+		batch.failed = 0;
+		memset(batch.diagnosed, 0, sizeof(batch.diagnosed));
+
+		memset(&batch.pages, 0, sizeof(batch.pages));
+		batch.pageFiles = 0;
+
+		batch.stats = NULL;
+		batch.slowestPath = NULL;
+		batch.slowest = 0;
+
+		/* Each file's read figures are handed to the thread that parses it,
+		 * whichever way it was read, and merged here once it's done
+		 */
+		if( stats ) {
+			batch.stats = calloc(1, sizeof(*batch.stats));
+			if( batch.stats == NULL ) {
+				FATAL("an error occurred while allocating memory\n");
+			}
+		}
+		pthread_mutex_init(&batch.outLock, NULL);
+
+		/* Attributing a file or sorting its symbols is CPU work, and io_uring
+		 * completions all come back on one thread: the thread pool spreads it
+		 * over every core
+		 */
+		if( sizeReport || symmapDir != NULL ) {
+			batchOptions.noUring = true;
+		}
+
+		if( sizeReport ) {
+			batch.sizeReport = elfSizeReportNew();
+			if( batch.sizeReport == NULL ) {
+				FATAL("an error occurred while allocating memory\n");
+			}
+		}
+
+		batchRead((const char *const *)files, fileNum, &batchOptions,
+			_batchFile, &batch);
+
+		if( sizeReport ) {
+			_sizeReport(batch.sizeReport, top);
+			elfSizeReportFree(batch.sizeReport);
+		} else if( flags & ELF_DUMP_PAGES ) {
+			_pageTotals(&batch.pages, batch.pageFiles);
+		}
+
+		_diagnosed(batch.diagnosed);
+
+		if( stats ) {
+			_statsSummary(batch.stats, batch.slowestPath, batch.slowest);
+			free(batch.stats);
+		}
+
+		pthread_mutex_destroy(&batch.outLock);
+		return batch.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	const char *file = files[0];
+
+	ELF_Status status;
+	ELF *elf = elfParseFile(file, &status);
 	if( elf == NULL ) {
+		if( status == ELF_ERR_IO ) {
+			ERR("couldn't read the file at '%s': %s\n", file, strerror(errno));
+		} else {
+			ERR("%s: %s\n", file, elfStatusString(status));
+		}
+
 		return EXIT_FAILURE;
 	}
 
-	elfDump(elf, flags);
+	if( addr2line ) {
+		_warnings(stderr, elf);
+		_addr2line(elf);
+	} else {
+		_warnings(stdout, elf);
+		elfDump(elf, flags);
+	}
 
 	elfFree(elf);
 
+	if( stats ) {
+		ELF_Stats figures;
+		elfStatsTake(&figures);
+
+		fflush(stdout);
+		_stats(&figures);
+	}
+
 	return EXIT_SUCCESS;
 }
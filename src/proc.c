@@ -0,0 +1,608 @@
+/* elfp
+ * Process mode
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "elfcache.h"
+#include "elfnote.h"
+#include "elfp.h"
+
+#include "fault.h"
+
+#include "proc.h"
+
+/* Longest build ID shown, in bytes */
+#define BUILD_ID_MAX 32
+
+/* A file mapped by a process, as /proc/PID/maps has it */
+typedef struct _Mapping {
+	uint64_t start;
+	uint64_t end;
+	uint64_t offset; /* In the file */
+	uint64_t dev;
+	uint64_t ino;
+	char perms[5];
+	char *path;
+	size_t module; /* Index of the file in the module table */
+} Mapping;
+
+typedef struct _Process {
+	pid_t pid;
+	char comm[32];
+	int error; /* Why its maps couldn't be read, 0 if they could */
+
+	Mapping *mappings;
+	size_t num;
+	size_t cap;
+} Process;
+
+/* A file mapped by any process, parsed once */
+typedef struct _Module {
+	uint64_t dev;
+	uint64_t ino;
+
+	const Process *owner; /* First process found mapping it */
+	const Mapping *mapping; /* ...and the mapping, to open the file through */
+
+	ELF_CacheEntry *entry; /* NULL if it isn't ELF or couldn't be read */
+	char buildId[2 * BUILD_ID_MAX + 1]; /* In hexadecimal, empty if none */
+	size_t shown; /* Last process it was reported for, plus one */
+} Module;
+
+typedef struct _Scan {
+	Process *processes;
+	size_t processNum;
+
+	Module *modules;
+	size_t moduleNum;
+	size_t moduleCap;
+
+	/* Hash table of modules by device and inode, holding indices plus one */
+	size_t *slots;
+	size_t slotCap;
+
+	ELF_Cache *cache;
+	uint64_t pageSize;
+} Scan;
+
+/* Work handed out to threads one item at a time */
+typedef struct _Work {
+	Scan *scan;
+	size_t num;
+	size_t next;
+	void (*run)(Scan *scan, size_t idx);
+} Work;
+
+static void _parallel(Scan *scan, size_t num, unsigned threads,
+	void (*run)(Scan *scan, size_t idx));
+static void *_workThread(void *arg);
+static bool _listProcesses(Scan *scan, const ProcOptions *OPTIONS);
+static void _readProcess(Scan *scan, size_t idx);
+static void _readMaps(Process *process, FILE *file);
+static void _indexModules(Scan *scan);
+static size_t _module(Scan *scan, const Process *PROCESS, Mapping *mapping);
+static void _parseModule(Scan *scan, size_t idx);
+static void _buildId(ELF *elf, char *out);
+static bool _loadBias(const Scan *SCAN, const Process *PROCESS,
+	size_t module, uint64_t *bias);
+static void _report(Scan *scan, size_t idx);
+static void _segmentReport(const Scan *SCAN, const Process *PROCESS,
+	size_t module, const ELF_PHEntry *PH, uint64_t bias);
+static void _free(Scan *scan);
+static uint64_t _now(void);
+
+int procRun(const ProcOptions *OPTIONS) {
+	unsigned threads = OPTIONS->threads;
+	if( threads == 0 ) {
+		const long CPUS = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = CPUS > 0 ? CPUS : 1;
+	}
+
+	Scan scan;
+	memset(&scan, 0, sizeof(scan));
+
+	const long PAGE_SIZE = sysconf(_SC_PAGESIZE);
+	scan.pageSize = PAGE_SIZE > 0 ? PAGE_SIZE : 4096;
+
+	scan.cache = elfCacheNew(OPTIONS->cacheBudget);
+	if( scan.cache == NULL || !_listProcesses(&scan, OPTIONS) ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	const uint64_t START = _now();
+
+	_parallel(&scan, scan.processNum, threads, _readProcess);
+	_indexModules(&scan);
+	_parallel(&scan, scan.moduleNum, threads, _parseModule);
+
+	const uint64_t ELAPSED = _now() - START;
+
+	bool failed = false;
+	size_t unreadable = 0;
+	size_t mappings = 0;
+	size_t elfs = 0;
+
+	for( size_t i = 0; i < scan.processNum; ++i ) {
+		const Process *PROCESS = &scan.processes[i];
+
+		/* Every process is looked at, but only those asked for by PID fail
+		 * the run: the others may well have exited since they were listed
+		 */
+		if( PROCESS->error != 0 ) {
+			++unreadable;
+			if( !OPTIONS->all ) {
+				ERR("couldn't read the maps of process %d: %s\n",
+					(int)PROCESS->pid, strerror(PROCESS->error));
+				failed = true;
+			}
+
+			continue;
+		}
+
+		mappings += PROCESS->num;
+		if( PROCESS->num > 0 || !OPTIONS->all ) {
+			_report(&scan, i);
+		}
+	}
+
+	for( size_t m = 0; m < scan.moduleNum; ++m ) {
+		elfs += scan.modules[m].entry != NULL;
+	}
+
+	printf("=== PROCESSES ===\n\n");
+	printf("Processes:  %zu (%zu unreadable)\n", scan.processNum, unreadable);
+	printf("Mappings:   %zu\n", mappings);
+	printf("Files:      %zu (%zu ELF, each parsed once)\n", scan.moduleNum,
+		elfs);
+	printf("Time:       %.3f s\n\n", ELAPSED / 1e9);
+
+	_free(&scan);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Runs 'run' on items 0 to num - 1, spread over threads */
+static void _parallel(Scan *scan, size_t num, unsigned threads,
+	void (*run)(Scan *scan, size_t idx)) {
+	Work work;
+	work.scan = scan;
+	work.num = num;
+	work.next = 0;
+	work.run = run;
+
+	if( threads > num ) {
+		threads = num;
+	}
+
+	pthread_t *ids = malloc(sizeof(*ids) * (threads > 0 ? threads : 1));
+
+	unsigned started = 0;
+	while( ids != NULL && started < threads
+		&& pthread_create(&ids[started], NULL, _workThread, &work) == 0 ) {
+		++started;
+	}
+
+	/* Make do with the calling thread if no other could be started */
+	if( started == 0 ) {
+		_workThread(&work);
+	}
+
+	for( unsigned i = 0; i < started; ++i ) {
+		pthread_join(ids[i], NULL);
+	}
+
+	free(ids);
+}
+
+static void *_workThread(void *arg) {
+	Work *work = arg;
+
+	for( ;; ) {
+		const size_t IDX = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+		if( IDX >= work->num ) {
+			return NULL;
+		}
+
+		work->run(work->scan, IDX);
+	}
+}
+
+/* Fills in the PIDs of the processes to look at
+ * Returns false if memory runs out
+ */
+static bool _listProcesses(Scan *scan, const ProcOptions *OPTIONS) {
+	if( !OPTIONS->all ) {
+		scan->processes = calloc(
+			OPTIONS->pidNum > 0 ? OPTIONS->pidNum : 1, sizeof(Process));
+		if( scan->processes == NULL ) {
+			return false;
+		}
+
+		for( size_t i = 0; i < OPTIONS->pidNum; ++i ) {
+			scan->processes[i].pid = OPTIONS->pids[i];
+		}
+
+		scan->processNum = OPTIONS->pidNum;
+		return true;
+	}
+
+	DIR *dir = opendir("/proc");
+	if( dir == NULL ) {
+		ERR("couldn't list the processes: %s\n", strerror(errno));
+		return true;
+	}
+
+	size_t cap = 0;
+	struct dirent *entry;
+
+	while( (entry = readdir(dir)) != NULL ) {
+		if( !isdigit((unsigned char)entry->d_name[0]) ) {
+			continue;
+		}
+
+		if( scan->processNum == cap ) {
+			cap = cap > 0 ? cap * 2 : 256;
+			Process *processes
+				= realloc(scan->processes, sizeof(*processes) * cap);
+			if( processes == NULL ) {
+				closedir(dir);
+				return false;
+			}
+
+			scan->processes = processes;
+		}
+
+		Process *process = &scan->processes[scan->processNum++];
+		memset(process, 0, sizeof(*process));
+		process->pid = strtol(entry->d_name, NULL, 10);
+	}
+
+	closedir(dir);
+	return true;
+}
+
+/* Reads the name and maps of a process */
+static void _readProcess(Scan *scan, size_t idx) {
+	Process *process = &scan->processes[idx];
+	char path[64];
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", (int)process->pid);
+	FILE *file = fopen(path, "re");
+	if( file != NULL ) {
+		if( fgets(process->comm, sizeof(process->comm), file) != NULL ) {
+			process->comm[strcspn(process->comm, "\n")] = '\0';
+		}
+
+		fclose(file);
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/maps", (int)process->pid);
+	file = fopen(path, "re");
+	if( file == NULL ) {
+		process->error = errno;
+		return;
+	}
+
+	_readMaps(process, file);
+	fclose(file);
+}
+
+/* Keeps the file-backed mappings of a process
+ * Lines look like "start-end perms offset major:minor inode path"
+ */
+static void _readMaps(Process *process, FILE *file) {
+	char *line = NULL;
+	size_t lineCap = 0;
+
+	while( getline(&line, &lineCap, file) > 0 ) {
+		Mapping mapping;
+		unsigned major;
+		unsigned minor;
+		int pathAt = 0;
+
+		if( sscanf(line,
+				"%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %x:%x %" SCNu64 " %n",
+				&mapping.start, &mapping.end, mapping.perms, &mapping.offset,
+				&major, &minor, &mapping.ino, &pathAt)
+				< 7
+			|| mapping.ino == 0 || line[pathAt] != '/' ) {
+			continue;
+		}
+
+		line[pathAt + strcspn(line + pathAt, "\n")] = '\0';
+		mapping.dev = (uint64_t)major << 32 | minor;
+		mapping.path = strdup(line + pathAt);
+		mapping.module = 0;
+
+		if( process->num == process->cap ) {
+			const size_t CAP = process->cap > 0 ? process->cap * 2 : 64;
+			Mapping *mappings
+				= realloc(process->mappings, sizeof(*mappings) * CAP);
+			if( mappings == NULL ) {
+				free(mapping.path);
+				break;
+			}
+
+			process->mappings = mappings;
+			process->cap = CAP;
+		}
+
+		if( mapping.path == NULL ) {
+			break;
+		}
+
+		process->mappings[process->num++] = mapping;
+	}
+
+	free(line);
+}
+
+/* Gives every mapped file its entry in the module table */
+static void _indexModules(Scan *scan) {
+	for( size_t p = 0; p < scan->processNum; ++p ) {
+		Process *process = &scan->processes[p];
+
+		for( size_t m = 0; m < process->num; ++m ) {
+			process->mappings[m].module
+				= _module(scan, process, &process->mappings[m]);
+		}
+	}
+}
+
+/* Returns the index of the module a mapping is of, adding it if it's new */
+static size_t _module(Scan *scan, const Process *PROCESS, Mapping *mapping) {
+	/* Keep the table at most half full */
+	if( 2 * (scan->moduleNum + 1) > scan->slotCap ) {
+		const size_t CAP = scan->slotCap > 0 ? scan->slotCap * 2 : 1024;
+		size_t *slots = calloc(CAP, sizeof(*slots));
+		if( slots == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		for( size_t s = 0; s < scan->slotCap; ++s ) {
+			if( scan->slots[s] == 0 ) {
+				continue;
+			}
+
+			const Module *MODULE = &scan->modules[scan->slots[s] - 1];
+			size_t at = (MODULE->dev * 31 + MODULE->ino) & (CAP - 1);
+			while( slots[at] != 0 ) {
+				at = (at + 1) & (CAP - 1);
+			}
+
+			slots[at] = scan->slots[s];
+		}
+
+		free(scan->slots);
+		scan->slots = slots;
+		scan->slotCap = CAP;
+	}
+
+	size_t at = (mapping->dev * 31 + mapping->ino) & (scan->slotCap - 1);
+	while( scan->slots[at] != 0 ) {
+		const Module *MODULE = &scan->modules[scan->slots[at] - 1];
+		if( MODULE->dev == mapping->dev && MODULE->ino == mapping->ino ) {
+			return scan->slots[at] - 1;
+		}
+
+		at = (at + 1) & (scan->slotCap - 1);
+	}
+
+	if( scan->moduleNum == scan->moduleCap ) {
+		const size_t CAP = scan->moduleCap > 0 ? scan->moduleCap * 2 : 256;
+		Module *modules = realloc(scan->modules, sizeof(*modules) * CAP);
+		if( modules == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		scan->modules = modules;
+		scan->moduleCap = CAP;
+	}
+
+	Module *module = &scan->modules[scan->moduleNum];
+	memset(module, 0, sizeof(*module));
+	module->dev = mapping->dev;
+	module->ino = mapping->ino;
+	module->owner = PROCESS;
+	module->mapping = mapping;
+
+	scan->slots[at] = ++scan->moduleNum;
+	return scan->moduleNum - 1;
+}
+
+/* Parses a mapped file, trying each way of opening it in turn */
+static void _parseModule(Scan *scan, size_t idx) {
+	Module *module = &scan->modules[idx];
+	const Mapping *MAPPING = module->mapping;
+	const int PID = module->owner->pid;
+
+	char path[PATH_MAX + 64];
+	ELF_Status status;
+
+	snprintf(path, sizeof(path), "/proc/%d/map_files/%" PRIx64 "-%" PRIx64,
+		PID, MAPPING->start, MAPPING->end);
+	module->entry = elfCacheAcquire(scan->cache, path, &status);
+
+	if( module->entry == NULL && status == ELF_ERR_IO ) {
+		snprintf(path, sizeof(path), "/proc/%d/root%s", PID, MAPPING->path);
+		module->entry = elfCacheAcquire(scan->cache, path, &status);
+	}
+
+	if( module->entry == NULL && status == ELF_ERR_IO ) {
+		module->entry = elfCacheAcquire(scan->cache, MAPPING->path, &status);
+	}
+
+	if( module->entry != NULL ) {
+		_buildId(module->entry->elf, module->buildId);
+	}
+}
+
+/* Writes the build ID of an ELF in hexadecimal, empty if it has none */
+static void _buildId(ELF *elf, char *out) {
+	const uint8_t *id;
+	uint32_t size = elfBuildId(elf, &id);
+
+	if( size > BUILD_ID_MAX ) {
+		size = BUILD_ID_MAX;
+	}
+
+	for( uint32_t b = 0; b < size; ++b ) {
+		sprintf(out + 2 * b, "%02x", id[b]);
+	}
+
+	out[2 * size] = '\0';
+}
+
+/* Works out where a module was loaded: the difference between the addresses
+ * its segments were linked at and those they're mapped at. Returns false if
+ * no mapping lines up with a segment
+ */
+static bool _loadBias(const Scan *SCAN, const Process *PROCESS,
+	size_t module, uint64_t *bias) {
+	const ELF *ELF_ = SCAN->modules[module].entry->elf;
+	const uint64_t PAGE_MASK = ~(SCAN->pageSize - 1);
+
+	for( size_t m = 0; m < PROCESS->num; ++m ) {
+		const Mapping *MAPPING = &PROCESS->mappings[m];
+		if( MAPPING->module != module ) {
+			continue;
+		}
+
+		/* A segment is mapped from the page holding its first byte, at the
+		 * page holding its first address
+		 */
+		for( uint16_t i = 0; i < ELF_->header.progHeaderEntryNum; ++i ) {
+			const ELF_PHEntry *PH = &ELF_->ph[i];
+			const uint64_t OFFSET = PH->offset & PAGE_MASK;
+
+			if( PH->type == ELF_PHT_LOAD && MAPPING->offset >= OFFSET
+				&& MAPPING->offset < PH->offset + PH->fileSize ) {
+				*bias = MAPPING->start - (MAPPING->offset - OFFSET)
+					- (PH->virtualAddr & PAGE_MASK);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* Prints the modules of a process, each followed by its segments */
+static void _report(Scan *scan, size_t idx) {
+	const Process *PROCESS = &scan->processes[idx];
+
+	printf("=== PROCESS %d (%s) ===\n\n", (int)PROCESS->pid, PROCESS->comm);
+	printf("Load bias          Build ID                                 "
+		   "Module\n");
+	printf("--------------------------------------------------------------"
+		   "------------\n");
+
+	for( size_t m = 0; m < PROCESS->num; ++m ) {
+		const Mapping *MAPPING = &PROCESS->mappings[m];
+		Module *module = &scan->modules[MAPPING->module];
+
+		/* Files that aren't ELF (like locale archives) are left out */
+		if( module->entry == NULL || module->shown == idx + 1 ) {
+			continue;
+		}
+
+		module->shown = idx + 1;
+
+		uint64_t bias = 0;
+		const bool KNOWN = _loadBias(scan, PROCESS, MAPPING->module, &bias);
+
+		if( KNOWN ) {
+			printf("0x%016" PRIx64 " ", bias);
+		} else {
+			printf("%-18s ", "?");
+		}
+
+		printf("%-40s %s\n", *module->buildId != '\0' ? module->buildId : "-",
+			MAPPING->path);
+
+		const ELF *ELF_ = module->entry->elf;
+		for( uint16_t i = 0; KNOWN && i < ELF_->header.progHeaderEntryNum;
+			 ++i ) {
+			if( ELF_->ph[i].type == ELF_PHT_LOAD ) {
+				_segmentReport(
+					scan, PROCESS, MAPPING->module, &ELF_->ph[i], bias);
+			}
+		}
+	}
+
+	printf("\n");
+}
+
+/* Prints a PT_LOAD segment, then the mappings of its module covering it */
+static void _segmentReport(const Scan *SCAN, const Process *PROCESS,
+	size_t module, const ELF_PHEntry *PH, uint64_t bias) {
+	const uint64_t PAGE_MASK = ~(SCAN->pageSize - 1);
+	const uint64_t START = (bias + PH->virtualAddr) & PAGE_MASK;
+	const uint64_t END
+		= (bias + PH->virtualAddr + PH->memSize + SCAN->pageSize - 1)
+		& PAGE_MASK;
+
+	printf("    LOAD 0x%016" PRIx64 " %c%c%c ", PH->virtualAddr,
+		PH->flags & ELF_PHF_R ? 'R' : '-', PH->flags & ELF_PHF_W ? 'W' : '-',
+		PH->flags & ELF_PHF_X ? 'X' : '-');
+
+	bool mapped = false;
+	for( size_t m = 0; m < PROCESS->num; ++m ) {
+		const Mapping *MAPPING = &PROCESS->mappings[m];
+
+		if( MAPPING->module == module && MAPPING->start < END
+			&& MAPPING->end > START ) {
+			printf(" 0x%012" PRIx64 "-0x%012" PRIx64 " %s", MAPPING->start,
+				MAPPING->end, MAPPING->perms);
+			mapped = true;
+		}
+	}
+
+	printf("%s\n", mapped ? "" : " not mapped");
+}
+
+static void _free(Scan *scan) {
+	for( size_t m = 0; m < scan->moduleNum; ++m ) {
+		if( scan->modules[m].entry != NULL ) {
+			elfCacheRelease(scan->cache, scan->modules[m].entry);
+		}
+	}
+
+	for( size_t p = 0; p < scan->processNum; ++p ) {
+		Process *process = &scan->processes[p];
+
+		for( size_t m = 0; m < process->num; ++m ) {
+			free(process->mappings[m].path);
+		}
+
+		free(process->mappings);
+	}
+
+	elfCacheFree(scan->cache);
+	free(scan->processes);
+	free(scan->modules);
+	free(scan->slots);
+}
+
+/* Returns the time on the monotonic clock, in ns */
+static uint64_t _now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
@@ -0,0 +1,595 @@
+/* elfp
+ * Server mode
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "elfcache.h"
+#include "elfdump.h"
+#include "elfintern.h"
+#include "elfp.h"
+
+#include "fault.h"
+
+#include "serve.h"
+
+/* Initial size of a connection's line buffer */
+#define LINE_BUFFER_SIZE 4096
+
+/* Longest request line, newline included; a client sending a longer one is
+ * told so and dropped
+ */
+#define REQUEST_MAX 16384
+
+/* Most requests queued at once; readers wait for room past that, so a client
+ * sending faster than it's answered stops being read from
+ */
+#define QUEUE_MAX 1024
+
+/* A client connection
+ * Shared by the thread reading its requests and the workers answering them
+ */
+typedef struct _Conn {
+	int in;
+	int out;
+	bool ownsFds; /* Whether the descriptors get closed with the connection */
+
+	pthread_mutex_t writeLock; /* Keeps responses from interleaving */
+
+	pthread_mutex_t refLock;
+	unsigned refs; /* Reader + pending requests */
+} Conn;
+
+/* A pending request */
+typedef struct _Job {
+	Conn *conn;
+	char *line;
+	struct _Job *next;
+} Job;
+
+typedef struct _Server {
+	ELF_Cache *cache;
+	size_t internBudget;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t room; /* Signalled when a job leaves a full queue */
+	Job *head;
+	Job *tail;
+	size_t queued;
+	bool closing; /* Workers exit once this is set and the queue is empty */
+
+	/* While the intern pool is reset, no request may be running */
+	unsigned active; /* Requests being answered */
+	bool draining; /* Whether a reset is waiting for them, or running */
+	pthread_cond_t drained; /* Signalled when the last of them is done */
+
+	pthread_t *workers;
+	unsigned threads; /* Workers started */
+} Server;
+
+/* Arguments of a socket connection's reader thread */
+typedef struct _Reader {
+	Server *server;
+	Conn *conn;
+} Reader;
+
+static Conn *_connNew(int in, int out, bool ownsFds);
+static void _connRef(Conn *conn);
+static void _connUnref(Conn *conn);
+
+static void _readRequests(Server *server, Conn *conn);
+static void *_readerThread(void *arg);
+static void _push(Server *server, Conn *conn, char *line);
+
+static void *_workerThread(void *arg);
+static void _resetIntern(Server *server);
+static void _handle(Server *server, Conn *conn, char *line);
+static void _respond(Conn *conn, const char *ID, bool ok, const char *PAYLOAD,
+	size_t length);
+static bool _writeAll(int fd, const char *DATA, size_t length);
+
+static int _serveStdio(Server *server);
+static int _serveSocket(Server *server, const char *PATH);
+
+int serveRun(const ServeOptions *OPTIONS) {
+	/* A client hanging up shouldn't take the whole server down */
+	signal(SIGPIPE, SIG_IGN);
+
+	Server server;
+	memset(&server, 0, sizeof(server));
+
+	server.cache = elfCacheNew(OPTIONS->cacheBudget);
+	server.internBudget = OPTIONS->internBudget;
+	const unsigned THREADS = OPTIONS->threads > 0 ? OPTIONS->threads : 1;
+	server.workers = malloc(sizeof(*server.workers) * THREADS);
+
+	if( server.cache == NULL || server.workers == NULL ) {
+		ERR("an error occurred while allocating memory\n");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.cond, NULL);
+	pthread_cond_init(&server.room, NULL);
+	pthread_cond_init(&server.drained, NULL);
+
+	while( server.threads < THREADS
+		&& pthread_create(&server.workers[server.threads], NULL,
+			   _workerThread, &server)
+			== 0 ) {
+		++server.threads;
+	}
+
+	int result = EXIT_FAILURE;
+	if( server.threads == 0 ) {
+		ERR("couldn't start any worker thread\n");
+	} else {
+		result = OPTIONS->socketPath != NULL
+			? _serveSocket(&server, OPTIONS->socketPath)
+			: _serveStdio(&server);
+	}
+
+	pthread_mutex_lock(&server.lock);
+	server.closing = true;
+	pthread_cond_broadcast(&server.cond);
+	pthread_cond_broadcast(&server.room);
+	pthread_mutex_unlock(&server.lock);
+
+	for( unsigned i = 0; i < server.threads; ++i ) {
+		pthread_join(server.workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&server.drained);
+	pthread_cond_destroy(&server.room);
+	pthread_cond_destroy(&server.cond);
+	pthread_mutex_destroy(&server.lock);
+
+	elfCacheFree(server.cache);
+	free(server.workers);
+
+	return result;
+}
+
+/* Serves requests from stdin until it's closed */
+static int _serveStdio(Server *server) {
+	Conn *conn = _connNew(STDIN_FILENO, STDOUT_FILENO, false);
+	if( conn == NULL ) {
+		ERR("an error occurred while allocating memory\n");
+		return EXIT_FAILURE;
+	}
+
+	_readRequests(server, conn);
+	return EXIT_SUCCESS;
+}
+
+/* Serves requests from a Unix socket, spawning a reader per connection */
+static int _serveSocket(Server *server, const char *PATH) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if( strlen(PATH) >= sizeof(addr.sun_path) ) {
+		ERR("socket path '%s' is too long\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	strcpy(addr.sun_path, PATH);
+
+	const int FD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( FD < 0 ) {
+		ERR("couldn't create socket: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	unlink(PATH);
+	if( bind(FD, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| listen(FD, SOMAXCONN) != 0 ) {
+		ERR("couldn't listen on '%s': %s\n", PATH, strerror(errno));
+		close(FD);
+		return EXIT_FAILURE;
+	}
+
+	for( ;; ) {
+		const int CLIENT = accept(FD, NULL, NULL);
+		if( CLIENT < 0 ) {
+			if( errno == EINTR || errno == ECONNABORTED ) {
+				continue;
+			}
+
+			ERR("couldn't accept connection: %s\n", strerror(errno));
+			break;
+		}
+
+		Conn *conn = _connNew(CLIENT, CLIENT, true);
+		if( conn == NULL ) {
+			close(CLIENT);
+			continue;
+		}
+
+		Reader *reader = malloc(sizeof(*reader));
+		if( reader == NULL ) {
+			_connUnref(conn);
+			continue;
+		}
+
+		reader->server = server;
+		reader->conn = conn;
+
+		pthread_t thread;
+		if( pthread_create(&thread, NULL, _readerThread, reader) != 0 ) {
+			_connUnref(conn);
+			free(reader);
+			continue;
+		}
+
+		pthread_detach(thread);
+	}
+
+	close(FD);
+	unlink(PATH);
+
+	return EXIT_FAILURE;
+}
+
+/* Creates a connection, owned by its reader */
+static Conn *_connNew(int in, int out, bool ownsFds) {
+	Conn *conn = malloc(sizeof(*conn));
+	if( conn == NULL ) {
+		return NULL;
+	}
+
+	conn->in = in;
+	conn->out = out;
+	conn->ownsFds = ownsFds;
+	conn->refs = 1;
+
+	pthread_mutex_init(&conn->writeLock, NULL);
+	pthread_mutex_init(&conn->refLock, NULL);
+
+	return conn;
+}
+
+static void _connRef(Conn *conn) {
+	pthread_mutex_lock(&conn->refLock);
+	++conn->refs;
+	pthread_mutex_unlock(&conn->refLock);
+}
+
+/* Drops a reference, closing the connection after the last one */
+static void _connUnref(Conn *conn) {
+	pthread_mutex_lock(&conn->refLock);
+	const unsigned REFS = --conn->refs;
+	pthread_mutex_unlock(&conn->refLock);
+
+	if( REFS > 0 ) {
+		return;
+	}
+
+	if( conn->ownsFds ) {
+		close(conn->in);
+		if( conn->out != conn->in ) {
+			close(conn->out);
+		}
+	}
+
+	pthread_mutex_destroy(&conn->writeLock);
+	pthread_mutex_destroy(&conn->refLock);
+	free(conn);
+}
+
+static void *_readerThread(void *arg) {
+	Reader *reader = arg;
+
+	_readRequests(reader->server, reader->conn);
+
+	free(reader);
+	return NULL;
+}
+
+/* Queues every request line read from a connection, then lets go of it */
+static void _readRequests(Server *server, Conn *conn) {
+	size_t cap = LINE_BUFFER_SIZE;
+	size_t len = 0;
+	char *buffer = malloc(cap);
+
+	while( buffer != NULL ) {
+		if( len == REQUEST_MAX ) {
+			const char *MSG = "request too long";
+			_respond(conn, "-", false, MSG, strlen(MSG));
+			break;
+		}
+
+		if( len == cap ) {
+			char *grown = realloc(buffer, cap * 2);
+			if( grown == NULL ) {
+				break;
+			}
+
+			buffer = grown;
+			cap *= 2;
+		}
+
+		const ssize_t READ = read(conn->in, buffer + len, cap - len);
+		if( READ < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( READ <= 0 ) {
+			break;
+		}
+
+		len += READ;
+
+		/* Hand out every complete line */
+		char *start = buffer;
+		char *nl;
+		while( (nl = memchr(start, '\n', len - (start - buffer))) != NULL ) {
+			*nl = '\0';
+
+			char *line = malloc(nl - start + 1);
+			if( line != NULL ) {
+				memcpy(line, start, nl - start + 1);
+				_push(server, conn, line);
+			}
+
+			start = nl + 1;
+		}
+
+		len -= start - buffer;
+		memmove(buffer, start, len);
+	}
+
+	free(buffer);
+	_connUnref(conn);
+}
+
+/* Queues a request, once there's room for it */
+static void _push(Server *server, Conn *conn, char *line) {
+	Job *job = malloc(sizeof(*job));
+	if( job == NULL ) {
+		free(line);
+		return;
+	}
+
+	_connRef(conn);
+
+	job->conn = conn;
+	job->line = line;
+	job->next = NULL;
+
+	pthread_mutex_lock(&server->lock);
+
+	while( server->queued >= QUEUE_MAX && !server->closing ) {
+		pthread_cond_wait(&server->room, &server->lock);
+	}
+
+	/* No worker is left to answer it */
+	if( server->closing ) {
+		pthread_mutex_unlock(&server->lock);
+
+		_connUnref(conn);
+		free(line);
+		free(job);
+		return;
+	}
+
+	if( server->tail != NULL ) {
+		server->tail->next = job;
+	} else {
+		server->head = job;
+	}
+
+	server->tail = job;
+	++server->queued;
+
+	pthread_cond_signal(&server->cond);
+	pthread_mutex_unlock(&server->lock);
+}
+
+static void *_workerThread(void *arg) {
+	Server *server = arg;
+
+	for( ;; ) {
+		pthread_mutex_lock(&server->lock);
+
+		while( (server->head == NULL && !server->closing)
+			|| server->draining ) {
+			pthread_cond_wait(&server->cond, &server->lock);
+		}
+
+		Job *job = server->head;
+		if( job == NULL ) {
+			pthread_mutex_unlock(&server->lock);
+			return NULL;
+		}
+
+		server->head = job->next;
+		if( server->head == NULL ) {
+			server->tail = NULL;
+		}
+
+		if( server->queued-- == QUEUE_MAX ) {
+			pthread_cond_broadcast(&server->room);
+		}
+
+		++server->active;
+		pthread_mutex_unlock(&server->lock);
+
+		_handle(server, job->conn, job->line);
+
+		_connUnref(job->conn);
+		free(job->line);
+		free(job);
+
+		pthread_mutex_lock(&server->lock);
+
+		if( --server->active == 0 && server->draining ) {
+			pthread_cond_signal(&server->drained);
+		}
+
+		pthread_mutex_unlock(&server->lock);
+
+		ELF_InternStats stats;
+		elfInternGetStats(&stats);
+		if( stats.footprint > server->internBudget ) {
+			_resetIntern(server);
+		}
+	}
+}
+
+/* Empties the intern pool, and with it the cache, whose ELFs hold its IDs
+ * New requests wait until it's done, and it waits for the running ones
+ */
+static void _resetIntern(Server *server) {
+	pthread_mutex_lock(&server->lock);
+
+	/* Another worker may be at it already */
+	if( server->draining ) {
+		pthread_mutex_unlock(&server->lock);
+		return;
+	}
+
+	server->draining = true;
+	while( server->active > 0 ) {
+		pthread_cond_wait(&server->drained, &server->lock);
+	}
+
+	pthread_mutex_unlock(&server->lock);
+
+	elfCacheClear(server->cache);
+	elfInternReset();
+
+	pthread_mutex_lock(&server->lock);
+	server->draining = false;
+	pthread_cond_broadcast(&server->cond);
+	pthread_mutex_unlock(&server->lock);
+}
+
+/* Answers a single request */
+static void _handle(Server *server, Conn *conn, char *line) {
+	char *id = line;
+	char *command = strchr(line, ' ');
+	if( command == NULL ) {
+		const char *MSG = "expected a command";
+		_respond(conn, *id != '\0' ? id : "-", false, MSG, strlen(MSG));
+		return;
+	}
+
+	*command++ = '\0';
+
+	/* Everything after the command is the path, spaces included */
+	char *path = strchr(command, ' ');
+	if( path != NULL ) {
+		*path++ = '\0';
+	}
+
+	int flags = 0;
+	if( strcmp(command, "header") == 0 ) {
+		flags = ELF_DUMP_EH;
+	} else if( strcmp(command, "program") == 0 ) {
+		flags = ELF_DUMP_PH;
+	} else if( strcmp(command, "section") == 0 ) {
+		flags = ELF_DUMP_SH;
+	} else if( strcmp(command, "all") == 0 ) {
+		flags = ELF_DUMP_ALL;
+	} else if( strcmp(command, "stats") == 0 ) {
+		ELF_CacheStats stats;
+		elfCacheGetStats(server->cache, &stats);
+
+		char payload[256];
+		const int LEN = snprintf(payload, sizeof(payload),
+			"hits %" PRIu64 "\nmisses %" PRIu64 "\nentries %zu\n"
+			"used %zu\nbudget %zu\n",
+			stats.hits, stats.misses, stats.entries, stats.used, stats.budget);
+
+		_respond(conn, id, true, payload, LEN);
+		return;
+	} else {
+		const char *MSG = "unknown command";
+		_respond(conn, id, false, MSG, strlen(MSG));
+		return;
+	}
+
+	if( path == NULL || *path == '\0' ) {
+		const char *MSG = "expected a path";
+		_respond(conn, id, false, MSG, strlen(MSG));
+		return;
+	}
+
+	ELF_Status status;
+	ELF_CacheEntry *entry = elfCacheAcquire(server->cache, path, &status);
+	if( entry == NULL ) {
+		const char *MSG = elfStatusString(status);
+		_respond(conn, id, false, MSG, strlen(MSG));
+		return;
+	}
+
+	char *payload = NULL;
+	size_t length = 0;
+
+	FILE *out = open_memstream(&payload, &length);
+	if( out == NULL ) {
+		elfCacheRelease(server->cache, entry);
+
+		const char *MSG = elfStatusString(ELF_ERR_NOMEM);
+		_respond(conn, id, false, MSG, strlen(MSG));
+		return;
+	}
+
+	elfDumpTo(out, entry->elf, flags);
+	fclose(out);
+
+	elfCacheRelease(server->cache, entry);
+
+	_respond(conn, id, true, payload, length);
+	free(payload);
+}
+
+/* Sends a response, in one piece */
+static void _respond(
+	Conn *conn, const char *ID, bool ok, const char *PAYLOAD, size_t length) {
+	char header[128];
+	const int HEADER_LEN = snprintf(header, sizeof(header), "%.64s %s %zu\n",
+		ID, ok ? "ok" : "error", length);
+
+	pthread_mutex_lock(&conn->writeLock);
+
+	if( _writeAll(conn->out, header, HEADER_LEN) ) {
+		_writeAll(conn->out, PAYLOAD, length);
+	}
+
+	pthread_mutex_unlock(&conn->writeLock);
+}
+
+/* Writes a whole buffer, retrying on short writes */
+static bool _writeAll(int fd, const char *DATA, size_t length) {
+	while( length > 0 ) {
+		const ssize_t WRITTEN = write(fd, DATA, length);
+		if( WRITTEN < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+
+			return false;
+		}
+
+		DATA += WRITTEN;
+		length -= WRITTEN;
+	}
+
+	return true;
+}
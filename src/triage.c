@@ -0,0 +1,646 @@
+/* elfp
+ * Triage mode
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "elfp.h"
+
+#include "fault.h"
+
+#include "triage.h"
+
+/* Bytes read from each file: enough for a 64-bit Entry Header */
+#define HEAD_SIZE 64
+
+/* Directory entries read per getdents64 call, in bytes */
+#define DENTS_SIZE 65536
+
+/* Output a thread gathers before writing it out */
+#define OUT_SIZE 65536
+
+/* Room a line takes besides its path */
+#define LINE_SIZE 32
+
+/* Walking is bound by the latency of lookups rather than by the CPU, so by
+ * default there are several threads per CPU to keep more of them in flight
+ */
+#define THREADS_PER_CPU 4
+
+/* Record of a directory entry, as getdents64 returns it */
+typedef struct _Dirent64 {
+	uint64_t ino;
+	int64_t off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[];
+} Dirent64;
+
+/* What regular files turn out to be */
+typedef enum _Kind {
+	KIND_ELF = 0,
+	KIND_OTHER, /* Not ELF */
+	KIND_TRUNCATED, /* ELF magic, but too short for an Entry Header */
+	KIND_UNREADABLE, /* Couldn't be opened or read */
+
+	KIND_NUM,
+} Kind;
+
+/* ELF files sharing a class, data encoding, type and machine */
+typedef struct _Tally {
+	uint64_t key;
+	uint64_t files;
+} Tally;
+
+/* State shared by the walking threads */
+typedef struct _Walk {
+	char **stack; /* Directories left to read */
+	size_t num;
+	size_t cap;
+	unsigned busy; /* Threads reading a directory */
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+
+	pthread_mutex_t outLock;
+	uint64_t failedDirs; /* Directories that couldn't be read */
+} Walk;
+
+/* State of one walking thread */
+typedef struct _Walker {
+	Walk *walk;
+	char *dents;
+
+	char *out;
+	size_t outLength;
+
+	uint64_t kinds[KIND_NUM];
+	uint64_t dirs;
+
+	Tally *tallies;
+	size_t tallyNum;
+	size_t tallyCap;
+} Walker;
+
+static void *_walkerThread(void *arg);
+static void _dir(Walker *walker, const char *PATH);
+static void _file(Walker *walker, int dir, const char *DIR, const char *NAME);
+static void _tally(Walker *walker, uint64_t key, uint64_t files);
+static void _line(Walker *walker, const ELF_Header *HEADER, const char *DIR,
+	const char *NAME);
+static void _flush(Walker *walker);
+static void _push(Walk *walk, char *path);
+static char *_join(const char *DIR, const char *NAME);
+static const char *_separator(const char *DIR);
+static uint64_t _key(const ELF_Header *HEADER);
+static const char *_className(unsigned class);
+static const char *_dataName(unsigned endianness);
+static const char *_typeName(unsigned type);
+static const char *_machineName(unsigned machine, char *buffer);
+static int _compareTallies(const void *A, const void *B);
+static uint64_t _now(void);
+
+int triageRun(const TriageOptions *OPTIONS) {
+	unsigned threads = OPTIONS->threads;
+	if( threads == 0 ) {
+		const long CPUS = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (CPUS > 0 ? CPUS : 1) * THREADS_PER_CPU;
+	}
+
+	Walk walk;
+	walk.stack = NULL;
+	walk.num = 0;
+	walk.cap = 0;
+	walk.busy = 0;
+	walk.failedDirs = 0;
+	pthread_mutex_init(&walk.lock, NULL);
+	pthread_cond_init(&walk.ready, NULL);
+	pthread_mutex_init(&walk.outLock, NULL);
+
+	Walker *walkers = calloc(threads, sizeof(*walkers));
+	pthread_t *ids = malloc(sizeof(*ids) * threads);
+	if( walkers == NULL || ids == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	for( unsigned i = 0; i < threads; ++i ) {
+		walkers[i].walk = &walk;
+		walkers[i].dents = malloc(DENTS_SIZE);
+		walkers[i].out = malloc(OUT_SIZE);
+		if( walkers[i].dents == NULL || walkers[i].out == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+	}
+
+	const uint64_t START = _now();
+	bool failed = false;
+
+	/* Roots are the only paths whose links are followed. Files given as roots
+	 * are looked at right away, directories are left to the threads
+	 */
+	for( size_t i = 0; i < OPTIONS->rootNum; ++i ) {
+		const char *ROOT = OPTIONS->roots[i];
+
+		struct stat st;
+		if( stat(ROOT, &st) != 0 ) {
+			ERR("couldn't read '%s': %s\n", ROOT, strerror(errno));
+			failed = true;
+		} else if( S_ISDIR(st.st_mode) ) {
+			char *path = strdup(ROOT);
+			if( path == NULL ) {
+				FATAL("an error occurred while allocating memory\n");
+			}
+
+			_push(&walk, path);
+		} else if( S_ISREG(st.st_mode) ) {
+			_file(&walkers[0], AT_FDCWD, NULL, ROOT);
+		} else {
+			ERR("'%s' is neither a directory nor a regular file\n", ROOT);
+			failed = true;
+		}
+	}
+
+	unsigned started = 0;
+	while( started < threads
+		&& pthread_create(&ids[started], NULL, _walkerThread,
+			   &walkers[started])
+			== 0 ) {
+		++started;
+	}
+
+	/* Make do with the calling thread if no other could be started */
+	if( started == 0 ) {
+		_walkerThread(&walkers[0]);
+	}
+
+	for( unsigned i = 0; i < started; ++i ) {
+		pthread_join(ids[i], NULL);
+	}
+
+	const uint64_t ELAPSED = _now() - START;
+
+	/* Every thread's counts go into the first one's */
+	Walker *total = &walkers[0];
+	_flush(total);
+
+	for( unsigned i = 1; i < threads; ++i ) {
+		Walker *walker = &walkers[i];
+		_flush(walker);
+
+		for( int k = 0; k < KIND_NUM; ++k ) {
+			total->kinds[k] += walker->kinds[k];
+		}
+
+		total->dirs += walker->dirs;
+
+		for( size_t t = 0; t < walker->tallyNum; ++t ) {
+			_tally(total, walker->tallies[t].key, walker->tallies[t].files);
+		}
+	}
+
+	uint64_t files = 0;
+	for( int k = 0; k < KIND_NUM; ++k ) {
+		files += total->kinds[k];
+	}
+
+	const double SECONDS = ELAPSED / 1e9;
+
+	printf("=== TRIAGE ===\n\n");
+	printf("%" PRIu64 " files in %" PRIu64 " directories, %.2f s (%.0f "
+		   "files/s)\n\n",
+		files, total->dirs, SECONDS, SECONDS > 0 ? files / SECONDS : 0);
+
+	printf("ELF:          %" PRIu64 "\n", total->kinds[KIND_ELF]);
+	printf("Other:        %" PRIu64 "\n", total->kinds[KIND_OTHER]);
+	printf("Truncated:    %" PRIu64 "\n", total->kinds[KIND_TRUNCATED]);
+	printf("Unreadable:   %" PRIu64 "\n", total->kinds[KIND_UNREADABLE]);
+	printf("Unread dirs:  %" PRIu64 "\n\n", walk.failedDirs);
+
+	qsort(total->tallies, total->tallyNum, sizeof(*total->tallies),
+		_compareTallies);
+
+	printf("Files    Class Data Type Machine\n");
+	printf("--------------------------------------------------------------\n");
+
+	for( size_t t = 0; t < total->tallyNum; ++t ) {
+		const uint64_t KEY = total->tallies[t].key;
+		char buffer[16];
+
+		printf("%-8" PRIu64 " %-5s %-4s %-4s %s\n", total->tallies[t].files,
+			_className(KEY >> 48 & 0xFF), _dataName(KEY >> 40 & 0xFF),
+			_typeName(KEY >> 16 & 0xFFFF), _machineName(KEY & 0xFFFF, buffer));
+	}
+
+	printf("\n");
+
+	for( unsigned i = 0; i < threads; ++i ) {
+		free(walkers[i].dents);
+		free(walkers[i].out);
+		free(walkers[i].tallies);
+	}
+
+	free(walkers);
+	free(ids);
+	free(walk.stack);
+
+	pthread_mutex_destroy(&walk.lock);
+	pthread_cond_destroy(&walk.ready);
+	pthread_mutex_destroy(&walk.outLock);
+
+	return failed || walk.failedDirs > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Takes directories off the shared stack until there are none left and no
+ * thread is reading one, which could add more
+ */
+static void *_walkerThread(void *arg) {
+	Walker *walker = arg;
+	Walk *walk = walker->walk;
+
+	pthread_mutex_lock(&walk->lock);
+
+	for( ;; ) {
+		while( walk->num == 0 && walk->busy > 0 ) {
+			pthread_cond_wait(&walk->ready, &walk->lock);
+		}
+
+		if( walk->num == 0 ) {
+			break;
+		}
+
+		char *path = walk->stack[--walk->num];
+		++walk->busy;
+
+		pthread_mutex_unlock(&walk->lock);
+
+		_dir(walker, path);
+		free(path);
+
+		pthread_mutex_lock(&walk->lock);
+
+		if( --walk->busy == 0 && walk->num == 0 ) {
+			pthread_cond_broadcast(&walk->ready);
+		}
+	}
+
+	pthread_mutex_unlock(&walk->lock);
+
+	_flush(walker);
+	return NULL;
+}
+
+/* Reads a directory, looking at its regular files and queueing its
+ * subdirectories
+ */
+static void _dir(Walker *walker, const char *PATH) {
+	const int DIR = open(PATH, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if( DIR < 0 ) {
+		const int ERROR = errno;
+
+		pthread_mutex_lock(&walker->walk->outLock);
+		ERR("couldn't read the directory at '%s': %s\n", PATH,
+			strerror(ERROR));
+		++walker->walk->failedDirs;
+		pthread_mutex_unlock(&walker->walk->outLock);
+		return;
+	}
+
+	++walker->dirs;
+
+	long length;
+	while( (length = syscall(SYS_getdents64, DIR, walker->dents, DENTS_SIZE))
+		> 0 ) {
+		for( long at = 0; at < length; ) {
+			const Dirent64 *ENTRY = (const Dirent64 *)(walker->dents + at);
+			at += ENTRY->reclen;
+
+			const char *NAME = ENTRY->name;
+			if( NAME[0] == '.'
+				&& (NAME[1] == '\0' || (NAME[1] == '.' && NAME[2] == '\0')) ) {
+				continue;
+			}
+
+			/* Some filesystems don't fill in the type */
+			unsigned char type = ENTRY->type;
+			if( type == DT_UNKNOWN ) {
+				struct stat st;
+				if( fstatat(DIR, NAME, &st, AT_SYMLINK_NOFOLLOW) == 0 ) {
+					type = S_ISDIR(st.st_mode) ? DT_DIR
+						: S_ISREG(st.st_mode)  ? DT_REG
+											   : DT_UNKNOWN;
+				}
+			}
+
+			if( type == DT_REG ) {
+				_file(walker, DIR, PATH, NAME);
+			} else if( type == DT_DIR ) {
+				char *path = _join(PATH, NAME);
+				if( path == NULL ) {
+					FATAL("an error occurred while allocating memory\n");
+				}
+
+				_push(walker->walk, path);
+			}
+		}
+	}
+
+	if( length < 0 ) {
+		const int ERROR = errno;
+
+		pthread_mutex_lock(&walker->walk->outLock);
+		ERR("couldn't read the directory at '%s': %s\n", PATH,
+			strerror(ERROR));
+		++walker->walk->failedDirs;
+		pthread_mutex_unlock(&walker->walk->outLock);
+	}
+
+	close(DIR);
+}
+
+/* Reads the start of a file, relative to the directory open as 'dir', and
+ * tells what it is. 'DIR' is the directory's path, NULL for a root
+ */
+static void _file(Walker *walker, int dir, const char *DIR, const char *NAME) {
+	/* Not following links, nor blocking on a file replaced by a FIFO since
+	 * its directory was read
+	 */
+	const int FD = openat(dir, NAME,
+		O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK
+			| (DIR != NULL ? O_NOFOLLOW : 0));
+	if( FD < 0 ) {
+		++walker->kinds[KIND_UNREADABLE];
+		return;
+	}
+
+	unsigned char head[HEAD_SIZE];
+	const ssize_t SIZE = pread(FD, head, HEAD_SIZE, 0);
+	close(FD);
+
+	if( SIZE < 0 ) {
+		++walker->kinds[KIND_UNREADABLE];
+		return;
+	}
+
+	if( SIZE < 4 || head[0] != 0x7F || head[1] != 'E' || head[2] != 'L'
+		|| head[3] != 'F' ) {
+		++walker->kinds[KIND_OTHER];
+		return;
+	}
+
+	ELF_Header header;
+	if( elfParseHeader(head, SIZE, &header, NULL) != ELF_OK ) {
+		++walker->kinds[KIND_TRUNCATED];
+		return;
+	}
+
+	++walker->kinds[KIND_ELF];
+	_tally(walker, _key(&header), 1);
+	_line(walker, &header, DIR, NAME);
+}
+
+/* Counts ELF files of some kind */
+static void _tally(Walker *walker, uint64_t key, uint64_t files) {
+	/* A tree holds few kinds of ELF files, a scan finds them soon enough */
+	for( size_t t = 0; t < walker->tallyNum; ++t ) {
+		if( walker->tallies[t].key == key ) {
+			walker->tallies[t].files += files;
+			return;
+		}
+	}
+
+	if( walker->tallyNum == walker->tallyCap ) {
+		const size_t CAP = walker->tallyCap > 0 ? walker->tallyCap * 2 : 16;
+		Tally *tallies = realloc(walker->tallies, sizeof(*tallies) * CAP);
+		if( tallies == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		walker->tallies = tallies;
+		walker->tallyCap = CAP;
+	}
+
+	walker->tallies[walker->tallyNum].key = key;
+	walker->tallies[walker->tallyNum].files = files;
+	++walker->tallyNum;
+}
+
+/* Adds the line of an ELF file to the thread's output */
+static void _line(Walker *walker, const ELF_Header *HEADER, const char *DIR,
+	const char *NAME) {
+	const char *PREFIX = DIR != NULL ? DIR : "";
+	const char *SEPARATOR = _separator(DIR);
+	const size_t NEED = strlen(PREFIX) + strlen(NAME) + LINE_SIZE;
+
+	if( walker->outLength + NEED > OUT_SIZE ) {
+		_flush(walker);
+	}
+
+	char buffer[16];
+	const char *CLASS = _className(HEADER->ident.class);
+	const char *DATA = _dataName(HEADER->ident.endianness);
+	const char *TYPE = _typeName(HEADER->type);
+	const char *MACHINE = _machineName(HEADER->machine, buffer);
+
+	/* Paths too long for the buffer are written out on their own */
+	if( NEED > OUT_SIZE ) {
+		pthread_mutex_lock(&walker->walk->outLock);
+		printf("%-5s %-3s %-4s %-9s %s%s%s\n", CLASS, DATA, TYPE, MACHINE,
+			PREFIX, SEPARATOR, NAME);
+		pthread_mutex_unlock(&walker->walk->outLock);
+		return;
+	}
+
+	walker->outLength += sprintf(walker->out + walker->outLength,
+		"%-5s %-3s %-4s %-9s %s%s%s\n", CLASS, DATA, TYPE, MACHINE, PREFIX,
+		SEPARATOR, NAME);
+}
+
+/* Writes out the lines a thread gathered */
+static void _flush(Walker *walker) {
+	if( walker->outLength == 0 ) {
+		return;
+	}
+
+	pthread_mutex_lock(&walker->walk->outLock);
+	fwrite(walker->out, 1, walker->outLength, stdout);
+	pthread_mutex_unlock(&walker->walk->outLock);
+
+	walker->outLength = 0;
+}
+
+/* Queues a directory, which the stack takes ownership of */
+static void _push(Walk *walk, char *path) {
+	pthread_mutex_lock(&walk->lock);
+
+	if( walk->num == walk->cap ) {
+		const size_t CAP = walk->cap > 0 ? walk->cap * 2 : 256;
+		char **stack = realloc(walk->stack, sizeof(*stack) * CAP);
+		if( stack == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		walk->stack = stack;
+		walk->cap = CAP;
+	}
+
+	walk->stack[walk->num++] = path;
+
+	pthread_cond_signal(&walk->ready);
+	pthread_mutex_unlock(&walk->lock);
+}
+
+/* Returns the path of an entry of a directory, to be freed */
+static char *_join(const char *DIR, const char *NAME) {
+	const char *SEPARATOR = _separator(DIR);
+	const size_t DIR_LENGTH = strlen(DIR);
+	const size_t SEPARATOR_LENGTH = strlen(SEPARATOR);
+	const size_t NAME_LENGTH = strlen(NAME);
+
+	char *path = malloc(DIR_LENGTH + SEPARATOR_LENGTH + NAME_LENGTH + 1);
+	if( path == NULL ) {
+		return NULL;
+	}
+
+	memcpy(path, DIR, DIR_LENGTH);
+	memcpy(path + DIR_LENGTH, SEPARATOR, SEPARATOR_LENGTH);
+	memcpy(path + DIR_LENGTH + SEPARATOR_LENGTH, NAME, NAME_LENGTH + 1);
+	return path;
+}
+
+/* Returns what goes between a directory's path and an entry's name */
+static const char *_separator(const char *DIR) {
+	if( DIR == NULL || (DIR[0] != '\0' && DIR[strlen(DIR) - 1] == '/') ) {
+		return "";
+	}
+
+	return "/";
+}
+
+/* Packs what an ELF file is counted by into a key, which sorts the same */
+static uint64_t _key(const ELF_Header *HEADER) {
+	return (uint64_t)HEADER->ident.class << 48
+		| (uint64_t)HEADER->ident.endianness << 40
+		| (uint64_t)HEADER->type << 16 | HEADER->machine;
+}
+
+static const char *_className(unsigned class) {
+	switch( class ) {
+	case ELF_CLASS_32_BIT:
+		return "ELF32";
+	case ELF_CLASS_64_BIT:
+		return "ELF64";
+	default:
+		return "?";
+	}
+}
+
+static const char *_dataName(unsigned endianness) {
+	switch( endianness ) {
+	case ELF_ENDIAN_LITTLE_ENDIAN:
+		return "LSB";
+	case ELF_ENDIAN_BIG_ENDIAN:
+		return "MSB";
+	default:
+		return "?";
+	}
+}
+
+static const char *_typeName(unsigned type) {
+	switch( type ) {
+	case ELF_ET_NONE:
+		return "NONE";
+	case ELF_ET_RELOCATABLE:
+		return "REL";
+	case ELF_ET_EXECUTABLE:
+		return "EXEC";
+	case ELF_ET_DYNAMIC:
+		return "DYN";
+	case ELF_ET_CORE:
+		return "CORE";
+	default:
+		return type >= ELF_ET_LOPROC ? "PROC"
+			: type >= ELF_ET_LOOS    ? "OS"
+									 : "?";
+	}
+}
+
+/* Returns a short name for a machine, rendered in 'buffer' (at least 16
+ * bytes) if it's not one of the common ones
+ */
+static const char *_machineName(unsigned machine, char *buffer) {
+	switch( machine ) {
+	case ELF_EM_NONE:
+		return "none";
+	case ELF_EM_SPARC:
+		return "SPARC";
+	case ELF_EM_I386:
+		return "i386";
+	case ELF_EM_M68K:
+		return "m68k";
+	case ELF_EM_MIPS:
+		return "MIPS";
+	case ELF_EM_PARISC:
+		return "PA-RISC";
+	case ELF_EM_POWERPC:
+		return "PowerPC";
+	case ELF_EM_POWERPC64:
+		return "PowerPC64";
+	case ELF_EM_S390:
+		return "S390";
+	case ELF_EM_ARM:
+		return "ARM";
+	case ELF_EM_SPARCV9:
+		return "SPARCV9";
+	case ELF_EM_IA_64:
+		return "IA-64";
+	case ELF_EM_X86_64:
+		return "x86-64";
+	case ELF_EM_AARCH64:
+		return "AArch64";
+	case ELF_EM_RISCV:
+		return "RISC-V";
+	case ELF_EM_BPF:
+		return "BPF";
+	case ELF_EM_LOONGARCH:
+		return "LoongArch";
+	default:
+		snprintf(buffer, 16, "EM_%u", machine);
+		return buffer;
+	}
+}
+
+/* Orders tallies by decreasing number of files, then by key */
+static int _compareTallies(const void *A, const void *B) {
+	const Tally *TALLY_A = A;
+	const Tally *TALLY_B = B;
+
+	if( TALLY_A->files != TALLY_B->files ) {
+		return TALLY_A->files < TALLY_B->files ? 1 : -1;
+	}
+
+	return (TALLY_A->key > TALLY_B->key) - (TALLY_A->key < TALLY_B->key);
+}
+
+/* Returns the time on the monotonic clock, in ns */
+static uint64_t _now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
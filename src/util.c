@@ -2,62 +2,181 @@
  * Utilities
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-#include "fault.h"
+#include "elfstats.h"
 
 #include "util.h"
 
 #define SHF(B, N) (((B) & 0xFF) << (N))
 
+static size_t _mapThreshold = 0;
+
+static FP *_readFile(const char *FILEPATH);
+static FP *_readFd(int fd, uint64_t size);
+
 FP *utilReadFile(const char *FILEPATH) {
+	ELF_PhaseMark mark;
+	elfPhaseBegin(&mark, ELF_PHASE_READ);
+
+	FP *fp = _readFile(FILEPATH);
+
+	elfPhaseEnd(&mark, fp != NULL ? fp->size : 0);
+	return fp;
+}
+
+static FP *_readFile(const char *FILEPATH) {
 	FILE *file = fopen(FILEPATH, "rb");
 	if( file == NULL ) {
-		ERR("couldn't open the file at '%s'\n", FILEPATH);
 		return NULL;
 	}
 
-	FP *fp = malloc(sizeof(*fp));
+	fseek(file, 0L, SEEK_END);
+	const long SIZE = ftell(file);
+
+	FP *fp = SIZE >= 0 ? _readFd(fileno(file), SIZE) : NULL;
+	fclose(file);
+
+	return fp;
+}
+
+FP *utilReadFd(int fd, uint64_t size) {
+	ELF_PhaseMark mark;
+	elfPhaseBegin(&mark, ELF_PHASE_READ);
+
+	FP *fp = _readFd(fd, size);
+
+	elfPhaseEnd(&mark, fp != NULL ? fp->size : 0);
+	return fp;
+}
+
+/* Reads 'size' bytes from the start of an open file, or maps them */
+static FP *_readFd(int fd, uint64_t size) {
+	if( size >= SIZE_MAX ) {
+		errno = EFBIG;
+		return NULL;
+	}
+
+	if( _mapThreshold > 0 && size >= _mapThreshold ) {
+		return utilMapFile(fd, size);
+	}
+
+	FP *fp = utilMalloc(sizeof(*fp));
 	if( fp == NULL ) {
-		ERR("failed to allocate file pointer for file at '%s", FILEPATH);
+		errno = ENOMEM;
+		return NULL;
 	}
 
-	fseek(file, 0L, SEEK_END);
-	fp->size = ftell(file);
-	rewind(file);
+	fp->size = size;
+	fp->_mapped = 0;
 
-	fp->_start = malloc(fp->size + 1);
+	fp->_start = utilMalloc(fp->size + 1);
 	if( fp->_start == NULL ) {
-		ERR("failed to allocate buffer for file at '%s'\n", FILEPATH);
+		free(fp);
+		errno = ENOMEM;
 		return NULL;
 	}
 
-	const size_t BYTES_READ = fread(fp->_start, sizeof(char), fp->size, file);
-	if( BYTES_READ < fp->size ) {
-		ERR("couldn't read the file at '%s'\n", FILEPATH);
-		return NULL;
+	size_t done = 0;
+	while( done < fp->size ) {
+		const ssize_t READ
+			= pread(fd, fp->_start + done, fp->size - done, done);
+		if( READ < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( READ <= 0 ) {
+			utilFreeFile(fp);
+			errno = EIO;
+			return NULL;
+		}
+
+		done += READ;
 	}
 
-	fp->_start[BYTES_READ] = '\0';
+	fp->_start[done] = '\0';
 	fp->data = fp->_start;
 
-	fclose(file);
+	return fp;
+}
+
+FP *utilMapFile(int fd, uint64_t size) {
+	if( size == 0 || size > SIZE_MAX ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	FP *fp = utilMalloc(sizeof(*fp));
+	if( fp == NULL ) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if( map == MAP_FAILED ) {
+		free(fp);
+		return NULL;
+	}
+
+	fp->_start = map;
+	fp->data = fp->_start;
+	fp->size = size;
+	fp->_mapped = size;
 
 	return fp;
 }
 
+void utilSetMapThreshold(size_t size) {
+	_mapThreshold = size;
+}
+
+size_t utilMapThreshold(void) {
+	return _mapThreshold;
+}
+
 void utilFreeFile(FP *fp) {
-	free(fp->_start);
+	if( fp->_mapped > 0 ) {
+		munmap(fp->_start, fp->_mapped);
+	} else {
+		free(fp->_start);
+	}
+
 	fp->data = NULL;
 
 	free(fp);
 	fp = NULL;
 }
 
+void *utilMalloc(size_t size) {
+	elfStatsAlloc(size);
+	return malloc(size);
+}
+
+void *utilCalloc(size_t num, size_t size) {
+	elfStatsAlloc(num * size);
+	return calloc(num, size);
+}
+
+void *utilRealloc(void *ptr, size_t size) {
+	elfStatsAlloc(size);
+	return realloc(ptr, size);
+}
+
+bool utilInBounds(FP *fp, uint64_t offset, uint64_t size) {
+	/* Written so that neither side can overflow */
+	return offset <= fp->size && size <= fp->size - offset;
+}
+
 uint8_t utilRead8(FP *fp) {
 	return *fp->data++;
 }
@@ -120,3 +239,91 @@ uint64_t utilRead64(bool le, FP *fp) {
 	return SHF(a, 56) | SHF(b, 48) | SHF(c, 40) | SHF(d, 32) | SHF(e, 24)
 		| SHF(f, 16) | SHF(g, 8) | (h & 0xFF);
 }
+
+uint64_t utilCursorRead(Cursor *cursor, unsigned size) {
+	if( !cursor->ok || size > 8
+		|| (size_t)(cursor->end - cursor->pos) < size ) {
+		cursor->ok = false;
+		return 0;
+	}
+
+	uint64_t value = 0;
+	for( unsigned i = 0; i < size; ++i ) {
+		const unsigned SHIFT = 8 * (cursor->le ? i : size - 1 - i);
+		value |= (uint64_t)cursor->pos[i] << SHIFT;
+	}
+
+	cursor->pos += size;
+	return value;
+}
+
+uint64_t utilCursorULEB(Cursor *cursor) {
+	uint64_t value = 0;
+
+	for( unsigned shift = 0;; shift += 7 ) {
+		if( !cursor->ok || cursor->pos >= cursor->end ) {
+			cursor->ok = false;
+			return 0;
+		}
+
+		const uint8_t BYTE = *cursor->pos++;
+		if( shift < 64 ) {
+			value |= (uint64_t)(BYTE & 0x7F) << shift;
+		}
+
+		if( !(BYTE & 0x80) ) {
+			return value;
+		}
+	}
+}
+
+int64_t utilCursorSLEB(Cursor *cursor) {
+	uint64_t value = 0;
+
+	for( unsigned shift = 0;; shift += 7 ) {
+		if( !cursor->ok || cursor->pos >= cursor->end ) {
+			cursor->ok = false;
+			return 0;
+		}
+
+		const uint8_t BYTE = *cursor->pos++;
+		if( shift < 64 ) {
+			value |= (uint64_t)(BYTE & 0x7F) << shift;
+		}
+
+		if( !(BYTE & 0x80) ) {
+			/* Sign-extend from the last byte's sign bit */
+			if( shift + 7 < 64 && (BYTE & 0x40) ) {
+				value |= ~(uint64_t)0 << (shift + 7);
+			}
+
+			return (int64_t)value;
+		}
+	}
+}
+
+const char *utilCursorString(Cursor *cursor) {
+	if( !cursor->ok ) {
+		return NULL;
+	}
+
+	const uint8_t *NUL = memchr(cursor->pos, '\0', cursor->end - cursor->pos);
+	if( NUL == NULL ) {
+		cursor->ok = false;
+		return NULL;
+	}
+
+	const char *STRING = (const char *)cursor->pos;
+	cursor->pos = NUL + 1;
+
+	return STRING;
+}
+
+void utilCursorSkip(Cursor *cursor, uint64_t size) {
+	if( !cursor->ok || (uint64_t)(cursor->end - cursor->pos) < size ) {
+		cursor->ok = false;
+		return;
+	}
+
+	cursor->pos += size;
+}
@@ -0,0 +1,561 @@
+/* elfp
+ * Watch mode
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "elfdump.h"
+#include "elfintern.h"
+#include "elfp.h"
+
+#include "fault.h"
+
+#include "watch.h"
+
+/* Events that make a file worth dumping again */
+#define INOTIFY_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+#define EVENT_BUFFER_SIZE 65536
+
+/* What's known about a file of the tree */
+typedef struct _Record {
+	char *path;
+	uint64_t digest; /* Of the last dump printed, 0 if none was */
+	int64_t due; /* When to dump it again, 0 if it isn't pending */
+} Record;
+
+/* A growable list of pointers */
+typedef struct _List {
+	void **items;
+	size_t num;
+	size_t cap;
+} List;
+
+typedef struct _Watcher {
+	const WatchOptions *OPTIONS;
+	char *root; /* Canonical path of the watched directory */
+	size_t rootLen;
+
+	/* Records by path, with linear probing */
+	Record **records;
+	uint32_t mask;
+	uint32_t used;
+
+	List pending; /* Records waiting out their debounce */
+
+	int fd;
+	bool fanotify;
+	List dirs; /* Directory of each inotify watch, by descriptor */
+
+	pthread_mutex_t outLock;
+} Watcher;
+
+/* Arguments of a batch of dumps */
+typedef struct _Flush {
+	Watcher *watcher;
+	Record **records;
+} Flush;
+
+static void _listPush(List *list, void *item);
+static char *_join(const char *BASE, const char *NAME);
+static int64_t _now(void);
+static uint64_t _digest(const char *TEXT, size_t length);
+static uint32_t _hashPath(const char *PATH);
+
+static Record *_record(Watcher *watcher, const char *PATH);
+static void _touch(Watcher *watcher, const char *PATH, int64_t due);
+
+static bool _initFanotify(Watcher *watcher);
+static bool _initInotify(Watcher *watcher);
+static void _addWatch(Watcher *watcher, const char *PATH);
+static void _scan(Watcher *watcher, const char *PATH, int64_t due);
+
+static void _readFanotify(Watcher *watcher);
+static void _readInotify(Watcher *watcher);
+static int _timeout(Watcher *watcher);
+static void _flushDue(Watcher *watcher);
+static void _dump(void *ctx, size_t idx, const char *PATH, FP *fp, int error);
+
+int watchRun(const WatchOptions *OPTIONS) {
+	Watcher watcher;
+	memset(&watcher, 0, sizeof(watcher));
+	watcher.OPTIONS = OPTIONS;
+
+	watcher.root = realpath(OPTIONS->dir, NULL);
+	if( watcher.root == NULL ) {
+		ERR("couldn't watch '%s': %s\n", OPTIONS->dir, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	watcher.rootLen = strlen(watcher.root);
+
+	watcher.mask = 1023;
+	watcher.records = calloc(watcher.mask + 1, sizeof(*watcher.records));
+	if( watcher.records == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	pthread_mutex_init(&watcher.outLock, NULL);
+
+	/* Start watching before the initial scan, so no write goes unnoticed */
+	if( (OPTIONS->noFanotify || !_initFanotify(&watcher))
+		&& !_initInotify(&watcher) ) {
+		ERR("couldn't watch '%s': %s\n", watcher.root, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* Everything is due right away the first time around */
+	_scan(&watcher, watcher.root, 1);
+	_flushDue(&watcher);
+
+	struct pollfd pfd;
+	pfd.fd = watcher.fd;
+	pfd.events = POLLIN;
+
+	for( ;; ) {
+		const int READY = poll(&pfd, 1, _timeout(&watcher));
+		if( READY < 0 && errno != EINTR ) {
+			ERR("couldn't wait for events: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		if( READY > 0 && watcher.fanotify ) {
+			_readFanotify(&watcher);
+		} else if( READY > 0 ) {
+			_readInotify(&watcher);
+		}
+
+		_flushDue(&watcher);
+	}
+}
+
+static void _listPush(List *list, void *item) {
+	if( list->num == list->cap ) {
+		list->cap = list->cap > 0 ? list->cap * 2 : 64;
+		list->items = realloc(list->items, sizeof(*list->items) * list->cap);
+
+		if( list->items == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+	}
+
+	list->items[list->num++] = item;
+}
+
+static char *_join(const char *BASE, const char *NAME) {
+	const size_t BASE_LEN = strlen(BASE);
+	const size_t NAME_LEN = strlen(NAME);
+
+	char *path = malloc(BASE_LEN + NAME_LEN + 2);
+	if( path == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	memcpy(path, BASE, BASE_LEN);
+	path[BASE_LEN] = '/';
+	memcpy(path + BASE_LEN + 1, NAME, NAME_LEN + 1);
+
+	return path;
+}
+
+/* Monotonic time, in milliseconds */
+static int64_t _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a hash of a dump, never 0 */
+static uint64_t _digest(const char *TEXT, size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for( size_t i = 0; i < length; ++i ) {
+		hash ^= (unsigned char)TEXT[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash | 1;
+}
+
+/* FNV-1a hash of a path */
+static uint32_t _hashPath(const char *PATH) {
+	uint32_t hash = 2166136261u;
+	for( ; *PATH != '\0'; ++PATH ) {
+		hash ^= (unsigned char)*PATH;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Finds the record of a file, creating it if there's none yet */
+static Record *_record(Watcher *watcher, const char *PATH) {
+	uint32_t i = _hashPath(PATH) & watcher->mask;
+	for( ; watcher->records[i] != NULL; i = (i + 1) & watcher->mask ) {
+		if( strcmp(watcher->records[i]->path, PATH) == 0 ) {
+			return watcher->records[i];
+		}
+	}
+
+	Record *record = calloc(1, sizeof(*record));
+	if( record == NULL || (record->path = strdup(PATH)) == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	watcher->records[i] = record;
+	++watcher->used;
+
+	/* Keep the table at most half full */
+	if( watcher->used * 2 > watcher->mask ) {
+		const uint32_t OLD_MASK = watcher->mask;
+		Record **old = watcher->records;
+
+		watcher->mask = OLD_MASK * 2 + 1;
+		watcher->records = calloc(watcher->mask + 1, sizeof(*old));
+		if( watcher->records == NULL ) {
+			FATAL("an error occurred while allocating memory\n");
+		}
+
+		for( uint32_t j = 0; j <= OLD_MASK; ++j ) {
+			if( old[j] == NULL ) {
+				continue;
+			}
+
+			uint32_t k = _hashPath(old[j]->path) & watcher->mask;
+			while( watcher->records[k] != NULL ) {
+				k = (k + 1) & watcher->mask;
+			}
+
+			watcher->records[k] = old[j];
+		}
+
+		free(old);
+	}
+
+	return record;
+}
+
+/* Notes that a file changed, pushing back when it gets dumped */
+static void _touch(Watcher *watcher, const char *PATH, int64_t due) {
+	Record *record = _record(watcher, PATH);
+	if( record->due == 0 ) {
+		_listPush(&watcher->pending, record);
+	}
+
+	record->due = due;
+}
+
+/* Watches the whole mount holding the tree, keeping events from inside it */
+static bool _initFanotify(Watcher *watcher) {
+	watcher->fd = fanotify_init(
+		FAN_CLASS_NOTIF | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if( watcher->fd < 0 ) {
+		return false;
+	}
+
+	if( fanotify_mark(watcher->fd, FAN_MARK_ADD | FAN_MARK_MOUNT,
+			FAN_CLOSE_WRITE, AT_FDCWD, watcher->root)
+		!= 0 ) {
+		close(watcher->fd);
+		return false;
+	}
+
+	watcher->fanotify = true;
+	return true;
+}
+
+static bool _initInotify(Watcher *watcher) {
+	watcher->fd = inotify_init1(IN_CLOEXEC);
+	watcher->fanotify = false;
+
+	return watcher->fd >= 0;
+}
+
+/* Adds an inotify watch on a directory, remembering its path */
+static void _addWatch(Watcher *watcher, const char *PATH) {
+	const int WD = inotify_add_watch(watcher->fd, PATH, INOTIFY_MASK);
+	if( WD < 0 ) {
+		fprintf(stderr, WARNING_MSG "couldn't watch '%s': %s\n", PATH,
+			strerror(errno));
+		return;
+	}
+
+	while( (size_t)WD >= watcher->dirs.num ) {
+		_listPush(&watcher->dirs, NULL);
+	}
+
+	free(watcher->dirs.items[WD]);
+	watcher->dirs.items[WD] = strdup(PATH);
+}
+
+/* Marks every file under a directory as changed, watching its directories
+ * when using inotify
+ */
+static void _scan(Watcher *watcher, const char *PATH, int64_t due) {
+	if( !watcher->fanotify ) {
+		_addWatch(watcher, PATH);
+	}
+
+	DIR *dir = opendir(PATH);
+	if( dir == NULL ) {
+		return;
+	}
+
+	struct dirent *entry;
+	while( (entry = readdir(dir)) != NULL ) {
+		if( strcmp(entry->d_name, ".") == 0
+			|| strcmp(entry->d_name, "..") == 0 ) {
+			continue;
+		}
+
+		char *path = _join(PATH, entry->d_name);
+
+		unsigned char type = entry->d_type;
+		struct stat st;
+		if( type == DT_UNKNOWN && lstat(path, &st) == 0 ) {
+			type = S_ISDIR(st.st_mode) ? DT_DIR
+				: S_ISREG(st.st_mode)  ? DT_REG
+									   : DT_UNKNOWN;
+		}
+
+		if( type == DT_DIR ) {
+			_scan(watcher, path, due);
+		} else if( type == DT_REG ) {
+			_touch(watcher, path, due);
+		}
+
+		free(path);
+	}
+
+	closedir(dir);
+}
+
+static void _readFanotify(Watcher *watcher) {
+	static char buffer[EVENT_BUFFER_SIZE]
+		__attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+
+	const ssize_t LENGTH = read(watcher->fd, buffer, sizeof(buffer));
+	if( LENGTH <= 0 ) {
+		return;
+	}
+
+	const int64_t DUE = _now() + watcher->OPTIONS->debounce;
+
+	struct fanotify_event_metadata *event = (void *)buffer;
+	for( ssize_t left = LENGTH; FAN_EVENT_OK(event, left);
+		 event = FAN_EVENT_NEXT(event, left) ) {
+		if( event->vers != FANOTIFY_METADATA_VERSION ) {
+			continue;
+		}
+
+		if( event->mask & FAN_Q_OVERFLOW ) {
+			_scan(watcher, watcher->root, DUE);
+		}
+
+		if( event->fd < 0 ) {
+			continue;
+		}
+
+		char link[64];
+		char path[PATH_MAX];
+		snprintf(link, sizeof(link), "/proc/self/fd/%d", event->fd);
+
+		const ssize_t PATH_LEN = readlink(link, path, sizeof(path) - 1);
+		close(event->fd);
+
+		/* Events come from the whole mount, keep only the tree's */
+		if( PATH_LEN <= (ssize_t)watcher->rootLen
+			|| memcmp(path, watcher->root, watcher->rootLen) != 0
+			|| (path[watcher->rootLen] != '/' && watcher->rootLen > 1) ) {
+			continue;
+		}
+
+		path[PATH_LEN] = '\0';
+		_touch(watcher, path, DUE);
+	}
+}
+
+static void _readInotify(Watcher *watcher) {
+	static char buffer[EVENT_BUFFER_SIZE]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	const ssize_t LENGTH = read(watcher->fd, buffer, sizeof(buffer));
+	if( LENGTH <= 0 ) {
+		return;
+	}
+
+	const int64_t DUE = _now() + watcher->OPTIONS->debounce;
+
+	for( ssize_t offset = 0; offset < LENGTH; ) {
+		const struct inotify_event *EVENT = (void *)(buffer + offset);
+		offset += sizeof(*EVENT) + EVENT->len;
+
+		if( EVENT->mask & IN_Q_OVERFLOW ) {
+			_scan(watcher, watcher->root, DUE);
+			continue;
+		}
+
+		if( EVENT->wd < 0 || (size_t)EVENT->wd >= watcher->dirs.num
+			|| watcher->dirs.items[EVENT->wd] == NULL ) {
+			continue;
+		}
+
+		if( EVENT->mask & IN_IGNORED ) {
+			free(watcher->dirs.items[EVENT->wd]);
+			watcher->dirs.items[EVENT->wd] = NULL;
+			continue;
+		}
+
+		if( EVENT->len == 0 ) {
+			continue;
+		}
+
+		char *path = _join(watcher->dirs.items[EVENT->wd], EVENT->name);
+
+		/* New directories get watched, and what's already in them dumped.
+		 * Files showing up through IN_CREATE are still being written, and
+		 * will come back with IN_CLOSE_WRITE
+		 */
+		if( EVENT->mask & IN_ISDIR ) {
+			_scan(watcher, path, DUE);
+		} else if( EVENT->mask & (IN_CLOSE_WRITE | IN_MOVED_TO) ) {
+			_touch(watcher, path, DUE);
+		}
+
+		free(path);
+	}
+}
+
+/* Milliseconds until the next pending file is due, -1 if there's none */
+static int _timeout(Watcher *watcher) {
+	if( watcher->pending.num == 0 ) {
+		return -1;
+	}
+
+	int64_t next = INT64_MAX;
+	for( size_t i = 0; i < watcher->pending.num; ++i ) {
+		const Record *RECORD = watcher->pending.items[i];
+		if( RECORD->due < next ) {
+			next = RECORD->due;
+		}
+	}
+
+	const int64_t NOW = _now();
+	return next > NOW ? (int)(next - NOW) : 0;
+}
+
+/* Dumps the pending files that are due */
+static void _flushDue(Watcher *watcher) {
+	const int64_t NOW = _now();
+
+	Record **due = malloc(sizeof(*due) * (watcher->pending.num + 1));
+	const char **paths = malloc(sizeof(*paths) * (watcher->pending.num + 1));
+	if( due == NULL || paths == NULL ) {
+		FATAL("an error occurred while allocating memory\n");
+	}
+
+	size_t dueNum = 0;
+	size_t kept = 0;
+
+	for( size_t i = 0; i < watcher->pending.num; ++i ) {
+		Record *record = watcher->pending.items[i];
+
+		if( record->due <= NOW ) {
+			record->due = 0;
+			paths[dueNum] = record->path;
+			due[dueNum++] = record;
+		} else {
+			watcher->pending.items[kept++] = record;
+		}
+	}
+
+	watcher->pending.num = kept;
+
+	if( dueNum > 0 ) {
+		Flush flush;
+		flush.watcher = watcher;
+		flush.records = due;
+
+		batchRead(paths, dueNum, &watcher->OPTIONS->batch, _dump, &flush);
+		fflush(stdout);
+
+		/* Every ELF of the batch is gone, and with it every interned ID */
+		ELF_InternStats stats;
+		elfInternGetStats(&stats);
+		if( stats.footprint > watcher->OPTIONS->internBudget ) {
+			elfInternReset();
+		}
+	}
+
+	free(due);
+	free(paths);
+}
+
+/* Dumps a file that was read, unless its dump is the same as last time */
+static void _dump(void *ctx, size_t idx, const char *PATH, FP *fp, int error) {
+	Flush *flush = ctx;
+	Record *record = flush->records[idx];
+	(void)error;
+
+	/* Files that vanished or aren't ELF files are of no interest */
+	ELF_Status status;
+	ELF *elf = fp != NULL ? elfParse(fp, &status) : NULL;
+	if( elf == NULL ) {
+		if( fp != NULL && status != ELF_ERR_BAD_MAGIC
+			&& status != ELF_ERR_TOO_SMALL ) {
+			ERR("%s: %s\n", PATH, elfStatusString(status));
+		}
+
+		return;
+	}
+
+	char *text = NULL;
+	size_t length = 0;
+
+	FILE *out = open_memstream(&text, &length);
+	if( out == NULL ) {
+		ERR("%s: %s\n", PATH, strerror(ENOMEM));
+		elfFree(elf);
+		return;
+	}
+
+	elfDumpTo(out, elf, flush->watcher->OPTIONS->flags);
+	fclose(out);
+	elfFree(elf);
+
+	const uint64_t DIGEST = _digest(text, length);
+
+	/* Each record is touched by a single thread, but output is shared */
+	pthread_mutex_lock(&flush->watcher->outLock);
+
+	if( DIGEST != record->digest ) {
+		record->digest = DIGEST;
+
+		printf("File: %s\n", PATH);
+		fwrite(text, 1, length, stdout);
+		printf("\n");
+	}
+
+	pthread_mutex_unlock(&flush->watcher->outLock);
+
+	free(text);
+}